@@ -0,0 +1,300 @@
+// tail latency of the reliable UDP transport (Common/socket/SktArq) over a simulated lossy link.
+// two CSktArq endpoints talk through an in-process link that drops, delays and reorders
+// datagrams on a virtual millisecond clock, so a minute of traffic runs in well under a
+// second and every run with the same seed is identical. the client sends a steady stream
+// of small messages, the latency is virtual time from Send to the server's Recv.
+//
+//   make -f makefile arqbench && ./release/sktarqbench --losses 0,5,10,20 --delay 40 --jitter 15
+//
+// each loss rate runs the profiles below, results go to stdout (or --out) as one json object.
+//   default  : SktArqConfig defaults, 30ms min rto, 1.5x backoff, fast resend after 2 acks
+//   tcplike  : 200ms min rto, doubling backoff, no fast resend, the retransmit timing of TCP
+//              without its congestion control, so it flatters TCP if anything
+//   unrel    : default profile on the unreliable channel, reports what got through
+#include "stdafx.h"
+#include "Common/socket/SktArq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#define ARQB_HEAD_BYTES            (4)      // u32 message id
+#define ARQB_DRAIN_MS              (60000)
+
+struct ArqBenchConfig
+{
+	int                 durationMs;
+	int                 rate;       // messages per second
+	int                 size;
+	int                 delayMs;    // one way
+	int                 jitterMs;   // added per datagram, uniform, reorders whatever it overlaps
+	int                 mtu;
+	unsigned int        seed;
+	std::vector<int>    losses;     // percent, both directions
+	std::string         out;
+};
+
+struct ArqBenchRun
+{
+	std::string         profile;
+	int                 loss;
+	int                 sent;
+	int                 delivered;
+	std::vector<Int64>  latency;
+	Int64               wireBytes;
+	Int64               payloadBytes;
+	SktArqStat          stat;
+	bool                dead;
+};
+
+// xorshift, the link has to be reproducible from the seed alone
+class CBenchRand
+{
+public:
+	explicit CBenchRand(unsigned int seed) : m_state(seed ? seed : 1) {}
+	unsigned int Next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+	int Below(int n) { return n > 0 ? (int)(Next() % (unsigned int)n) : 0; }
+private:
+	unsigned int m_state;
+};
+
+// one direction of the simulated path
+class CLossyLink
+{
+public:
+	CLossyLink(int loss, int delayMs, int jitterMs, unsigned int seed)
+		: m_loss(loss), m_delayMs(delayMs), m_jitterMs(jitterMs), m_rand(seed), m_nowMs(0), m_order(0), m_bytes(0) {}
+	void    SetNow(unsigned int nowMs) { m_nowMs = nowMs; }
+	void    Push(const char* buf, int len)
+	{
+		m_bytes += len;
+		if (m_rand.Below(100) < m_loss)
+			return;
+		unsigned int at = m_nowMs + m_delayMs + m_rand.Below(m_jitterMs + 1);
+		m_flight.insert(std::make_pair(std::make_pair(at, m_order++), std::vector<char>(buf, buf + len)));
+	}
+	void    Deliver(CSktArq* to)
+	{
+		while (!m_flight.empty() && m_flight.begin()->first.first <= m_nowMs)
+		{
+			std::vector<char>& d = m_flight.begin()->second;
+			to->Input(&d[0], (int)d.size());
+			m_flight.erase(m_flight.begin());
+		}
+	}
+	bool    Empty() const { return m_flight.empty(); }
+	Int64   GetBytes() const { return m_bytes; }
+	static int Output(const char* buf, int len, void* user)
+	{
+		((CLossyLink*)user)->Push(buf, len);
+		return len;
+	}
+private:
+	int                 m_loss;
+	int                 m_delayMs;
+	int                 m_jitterMs;
+	CBenchRand          m_rand;
+	unsigned int        m_nowMs;
+	unsigned int        m_order;
+	Int64               m_bytes;
+	std::map<std::pair<unsigned int, unsigned int>, std::vector<char> > m_flight;
+};
+
+static Int64 percentile(std::vector<Int64>& v, double p)
+{
+	if (v.empty())
+		return 0;
+	size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + idx, v.end());
+	return v[idx];
+}
+
+static void runOnce(const ArqBenchConfig& cfg, const std::string& profile, int loss, ArqBenchRun& run)
+{
+	run.profile = profile;
+	run.loss = loss;
+	run.sent = 0;
+	run.delivered = 0;
+	run.dead = false;
+	CLossyLink up(loss, cfg.delayMs, cfg.jitterMs, cfg.seed);
+	CLossyLink down(loss, cfg.delayMs, cfg.jitterMs, cfg.seed * 7 + 1);
+	CSktArq client(0x5EED0001, CLossyLink::Output, &up);
+	CSktArq server(0x5EED0001, CLossyLink::Output, &down);
+	SktArqConfig config;
+	CSktArq::DefaultConfig(config);
+	config.mtu = cfg.mtu;
+	if (profile == "tcplike")
+	{
+		config.minRto = 200;
+		config.nodelay = false;
+		config.fastResend = 0;
+	}
+	// the bench wants the tail, not a dead link verdict
+	config.deadLink = 1000;
+	client.SetConfig(config);
+	server.SetConfig(config);
+	bool reliable = profile != "unrel";
+
+	int total = (int)((Int64)cfg.durationMs * cfg.rate / 1000);
+	std::vector<unsigned int> sendMs(total, 0);
+	std::vector<char> payload(cfg.size, 'a');
+	std::vector<char> msg;
+	unsigned int end = cfg.durationMs + ARQB_DRAIN_MS;
+	for (unsigned int now = 0; now < end; now++)
+	{
+		up.SetNow(now);
+		down.SetNow(now);
+		while (run.sent < total && (Int64)run.sent * 1000 <= (Int64)now * cfg.rate)
+		{
+			unsigned int id = (unsigned int)run.sent;
+			memcpy(&payload[0], &id, ARQB_HEAD_BYTES);
+			client.Send(&payload[0], cfg.size, reliable);
+			sendMs[id] = now;
+			run.sent++;
+		}
+		up.Deliver(&server);
+		down.Deliver(&client);
+		bool gotReliable = false;
+		while (server.Recv(msg, gotReliable))
+		{
+			unsigned int id = 0;
+			if (msg.size() >= ARQB_HEAD_BYTES)
+				memcpy(&id, &msg[0], ARQB_HEAD_BYTES);
+			if (id < (unsigned int)total)
+			{
+				run.latency.push_back((Int64)(now - sendMs[id]));
+				run.delivered++;
+			}
+		}
+		if (now % config.interval == 0)
+		{
+			client.Update(now);
+			server.Update(now);
+		}
+		if (run.sent == total && client.GetWaitSnd() == 0 && up.Empty() && down.Empty())
+			break;
+	}
+	run.wireBytes = up.GetBytes() + down.GetBytes();
+	run.payloadBytes = (Int64)run.delivered * cfg.size;
+	run.stat = client.GetStat();
+	run.dead = client.IsDead();
+}
+
+static void writeJson(FILE* f, const ArqBenchConfig& cfg, std::vector<ArqBenchRun>& runs)
+{
+	fprintf(f, "{\n  \"config\": {\"durationMs\": %d, \"rate\": %d, \"size\": %d, \"delayMs\": %d, \"jitterMs\": %d, \"mtu\": %d, \"seed\": %u},\n",
+		cfg.durationMs, cfg.rate, cfg.size, cfg.delayMs, cfg.jitterMs, cfg.mtu, cfg.seed);
+	fprintf(f, "  \"runs\": [");
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		ArqBenchRun& run = runs[i];
+		fprintf(f, "%s\n    {\"profile\": \"%s\", \"lossPct\": %d, \"sent\": %d, \"delivered\": %d, \"dead\": %s,\n",
+			i ? "," : "", run.profile.c_str(), run.loss, run.sent, run.delivered, run.dead ? "true" : "false");
+		fprintf(f, "     \"latencyMs\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld},\n",
+			(long long)percentile(run.latency, 0.5), (long long)percentile(run.latency, 0.99),
+			(long long)percentile(run.latency, 0.999), (long long)percentile(run.latency, 1.0));
+		fprintf(f, "     \"retransmits\": %lld, \"fastRetransmits\": %lld, \"srttMs\": %d, \"rtoMs\": %d, \"wireBytesPerPayloadByte\": %.3f}",
+			(long long)run.stat.retransmits, (long long)run.stat.fastRetransmits, run.stat.srtt, run.stat.rto,
+			run.payloadBytes > 0 ? (double)run.wireBytes / run.payloadBytes : 0);
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"sktarqbench [--duration-ms N] [--rate N] [--size N] [--delay ms] [--jitter ms]\n"
+		"            [--mtu N] [--losses a,b,..] [--seed N] [--out file]\n"
+		"  defaults: 60000ms of 50 msgs/s of 100 bytes, 40ms +0..15ms one way,\n"
+		"  mtu 1400, losses 0,5,10,15,20 percent in both directions\n");
+}
+
+static bool parseArgs(int argc, char** argv, ArqBenchConfig& cfg)
+{
+	cfg.durationMs = 60000;
+	cfg.rate = 50;
+	cfg.size = 100;
+	cfg.delayMs = 40;
+	cfg.jitterMs = 15;
+	cfg.mtu = 1400;
+	cfg.seed = 12345;
+	std::string losses = "0,5,10,15,20";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--duration-ms" && hasValue)
+			cfg.durationMs = atoi(argv[++i]);
+		else if (arg == "--rate" && hasValue)
+			cfg.rate = atoi(argv[++i]);
+		else if (arg == "--size" && hasValue)
+			cfg.size = atoi(argv[++i]);
+		else if (arg == "--delay" && hasValue)
+			cfg.delayMs = atoi(argv[++i]);
+		else if (arg == "--jitter" && hasValue)
+			cfg.jitterMs = atoi(argv[++i]);
+		else if (arg == "--mtu" && hasValue)
+			cfg.mtu = atoi(argv[++i]);
+		else if (arg == "--losses" && hasValue)
+			losses = argv[++i];
+		else if (arg == "--seed" && hasValue)
+			cfg.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else if (arg == "--out" && hasValue)
+			cfg.out = argv[++i];
+		else
+			return false;
+	}
+	if (cfg.durationMs <= 0 || cfg.rate <= 0 || cfg.rate > 1000 || cfg.size < ARQB_HEAD_BYTES
+		|| cfg.delayMs < 0 || cfg.jitterMs < 0)
+		return false;
+	size_t pos = 0;
+	while (pos < losses.size())
+	{
+		size_t comma = losses.find(',', pos);
+		int loss = atoi(losses.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos).c_str());
+		if (loss < 0 || loss > 90)
+			return false;
+		cfg.losses.push_back(loss);
+		if (comma == std::string::npos)
+			break;
+		pos = comma + 1;
+	}
+	return !cfg.losses.empty();
+}
+
+int main(int argc, char** argv)
+{
+	ArqBenchConfig cfg;
+	if (!parseArgs(argc, argv, cfg))
+	{
+		usage();
+		return 2;
+	}
+	const char* profiles[] = { "default", "tcplike", "unrel" };
+	std::vector<ArqBenchRun> runs;
+	for (size_t i = 0; i < cfg.losses.size(); i++)
+	{
+		for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++)
+		{
+			runs.push_back(ArqBenchRun());
+			runOnce(cfg, profiles[p], cfg.losses[i], runs.back());
+		}
+	}
+	FILE* f = cfg.out.empty() ? stdout : fopen(cfg.out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, cfg, runs);
+		if (f != stdout)
+			fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,667 @@
+// loopback benchmark for the eng.socket stack.
+// an in-process echo server on 127.0.0.1 serves one or more S_O_TCP clients that are
+// driven through the same CSktReactor::Poll + CSocketConnectionManager::Update(dt) loop
+// the engine runs every frame. every payload carries its send time, so the round trip
+// is measured from SendMsgFromNetMsg to the moment the echo is popped for dispatch.
+// the rate mode runs the loop at a fixed frame rate instead and also reports how long a
+// received frame waits for its dispatch and how late the frames start.
+//
+//   make -f makefile bench && ./release/sktbench --mode flood --sizes 16,4096,65535,1048576
+//   ./release/sktbench --mode rate --rate 10000 --sizes 256 [--iothread]
+//
+// every run also checks each cipher kernel against a reference keystream, a mismatch fails it.
+// results go to stdout (or --out) as one json object, keep them to compare runs.
+#include "stdafx.h"
+#include "Common/socket/S_O_TCP.h"
+#include "Common/socket/SocketConnectionManager.h"
+#include "Common/socket/SktReactor.h"
+#include "Common/socket/SktCipher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define BENCH_SOCKET_PREFIX        "bench"
+#define BENCH_HEAD_BYTES           (12)     // u32 client seq + i64 send time in us
+#define BENCH_MIN_SIZE             (16)
+#define BENCH_MAX_SIZE             (1024 * 1024)
+#define BENCH_CONNECT_MS           (3000)
+#define BENCH_RUN_TIMEOUT_S        (120)
+// without --msgs a run stops at this many payload bytes, the mix averages about 64K
+#define BENCH_AUTO_BYTES           (256LL * 1024 * 1024)
+#define BENCH_MIX_AVG_SIZE         (64 * 1024)
+#define BENCH_RATE_SECONDS         (5)
+#define BENCH_FRAME_US             (16667)  // 60 frames a second
+
+//------------------------------------------------------------------------------
+// host side hooks the engine normally provides, the benchmark runs without the app
+namespace ENG_DBG
+{
+	int g_OutLog = 0;
+	int g_DevMode = 0;
+	void DOut(int Type, const char* format, ...)
+	{
+		if (g_OutLog != 1)
+			return;
+		va_list arg_list;
+		va_start(arg_list, format);
+		vfprintf(stderr, format, arg_list);
+		va_end(arg_list);
+		fputc('\n', stderr);
+	}
+}
+int TrackingAssert(const char * key, const char * file, int line)
+{
+	fprintf(stderr, "assert %s at %s:%d\n", key, file, line);
+	return 0;
+}
+static std::atomic<int> g_netFailed(0);
+void lua::OnNetFailed(const char * connectName, int codeId)
+{
+	fprintf(stderr, "%s failed, error code %d\n", connectName, codeId);
+	g_netFailed.fetch_add(1);
+}
+void lua::OnTryingReconnect(const char * connectName) {}
+void lua::OnConnectToServer(const char * connectName) {}
+void lua::OnSendQueueHigh(const char * connectName, int bytes, int msgs) {}
+void lua::OnSendQueueLow(const char * connectName, int bytes, int msgs) {}
+void lua::OnLatencyHigh(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnLatencyLow(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total) {}
+
+//------------------------------------------------------------------------------
+// every operator new of the process, the server thread does not allocate
+static std::atomic<long long> g_allocCount(0);
+void* operator new(size_t size)
+{
+	g_allocCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size)
+{
+	g_allocCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+static Int64 nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+struct BenchConfig
+{
+	std::string         mode;
+	int                 clients;
+	int                 msgs;       // 0 picks a count per size
+	int                 window;
+	int                 tickUs;
+	int                 rate;       // rate mode, messages a second over all clients
+	int                 frameUs;
+	bool                ioThread;
+	bool                encrypt;
+	int                 compress;
+	std::vector<int>    sizes;      // 0 is the mixed distribution
+	std::string         out;
+};
+
+struct BenchRun
+{
+	std::string         label;
+	int                 msgs;
+	Int64               bytes;
+	double              seconds;
+	std::vector<Int64>  rtt;
+	std::vector<Int64>  dispatch;   // frame read off the socket to popped for dispatch
+	std::vector<Int64>  ticks;
+	std::vector<Int64>  frameLate;  // rate mode, frame start after its slot
+	Int64               allocs;
+	Int64               poolMisses;
+	SktConnStat         stat;
+	Int64               compressIn;
+	Int64               compressOut;
+	bool                ok;
+};
+
+// plain blocking echo, bytes go back untouched so framing, cipher and compression
+// all come back the way the client expects them
+class CBenchServer
+{
+public:
+	CBenchServer() : m_listenFd(-1), m_port(0) {}
+	bool Start(int clients)
+	{
+		m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listenFd, clients + 16) != 0)
+			return false;
+		socklen_t len = sizeof(addr);
+		getsockname(m_listenFd, (struct sockaddr*)&addr, &len);
+		m_port = ntohs(addr.sin_port);
+		m_acceptThread = std::thread(&CBenchServer::AcceptLoop, this, clients);
+		return true;
+	}
+	void Stop()
+	{
+		shutdown(m_listenFd, SHUT_RDWR);
+		if (m_acceptThread.joinable())
+			m_acceptThread.join();
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_workers[i].join();
+		close(m_listenFd);
+	}
+	int GetPort() const { return m_port; }
+private:
+	void AcceptLoop(int clients)
+	{
+		for (int i = 0; i < clients; i++)
+		{
+			int fd = accept(m_listenFd, NULL, NULL);
+			if (fd < 0)
+				return;
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			m_workers.push_back(std::thread(&CBenchServer::Echo, fd));
+		}
+	}
+	static void Echo(int fd)
+	{
+		static const int bufSize = 256 * 1024;
+		char* buf = (char*)malloc(bufSize);
+		for (;;)
+		{
+			ssize_t n = recv(fd, buf, bufSize, 0);
+			if (n <= 0)
+				break;
+			ssize_t off = 0;
+			while (off < n)
+			{
+				ssize_t s = send(fd, buf + off, n - off, MSG_NOSIGNAL);
+				if (s <= 0)
+					break;
+				off += s;
+			}
+			if (off < n)
+				break;
+		}
+		free(buf);
+		close(fd);
+	}
+	int                         m_listenFd;
+	int                         m_port;
+	std::thread                 m_acceptThread;
+	std::vector<std::thread>    m_workers;
+};
+
+struct BenchClient
+{
+	S_O_TCP*                    obj;
+	CSocketConnectionManager*   mgr;
+	int                         sent;
+	int                         received;
+	int                         quota;
+};
+
+// 16B .. 1MB, log uniform, same sequence every run
+static int mixedSize(unsigned int& seed)
+{
+	seed = seed * 1103515245u + 12345u;
+	double r = (double)((seed >> 8) & 0xFFFFFF) / (double)0x1000000;
+	int size = (int)(BENCH_MIN_SIZE * pow((double)BENCH_MAX_SIZE / BENCH_MIN_SIZE, r));
+	return std::max(BENCH_MIN_SIZE, std::min(BENCH_MAX_SIZE, size));
+}
+
+static void sendOne(BenchClient& client, int size, std::vector<char>& fill)
+{
+	NTMSG* msg = new NTMSG(512);
+	msg->NTMSG_beginWriteData();
+	char head[BENCH_HEAD_BYTES];
+	unsigned int seq = (unsigned int)client.sent;
+	Int64 sendUs = nowUs();
+	memcpy(head, &seq, 4);
+	memcpy(head + 4, &sendUs, 8);
+	msg->NTMSG_wRawValue(head, BENCH_HEAD_BYTES);
+	msg->NTMSG_wRawValue(&fill[0], size - BENCH_HEAD_BYTES);
+	msg->NTMSG_endWriteData();
+	client.mgr->SendMsgFromNetMsg(msg);
+	client.sent++;
+}
+
+static int msgsOfRun(const BenchConfig& cfg, int size)
+{
+	if (cfg.msgs > 0)
+		return cfg.msgs;
+	if (cfg.mode == "rate")
+		return std::max(cfg.clients, cfg.rate * BENCH_RATE_SECONDS);
+	int msgs = cfg.mode == "echo" ? 20000 : 200000;
+	Int64 cap = BENCH_AUTO_BYTES / (size == 0 ? BENCH_MIX_AVG_SIZE : size);
+	return (int)std::max((Int64)cfg.clients, std::min((Int64)msgs, cap));
+}
+
+static bool runOnce(const BenchConfig& cfg, std::vector<BenchClient>& clients, int size, BenchRun& run)
+{
+	int total = msgsOfRun(cfg, size);
+	std::vector<char> fill(BENCH_MAX_SIZE);
+	for (size_t i = 0; i < fill.size(); i++)
+		fill[i] = "engsocketbench.."[(i * 7 / 13) & 15];
+	unsigned int seed = 20240601u;
+	run.label = size == 0 ? "mix" : std::to_string((long long)size);
+	run.msgs = 0;
+	run.bytes = 0;
+	run.rtt.clear();
+	run.rtt.reserve(total);
+	run.dispatch.clear();
+	run.dispatch.reserve(total);
+	run.ticks.clear();
+	run.frameLate.clear();
+	run.ok = false;
+	for (size_t c = 0; c < clients.size(); c++)
+	{
+		clients[c].sent = 0;
+		clients[c].received = 0;
+		clients[c].quota = total / (int)clients.size() + ((int)c < total % (int)clients.size() ? 1 : 0);
+		clients[c].mgr->ResetStats();
+	}
+	NTMSG_PoolStat poolBefore;
+	NTMSG::NTMSG_PoolGetStat(poolBefore);
+	SktCompressStat compressBefore = clients[0].mgr->GetCompressStat();
+	Int64 allocBefore = g_allocCount.load();
+	bool paced = cfg.mode == "rate";
+	Int64 start = nowUs();
+	Int64 lastTick = start;
+	Int64 frames = 0;
+	int done = 0;
+	while (done < total)
+	{
+		// the rate spreads over the clients, each sends what is due by now
+		int due = (int)((nowUs() - start) * cfg.rate / 1000000 / (Int64)clients.size()) + 1;
+		for (size_t c = 0; c < clients.size(); c++)
+		{
+			BenchClient& client = clients[c];
+			while (client.sent < client.quota && (paced ? client.sent < due : client.sent - client.received < cfg.window))
+			{
+				int msgSize = size == 0 ? mixedSize(seed) : size;
+				sendOne(client, msgSize, fill);
+				run.bytes += msgSize;
+			}
+		}
+		Int64 tickStart = nowUs();
+		CSktReactor::Inst()->Poll();
+		for (size_t c = 0; c < clients.size(); c++)
+		{
+			BenchClient& client = clients[c];
+			client.mgr->Update((int)((tickStart - lastTick) / 1000));
+			NTMSG* msg = NULL;
+			while ((msg = client.mgr->PopMsgFromCache()) != NULL)
+			{
+				Int64 arrivedUs = nowUs();
+				if (msg->NTMSG_getArrival() > 0)
+					run.dispatch.push_back(arrivedUs - msg->NTMSG_getArrival());
+				msg->NTMSG_ResetFReadPos();
+				Int64 sendUs = 0;
+				memcpy(&sendUs, msg->NTMSG_rRawValue(BENCH_HEAD_BYTES) + 4, 8);
+				run.rtt.push_back(arrivedUs - sendUs);
+				delete msg;
+				client.received++;
+				done++;
+			}
+		}
+		Int64 tickEnd = nowUs();
+		run.ticks.push_back(tickEnd - tickStart);
+		lastTick = tickStart;
+		if (g_netFailed.load() != 0 || tickEnd - start > (Int64)BENCH_RUN_TIMEOUT_S * 1000000)
+			return false;
+		if (paced)
+		{
+			run.frameLate.push_back(tickStart - (start + frames * cfg.frameUs));
+			frames++;
+			Int64 next = start + frames * cfg.frameUs;
+			if (next > tickEnd)
+				usleep((useconds_t)(next - tickEnd));
+		}
+		else if (cfg.tickUs > 0)
+			usleep(cfg.tickUs);
+	}
+	run.seconds = (nowUs() - start) / 1e6;
+	run.msgs = done;
+	run.allocs = g_allocCount.load() - allocBefore;
+	NTMSG_PoolStat poolAfter;
+	NTMSG::NTMSG_PoolGetStat(poolAfter);
+	run.poolMisses = poolAfter.misses - poolBefore.misses;
+	memset(&run.stat, 0, sizeof(run.stat));
+	for (size_t c = 0; c < clients.size(); c++)
+	{
+		SktConnStat stat;
+		clients[c].mgr->GetStats(stat);
+		run.stat.bytesSent += stat.bytesSent;
+		run.stat.bytesRecv += stat.bytesRecv;
+		run.stat.sendCalls += stat.sendCalls;
+		run.stat.recvCalls += stat.recvCalls;
+		run.stat.pollCalls += stat.pollCalls;
+		run.stat.partialWrites += stat.partialWrites;
+		run.stat.sendQueueMax = std::max(run.stat.sendQueueMax, stat.sendQueueMax);
+		run.stat.recvQueueMax = std::max(run.stat.recvQueueMax, stat.recvQueueMax);
+	}
+	const SktCompressStat& compressAfter = clients[0].mgr->GetCompressStat();
+	run.compressIn = compressAfter.bytesIn - compressBefore.bytesIn;
+	run.compressOut = compressAfter.bytesOut - compressBefore.bytesOut;
+	run.ok = true;
+	return true;
+}
+
+static Int64 percentile(std::vector<Int64>& v, double p)
+{
+	if (v.empty())
+		return 0;
+	size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + idx, v.end());
+	return v[idx];
+}
+
+// keystream throughput of the payload cipher, the part of SendMsgFromNetMsg that scales with size
+static double cipherGBps()
+{
+	std::vector<char> buf(16 * 1024 * 1024, 'x');
+	CSktCipher cipher;
+	cipher.Init(12345);
+	Int64 start = nowUs();
+	const int rounds = 8;
+	for (int i = 0; i < rounds; i++)
+		cipher.Apply(&buf[0], (int)buf.size());
+	double seconds = (nowUs() - start) / 1e6;
+	return seconds > 0 ? (double)buf.size() * rounds / seconds / 1e9 : 0;
+}
+
+// the keystream as the header of SktCipher.h writes it down, one byte at a time
+static unsigned long long refMix64(unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static void refKeystream(unsigned int seed, std::vector<unsigned char>& ks)
+{
+	unsigned long long key = refMix64((unsigned long long)seed ^ 0x6A09E667F3BCC909ULL);
+	for (size_t n = 0; n < ks.size(); n++)
+		ks[n] = (unsigned char)(refMix64(key + (n >> 3) * 0x9E3779B97F4A7C15ULL) >> ((n & 7) * 8));
+}
+
+// a few bytes, or anything up to a couple of 4K keystream blocks
+static void applyInCuts(CSktCipher& cipher, std::vector<unsigned char>& buf)
+{
+	size_t at = 0;
+	while (at < buf.size())
+	{
+		size_t cut = rand() % 3 == 0 ? rand() % 9 + 1 : rand() % 9000 + 1;
+		if (cut > buf.size() - at)
+			cut = buf.size() - at;
+		cipher.Apply((char*)&buf[at], (int)cut);
+		at += cut;
+	}
+}
+
+// every xor kernel this build and cpu have against the reference keystream. the stream is cut
+// at random points so pieces start and end anywhere in a vector or a block, and the receiving
+// side cuts it differently from the sending one. kernels gets the names of the ones checked
+static bool cipherCheck(std::string& kernels)
+{
+	const char* names[] = {"scalar", "sse2", "avx2", "neon"};
+	const char* picked = CSktCipher::GetKernelName();
+	std::vector<unsigned char> plain(100 * 1000), ks(plain.size()), wire, back;
+	bool ok = true;
+	srand(7);
+	for (int k = 0; k < 4 && ok; k++)
+	{
+		if (!CSktCipher::UseKernel(names[k]))
+			continue;
+		kernels += kernels.empty() ? names[k] : std::string(",") + names[k];
+		for (int round = 0; round < 16 && ok; round++)
+		{
+			unsigned int seed = (unsigned int)rand() * 2654435761u;
+			for (size_t i = 0; i < plain.size(); i++)
+				plain[i] = (unsigned char)rand();
+			refKeystream(seed, ks);
+			wire = plain;
+			CSktCipher send;
+			send.Init(seed);
+			applyInCuts(send, wire);
+			for (size_t i = 0; i < plain.size() && ok; i++)
+				ok = wire[i] == (unsigned char)(plain[i] ^ ks[i]);
+			back = wire;
+			CSktCipher recv;
+			recv.Init(seed);
+			applyInCuts(recv, back);
+			ok = ok && back == plain;
+			if (!ok)
+				fprintf(stderr, "cipher kernel %s differs from the reference, seed %u\n", names[k], seed);
+		}
+	}
+	CSktCipher::UseKernel(picked);
+	return ok;
+}
+
+static void writeJson(FILE* f, const BenchConfig& cfg, std::vector<BenchRun>& runs, double cipher, const std::string& kernels, bool cipherOk)
+{
+	fprintf(f, "{\n  \"config\": {\"mode\": \"%s\", \"clients\": %d, \"msgs\": %d, \"window\": %d, \"tickUs\": %d, "
+		"\"rate\": %d, \"frameUs\": %d, \"ioThread\": %s, \"encrypt\": %s, \"compress\": %d},\n",
+		cfg.mode.c_str(), cfg.clients, cfg.msgs, cfg.window, cfg.tickUs, cfg.rate, cfg.frameUs,
+		cfg.ioThread ? "true" : "false", cfg.encrypt ? "true" : "false", cfg.compress);
+	fprintf(f, "  \"cipherGBps\": %.3f,\n  \"cipherCheck\": {\"kernels\": \"%s\", \"ok\": %s},\n  \"runs\": [",
+		cipher, kernels.c_str(), cipherOk ? "true" : "false");
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		BenchRun& run = runs[i];
+		double msgs = run.msgs > 0 ? run.msgs : 1;
+		fprintf(f, "%s\n    {\"size\": \"%s\", \"ok\": %s, \"msgs\": %d, \"seconds\": %.6f, \"msgsPerSec\": %.1f, \"MBPerSec\": %.3f,\n",
+			i ? "," : "", run.label.c_str(), run.ok ? "true" : "false", run.msgs, run.seconds,
+			run.seconds > 0 ? run.msgs / run.seconds : 0, run.seconds > 0 ? run.bytes / run.seconds / (1024.0 * 1024.0) : 0);
+		fprintf(f, "     \"rttUs\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld},\n",
+			(long long)percentile(run.rtt, 0.5), (long long)percentile(run.rtt, 0.99),
+			(long long)percentile(run.rtt, 0.999), (long long)percentile(run.rtt, 1.0));
+		fprintf(f, "     \"dispatchUs\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld},\n",
+			(long long)percentile(run.dispatch, 0.5), (long long)percentile(run.dispatch, 0.99),
+			(long long)percentile(run.dispatch, 0.999), (long long)percentile(run.dispatch, 1.0));
+		fprintf(f, "     \"tickUs\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld},\n",
+			(long long)percentile(run.ticks, 0.5), (long long)percentile(run.ticks, 0.99), (long long)percentile(run.ticks, 1.0));
+		if (!run.frameLate.empty())
+		{
+			fprintf(f, "     \"frameLateUs\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld},\n",
+				(long long)percentile(run.frameLate, 0.5), (long long)percentile(run.frameLate, 0.99),
+				(long long)percentile(run.frameLate, 1.0));
+		}
+		fprintf(f, "     \"allocsPerMsg\": %.3f, \"poolMissesPerMsg\": %.3f,\n", run.allocs / msgs, run.poolMisses / msgs);
+		fprintf(f, "     \"callsPer1kMsgs\": {\"send\": %.1f, \"recv\": %.1f, \"poll\": %.1f}, \"partialWrites\": %lld,\n",
+			run.stat.sendCalls * 1000.0 / msgs, run.stat.recvCalls * 1000.0 / msgs, run.stat.pollCalls * 1000.0 / msgs,
+			(long long)run.stat.partialWrites);
+		fprintf(f, "     \"wireBytesSent\": %lld, \"wireBytesRecv\": %lld, \"sendQueueMax\": %d, \"recvQueueMax\": %d,\n",
+			(long long)run.stat.bytesSent, (long long)run.stat.bytesRecv, run.stat.sendQueueMax, run.stat.recvQueueMax);
+		fprintf(f, "     \"compressedIn\": %lld, \"compressedOut\": %lld}",
+			(long long)run.compressIn, (long long)run.compressOut);
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"sktbench [--mode echo|flood|rate] [--clients N] [--msgs N] [--window N] [--sizes a,b,..|mix]\n"
+		"         [--tick-us N] [--rate N] [--frame-us N] [--iothread] [--encrypt] [--compress threshold]\n"
+		"         [--out file]\n"
+		"  echo  : one message in flight per client, the round trip is the latency\n"
+		"  flood : --window (default 256) messages in flight per client, for throughput\n"
+		"  rate  : --rate (default 10000) messages a second from a loop of --frame-us (default\n"
+		"          16667) frames, dispatchUs is socket read to pop, frameLateUs the frame jitter\n"
+		"  --msgs defaults to 20000 (echo), 200000 (flood) or 5s of the rate, at most 256MB of\n"
+		"  payload per size\n"
+		"  sizes default to 16,256,4096,65534,65535,262144,1048576,mix, 65535 and up take the\n"
+		"  0xFFFF four byte header, mix is log uniform over 16B..1MB\n");
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& cfg)
+{
+	cfg.mode = "echo";
+	cfg.clients = 1;
+	cfg.msgs = 0;
+	cfg.window = 0;
+	cfg.tickUs = 0;
+	cfg.rate = 10000;
+	cfg.frameUs = BENCH_FRAME_US;
+	cfg.ioThread = false;
+	cfg.encrypt = false;
+	cfg.compress = -1;
+	std::string sizes = "16,256,4096,65534,65535,262144,1048576,mix";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--mode" && hasValue)
+			cfg.mode = argv[++i];
+		else if (arg == "--clients" && hasValue)
+			cfg.clients = atoi(argv[++i]);
+		else if (arg == "--msgs" && hasValue)
+			cfg.msgs = atoi(argv[++i]);
+		else if (arg == "--window" && hasValue)
+			cfg.window = atoi(argv[++i]);
+		else if (arg == "--sizes" && hasValue)
+			sizes = argv[++i];
+		else if (arg == "--tick-us" && hasValue)
+			cfg.tickUs = atoi(argv[++i]);
+		else if (arg == "--rate" && hasValue)
+			cfg.rate = atoi(argv[++i]);
+		else if (arg == "--frame-us" && hasValue)
+			cfg.frameUs = atoi(argv[++i]);
+		else if (arg == "--iothread")
+			cfg.ioThread = true;
+		else if (arg == "--encrypt")
+			cfg.encrypt = true;
+		else if (arg == "--compress" && hasValue)
+			cfg.compress = atoi(argv[++i]);
+		else if (arg == "--out" && hasValue)
+			cfg.out = argv[++i];
+		else
+			return false;
+	}
+	if (cfg.mode != "echo" && cfg.mode != "flood" && cfg.mode != "rate")
+		return false;
+	if (cfg.rate <= 0 || cfg.frameUs <= 0)
+		return false;
+	if (cfg.window <= 0)
+		cfg.window = cfg.mode == "echo" ? 1 : 256;
+	if (cfg.clients <= 0 || cfg.msgs < 0)
+		return false;
+	size_t pos = 0;
+	while (pos < sizes.size())
+	{
+		size_t comma = sizes.find(',', pos);
+		std::string item = sizes.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+		int size = item == "mix" ? 0 : atoi(item.c_str());
+		if (size != 0 && (size < BENCH_MIN_SIZE || size > BENCH_MAX_SIZE))
+			return false;
+		cfg.sizes.push_back(size);
+		if (comma == std::string::npos)
+			break;
+		pos = comma + 1;
+	}
+	return !cfg.sizes.empty();
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig cfg;
+	if (!parseArgs(argc, argv, cfg))
+	{
+		usage();
+		return 2;
+	}
+	CBenchServer server;
+	if (!server.Start(cfg.clients))
+	{
+		fprintf(stderr, "can not listen on 127.0.0.1\n");
+		return 1;
+	}
+	std::vector<BenchClient> clients(cfg.clients);
+	for (int c = 0; c < cfg.clients; c++)
+	{
+		std::string name = BENCH_SOCKET_PREFIX + std::to_string((long long)c);
+		clients[c].obj = new S_O_TCP(name.c_str());
+		clients[c].mgr = clients[c].obj->GetConnectionSocketManager();
+		clients[c].mgr->SetIOThreadMode(cfg.ioThread);
+		if (cfg.compress >= 0)
+			clients[c].mgr->SetCompression(cfg.compress, NULL, 0);
+		clients[c].mgr->ConnectToAddrPort(server.GetPort(), "127.0.0.1");
+	}
+	Int64 deadline = nowUs() + BENCH_CONNECT_MS * 1000;
+	for (int c = 0; c < cfg.clients; c++)
+	{
+		while (clients[c].mgr->GetStateOfNet() != NetConState_Connected && nowUs() < deadline)
+		{
+			CSktReactor::Inst()->Poll();
+			clients[c].mgr->Update(1);
+			usleep(100);
+		}
+		if (clients[c].mgr->GetStateOfNet() != NetConState_Connected)
+		{
+			fprintf(stderr, "client %d could not connect\n", c);
+			return 1;
+		}
+		// both directions use the same seed, the echo is decoded with what encoded it
+		if (cfg.encrypt)
+			clients[c].mgr->InitEncryptBySeed(c + 1, c + 1);
+	}
+
+	std::vector<BenchRun> runs(cfg.sizes.size());
+	int exitCode = 0;
+	for (size_t i = 0; i < cfg.sizes.size(); i++)
+	{
+		if (!runOnce(cfg, clients, cfg.sizes[i], runs[i]))
+		{
+			fprintf(stderr, "run %s failed\n", runs[i].label.c_str());
+			runs.resize(i + 1);
+			exitCode = 1;
+			break;
+		}
+	}
+	double cipher = cipherGBps();
+	std::string kernels;
+	bool cipherOk = cipherCheck(kernels);
+	if (!cipherOk)
+		exitCode = 1;
+	FILE* f = cfg.out.empty() ? stdout : fopen(cfg.out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, cfg, runs, cipher, kernels, cipherOk);
+		if (f != stdout)
+			fclose(f);
+	}
+	for (int c = 0; c < cfg.clients; c++)
+		delete clients[c].obj;
+	server.Stop();
+	return exitCode;
+}
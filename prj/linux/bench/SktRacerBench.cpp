@@ -0,0 +1,388 @@
+// local check of the happy eyeballs connect (Common/socket/SktConnectRacer).
+// a stub resolver hands the manager one host with addresses on 127.0.0.1 and ::1, both on
+// the same port, and each family gets a listener that accepts, refuses or blackholes.
+// a blackholed listener has its accept queue filled, so the kernel drops further SYNs
+// and a connect to it hangs like one to a dead route.
+//
+//   make -f makefile racebench && ./release/sktracebench
+//
+// scenarios, addresses in the order the resolver returns them:
+//   v6-blackhole           : nothing else to try, NetErrorCode_ConnectTimeOut after the connect timeout
+//   v6-blackhole,v4-ok     : v4 starts one stagger in and wins
+//   v4-blackhole,v6-ok     : the same with the families swapped
+//   v6-refused,v4-ok       : v4 starts as soon as v6 fails, well inside the stagger
+//   v6-refused,v4-refused  : NetErrorCode_ConnectToServer as soon as both fail
+// scenarios on ::1 are skipped on hosts without ipv6 loopback.
+// results go to stdout (or --out) as one json object, a failed scenario makes the exit code 1.
+#include "stdafx.h"
+#include "Common/socket/S_O_TCP.h"
+#include "Common/socket/SocketConnectionManager.h"
+#include "Common/socket/SktReactor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#define RACEB_HOST                 "race.racebench.invalid"
+#define RACEB_OK                   (0)
+#define RACEB_REFUSED              (1)
+#define RACEB_BLACKHOLE            (2)
+// connects used to fill a blackholed accept queue, the first one left hanging ends it
+#define RACEB_FILL_MAX             (16)
+#define RACEB_FILL_WAIT_MS         (100)
+#define RACEB_PORT_TRIES           (20)
+// the manager gives up after its 5s connect timeout, give or take a tick
+#define RACEB_TIMEOUT_MIN_MS       (4500)
+#define RACEB_WAIT_MS              (8000)
+// a winner that had to wait out the stagger, with room for a loaded machine
+#define RACEB_STAGGER_MAX_MS       (1000)
+
+//------------------------------------------------------------------------------
+// host side hooks the engine normally provides, the bench runs without the app
+namespace ENG_DBG
+{
+	int g_OutLog = 0;
+	int g_DevMode = 0;
+	void DOut(int Type, const char* format, ...)
+	{
+		if (g_OutLog != 1)
+			return;
+		va_list arg_list;
+		va_start(arg_list, format);
+		vfprintf(stderr, format, arg_list);
+		va_end(arg_list);
+		fputc('\n', stderr);
+	}
+}
+int TrackingAssert(const char * key, const char * file, int line)
+{
+	fprintf(stderr, "assert %s at %s:%d\n", key, file, line);
+	return 0;
+}
+
+static bool g_connected = false;
+static int g_failCode = -1;
+
+void lua::OnNetFailed(const char * connectName, int codeId) { g_failCode = codeId; }
+void lua::OnTryingReconnect(const char * connectName) {}
+void lua::OnConnectToServer(const char * connectName) { g_connected = true; }
+void lua::OnSendQueueHigh(const char * connectName, int bytes, int msgs) {}
+void lua::OnSendQueueLow(const char * connectName, int bytes, int msgs) {}
+void lua::OnLatencyHigh(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnLatencyLow(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total) {}
+
+static Int64 nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+struct RacerBenchCandidate
+{
+	int                 family;
+	int                 behavior;   // RACEB_OK, RACEB_REFUSED or RACEB_BLACKHOLE
+};
+
+struct RacerBenchScenario
+{
+	const char*         name;
+	RacerBenchCandidate candidates[2];
+	int                 count;
+	bool                expectConnect;
+	int                 expectCode;
+	int                 minMs;
+	int                 maxMs;
+};
+
+struct RacerBenchRun
+{
+	std::string         name;
+	bool                ok;
+	bool                skipped;
+	bool                connected;
+	int                 failCode;
+	double              outcomeMs;  // connect call to OnConnectToServer or OnNetFailed
+};
+
+// one family's end of a scenario, the listener and whatever fills its queue
+struct RacerBenchPeer
+{
+	int                 listenFd;
+	std::vector<int>    fillers;
+};
+
+static SktResolvedList g_stubAddrs;
+
+// stands in for getaddrinfo on the resolver thread, the port is filled in by the racer
+static int stubResolve(const char* host, SktResolvedList& out)
+{
+	out = g_stubAddrs;
+	return out.empty() ? EAI_NONAME : 0;
+}
+
+static void loopbackAddr(int family, int port, SktResolvedAddr& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.family = family;
+	addr.socktype = SOCK_STREAM;
+	addr.protocol = IPPROTO_TCP;
+	if (family == AF_INET)
+	{
+		struct sockaddr_in* sin = (struct sockaddr_in*)&addr.addr;
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.addrlen = sizeof(struct sockaddr_in);
+	}
+	else
+	{
+		struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&addr.addr;
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		sin6->sin6_addr = in6addr_loopback;
+		addr.addrlen = sizeof(struct sockaddr_in6);
+	}
+}
+
+// a refused family keeps its port bound without listening, the kernel answers with a reset
+static int bindPeer(int family, int port, int& boundPort)
+{
+	int fd = socket(family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	int one = 1;
+	if (family == AF_INET6)
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+	SktResolvedAddr addr;
+	loopbackAddr(family, port, addr);
+	socklen_t len = addr.addrlen;
+	if (bind(fd, (struct sockaddr*)&addr.addr, addr.addrlen) != 0
+		|| getsockname(fd, (struct sockaddr*)&addr.addr, &len) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	boundPort = family == AF_INET ? ntohs(((struct sockaddr_in*)&addr.addr)->sin_port)
+		: ntohs(((struct sockaddr_in6*)&addr.addr)->sin6_port);
+	return fd;
+}
+
+// non blocking connects until one is left hanging, the queue is full from then on
+static bool fillAcceptQueue(int family, int port, std::vector<int>& fillers)
+{
+	SktResolvedAddr addr;
+	loopbackAddr(family, port, addr);
+	for (int i = 0; i < RACEB_FILL_MAX; i++)
+	{
+		int fd = socket(family, SOCK_STREAM, 0);
+		if (fd < 0)
+			return false;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		fillers.push_back(fd);
+		if (connect(fd, (struct sockaddr*)&addr.addr, addr.addrlen) == 0)
+			continue;
+		if (errno != EINPROGRESS)
+			return false;
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, RACEB_FILL_WAIT_MS) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void closePeer(RacerBenchPeer& peer)
+{
+	for (size_t i = 0; i < peer.fillers.size(); i++)
+		close(peer.fillers[i]);
+	peer.fillers.clear();
+	if (peer.listenFd >= 0)
+		close(peer.listenFd);
+	peer.listenFd = -1;
+}
+
+// every family of the scenario on one port, the racer connects all candidates to the same one
+static bool openPeers(const RacerBenchScenario& scenario, RacerBenchPeer* peers, int& port)
+{
+	for (int tries = 0; tries < RACEB_PORT_TRIES; tries++)
+	{
+		port = 0;
+		int i = 0;
+		for (; i < scenario.count; i++)
+		{
+			peers[i].listenFd = bindPeer(scenario.candidates[i].family, port, port);
+			if (peers[i].listenFd < 0)
+				break;
+		}
+		if (i == scenario.count)
+			break;
+		for (int j = 0; j < i; j++)
+			closePeer(peers[j]);
+		if (tries + 1 == RACEB_PORT_TRIES)
+			return false;
+	}
+	for (int i = 0; i < scenario.count; i++)
+	{
+		int behavior = scenario.candidates[i].behavior;
+		if (behavior == RACEB_REFUSED)
+			continue;
+		if (listen(peers[i].listenFd, behavior == RACEB_BLACKHOLE ? 0 : 16) != 0)
+			return false;
+		if (behavior == RACEB_BLACKHOLE && !fillAcceptQueue(scenario.candidates[i].family, port, peers[i].fillers))
+			return false;
+	}
+	return true;
+}
+
+static bool hasLoopback6()
+{
+	int boundPort = 0;
+	int fd = bindPeer(AF_INET6, 0, boundPort);
+	if (fd < 0)
+		return false;
+	close(fd);
+	return true;
+}
+
+// ticks until the connect is decided or RACEB_WAIT_MS is up, the way the app's frame would
+static void runScenario(CSocketConnectionManager* mgr, const RacerBenchScenario& scenario, RacerBenchRun& run)
+{
+	run.name = scenario.name;
+	run.ok = false;
+	run.skipped = false;
+	run.connected = false;
+	run.failCode = -1;
+	run.outcomeMs = 0;
+	RacerBenchPeer peers[2];
+	for (int i = 0; i < 2; i++)
+		peers[i].listenFd = -1;
+	int port = 0;
+	if (!openPeers(scenario, peers, port))
+	{
+		fprintf(stderr, "%s: could not set up the listeners\n", scenario.name);
+		for (int i = 0; i < scenario.count; i++)
+			closePeer(peers[i]);
+		return;
+	}
+	g_stubAddrs.clear();
+	for (int i = 0; i < scenario.count; i++)
+	{
+		g_stubAddrs.push_back(SktResolvedAddr());
+		loopbackAddr(scenario.candidates[i].family, 0, g_stubAddrs.back());
+	}
+	CSktResolver::Inst()->Flush();
+	g_connected = false;
+	g_failCode = -1;
+	Int64 startUs = nowUs();
+	mgr->ConnectToAddrPort(port, RACEB_HOST);
+	Int64 lastUs = nowUs();
+	while (!g_connected && g_failCode < 0 && lastUs - startUs < RACEB_WAIT_MS * 1000LL)
+	{
+		usleep(1000);
+		Int64 tickUs = nowUs();
+		CSktReactor::Inst()->Poll();
+		mgr->Update((int)((tickUs - lastUs) / 1000));
+		// dt is whole ms, the remainder carries over to the next tick
+		lastUs = tickUs - (tickUs - lastUs) % 1000;
+	}
+	run.outcomeMs = (nowUs() - startUs) / 1000.0;
+	run.connected = g_connected;
+	run.failCode = g_failCode;
+	mgr->CloseConnect();
+	for (int i = 0; i < scenario.count; i++)
+		closePeer(peers[i]);
+	run.ok = run.outcomeMs >= scenario.minMs && run.outcomeMs < scenario.maxMs
+		&& (scenario.expectConnect ? run.connected : run.failCode == scenario.expectCode);
+}
+
+static void writeJson(FILE* f, const std::vector<RacerBenchRun>& runs)
+{
+	fprintf(f, "{\n  \"staggerMs\": %d,\n  \"scenarios\": [", SKT_RACER_STAGGER_MS);
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		const RacerBenchRun& run = runs[i];
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"ok\": %s, \"skipped\": %s, \"connected\": %s, \"failCode\": %d, \"outcomeMs\": %.1f}",
+			i ? "," : "", run.name.c_str(), run.ok ? "true" : "false", run.skipped ? "true" : "false",
+			run.connected ? "true" : "false", run.failCode, run.outcomeMs);
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"sktracebench [--out file]\n"
+		"  races connects against local listeners on 127.0.0.1 and ::1, takes about 6s,\n"
+		"  the v6-blackhole scenario waits out the connect timeout\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::string out;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc)
+			out = argv[++i];
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	const RacerBenchScenario scenarios[] =
+	{
+		{ "v6-blackhole",          { { AF_INET6, RACEB_BLACKHOLE }, { 0, 0 } },                   1, false, NetErrorCode_ConnectTimeOut, RACEB_TIMEOUT_MIN_MS, RACEB_WAIT_MS },
+		{ "v6-blackhole,v4-ok",    { { AF_INET6, RACEB_BLACKHOLE }, { AF_INET, RACEB_OK } },      2, true, -1, SKT_RACER_STAGGER_MS, RACEB_STAGGER_MAX_MS },
+		{ "v4-blackhole,v6-ok",    { { AF_INET, RACEB_BLACKHOLE }, { AF_INET6, RACEB_OK } },      2, true, -1, SKT_RACER_STAGGER_MS, RACEB_STAGGER_MAX_MS },
+		{ "v6-refused,v4-ok",      { { AF_INET6, RACEB_REFUSED }, { AF_INET, RACEB_OK } },        2, true, -1, 0, SKT_RACER_STAGGER_MS },
+		{ "v6-refused,v4-refused", { { AF_INET6, RACEB_REFUSED }, { AF_INET, RACEB_REFUSED } },   2, false, NetErrorCode_ConnectToServer, 0, SKT_RACER_STAGGER_MS },
+	};
+	bool loopback6 = hasLoopback6();
+	CSktResolver::Inst()->SetResolveFunc(stubResolve);
+	S_O_TCP* obj = new S_O_TCP("racebench");
+	CSocketConnectionManager* mgr = obj->GetConnectionSocketManager();
+	std::vector<RacerBenchRun> runs;
+	int exitCode = 0;
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+	{
+		runs.push_back(RacerBenchRun());
+		// every scenario has a v6 candidate
+		if (!loopback6)
+		{
+			runs.back().name = scenarios[i].name;
+			runs.back().ok = true;
+			runs.back().skipped = true;
+			runs.back().connected = false;
+			runs.back().failCode = -1;
+			runs.back().outcomeMs = 0;
+			continue;
+		}
+		runScenario(mgr, scenarios[i], runs.back());
+		if (!runs.back().ok)
+			exitCode = 1;
+	}
+	delete obj;
+	FILE* f = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, runs);
+		if (f != stdout)
+			fclose(f);
+	}
+	return exitCode;
+}
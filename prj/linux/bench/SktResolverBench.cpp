@@ -0,0 +1,276 @@
+// offline check of the connect path through CSktResolver (Common/socket/SktResolver).
+// SetResolveFunc swaps getaddrinfo for a stub that answers made up host names with
+// 127.0.0.1, where a local listener takes the connect, so nothing leaves the machine.
+// the manager is ticked with the app's Poll + Update(dt) frame.
+//
+//   make -f makefile resolvebench && ./release/sktresolvebench
+//
+// scenarios, in this order since the stalled lookup holds the one resolver thread:
+//   slow     : the stub takes 200ms, the connect call and every tick stay under a few ms
+//   cached   : reconnect to the same host, served from the cache without a lookup
+//   dnserror : the stub fails, NetErrorCode_DNSError
+//   timeout  : the stub never answers, NetErrorCode_ConnectTimeOut after the connect timeout
+// results go to stdout (or --out) as one json object, a failed scenario makes the exit code 1.
+#include "stdafx.h"
+#include "Common/socket/S_O_TCP.h"
+#include "Common/socket/SocketConnectionManager.h"
+#include "Common/socket/SktReactor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#define RB_HOST_SLOW               "slow.resolvebench.invalid"
+#define RB_HOST_BAD                "bad.resolvebench.invalid"
+#define RB_HOST_STALL              "stall.resolvebench.invalid"
+#define RB_SLOW_MS                 (200)
+// the slow lookup must not show up on the lua thread, a connect call or tick above this fails it
+#define RB_TICK_LIMIT_MS           (5.0)
+#define RB_CACHED_LIMIT_MS         (100)
+#define RB_DNSERROR_LIMIT_MS       (1000)
+// the manager gives up after its 5s connect timeout, give or take a tick
+#define RB_TIMEOUT_MIN_MS          (4500)
+#define RB_WAIT_MS                 (8000)
+
+//------------------------------------------------------------------------------
+// host side hooks the engine normally provides, the bench runs without the app
+namespace ENG_DBG
+{
+	int g_OutLog = 0;
+	int g_DevMode = 0;
+	void DOut(int Type, const char* format, ...)
+	{
+		if (g_OutLog != 1)
+			return;
+		va_list arg_list;
+		va_start(arg_list, format);
+		vfprintf(stderr, format, arg_list);
+		va_end(arg_list);
+		fputc('\n', stderr);
+	}
+}
+int TrackingAssert(const char * key, const char * file, int line)
+{
+	fprintf(stderr, "assert %s at %s:%d\n", key, file, line);
+	return 0;
+}
+
+static bool g_connected = false;
+static int g_failCode = -1;
+
+void lua::OnNetFailed(const char * connectName, int codeId) { g_failCode = codeId; }
+void lua::OnTryingReconnect(const char * connectName) {}
+void lua::OnConnectToServer(const char * connectName) { g_connected = true; }
+void lua::OnSendQueueHigh(const char * connectName, int bytes, int msgs) {}
+void lua::OnSendQueueLow(const char * connectName, int bytes, int msgs) {}
+void lua::OnLatencyHigh(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnLatencyLow(const char * connectName, int rttUs, int jitterUs) {}
+void lua::OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total) {}
+
+static Int64 nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+struct ResolverBenchRun
+{
+	std::string         name;
+	bool                ok;
+	bool                connected;
+	int                 failCode;
+	double              callMs;     // the ConnectToAddrPort call itself
+	double              outcomeMs;  // connect call to OnConnectToServer or OnNetFailed
+	double              maxTickMs;  // slowest Poll + Update on the way
+	int                 cacheHits;  // resolver stats gained during the scenario
+	int                 lookups;
+};
+
+static std::atomic<bool> g_releaseStall(false);
+
+// stands in for getaddrinfo on the resolver thread
+static int stubResolve(const char* host, SktResolvedList& out)
+{
+	std::string name = host;
+	if (name == RB_HOST_SLOW)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(RB_SLOW_MS));
+		SktResolvedAddr addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.family = AF_INET;
+		addr.socktype = SOCK_STREAM;
+		addr.protocol = IPPROTO_TCP;
+		addr.addrlen = sizeof(struct sockaddr_in);
+		struct sockaddr_in* sin = (struct sockaddr_in*)&addr.addr;
+		sin->sin_family = AF_INET;
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		out.push_back(addr);
+		return 0;
+	}
+	if (name == RB_HOST_STALL)
+	{
+		// released once the scenario is over so the resolver thread can be joined at exit
+		while (!g_releaseStall.load())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return EAI_AGAIN;
+	}
+	return EAI_NONAME;
+}
+
+// connects complete in the kernel's accept queue, nothing has to accept them
+static int openListener(int& port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0
+		|| getsockname(fd, (struct sockaddr*)&addr, &len) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	port = ntohs(addr.sin_port);
+	return fd;
+}
+
+// ticks until the connect is decided or waitMs is up, the way the app's frame would
+static void runConnect(CSocketConnectionManager* mgr, const char* host, int port, ResolverBenchRun& run)
+{
+	SktResolverStat before;
+	CSktResolver::Inst()->GetStat(before);
+	g_connected = false;
+	g_failCode = -1;
+	run.maxTickMs = 0;
+	Int64 startUs = nowUs();
+	mgr->ConnectToAddrPort(port, host);
+	Int64 lastUs = nowUs();
+	run.callMs = (lastUs - startUs) / 1000.0;
+	while (!g_connected && g_failCode < 0 && lastUs - startUs < RB_WAIT_MS * 1000LL)
+	{
+		usleep(1000);
+		Int64 tickUs = nowUs();
+		CSktReactor::Inst()->Poll();
+		mgr->Update((int)((tickUs - lastUs) / 1000));
+		Int64 doneUs = nowUs();
+		if ((doneUs - tickUs) / 1000.0 > run.maxTickMs)
+			run.maxTickMs = (doneUs - tickUs) / 1000.0;
+		// dt is whole ms, the remainder carries over to the next tick
+		lastUs = tickUs - (tickUs - lastUs) % 1000;
+	}
+	run.outcomeMs = (nowUs() - startUs) / 1000.0;
+	run.connected = g_connected;
+	run.failCode = g_failCode;
+	SktResolverStat after;
+	CSktResolver::Inst()->GetStat(after);
+	run.cacheHits = after.cacheHits - before.cacheHits;
+	run.lookups = after.lookups - before.lookups;
+}
+
+static void writeJson(FILE* f, const std::vector<ResolverBenchRun>& runs)
+{
+	fprintf(f, "{\n  \"scenarios\": [");
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		const ResolverBenchRun& run = runs[i];
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"ok\": %s, \"connected\": %s, \"failCode\": %d, \"callMs\": %.3f, \"outcomeMs\": %.1f,\n",
+			i ? "," : "", run.name.c_str(), run.ok ? "true" : "false", run.connected ? "true" : "false",
+			run.failCode, run.callMs, run.outcomeMs);
+		fprintf(f, "     \"maxTickMs\": %.3f, \"cacheHits\": %d, \"lookups\": %d}", run.maxTickMs, run.cacheHits, run.lookups);
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"sktresolvebench [--out file]\n"
+		"  runs the slow, cached, dnserror and timeout scenarios against a stub resolver,\n"
+		"  takes about 6s, the timeout one waits out the connect timeout\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::string out;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc)
+			out = argv[++i];
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	int port = 0;
+	int listenFd = openListener(port);
+	if (listenFd < 0)
+	{
+		fprintf(stderr, "no loopback listener\n");
+		return 1;
+	}
+	CSktResolver::Inst()->SetResolveFunc(stubResolve);
+	S_O_TCP* obj = new S_O_TCP("resolvebench");
+	CSocketConnectionManager* mgr = obj->GetConnectionSocketManager();
+	std::vector<ResolverBenchRun> runs;
+
+	runs.push_back(ResolverBenchRun());
+	runs.back().name = "slow";
+	runConnect(mgr, RB_HOST_SLOW, port, runs.back());
+	runs.back().ok = runs.back().connected && runs.back().lookups == 1 && runs.back().outcomeMs >= RB_SLOW_MS
+		&& runs.back().callMs < RB_TICK_LIMIT_MS && runs.back().maxTickMs < RB_TICK_LIMIT_MS;
+	mgr->CloseConnect();
+
+	runs.push_back(ResolverBenchRun());
+	runs.back().name = "cached";
+	runConnect(mgr, RB_HOST_SLOW, port, runs.back());
+	runs.back().ok = runs.back().connected && runs.back().cacheHits == 1 && runs.back().lookups == 0
+		&& runs.back().outcomeMs < RB_CACHED_LIMIT_MS;
+	mgr->CloseConnect();
+
+	runs.push_back(ResolverBenchRun());
+	runs.back().name = "dnserror";
+	runConnect(mgr, RB_HOST_BAD, port, runs.back());
+	runs.back().ok = runs.back().failCode == NetErrorCode_DNSError && runs.back().outcomeMs < RB_DNSERROR_LIMIT_MS;
+	mgr->CloseConnect();
+
+	runs.push_back(ResolverBenchRun());
+	runs.back().name = "timeout";
+	runConnect(mgr, RB_HOST_STALL, port, runs.back());
+	runs.back().ok = runs.back().failCode == NetErrorCode_ConnectTimeOut && runs.back().outcomeMs >= RB_TIMEOUT_MIN_MS
+		&& runs.back().maxTickMs < RB_TICK_LIMIT_MS;
+	mgr->CloseConnect();
+	g_releaseStall.store(true);
+
+	delete obj;
+	close(listenFd);
+	int exitCode = 0;
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		if (!runs[i].ok)
+			exitCode = 1;
+	}
+	FILE* f = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, runs);
+		if (f != stdout)
+			fclose(f);
+	}
+	return exitCode;
+}
@@ -0,0 +1,868 @@
+// headless load generator for the eng.socket stack.
+// every simulated client is its own lua state running the client script with its own S_O_TCP
+// connections. the clients are ticked across a thread pool and share the one CSktReactor,
+// the same Poll + Update(dt) frame the app runs, so thousands of bots fit in one process.
+//
+//   make -f makefile swarm && ./release/sktswarm --clients 2000 --threads 8 --duration 20
+//
+// without --server an epoll echo server in the process stands in for the game server.
+// the script (--script, the built in echo client otherwise) sees CLMData, eng.socket and
+// RegisteSocketClass like GameRoot.ls does, plus a swarm table:
+//   swarm.id, swarm.host, swarm.port, swarm.rate, swarm.size
+//   swarm.now()        monotonic clock in us
+//   swarm.latency(us)  records one round trip of this client
+// Start(id, host, port) is called once when the client ramps in, Update(dt) every tick after,
+// and the OnConnectToServer/OnNetFailed/... callbacks as in the app.
+// results go to stdout (or --out) as one json object, progress goes to stderr.
+#include "stdafx.h"
+#include "Common/socket/S_O_TCP.h"
+#include "Common/socket/SocketConnectionManager.h"
+#include "Common/socket/SktReactor.h"
+#include "Common/socket/LMData.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SWARM_BATCH                (16)     // clients a worker takes per grab
+#define SWARM_MAX_SAMPLES          (100000) // latency samples kept per client
+#define SWARM_SERVER_READ          (256 * 1024)
+#define SWARM_SERVER_BACKLOG       (4096)
+// the stand in server stops reading a connection that has this much echo queued
+#define SWARM_SERVER_OUT_MAX       (4 * 1024 * 1024)
+#define SWARM_MAX_LUA_ERRORS       (5)
+
+//------------------------------------------------------------------------------
+// host side hooks the engine normally provides, the swarm runs without the app
+namespace ENG_DBG
+{
+	int g_OutLog = 0;
+	int g_DevMode = 0;
+	void DOut(int Type, const char* format, ...)
+	{
+		if (g_OutLog != 1)
+			return;
+		va_list arg_list;
+		va_start(arg_list, format);
+		vfprintf(stderr, format, arg_list);
+		va_end(arg_list);
+		fputc('\n', stderr);
+	}
+}
+int TrackingAssert(const char * key, const char * file, int line)
+{
+	fprintf(stderr, "assert %s at %s:%d\n", key, file, line);
+	return 0;
+}
+
+static Int64 nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+struct SwarmConfig
+{
+	int                 clients;
+	int                 threads;
+	int                 duration;   // seconds
+	int                 tickMs;
+	int                 ramp;       // clients started per second, 0 starts all on the first tick
+	int                 rate;       // messages per second per client, for the built in script
+	int                 size;
+	std::string         host;
+	int                 port;       // 0 runs the stand in server
+	std::string         script;
+	std::string         out;
+};
+
+struct SwarmClient
+{
+	int                 id;
+	lua_State*          L;
+	std::set<S_O_TCP*>  sockets;    // bound while the client runs, see S_O_TCP::BindSocketList
+	Int64               startAt;
+	Int64               startUs;
+	Int64               connectUs;
+	int                 connects;
+	int                 failures;
+	int                 luaErrors;
+	std::vector<Int64>  latency;
+};
+
+static SwarmConfig                  g_cfg;
+static std::atomic<int>             g_luaErrors(0);
+static __thread SwarmClient*        t_client = NULL;
+
+static void reportLuaError(SwarmClient* client, const char* where)
+{
+	client->luaErrors++;
+	if (g_luaErrors.fetch_add(1) < SWARM_MAX_LUA_ERRORS)
+		fprintf(stderr, "client %d %s: %s\n", client->id, where, lua_tostring(client->L, -1));
+	lua_pop(client->L, 1);
+}
+
+// calls a global of the running client, missing ones are skipped like the app's stubs would be
+static void callClient(const char* func, const char* connectName, int nInts, int a, int b)
+{
+	SwarmClient* client = t_client;
+	if (client == NULL)
+		return;
+	lua_State* L = client->L;
+	lua_getglobal(L, func);
+	if (!lua_isfunction(L, -1))
+	{
+		lua_pop(L, 1);
+		return;
+	}
+	lua_pushstring(L, connectName);
+	if (nInts > 0)
+		lua_pushinteger(L, a);
+	if (nInts > 1)
+		lua_pushinteger(L, b);
+	if (lua_pcall(L, 1 + nInts, 0, 0) != 0)
+		reportLuaError(client, func);
+}
+
+void lua::OnNetFailed(const char * connectName, int codeId)
+{
+	if (t_client != NULL)
+		t_client->failures++;
+	callClient("OnNetFailed", connectName, 1, codeId, 0);
+}
+void lua::OnTryingReconnect(const char * connectName)
+{
+	callClient("OnTryingReconnect", connectName, 0, 0, 0);
+}
+void lua::OnConnectToServer(const char * connectName)
+{
+	if (t_client != NULL)
+	{
+		if (t_client->connectUs == 0)
+			t_client->connectUs = nowUs();
+		t_client->connects++;
+	}
+	callClient("OnConnectToServer", connectName, 0, 0, 0);
+}
+void lua::OnSendQueueHigh(const char * connectName, int bytes, int msgs)
+{
+	callClient("OnSendQueueHigh", connectName, 2, bytes, msgs);
+}
+void lua::OnSendQueueLow(const char * connectName, int bytes, int msgs)
+{
+	callClient("OnSendQueueLow", connectName, 2, bytes, msgs);
+}
+
+void lua::OnLatencyHigh(const char * connectName, int rttUs, int jitterUs)
+{
+	callClient("OnLatencyHigh", connectName, 2, rttUs, jitterUs);
+}
+
+void lua::OnLatencyLow(const char * connectName, int rttUs, int jitterUs)
+{
+	callClient("OnLatencyLow", connectName, 2, rttUs, jitterUs);
+}
+
+void lua::OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total)
+{
+	SwarmClient* client = t_client;
+	if (client == NULL)
+		return;
+	lua_State* L = client->L;
+	lua_getglobal(L, "OnStreamChunk");
+	if (!lua_isfunction(L, -1))
+	{
+		lua_pop(L, 1);
+		return;
+	}
+	lua_pushstring(L, connectName);
+	lua_pushlstring(L, data, size);
+	lua_pushinteger(L, offset);
+	lua_pushinteger(L, total);
+	if (lua_pcall(L, 4, 0, 0) != 0)
+		reportLuaError(client, "OnStreamChunk");
+}
+
+//------------------------------------------------------------------------------
+// echoes --rate messages a second, the send time rides in the payload. sends are queued
+// before eng.socket.update so they leave in the same tick
+static const char* s_defaultScript =
+	"local out = CLMData:new()\n"
+	"local pad = string.rep('x', math.max(0, swarm.size - 12))\n"
+	"local connected = false\n"
+	"local budget = 0\n"
+	"function Start(id, host, port)\n"
+	"	RegisteSocketClass('defaultSocket')\n"
+	"	sock = defaultSocket:new()\n"
+	"	eng.socket.connect(host, port, 0)\n"
+	"end\n"
+	"function OnConnectToServer(name) connected = true end\n"
+	"function OnNetFailed(name, code) connected = false end\n"
+	"function Update(dt)\n"
+	"	if connected then\n"
+	"		budget = budget + dt * swarm.rate / 1000\n"
+	"		while budget >= 1 do\n"
+	"			budget = budget - 1\n"
+	"			out:NewC() out:WriteBegin() out:WriteDouble(swarm.now()) out:WriteString(pad) out:WriteEnd() out:SendMsg()\n"
+	"		end\n"
+	"	end\n"
+	"	eng.socket.update(dt)\n"
+	"	local msgs = eng.socket.drain()\n"
+	"	for i = 1, #msgs do swarm.latency(swarm.now() - msgs[i]:ReadDouble()) end\n"
+	"end\n";
+
+static int swarmNow(lua_State* L)
+{
+	lua_pushnumber(L, (lua_Number)nowUs());
+	return 1;
+}
+
+static int swarmLatency(lua_State* L)
+{
+	Int64 us = (Int64)luaL_checknumber(L, 1);
+	if (t_client != NULL && t_client->latency.size() < SWARM_MAX_SAMPLES)
+		t_client->latency.push_back(us);
+	return 0;
+}
+
+static void bindClient(SwarmClient* client)
+{
+	t_client = client;
+	S_O_TCP::BindSocketList(client != NULL ? &client->sockets : NULL);
+}
+
+static bool createClient(SwarmClient& client, const std::string& script)
+{
+	lua_State* L = luaL_newstate();
+	if (L == NULL)
+		return false;
+	client.L = L;
+	// this lua calls the panic hook on caught errors too, the pcalls below report them
+	lua_atpanic(L, NULL);
+	luaL_openlibs(L);
+	lua::LuaPlus<CLMData>::Register(L);
+	eng_lua_socket_register(L);
+	lua_settop(L, 0);
+	lua_register(L, "RegisteSocketClass", lua::LuaPlus<S_O_TCP>::RegisteSocketClassL);
+	lua_newtable(L);
+	lua_pushinteger(L, client.id);
+	lua_setfield(L, -2, "id");
+	lua_pushstring(L, g_cfg.host.c_str());
+	lua_setfield(L, -2, "host");
+	lua_pushinteger(L, g_cfg.port);
+	lua_setfield(L, -2, "port");
+	lua_pushinteger(L, g_cfg.rate);
+	lua_setfield(L, -2, "rate");
+	lua_pushinteger(L, g_cfg.size);
+	lua_setfield(L, -2, "size");
+	lua_pushcfunction(L, swarmNow);
+	lua_setfield(L, -2, "now");
+	lua_pushcfunction(L, swarmLatency);
+	lua_setfield(L, -2, "latency");
+	lua_setglobal(L, "swarm");
+	bindClient(&client);
+	bool ok = true;
+	std::string chunkName = g_cfg.script.empty() ? "=swarm" : "@" + g_cfg.script;
+	if (luaL_loadbuffer(L, script.c_str(), script.size(), chunkName.c_str()) != 0
+		|| lua_pcall(L, 0, 0, 0) != 0)
+	{
+		reportLuaError(&client, "load");
+		ok = false;
+	}
+	bindClient(NULL);
+	return ok;
+}
+
+// gc of the S_O_TCP userdata closes the client's connections
+static void destroyClient(SwarmClient& client)
+{
+	if (client.L == NULL)
+		return;
+	bindClient(&client);
+	lua_close(client.L);
+	client.L = NULL;
+	bindClient(NULL);
+}
+
+static void tickClient(SwarmClient& client, Int64 now, int dt)
+{
+	if (client.L == NULL)
+		return;
+	lua_State* L = client.L;
+	bindClient(&client);
+	if (client.startUs == 0)
+	{
+		if (now >= client.startAt)
+		{
+			client.startUs = nowUs();
+			lua_getglobal(L, "Start");
+			lua_pushinteger(L, client.id);
+			lua_pushstring(L, g_cfg.host.c_str());
+			lua_pushinteger(L, g_cfg.port);
+			if (lua_pcall(L, 3, 0, 0) != 0)
+				reportLuaError(&client, "Start");
+		}
+	}
+	else
+	{
+		lua_getglobal(L, "Update");
+		lua_pushinteger(L, dt);
+		if (lua_pcall(L, 1, 0, 0) != 0)
+			reportLuaError(&client, "Update");
+	}
+	bindClient(NULL);
+}
+
+//------------------------------------------------------------------------------
+// runs fn over [0, count) on the workers and returns once every index is done
+class CSwarmPool
+{
+public:
+	CSwarmPool() : m_count(0), m_busy(0), m_generation(0), m_stop(false), m_next(0) {}
+	void Start(int threads)
+	{
+		for (int i = 0; i < threads; i++)
+			m_threads.push_back(new std::thread(&CSwarmPool::Worker, this));
+	}
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_work.notify_all();
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i]->join();
+			delete m_threads[i];
+		}
+		m_threads.clear();
+	}
+	void Run(const std::function<void(int)>& fn, int count)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_fn = fn;
+		m_count = count;
+		m_next.store(0);
+		m_busy = (int)m_threads.size();
+		m_generation++;
+		m_work.notify_all();
+		m_done.wait(lock, [this] { return m_busy == 0; });
+	}
+private:
+	void Worker()
+	{
+		unsigned int seen = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_work.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop)
+				return;
+			seen = m_generation;
+			lock.unlock();
+			for (;;)
+			{
+				int first = m_next.fetch_add(SWARM_BATCH);
+				if (first >= m_count)
+					break;
+				int last = std::min(first + SWARM_BATCH, m_count);
+				for (int i = first; i < last; i++)
+					m_fn(i);
+			}
+			lock.lock();
+			if (--m_busy == 0)
+				m_done.notify_one();
+		}
+	}
+	std::vector<std::thread*>   m_threads;
+	std::mutex                  m_mutex;
+	std::condition_variable     m_work;
+	std::condition_variable     m_done;
+	std::function<void(int)>    m_fn;
+	int                         m_count;
+	int                         m_busy;
+	unsigned int                m_generation;
+	bool                        m_stop;
+	std::atomic<int>            m_next;
+};
+
+//------------------------------------------------------------------------------
+// level triggered epoll echo on one thread, bytes go back untouched so the framing holds
+class CSwarmServer
+{
+public:
+	CSwarmServer() : m_listenFd(-1), m_epfd(-1), m_port(0), m_stop(false), m_accepted(0), m_thread(NULL) {}
+	bool Start()
+	{
+		m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		int one = 1;
+		setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listenFd, SWARM_SERVER_BACKLOG) != 0)
+			return false;
+		socklen_t len = sizeof(addr);
+		getsockname(m_listenFd, (struct sockaddr*)&addr, &len);
+		m_port = ntohs(addr.sin_port);
+		m_epfd = epoll_create1(0);
+		Watch(m_listenFd, EPOLLIN, EPOLL_CTL_ADD);
+		m_thread = new std::thread(&CSwarmServer::Run, this);
+		return true;
+	}
+	void Stop()
+	{
+		m_stop = true;
+		if (m_thread != NULL)
+		{
+			m_thread->join();
+			delete m_thread;
+			m_thread = NULL;
+		}
+		for (std::map<int, Conn*>::iterator iter = m_conns.begin(); iter != m_conns.end(); ++iter)
+		{
+			close(iter->first);
+			delete iter->second;
+		}
+		m_conns.clear();
+		close(m_epfd);
+		close(m_listenFd);
+	}
+	int GetPort() const { return m_port; }
+	int GetAccepted() const { return m_accepted.load(); }
+private:
+	struct Conn
+	{
+		std::vector<char>   out;
+		size_t              outPos;
+		unsigned int        events;
+	};
+	void Watch(int fd, unsigned int events, int op)
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = fd;
+		epoll_ctl(m_epfd, op, fd, &ev);
+	}
+	void Drop(int fd)
+	{
+		std::map<int, Conn*>::iterator iter = m_conns.find(fd);
+		if (iter == m_conns.end())
+			return;
+		epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+		close(fd);
+		delete iter->second;
+		m_conns.erase(iter);
+	}
+	void Accept()
+	{
+		for (;;)
+		{
+			int fd = accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK);
+			if (fd < 0)
+				return;
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			Conn* conn = new Conn();
+			conn->outPos = 0;
+			conn->events = EPOLLIN;
+			m_conns[fd] = conn;
+			Watch(fd, conn->events, EPOLL_CTL_ADD);
+			m_accepted.fetch_add(1);
+		}
+	}
+	// false when the connection is gone
+	bool Flush(int fd, Conn* conn)
+	{
+		while (conn->outPos < conn->out.size())
+		{
+			ssize_t n = send(fd, &conn->out[conn->outPos], conn->out.size() - conn->outPos, MSG_NOSIGNAL);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			if (n <= 0)
+				return false;
+			conn->outPos += n;
+		}
+		if (conn->outPos == conn->out.size())
+		{
+			conn->out.clear();
+			conn->outPos = 0;
+		}
+		size_t pending = conn->out.size() - conn->outPos;
+		unsigned int events = (pending < SWARM_SERVER_OUT_MAX ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+		if (events != conn->events)
+		{
+			conn->events = events;
+			Watch(fd, events, EPOLL_CTL_MOD);
+		}
+		return true;
+	}
+	void Run()
+	{
+		std::vector<char> buf(SWARM_SERVER_READ);
+		struct epoll_event evs[256];
+		while (!m_stop)
+		{
+			int n = epoll_wait(m_epfd, evs, 256, 50);
+			for (int i = 0; i < n; i++)
+			{
+				int fd = evs[i].data.fd;
+				if (fd == m_listenFd)
+				{
+					Accept();
+					continue;
+				}
+				std::map<int, Conn*>::iterator iter = m_conns.find(fd);
+				if (iter == m_conns.end())
+					continue;
+				Conn* conn = iter->second;
+				bool alive = true;
+				if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				{
+					ssize_t got = recv(fd, &buf[0], buf.size(), 0);
+					if (got > 0)
+						conn->out.insert(conn->out.end(), buf.begin(), buf.begin() + got);
+					else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+						alive = false;
+				}
+				if (alive)
+					alive = Flush(fd, conn);
+				if (!alive)
+					Drop(fd);
+			}
+		}
+	}
+	int                         m_listenFd;
+	int                         m_epfd;
+	int                         m_port;
+	std::atomic<bool>           m_stop;
+	std::atomic<int>            m_accepted;
+	std::map<int, Conn*>        m_conns;
+	std::thread*                m_thread;
+};
+
+//------------------------------------------------------------------------------
+static Int64 percentile(std::vector<Int64>& v, double p)
+{
+	if (v.empty())
+		return 0;
+	size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + idx, v.end());
+	return v[idx];
+}
+
+struct SwarmTotals
+{
+	Int64   framesSent;
+	Int64   framesRecv;
+	Int64   bytesSent;
+	Int64   bytesRecv;
+	int     connected;
+};
+
+// only while the workers are parked, the stats belong to the client threads
+static void sumClients(std::vector<SwarmClient>& clients, SwarmTotals& totals)
+{
+	memset(&totals, 0, sizeof(totals));
+	for (size_t c = 0; c < clients.size(); c++)
+	{
+		if (clients[c].connectUs != 0)
+			totals.connected++;
+		for (std::set<S_O_TCP*>::iterator it = clients[c].sockets.begin(); it != clients[c].sockets.end(); ++it)
+		{
+			SktConnStat stat;
+			(*it)->GetConnectionSocketManager()->GetStats(stat);
+			totals.framesSent += stat.framesSent;
+			totals.framesRecv += stat.framesRecv;
+			totals.bytesSent += stat.bytesSent;
+			totals.bytesRecv += stat.bytesRecv;
+		}
+	}
+}
+
+static void writeJson(FILE* f, std::vector<SwarmClient>& clients, const SwarmTotals& totals, double seconds, std::vector<Int64>& ticks)
+{
+	std::vector<Int64> connectUs;
+	std::vector<Int64> latency;
+	std::vector<Int64> clientP99;
+	Int64 firstStart = 0;
+	Int64 lastConnect = 0;
+	int failures = 0;
+	int luaErrors = 0;
+	for (size_t c = 0; c < clients.size(); c++)
+	{
+		SwarmClient& client = clients[c];
+		failures += client.failures;
+		luaErrors += client.luaErrors;
+		if (client.startUs != 0 && (firstStart == 0 || client.startUs < firstStart))
+			firstStart = client.startUs;
+		if (client.connectUs != 0)
+		{
+			connectUs.push_back(client.connectUs - client.startUs);
+			lastConnect = std::max(lastConnect, client.connectUs);
+		}
+		if (!client.latency.empty())
+		{
+			latency.insert(latency.end(), client.latency.begin(), client.latency.end());
+			clientP99.push_back(percentile(client.latency, 0.99));
+		}
+	}
+	double connectSeconds = lastConnect > firstStart ? (lastConnect - firstStart) / 1e6 : 0;
+	fprintf(f, "{\n  \"config\": {\"clients\": %d, \"threads\": %d, \"duration\": %d, \"tickMs\": %d, \"ramp\": %d, "
+		"\"rate\": %d, \"size\": %d, \"server\": \"%s:%d\", \"script\": \"%s\"},\n",
+		g_cfg.clients, g_cfg.threads, g_cfg.duration, g_cfg.tickMs, g_cfg.ramp, g_cfg.rate, g_cfg.size,
+		g_cfg.host.c_str(), g_cfg.port, g_cfg.script.empty() ? "builtin" : g_cfg.script.c_str());
+	fprintf(f, "  \"connected\": %d, \"netFailures\": %d, \"luaErrors\": %d, \"seconds\": %.3f,\n",
+		totals.connected, failures, luaErrors, seconds);
+	fprintf(f, "  \"connectPerSec\": %.1f, \"connectUs\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld},\n",
+		connectSeconds > 0 ? totals.connected / connectSeconds : 0,
+		(long long)percentile(connectUs, 0.5), (long long)percentile(connectUs, 0.99), (long long)percentile(connectUs, 1.0));
+	fprintf(f, "  \"framesSent\": %lld, \"framesRecv\": %lld, \"msgsPerSec\": %.1f, \"MBPerSec\": %.3f,\n",
+		(long long)totals.framesSent, (long long)totals.framesRecv,
+		seconds > 0 ? totals.framesRecv / seconds : 0, seconds > 0 ? (totals.bytesSent + totals.bytesRecv) / seconds / (1024.0 * 1024.0) : 0);
+	fprintf(f, "  \"latencyUs\": {\"samples\": %lld, \"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld},\n",
+		(long long)latency.size(), (long long)percentile(latency, 0.5), (long long)percentile(latency, 0.9),
+		(long long)percentile(latency, 0.99), (long long)percentile(latency, 0.999), (long long)percentile(latency, 1.0));
+	fprintf(f, "  \"clientP99Us\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld},\n",
+		(long long)percentile(clientP99, 0.5), (long long)percentile(clientP99, 0.99), (long long)percentile(clientP99, 1.0));
+	fprintf(f, "  \"ticks\": %lld, \"tickUs\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld}\n}\n",
+		(long long)ticks.size(), (long long)percentile(ticks, 0.5), (long long)percentile(ticks, 0.99), (long long)percentile(ticks, 1.0));
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"sktswarm [--clients N] [--threads N] [--duration s] [--tick-ms N] [--ramp clients/s]\n"
+		"         [--rate msgs/s] [--size bytes] [--server host:port] [--script file.lua] [--out file]\n"
+		"  every client is a lua state running --script, the built in one echoes --rate\n"
+		"  messages of --size bytes a second and records their round trips.\n"
+		"  without --server an echo server on 127.0.0.1 in the process answers.\n"
+		"  latencies include the tick the reply waited for, keep --tick-ms small to see the wire.\n");
+}
+
+static bool parseArgs(int argc, char** argv)
+{
+	g_cfg.clients = 100;
+	g_cfg.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	g_cfg.duration = 10;
+	g_cfg.tickMs = 20;
+	g_cfg.ramp = 0;
+	g_cfg.rate = 10;
+	g_cfg.size = 64;
+	g_cfg.host = "127.0.0.1";
+	g_cfg.port = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--clients" && hasValue)
+			g_cfg.clients = atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue)
+			g_cfg.threads = atoi(argv[++i]);
+		else if (arg == "--duration" && hasValue)
+			g_cfg.duration = atoi(argv[++i]);
+		else if (arg == "--tick-ms" && hasValue)
+			g_cfg.tickMs = atoi(argv[++i]);
+		else if (arg == "--ramp" && hasValue)
+			g_cfg.ramp = atoi(argv[++i]);
+		else if (arg == "--rate" && hasValue)
+			g_cfg.rate = atoi(argv[++i]);
+		else if (arg == "--size" && hasValue)
+			g_cfg.size = atoi(argv[++i]);
+		else if (arg == "--server" && hasValue)
+		{
+			std::string server = argv[++i];
+			size_t colon = server.rfind(':');
+			if (colon == std::string::npos)
+				return false;
+			g_cfg.host = server.substr(0, colon);
+			g_cfg.port = atoi(server.c_str() + colon + 1);
+			if (g_cfg.port <= 0)
+				return false;
+		}
+		else if (arg == "--script" && hasValue)
+			g_cfg.script = argv[++i];
+		else if (arg == "--out" && hasValue)
+			g_cfg.out = argv[++i];
+		else
+			return false;
+	}
+	return g_cfg.clients > 0 && g_cfg.threads > 0 && g_cfg.duration > 0 && g_cfg.tickMs > 0
+		&& g_cfg.ramp >= 0 && g_cfg.rate >= 0 && g_cfg.size >= 16;
+}
+
+static bool loadScript(std::string& script)
+{
+	if (g_cfg.script.empty())
+	{
+		script = s_defaultScript;
+		return true;
+	}
+	FILE* f = fopen(g_cfg.script.c_str(), "rb");
+	if (f == NULL)
+		return false;
+	char buf[4096];
+	size_t n = 0;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		script.append(buf, n);
+	fclose(f);
+	return true;
+}
+
+// each client holds its socket, the stand in server holds the other end
+static void raiseFdLimit(int clients)
+{
+	struct rlimit lim;
+	if (getrlimit(RLIMIT_NOFILE, &lim) != 0)
+		return;
+	rlim_t want = (rlim_t)clients * 2 + 64;
+	if (lim.rlim_cur < want)
+	{
+		lim.rlim_cur = std::min(want, lim.rlim_max);
+		setrlimit(RLIMIT_NOFILE, &lim);
+	}
+	if (lim.rlim_cur < want)
+		fprintf(stderr, "open file limit %llu is below the %llu descriptors %d clients need\n",
+			(unsigned long long)lim.rlim_cur, (unsigned long long)want, clients);
+}
+
+int main(int argc, char** argv)
+{
+	if (!parseArgs(argc, argv))
+	{
+		usage();
+		return 2;
+	}
+	std::string script;
+	if (!loadScript(script))
+	{
+		fprintf(stderr, "can not read %s\n", g_cfg.script.c_str());
+		return 1;
+	}
+	raiseFdLimit(g_cfg.clients);
+	CSwarmServer server;
+	if (g_cfg.port == 0)
+	{
+		if (!server.Start())
+		{
+			fprintf(stderr, "can not listen on 127.0.0.1\n");
+			return 1;
+		}
+		g_cfg.port = server.GetPort();
+	}
+	CSwarmPool pool;
+	pool.Start(g_cfg.threads);
+
+	std::vector<SwarmClient> clients(g_cfg.clients);
+	// lua_load flips the global isLoadingLua, so the states are built one at a time
+	int created = 0;
+	for (int c = 0; c < g_cfg.clients; c++)
+	{
+		SwarmClient& client = clients[c];
+		client.id = c;
+		client.L = NULL;
+		client.startUs = 0;
+		client.connectUs = 0;
+		client.connects = 0;
+		client.failures = 0;
+		client.luaErrors = 0;
+		if (createClient(client, script))
+			created++;
+	}
+	if (created != g_cfg.clients)
+	{
+		fprintf(stderr, "%d of %d clients failed to load the script\n", g_cfg.clients - created, g_cfg.clients);
+		pool.Run([&](int c) { destroyClient(clients[c]); }, g_cfg.clients);
+		pool.Stop();
+		if (server.GetPort() != 0)
+			server.Stop();
+		return 1;
+	}
+
+	Int64 start = nowUs();
+	for (int c = 0; c < g_cfg.clients; c++)
+		clients[c].startAt = g_cfg.ramp > 0 ? start + (Int64)c * 1000000 / g_cfg.ramp : start;
+	Int64 end = start + (Int64)g_cfg.duration * 1000000;
+	Int64 tickUs = (Int64)g_cfg.tickMs * 1000;
+	Int64 nextTick = start;
+	Int64 lastTick = start;
+	Int64 nextReport = start + 1000000;
+	Int64 lastReportRecv = 0;
+	std::vector<Int64> ticks;
+	ticks.reserve((size_t)(g_cfg.duration * 1000 / g_cfg.tickMs + 16));
+	for (;;)
+	{
+		Int64 now = nowUs();
+		if (now >= end)
+			break;
+		int dt = (int)((now - lastTick) / 1000);
+		lastTick = now;
+		CSktReactor::Inst()->Poll();
+		NTMSG::NTMSG_PoolUpdate(dt);
+		pool.Run([&](int c) { tickClient(clients[c], now, dt); }, g_cfg.clients);
+		Int64 done = nowUs();
+		ticks.push_back(done - now);
+		if (done >= nextReport)
+		{
+			SwarmTotals totals;
+			sumClients(clients, totals);
+			fprintf(stderr, "%4.0fs connected %d/%d, %lld msgs/s, tick %lld us\n",
+				(done - start) / 1e6, totals.connected, g_cfg.clients,
+				(long long)(totals.framesRecv - lastReportRecv), (long long)(done - now));
+			lastReportRecv = totals.framesRecv;
+			nextReport += 1000000;
+		}
+		// a tick that overran does not queue up catch up ticks
+		nextTick = std::max(nextTick + tickUs, done);
+		if (nextTick > done)
+			usleep((useconds_t)(nextTick - done));
+	}
+	double seconds = (nowUs() - start) / 1e6;
+
+	SwarmTotals totals;
+	sumClients(clients, totals);
+	// collected CLMData objects say so on stdout, keep that out of the json
+	fflush(stdout);
+	int savedStdout = dup(STDOUT_FILENO);
+	int devNull = open("/dev/null", O_WRONLY);
+	dup2(devNull, STDOUT_FILENO);
+	pool.Run([&](int c) { destroyClient(clients[c]); }, g_cfg.clients);
+	fflush(stdout);
+	dup2(savedStdout, STDOUT_FILENO);
+	close(savedStdout);
+	close(devNull);
+	pool.Stop();
+	if (server.GetPort() != 0)
+		server.Stop();
+	FILE* f = g_cfg.out.empty() ? stdout : fopen(g_cfg.out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, clients, totals, seconds, ticks);
+		if (f != stdout)
+			fclose(f);
+	}
+	return totals.connected == g_cfg.clients ? 0 : 1;
+}
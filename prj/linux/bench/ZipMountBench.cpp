@@ -0,0 +1,403 @@
+// mount time of a large archive (IO/ZipReader) with the central directory read in one go,
+// against the scan it replaced that read every central directory record and local header on
+// its own. the archive is generated first, small scripts with every third one deflated, so
+// the numbers are about the index and not about the data. the file is in the page cache
+// after it was written, so this is the warm start, a cold start adds the random reads the old
+// scan made on top.
+//
+//   make -f makefile zipbench && ./release/zipmountbench --entries 50000 --reps 5
+//
+//   legacy  : zGetCentralDir + zGetFileHeader per entry over zFRder, what zGetFileList did
+//   bulk    : zGetFileList over zFRder, into the name sorted list CZFRder keeps
+//   mapped  : zGetFileList over zMapRder
+//   mount   : CZFRder over the archive, the path CFSys::addZip takes
+//   indexed : the same with the index sidecar (IO/ZipIndex) written before the reps, what a
+//             second boot maps instead of parsing the central directory
+//   open    : the first and the second open of --opens random entries after a mount, the
+//             first one finds the data offset behind the local header
+//   lookup  : exist for --opens names, half of them missing, with the archive mounted
+//             --mounts times. perArchive asks every reader in turn as CFSys did, overlay is
+//             the one merged table (IO/ZipOverlay) CFSys asks now
+// results go to stdout (or --out) as one json object, times are the median of the reps in ms.
+#include "stdafx.h"
+#include "IO/ZipReader.h"
+#include "IO/ZipOverlay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#define ZMB_PAYLOAD_MIN            (64)
+#define ZMB_PAYLOAD_MAX            (2048)
+#define ZMB_SIGN_LOCAL             (0x04034b50)
+#define ZMB_SIGN_CENTRAL           (0x02014b50)
+#define ZMB_SIGN_END               (0x06054b50)
+
+//------------------------------------------------------------------------------
+// host side hooks the engine normally provides, the benchmark runs without the app
+namespace ENG_DBG
+{
+	int g_OutLog = 0;
+	void DOut(int Type, const char* format, ...)
+	{
+		if (g_OutLog != 1)
+			return;
+		va_list arg_list;
+		va_start(arg_list, format);
+		vfprintf(stderr, format, arg_list);
+		va_end(arg_list);
+		fputc('\n', stderr);
+	}
+}
+
+struct ZipMountBenchConfig
+{
+	int                 entries;
+	int                 reps;
+	int                 opens;
+	int                 mounts;
+	std::string         path;
+	std::string         out;
+};
+
+struct ZipMountBenchResult
+{
+	double              legacyMs;
+	double              bulkMs;
+	double              mappedMs;
+	double              mountMs;
+	double              indexedMs;
+	double              indexedOpenMs;
+	double              perArchiveMs;
+	double              overlayMs;
+	double              firstOpenMs;
+	double              secondOpenMs;
+	int                 listed;
+	int                 found;
+	long                archiveBytes;
+	long                directoryBytes;
+};
+
+static double nowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double median(std::vector<double>& v)
+{
+	std::sort(v.begin(), v.end());
+	return v.empty() ? 0 : v[v.size() / 2];
+}
+
+static std::string entryName(int i)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "scripts/mod%03d/file%06d.lua", i % 500, i);
+	return name;
+}
+
+static bool writeArchive(const ZipMountBenchConfig& cfg, ZipMountBenchResult& res)
+{
+	FILE* f = fopen(cfg.path.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	std::vector<zCDir> dirs;
+	std::vector<std::string> names;
+	std::vector<unsigned char> payload;
+	std::vector<unsigned char> packed;
+	unsigned int seed = 12345;
+	long offset = 0;
+	for (int i = 0; i < cfg.entries; i++)
+	{
+		std::string name = entryName(i);
+		seed = seed * 1103515245 + 12345;
+		int size = ZMB_PAYLOAD_MIN + (int)((seed >> 8) % (ZMB_PAYLOAD_MAX - ZMB_PAYLOAD_MIN));
+		payload.resize(size);
+		for (int k = 0; k < size; k++)
+			payload[k] = (unsigned char)("local x = require('a')\n"[k % 23] + (k / 97) % 3);
+		U16 method = i % 3 == 0 ? 8 : 0;
+		const unsigned char* data = &payload[0];
+		int dataSize = size;
+		if (method == 8)
+		{
+			z_stream zs;
+			memset(&zs, 0, sizeof(zs));
+			deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+			packed.resize(deflateBound(&zs, size));
+			zs.next_in = &payload[0];
+			zs.avail_in = size;
+			zs.next_out = &packed[0];
+			zs.avail_out = (uInt)packed.size();
+			deflate(&zs, Z_FINISH);
+			dataSize = (int)zs.total_out;
+			deflateEnd(&zs);
+			data = &packed[0];
+		}
+		U32 crc = (U32)crc32(crc32(0L, Z_NULL, 0), &payload[0], size);
+		zFHeader lh;
+		memset(&lh, 0, sizeof(lh));
+		lh.sign = ZMB_SIGN_LOCAL;
+		lh.extfild = 20;
+		lh.cmethod = method;
+		lh.crc32 = crc;
+		lh.csize = dataSize;
+		lh.ucsize = size;
+		lh.fnlen = (U16)name.size();
+		fwrite(&lh, sizeof(lh), 1, f);
+		fwrite(name.data(), name.size(), 1, f);
+		fwrite(data, dataSize, 1, f);
+		zCDir cd;
+		memset(&cd, 0, sizeof(cd));
+		cd.sign = ZMB_SIGN_CENTRAL;
+		cd.made_by = 20;
+		cd.extfild = 20;
+		cd.cmethod = method;
+		cd.crc32 = crc;
+		cd.csize = dataSize;
+		cd.ucsize = size;
+		cd.fnlen = (U16)name.size();
+		cd.fheaderoff = (U32)offset;
+		dirs.push_back(cd);
+		names.push_back(name);
+		offset += (long)sizeof(lh) + (long)name.size() + dataSize;
+	}
+	long dirOffset = offset;
+	for (size_t i = 0; i < dirs.size(); i++)
+	{
+		fwrite(&dirs[i], sizeof(zCDir), 1, f);
+		fwrite(names[i].data(), names[i].size(), 1, f);
+		offset += (long)sizeof(zCDir) + (long)names[i].size();
+	}
+	zArchiveEnd end;
+	memset(&end, 0, sizeof(end));
+	end.sign = ZMB_SIGN_END;
+	end.dirnumondisk = (U16)cfg.entries;
+	end.dirnum = (U16)cfg.entries;
+	end.dirlen = (U32)(offset - dirOffset);
+	end.diroff = (U32)dirOffset;
+	fwrite(&end, sizeof(end), 1, f);
+	fclose(f);
+	res.archiveBytes = offset + (long)sizeof(end);
+	res.directoryBytes = offset - dirOffset;
+	return true;
+}
+
+// the per entry scan zGetFileList made before it read the directory in one go
+static int legacyScan(ReadFileInt* file, std::map<std::string, ZipFile>& lst)
+{
+	zArchiveEnd* aE = zGetArchiveEnd(file);
+	unsigned long dirOff = 0;
+	for (int i = 0; i < aE->dirnum; i++)
+	{
+		zCDirExt* dir = zGetCentralDir(file, dirOff + aE->diroff);
+		if (dir == NULL)
+			break;
+		dirOff += dir->size;
+		zFHeaderExt* hd = zGetFileHeader(file, dir->data.fheaderoff);
+		if (hd != NULL && hd->data.fnlen != 0 && hd->file_name[hd->data.fnlen - 1] != '/')
+		{
+			ZipFile zinfo;
+			zinfo.flags = dir->data.cmethod;
+			zinfo.fileOffset = dir->data.fheaderoff;
+			zinfo.dataOffset = -1;
+			zinfo.comSize = dir->data.csize;
+			zinfo.fileSize = dir->data.ucsize;
+			zinfo.fileName = hd->file_name;
+			zinfo.crc32 = hd->data.crc32;
+			std::string key = zinfo.fileName.substr(zinfo.fileName.rfind('/') + 1);
+			lst.insert(std::make_pair(key, zinfo));
+		}
+		delete hd;
+		delete dir;
+	}
+	delete aE;
+	return (int)lst.size();
+}
+
+static void runBench(const ZipMountBenchConfig& cfg, ZipMountBenchResult& res)
+{
+	std::vector<double> legacy, bulk, mapped, mount, indexed, indexedOpen, firstOpen, secondOpen, perArchive, overlay;
+	std::string indexPath = cfg.path + ".zidx";
+	remove(indexPath.c_str());
+	delete new CZFRder(FileBaseStreamPtr(new CFStream(cfg.path.c_str(), ESM::FAM_READ)), indexPath.c_str());
+	for (int r = 0; r < cfg.reps; r++)
+	{
+		{
+			zFRder file;
+			std::map<std::string, ZipFile> lst;
+			double t = nowMs();
+			file.open(cfg.path);
+			legacyScan(&file, lst);
+			legacy.push_back(nowMs() - t);
+		}
+		{
+			zFRder file;
+			std::vector<ZipFile> lst;
+			double t = nowMs();
+			file.open(cfg.path);
+			zGetFileList(&file, lst);
+			bulk.push_back(nowMs() - t);
+			res.listed = (int)lst.size();
+		}
+		{
+			zMapRder* file = new zMapRder();
+			std::vector<ZipFile> lst;
+			double t = nowMs();
+			file->open(cfg.path);
+			zGetFileList(file, lst);
+			mapped.push_back(nowMs() - t);
+			file->release();
+		}
+		double t = nowMs();
+		CZFRder* reader = new CZFRder(FileBaseStreamPtr(new CFStream(cfg.path.c_str(), ESM::FAM_READ)));
+		mount.push_back(nowMs() - t);
+		std::vector<std::string> picks;
+		unsigned int seed = 777 + r;
+		for (int i = 0; i < cfg.opens; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			picks.push_back(entryName((int)((seed >> 8) % cfg.entries)));
+		}
+		for (int pass = 0; pass < 2; pass++)
+		{
+			t = nowMs();
+			for (size_t i = 0; i < picks.size(); i++)
+				reader->openFile(picks[i].c_str());
+			(pass == 0 ? firstOpen : secondOpen).push_back(nowMs() - t);
+		}
+		delete reader;
+		t = nowMs();
+		reader = new CZFRder(FileBaseStreamPtr(new CFStream(cfg.path.c_str(), ESM::FAM_READ)), indexPath.c_str());
+		indexed.push_back(nowMs() - t);
+		t = nowMs();
+		for (size_t i = 0; i < picks.size(); i++)
+			reader->openFile(picks[i].c_str());
+		indexedOpen.push_back(nowMs() - t);
+		delete reader;
+		std::vector<CZFRder*> readers;
+		CZipOverlay merged;
+		for (int m = 0; m < cfg.mounts; m++)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "patch%02d", m);
+			readers.push_back(new CZFRder(FileBaseStreamPtr(new CFStream(cfg.path.c_str(), ESM::FAM_READ)), indexPath.c_str()));
+			merged.Add(name, readers.back());
+		}
+		for (size_t i = 0; i < picks.size(); i += 2)
+			picks[i] = "missing/" + picks[i];
+		int found = 0;
+		t = nowMs();
+		for (size_t i = 0; i < picks.size(); i++)
+		{
+			for (size_t m = 0; m < readers.size(); m++)
+			{
+				if (readers[m]->exist(picks[i].c_str()))
+				{
+					found++;
+					break;
+				}
+			}
+		}
+		perArchive.push_back(nowMs() - t);
+		t = nowMs();
+		for (size_t i = 0; i < picks.size(); i++)
+			found += merged.Exist(picks[i].c_str()) ? 1 : 0;
+		overlay.push_back(nowMs() - t);
+		merged.Clear();
+		for (size_t m = 0; m < readers.size(); m++)
+			delete readers[m];
+		res.found = found;
+	}
+	remove(indexPath.c_str());
+	res.legacyMs = median(legacy);
+	res.bulkMs = median(bulk);
+	res.mappedMs = median(mapped);
+	res.mountMs = median(mount);
+	res.indexedMs = median(indexed);
+	res.indexedOpenMs = median(indexedOpen);
+	res.perArchiveMs = median(perArchive);
+	res.overlayMs = median(overlay);
+	res.firstOpenMs = median(firstOpen);
+	res.secondOpenMs = median(secondOpen);
+}
+
+static void writeJson(FILE* f, const ZipMountBenchConfig& cfg, const ZipMountBenchResult& res)
+{
+	fprintf(f, "{\n  \"config\": {\"entries\": %d, \"reps\": %d, \"opens\": %d, \"archiveBytes\": %ld, \"directoryBytes\": %ld},\n",
+		cfg.entries, cfg.reps, cfg.opens, res.archiveBytes, res.directoryBytes);
+	fprintf(f, "  \"listed\": %d,\n  \"found\": %d,\n", res.listed, res.found);
+	fprintf(f, "  \"scanMs\": {\"legacy\": %.2f, \"bulk\": %.2f, \"mapped\": %.2f, \"mount\": %.2f, \"indexed\": %.2f},\n",
+		res.legacyMs, res.bulkMs, res.mappedMs, res.mountMs, res.indexedMs);
+	fprintf(f, "  \"openMs\": {\"first\": %.2f, \"second\": %.2f, \"indexed\": %.2f},\n",
+		res.firstOpenMs, res.secondOpenMs, res.indexedOpenMs);
+	fprintf(f, "  \"lookupMs\": {\"mounts\": %d, \"perArchive\": %.2f, \"overlay\": %.2f}\n}\n",
+		cfg.mounts, res.perArchiveMs, res.overlayMs);
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"zipmountbench [--entries N] [--reps N] [--opens N] [--mounts N] [--path file] [--out file]\n"
+		"  defaults: 50000 entries, 5 reps, 1000 opens, 8 mounts, archive written to zipmountbench.zip\n");
+}
+
+static bool parseArgs(int argc, char** argv, ZipMountBenchConfig& cfg)
+{
+	cfg.entries = 50000;
+	cfg.reps = 5;
+	cfg.opens = 1000;
+	cfg.mounts = 8;
+	cfg.path = "zipmountbench.zip";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--entries" && hasValue)
+			cfg.entries = atoi(argv[++i]);
+		else if (arg == "--reps" && hasValue)
+			cfg.reps = atoi(argv[++i]);
+		else if (arg == "--opens" && hasValue)
+			cfg.opens = atoi(argv[++i]);
+		else if (arg == "--mounts" && hasValue)
+			cfg.mounts = atoi(argv[++i]);
+		else if (arg == "--path" && hasValue)
+			cfg.path = argv[++i];
+		else if (arg == "--out" && hasValue)
+			cfg.out = argv[++i];
+		else
+			return false;
+	}
+	// the end record counts entries in 16 bits
+	return cfg.entries > 0 && cfg.entries <= 65535 && cfg.reps > 0 && cfg.opens >= 0 && cfg.mounts > 0;
+}
+
+int main(int argc, char** argv)
+{
+	ZipMountBenchConfig cfg;
+	if (!parseArgs(argc, argv, cfg))
+	{
+		usage();
+		return 2;
+	}
+	ZipMountBenchResult res;
+	memset(&res, 0, sizeof(res));
+	if (!writeArchive(cfg, res))
+	{
+		fprintf(stderr, "can not write %s\n", cfg.path.c_str());
+		return 1;
+	}
+	runBench(cfg, res);
+	remove(cfg.path.c_str());
+	FILE* f = cfg.out.empty() ? stdout : fopen(cfg.out.c_str(), "w");
+	if (f != NULL)
+	{
+		writeJson(f, cfg, res);
+		if (f != stdout)
+			fclose(f);
+	}
+	return 0;
+}
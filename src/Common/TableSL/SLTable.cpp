@@ -388,6 +388,7 @@ static FILE*SALTAB_GFPTR(lua_State *L)
 	const char* tTN = luaL_checklstring(L, 1, &tlsz);
 	char tfnS[1023];
 	snprintf(tfnS, 1023, "%s%s", GameApp::getInstance()->getSavePath(), tTN);
+	GET_FS()->InvalidateFile(tfnS);
 	return fopen(tfnS, "wb");	
 }
 int SALTATable(lua_State *L)
@@ -416,6 +417,7 @@ int RmvDelFileL(lua_State *L)
 	const char* tFN = luaL_checklstring(L, 1, &tl);
 	snprintf(tfS, 1024, "%s%s", GameApp::getInstance()->getSavePath(), tFN);
 	lua_pushinteger(L, remove(tfS));
+	GET_FS()->InvalidateFile(tfS);
 	return 1;
 }
 
@@ -23,6 +23,7 @@ CSkt::CSkt()
 {
 	m_rS = 0;
 	m_wS = 0;
+	m_eS = 0;
 	m_sktID = -1;
 #ifdef WIN32
 	WORD wVRqstedofwin32sKT;
@@ -41,6 +42,7 @@ CSkt::CSkt(int s)
 {
 	m_rS = 0;
 	m_wS = 0;
+	m_eS = 0;
 	m_sktID = s;
 	a = 0;
 	b = 0;
@@ -81,6 +83,16 @@ int CSkt::SKT_GEo()
 #endif
 }
 
+int CSkt::SKT_IsWB()
+{
+#ifndef WIN32
+	int e = errno;
+	return (e == EAGAIN || e == EWOULDBLOCK) ? 1 : 0;
+#else
+	return WSAGetLastError() == WSAEWOULDBLOCK ? 1 : 0;
+#endif
+}
+
 int CSkt::SKT_CrtSkt(int f, int t, int p)
 {
 #ifdef DEBUG_SKT_INFO_STACK
@@ -174,6 +186,17 @@ int CSkt::SKT_S(int l,char* b)
 #endif
 	return send(m_sktID, b, l, 0);
 }
+int CSkt::SKT_SV(int n,SKT_IOV* v)
+{
+#ifndef WIN32
+	return (int)writev(m_sktID, v, n);
+#else
+	DWORD sentBytesOfWSASend = 0;
+	if (WSASend(m_sktID, (LPWSABUF)v, (DWORD)n, &sentBytesOfWSASend, 0, NULL, NULL) != 0)
+		return -1;
+	return (int)sentBytesOfWSASend;
+#endif
+}
 int CSkt::setC(const char *C)
 {
 	c = C;
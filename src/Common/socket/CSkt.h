@@ -12,6 +12,27 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define SKT_IOV_MAX		IOV_MAX
+#else
+#define SKT_IOV_MAX		1024
+#endif
+
+// one gathered buffer for SKT_SV, laid out like WSABUF on windows and iovec elsewhere
+#ifdef WIN32
+struct SKT_IOV
+{
+	unsigned long len;
+	char* buf;
+};
+#define SKT_IOV_SET(v, b, l)	{ (v).buf = (b); (v).len = (unsigned long)(l); }
+#else
+typedef struct iovec SKT_IOV;
+#define SKT_IOV_SET(v, b, l)	{ (v).iov_base = (b); (v).iov_len = (size_t)(l); }
 #endif
  
 class CSkt
@@ -22,15 +43,19 @@ public:
 	void    SetRS(bool val)  { m_rS = val?1:0; }
 	void    SetWSI(int val)  { m_wS = (val == 0 ? 0 : 1); }
 	void    SetRSI(int val)  { m_rS = (val == 0 ? 0 : 1); }
+	void    SetES(bool val)  { m_eS = val?1:0; }
 	int     getWS()          { return m_wS; }
 	int     getRS()		     { return m_rS; }
+	int     getES()		     { return m_eS; }
 	CSkt(int s);
 	~CSkt();
     int     SKT_R(int ,char* );
     int     SKT_S(int ,char* );
+	int     SKT_SV(int ,SKT_IOV* );
 	int     SKT_CrtSkt(int f, int t, int p);
     int     SKT_ClsSkt(int );
     int     SKT_GEo();    
+	int     SKT_IsWB();
 	int     SKT_CNC2(struct addrinfo* addr);
 	int     SKT_GSkt()   { return m_sktID; }
 	int     SKT_KCAld(int [4]/*alive_idle_interval_count*/);    
@@ -47,6 +72,7 @@ public:
 private:
     int     m_rS;
     int     m_wS;
+    int     m_eS;
     int     m_sktID;   
 	int     a;
 	int     b;
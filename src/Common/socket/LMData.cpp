@@ -36,6 +36,14 @@ int CLMData::CLuaMessage_GetLast_CALL_STP(lua_State *L)
 	lua_pushstring(L,m_callstepName);
 	return 2;
 }
+// takes ownership of a received message, used by eng.socket.drain
+void CLMData::AttachNTMSG(NTMSG* msg)
+{
+	Class_LuaMessageObject_releaseMem();
+	m_pMsgNetMessage = msg;
+	m_pMsgNetMessage->NTMSG_ResetFReadPos();
+	SetCallStep(26, "AttachNTMSG");
+}
 int CLMData::CLuaMessage_CNM(lua_State *L)
 {	
 	m_pMsgNetMessage = new NTMSG(512);
@@ -52,8 +60,7 @@ const char * CLMData::getLuaStateStringParam(lua_State *L, int index)
 
 int CLMData::CLuaMessage_ZeroParam_LM(lua_State *L)
 {
-	m_pMsgNetMessage = GetSocketObjectByDefaultName()->GetConnectionSocketManager()->getMsgFromCache();
-	GetSocketObjectByDefaultName()->GetConnectionSocketManager()->RemoveMsgFromCache(m_pMsgNetMessage);
+	m_pMsgNetMessage = GetSocketObjectByDefaultName()->GetConnectionSocketManager()->PopMsgFromCache();
 	m_pMsgNetMessage->NTMSG_ResetFReadPos();
 	SetCallStep(3, "CLuaMessage_ZeroParam_LM");
 	return 0;
@@ -62,8 +69,7 @@ int CLMData::CLuaMessage_NZeroParam_LM(lua_State *L)
 {	
 	const char *socketname = getLuaStateStringParam(L,1);
 	S_O_TCP*tmp = GetSocketObjectByName(socketname);
-	m_pMsgNetMessage = tmp->GetConnectionSocketManager()->getMsgFromCache();
-	tmp->GetConnectionSocketManager()->RemoveMsgFromCache(m_pMsgNetMessage);
+	m_pMsgNetMessage = tmp->GetConnectionSocketManager()->PopMsgFromCache();
 	m_pMsgNetMessage->NTMSG_ResetFReadPos();
 	SetCallStep(4, "CLuaMessage_NZeroParam_LM");
 	return 0;
@@ -157,6 +163,221 @@ int CLMData::CLuaMessage_EFW(lua_State *L)
     return RET_ONE;
 }
 
+static NTMSG* checkMsgOfLMData(lua_State *L, NTMSG* msg)
+{
+	if (msg == NULL)
+		luaL_error(L, "message not loaded");
+	return msg;
+}
+
+static const unsigned char* readSpanOfLMData(lua_State *L, NTMSG* msg, int sz)
+{
+	const char* p = checkMsgOfLMData(L, msg)->NTMSG_rSpan(sz);
+	if (p == NULL)
+		luaL_error(L, "read of %d bytes past the end of message, %d left", sz, msg->NTMSG_rRemain());
+	return (const unsigned char*)p;
+}
+
+template<int N, bool LE> static unsigned long long loadBytesOfLMData(const unsigned char* p)
+{
+	unsigned long long v = 0;
+	for (int i = 0; i < N; i++)
+		v |= (unsigned long long)p[LE ? i : N - 1 - i] << (i * 8);
+	return v;
+}
+
+template<int N, bool LE> static void storeBytesOfLMData(unsigned char* p, unsigned long long v)
+{
+	for (int i = 0; i < N; i++)
+		p[LE ? i : N - 1 - i] = (unsigned char)(v >> (i * 8));
+}
+
+// 64 bit values come back as lua numbers, exact up to 2^53
+template<int N, bool LE, bool S> int CLMData::CLuaMessage_RI(lua_State *L)
+{
+	unsigned long long v = loadBytesOfLMData<N, LE>(readSpanOfLMData(L, m_pMsgNetMessage, N));
+	if (S && N < 8 && (v >> (N * 8 - 1)) != 0)
+		v |= ~0ULL << (N * 8);
+	lua_pushnumber(L, S ? (lua_Number)(Int64)v : (lua_Number)v);
+	SetCallStep(16, "CLuaMessage_RI");
+	return RET_ONE;
+}
+
+template<int N, bool LE> int CLMData::CLuaMessage_WI(lua_State *L)
+{
+	lua_Number n = luaL_checknumber(L, 1);
+	unsigned long long v = n < 0 ? (unsigned long long)(Int64)n : (unsigned long long)n;
+	storeBytesOfLMData<N, LE>((unsigned char*)checkMsgOfLMData(L, m_pMsgNetMessage)->NTMSG_wSpan(N), v);
+	SetCallStep(17, "CLuaMessage_WI");
+	return RET_ZERO;
+}
+
+template<typename F, bool LE> int CLMData::CLuaMessage_RF(lua_State *L)
+{
+	unsigned long long bits = loadBytesOfLMData<sizeof(F), LE>(readSpanOfLMData(L, m_pMsgNetMessage, sizeof(F)));
+	F v;
+	if (sizeof(F) == 4)
+	{
+		unsigned int b32 = (unsigned int)bits;
+		memcpy(&v, &b32, sizeof(F));
+	}
+	else
+	{
+		memcpy(&v, &bits, sizeof(F));
+	}
+	lua_pushnumber(L, (lua_Number)v);
+	SetCallStep(18, "CLuaMessage_RF");
+	return RET_ONE;
+}
+
+template<typename F, bool LE> int CLMData::CLuaMessage_WF(lua_State *L)
+{
+	F v = (F)luaL_checknumber(L, 1);
+	unsigned long long bits = 0;
+	if (sizeof(F) == 4)
+	{
+		unsigned int b32;
+		memcpy(&b32, &v, sizeof(F));
+		bits = b32;
+	}
+	else
+	{
+		memcpy(&bits, &v, sizeof(F));
+	}
+	storeBytesOfLMData<sizeof(F), LE>((unsigned char*)checkMsgOfLMData(L, m_pMsgNetMessage)->NTMSG_wSpan(sizeof(F)), bits);
+	SetCallStep(19, "CLuaMessage_WF");
+	return RET_ZERO;
+}
+
+// LEB128, ReadVarint(true) / WriteVarint(v, true) use the zigzag form for signed values
+int CLMData::CLuaMessage_RV(lua_State *L)
+{
+	bool zigzag = lua_toboolean(L, 1) != 0;
+	NTMSG* msg = checkMsgOfLMData(L, m_pMsgNetMessage);
+	unsigned long long v = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		if (shift > 63)
+			return luaL_error(L, "varint longer than 10 bytes");
+		unsigned char b = *readSpanOfLMData(L, msg, 1);
+		v |= (unsigned long long)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			break;
+	}
+	if (zigzag)
+		lua_pushnumber(L, (lua_Number)(Int64)((v >> 1) ^ (~(v & 1) + 1)));
+	else
+		lua_pushnumber(L, (lua_Number)v);
+	SetCallStep(20, "CLuaMessage_RV");
+	return RET_ONE;
+}
+
+int CLMData::CLuaMessage_WV(lua_State *L)
+{
+	lua_Number n = luaL_checknumber(L, 1);
+	bool zigzag = lua_toboolean(L, 2) != 0;
+	unsigned long long v;
+	if (zigzag)
+	{
+		Int64 s = (Int64)n;
+		v = ((unsigned long long)s << 1) ^ (unsigned long long)(s >> 63);
+	}
+	else
+	{
+		v = n < 0 ? (unsigned long long)(Int64)n : (unsigned long long)n;
+	}
+	unsigned char tmp[10];
+	int len = 0;
+	do
+	{
+		tmp[len] = (unsigned char)(v & 0x7F);
+		v >>= 7;
+		if (v != 0)
+			tmp[len] |= 0x80;
+		len++;
+	} while (v != 0);
+	memcpy(checkMsgOfLMData(L, m_pMsgNetMessage)->NTMSG_wSpan(len), tmp, len);
+	SetCallStep(21, "CLuaMessage_WV");
+	return RET_ZERO;
+}
+
+// big endian length prefix of 1, 2 (default) or 4 bytes, ReadString([prefixBytes])
+int CLMData::CLuaMessage_RS(lua_State *L)
+{
+	int prefix = (int)luaL_optinteger(L, 1, 2);
+	NTMSG* msg = checkMsgOfLMData(L, m_pMsgNetMessage);
+	int len = 0;
+	if (prefix == 1)
+		len = (int)loadBytesOfLMData<1, false>(readSpanOfLMData(L, msg, 1));
+	else if (prefix == 2)
+		len = (int)loadBytesOfLMData<2, false>(readSpanOfLMData(L, msg, 2));
+	else if (prefix == 4)
+		len = (int)loadBytesOfLMData<4, false>(readSpanOfLMData(L, msg, 4));
+	else
+		return luaL_argerror(L, 1, "prefix must be 1, 2 or 4");
+	const char* p = (const char*)readSpanOfLMData(L, msg, len);
+	lua_pushlstring(L, p, len);
+	SetCallStep(22, "CLuaMessage_RS");
+	return RET_ONE;
+}
+
+// WriteString(s [, prefixBytes])
+int CLMData::CLuaMessage_WS(lua_State *L)
+{
+	size_t len = 0;
+	const char* s = luaL_checklstring(L, 1, &len);
+	int prefix = (int)luaL_optinteger(L, 2, 2);
+	if (prefix != 1 && prefix != 2 && prefix != 4)
+		return luaL_argerror(L, 2, "prefix must be 1, 2 or 4");
+	if (prefix < 4 && len >> (prefix * 8) != 0)
+		return luaL_argerror(L, 1, "string too long for its length prefix");
+	unsigned char* p = (unsigned char*)checkMsgOfLMData(L, m_pMsgNetMessage)->NTMSG_wSpan(prefix + (int)len);
+	if (prefix == 1)
+		storeBytesOfLMData<1, false>(p, len);
+	else if (prefix == 2)
+		storeBytesOfLMData<2, false>(p, len);
+	else
+		storeBytesOfLMData<4, false>(p, len);
+	memcpy(p + prefix, s, len);
+	SetCallStep(23, "CLuaMessage_WS");
+	return RET_ZERO;
+}
+
+int CLMData::CLuaMessage_SK(lua_State *L)
+{
+	readSpanOfLMData(L, m_pMsgNetMessage, (int)luaL_checkinteger(L, 1));
+	SetCallStep(24, "CLuaMessage_SK");
+	return RET_ZERO;
+}
+
+int CLMData::CLuaMessage_RM(lua_State *L)
+{
+	lua_pushinteger(L, checkMsgOfLMData(L, m_pMsgNetMessage)->NTMSG_rRemain());
+	SetCallStep(25, "CLuaMessage_RM");
+	return RET_ONE;
+}
+
+// SendOnLane(lane [, socketName]), lane is one of eng.socket.LANE_*
+int CLMData::CLuaMessage_SL(lua_State *L)
+{
+	int laneFromLuaState = luaL_checkint(L, 1);
+	S_O_TCP* tmp = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	tmp->GetConnectionSocketManager()->SendMsgFromNetMsg(checkMsgOfLMData(L, m_pMsgNetMessage), laneFromLuaState);
+	m_pMsgNetMessage = NULL;
+	SetCallStep(27, "CLuaMessage_SL");
+	return RET_ZERO;
+}
+
+// SendUnreliable([socketName]), no resends and no ordering on a udp link, a plain send elsewhere
+int CLMData::CLuaMessage_SU(lua_State *L)
+{
+	S_O_TCP* tmp = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	tmp->GetConnectionSocketManager()->SendUnreliableFromNetMsg(checkMsgOfLMData(L, m_pMsgNetMessage));
+	m_pMsgNetMessage = NULL;
+	SetCallStep(28, "CLuaMessage_SU");
+	return RET_ZERO;
+}
+
 LUNPLUS_DEFINE_INTERFACE(CLMData);
 LUNPLUS_METHOD_BEGIN(CLMData)
 {
@@ -169,6 +390,41 @@ LUNPLUS_METHOD_BEGIN(CLMData)
 { "GetSize", &CLMData::CLuaMessage_GS },
 { "ReadRaw", &CLMData::CLuaMessage_RR },
 { "WriteRaw", &CLMData::CLuaMessage_WR },
+{ "ReadInt8", &CLMData::CLuaMessage_RI<1, false, true> },
+{ "ReadUInt8", &CLMData::CLuaMessage_RI<1, false, false> },
+{ "ReadInt16", &CLMData::CLuaMessage_RI<2, false, true> },
+{ "ReadUInt16", &CLMData::CLuaMessage_RI<2, false, false> },
+{ "ReadInt32", &CLMData::CLuaMessage_RI<4, false, true> },
+{ "ReadUInt32", &CLMData::CLuaMessage_RI<4, false, false> },
+{ "ReadInt64", &CLMData::CLuaMessage_RI<8, false, true> },
+{ "ReadInt16LE", &CLMData::CLuaMessage_RI<2, true, true> },
+{ "ReadUInt16LE", &CLMData::CLuaMessage_RI<2, true, false> },
+{ "ReadInt32LE", &CLMData::CLuaMessage_RI<4, true, true> },
+{ "ReadUInt32LE", &CLMData::CLuaMessage_RI<4, true, false> },
+{ "ReadInt64LE", &CLMData::CLuaMessage_RI<8, true, true> },
+{ "WriteInt8", &CLMData::CLuaMessage_WI<1, false> },
+{ "WriteInt16", &CLMData::CLuaMessage_WI<2, false> },
+{ "WriteInt32", &CLMData::CLuaMessage_WI<4, false> },
+{ "WriteInt64", &CLMData::CLuaMessage_WI<8, false> },
+{ "WriteInt16LE", &CLMData::CLuaMessage_WI<2, true> },
+{ "WriteInt32LE", &CLMData::CLuaMessage_WI<4, true> },
+{ "WriteInt64LE", &CLMData::CLuaMessage_WI<8, true> },
+{ "ReadFloat", &CLMData::CLuaMessage_RF<float, false> },
+{ "ReadDouble", &CLMData::CLuaMessage_RF<double, false> },
+{ "ReadFloatLE", &CLMData::CLuaMessage_RF<float, true> },
+{ "ReadDoubleLE", &CLMData::CLuaMessage_RF<double, true> },
+{ "WriteFloat", &CLMData::CLuaMessage_WF<float, false> },
+{ "WriteDouble", &CLMData::CLuaMessage_WF<double, false> },
+{ "WriteFloatLE", &CLMData::CLuaMessage_WF<float, true> },
+{ "WriteDoubleLE", &CLMData::CLuaMessage_WF<double, true> },
+{ "ReadVarint", &CLMData::CLuaMessage_RV },
+{ "WriteVarint", &CLMData::CLuaMessage_WV },
+{ "ReadString", &CLMData::CLuaMessage_RS },
+{ "WriteString", &CLMData::CLuaMessage_WS },
+{ "Skip", &CLMData::CLuaMessage_SK },
+{ "Remaining", &CLMData::CLuaMessage_RM },
+{ "SendOnLane", &CLMData::CLuaMessage_SL },
+{ "SendUnreliable", &CLMData::CLuaMessage_SU },
 
 { "ZeroParam_LM", &CLMData::CLuaMessage_ZeroParam_LM },
 { "NZeroParam_LM", &CLMData::CLuaMessage_NZeroParam_LM },
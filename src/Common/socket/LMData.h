@@ -12,6 +12,18 @@
 //#CLuaMessage_BFW#BeginForWrite
 //#CLuaMessage_EFW#EndForWrite
 //#CLuaMessage_SM#SendMsg
+//#CLuaMessage_RI#ReadInt8..ReadInt64LE
+//#CLuaMessage_WI#WriteInt8..WriteInt64LE
+//#CLuaMessage_RF#ReadFloat/ReadDouble(LE)
+//#CLuaMessage_WF#WriteFloat/WriteDouble(LE)
+//#CLuaMessage_RV#ReadVarint
+//#CLuaMessage_WV#WriteVarint
+//#CLuaMessage_RS#ReadString
+//#CLuaMessage_WS#WriteString
+//#CLuaMessage_SK#Skip
+//#CLuaMessage_RM#Remaining
+//#CLuaMessage_SL#SendOnLane
+//#CLuaMessage_SU#SendUnreliable
 class CLMData
 {
 public:
@@ -38,7 +50,21 @@ public:
 	int CLuaMessage_NZeroParam_SM(lua_State *L);
 	int CLuaMessage_SM(lua_State *L);
 	int CLuaMessage_GetLast_CALL_STP(lua_State *L);
+	// typed cursor access straight on the message buffer, nothing is copied per field
+	template<int N, bool LE, bool S> int CLuaMessage_RI(lua_State *L);
+	template<int N, bool LE> int CLuaMessage_WI(lua_State *L);
+	template<typename F, bool LE> int CLuaMessage_RF(lua_State *L);
+	template<typename F, bool LE> int CLuaMessage_WF(lua_State *L);
+	int CLuaMessage_RV(lua_State *L);
+	int CLuaMessage_WV(lua_State *L);
+	int CLuaMessage_RS(lua_State *L);
+	int CLuaMessage_WS(lua_State *L);
+	int CLuaMessage_SK(lua_State *L);
+	int CLuaMessage_RM(lua_State *L);
+	int CLuaMessage_SL(lua_State *L);
+	int CLuaMessage_SU(lua_State *L);
 	int SetCallStep(int id, const char * idname);
+	void AttachNTMSG(NTMSG* msg);
 	LUNPLUS_DECLARE_INTERFACE(CLMData);
 private:
 	int m_callstep;
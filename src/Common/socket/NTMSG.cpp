@@ -7,17 +7,30 @@
 #include "NTMSG.h"
 
 
-#include <list>
+#include <vector>
+#include <mutex>
 #ifndef WIN32
 #include "arpa/inet.h"
 #endif
 #include "Common/ENG_DBG.h"
+#define CMBP_MIN_CLASS_SHIFT        (9)     // 512 byte, the default NTMSG size
+#define CMBP_CLASS_NUM              (12)    // 512 .. 1M, larger buffers are not cached
+#define CMBP_DEFAULT_HIGH_WATER     (256)
+#define CMBP_DEFAULT_IDLE_TRIM_MS   (30000)
+#define DEFAULT_SIZE_MEM_NUM        (6)
+
 class MemCacheBufferForCMBP;
+// power of two size classes, every class is a plain stack of free buffers
 class CMBPClass{
 public:
 	CMBPClass()
 	{
 		m_beInited = true;
+		m_seeded = false;
+		m_highWater = CMBP_DEFAULT_HIGH_WATER;
+		m_idleTrimMs = CMBP_DEFAULT_IDLE_TRIM_MS;
+		m_idleMs = 0;
+		memset(&m_stat, 0, sizeof(m_stat));
 	}
 	~CMBPClass();
 	static CMBPClass*     getCMBPInst()
@@ -25,13 +38,26 @@ public:
 		static CMBPClass icmbpclass;
 		return &icmbpclass;
 	}
+	static int getClassIndex(int size);
 	void InitCMBPClass();
 	MemCacheBufferForCMBP* reqAMBF(int size);
 	MemCacheBufferForCMBP* reqAMBF_impl(int size);
+	MemCacheBufferForCMBP* growAMBF(MemCacheBufferForCMBP* pBuf, int size);
 	void rlsMemBF(MemCacheBufferForCMBP* pBuf);
 	void rlsMemBF_impl(MemCacheBufferForCMBP* pBuf);
+	void update(int dt);
+	void trim(int keepSmall);
+	void getStat(NTMSG_PoolStat& stat);
+	void setConfig(int highWater, int idleTrimMs);
 	static bool m_beInited;
-	std::list<MemCacheBufferForCMBP*> m_pmlist;
+	bool            m_seeded;
+	std::vector<MemCacheBufferForCMBP*> m_pmclass[CMBP_CLASS_NUM];
+	int             m_highWater;
+	int             m_idleTrimMs;
+	int             m_idleMs;
+	NTMSG_PoolStat  m_stat;
+	// NTMSG are created and freed on both the lua thread and the socket io threads
+	std::mutex m_pmlock;
 };
 class MemCacheBufferForCMBP{
 public:
@@ -43,7 +69,6 @@ public:
 		m_cachespacebuf = NULL;
 	}
 
-	void AllocMoreSize();
 	int getSpaceSize()   const
 	{
 		return m_cachesz;
@@ -112,19 +137,6 @@ int NTMSG::NTMSG_getRdCapSize()
 	}
 }
 
-void MemCacheBufferForCMBP::AllocMoreSize()
-{
-	m_cachesz *= 2;	
-	void *pNewBufMemCache = realloc((void*)m_cachespacebuf, getSpaceSize());
-	if (pNewBufMemCache == NULL)
-	{
-		DBG_L("realloc pNewBufMemCache failed \n");
-		m_cachesz = 0;
-		free(m_cachespacebuf);
-	}
-	m_cachespacebuf = (char*)pNewBufMemCache;
-}
-
 char* MemCacheBufferForCMBP::getMemCacheBuf(int psinmemcache)
 {
 	if (psinmemcache >= getSpaceSize())
@@ -137,26 +149,15 @@ bool CMBPClass::m_beInited = false;
 
 CMBPClass::~CMBPClass()
 {
-	std::list<MemCacheBufferForCMBP*>::iterator iterofpmlist = m_pmlist.begin();
-	for (; iterofpmlist != m_pmlist.end(); ++iterofpmlist)
-	{
-		delete *iterofpmlist;
-	}
-	m_beInited = false;
-	if (m_beInited)
+	for (int i = 0; i < CMBP_CLASS_NUM; ++i)
 	{
-		int sz = 2;
-		if (m_pmlist.empty())
+		for (size_t j = 0; j < m_pmclass[i].size(); ++j)
 		{
-			InitCMBPClass();
-		}
-		MemCacheBufferForCMBP* pointRet = NULL;
-		if (!sz)
-		{
-			pointRet = m_pmlist.front();
-			m_pmlist.pop_front();			
+			delete m_pmclass[i][j];
 		}
+		m_pmclass[i].clear();
 	}
+	m_beInited = false;
 }
 void do_exit_while_error()
 {
@@ -167,15 +168,20 @@ void do_exit_while_error()
 #endif
 
 }
-#define DEFAULT_SIZE_MEM_NUM (6)
-void CMBPClass::InitCMBPClass()
+
+// -1 when the size is above the largest cached class
+int CMBPClass::getClassIndex(int sz)
 {
-	for (int i = 0; i < DEFAULT_SIZE_MEM_NUM; ++i)
+	int idx = 0;
+	while (idx < CMBP_CLASS_NUM && (1 << (idx + CMBP_MIN_CLASS_SHIFT)) < sz)
 	{
-		MemCacheBufferForCMBP *pBuf = new MemCacheBufferForCMBP(512);
-		m_pmlist.push_back(pBuf);
+		++idx;
 	}
-	
+	return idx < CMBP_CLASS_NUM ? idx : -1;
+}
+
+void CMBPClass::InitCMBPClass()
+{
 	if (DEFAULT_SIZE_MEM_NUM == 0)
 	{
 		printf("error size mem num!!!! force exit!!!!");
@@ -183,53 +189,60 @@ void CMBPClass::InitCMBPClass()
 	}
 	for (int i = 0; i < DEFAULT_SIZE_MEM_NUM; ++i)
 	{
-		MemCacheBufferForCMBP *pBuf = new MemCacheBufferForCMBP(1024);
-		m_pmlist.push_back(pBuf);
+		rlsMemBF_impl(new MemCacheBufferForCMBP(512));
+		rlsMemBF_impl(new MemCacheBufferForCMBP(1024));
 	}
-	MemCacheBufferForCMBP *pBuf = new MemCacheBufferForCMBP(65536);
-	m_pmlist.push_back(pBuf);
+	rlsMemBF_impl(new MemCacheBufferForCMBP(65536));
 }
 
 MemCacheBufferForCMBP* CMBPClass::reqAMBF(int sz)
 {
-	if (m_pmlist.empty())
+	std::lock_guard<std::mutex> guard(m_pmlock);
+	if (!m_seeded)
 	{
+		m_seeded = true;
 		InitCMBPClass();
 	}
-	MemCacheBufferForCMBP* pointRet = NULL;
-	if (!sz)
+	m_idleMs = 0;
+	return reqAMBF_impl(sz > 0 ? sz : 1);
+}
+MemCacheBufferForCMBP* CMBPClass::reqAMBF_impl(int sz)
+{
+	int idx = getClassIndex(sz);
+	if (idx < 0)
 	{
-		pointRet = m_pmlist.front();
-		m_pmlist.pop_front();
-		return pointRet;
+		m_stat.misses++;
+		return new MemCacheBufferForCMBP(sz);
 	}
-	else
+	std::vector<MemCacheBufferForCMBP*>& freeList = m_pmclass[idx];
+	if (freeList.empty())
 	{
-		return reqAMBF_impl(sz);
+		m_stat.misses++;
+		return new MemCacheBufferForCMBP(1 << (idx + CMBP_MIN_CLASS_SHIFT));
 	}
+	MemCacheBufferForCMBP* pointRet = freeList.back();
+	freeList.pop_back();
+	m_stat.hits++;
+	m_stat.buffersHeld--;
+	m_stat.bytesHeld -= pointRet->getSpaceSize();
+	return pointRet;
 }
-MemCacheBufferForCMBP* CMBPClass::reqAMBF_impl(int sz)
+// moves the content into a buffer of at least sz bytes and recycles the old one. past the
+// largest class the size doubles, as AllocMoreSize did, so a message built field by field
+// is not copied once per field
+MemCacheBufferForCMBP* CMBPClass::growAMBF(MemCacheBufferForCMBP* pBufCMBP, int sz)
 {
-	MemCacheBufferForCMBP* pointRet = NULL;
-	std::list<MemCacheBufferForCMBP*>::iterator iter = m_pmlist.begin();
-	for (; iter != m_pmlist.end(); ++iter)
+	if (getClassIndex(sz) < 0 && sz < pBufCMBP->getSpaceSize() * 2)
 	{
-		if ((*iter)->getSpaceSize() >= sz)
-		{
-			pointRet = *iter;
-			m_pmlist.erase(iter);
-			return pointRet;
-		}
-		else
-		{
-#ifdef DEBUG_NET_MSG_OUT
-			pointRet = m_pmlist.front();
-			m_pmlist.pop_front();
-			return pointRet;
-#endif
-		}
-		}
-	pointRet = new MemCacheBufferForCMBP(sz);
+		sz = pBufCMBP->getSpaceSize() * 2;
+	}
+	MemCacheBufferForCMBP* pointRet = reqAMBF(sz);
+	if (pointRet->m_cachespacebuf == NULL)
+	{
+		do_exit_while_error();
+	}
+	memcpy(pointRet->m_cachespacebuf, pBufCMBP->m_cachespacebuf, pBufCMBP->getSpaceSize());
+	rlsMemBF(pBufCMBP);
 	return pointRet;
 }
 void CMBPClass::rlsMemBF(MemCacheBufferForCMBP* pBufCMBP)
@@ -240,21 +253,120 @@ void CMBPClass::rlsMemBF(MemCacheBufferForCMBP* pBufCMBP)
 	}
 	else
 	{
+		std::lock_guard<std::mutex> guard(m_pmlock);
+		m_idleMs = 0;
 		rlsMemBF_impl(pBufCMBP);
 	}
 }
 void CMBPClass::rlsMemBF_impl(MemCacheBufferForCMBP* pBufCMBP)
 {
-	std::list<MemCacheBufferForCMBP*>::iterator iter = m_pmlist.begin();
-	for (; m_pmlist.size() != 0 && iter != m_pmlist.end(); ++iter)
+	int idx = getClassIndex(pBufCMBP->getSpaceSize());
+	if (idx < 0 || pBufCMBP->getSpaceSize() != (1 << (idx + CMBP_MIN_CLASS_SHIFT))
+		|| (int)m_pmclass[idx].size() >= m_highWater)
+	{
+		delete pBufCMBP;
+		return;
+	}
+	m_pmclass[idx].push_back(pBufCMBP);
+	m_stat.buffersHeld++;
+	m_stat.bytesHeld += pBufCMBP->getSpaceSize();
+}
+
+void CMBPClass::update(int dt)
+{
+	std::lock_guard<std::mutex> guard(m_pmlock);
+	m_idleMs += dt;
+	if (m_idleTrimMs <= 0 || m_idleMs < m_idleTrimMs)
+	{
+		return;
+	}
+	m_idleMs = 0;
+	trim(DEFAULT_SIZE_MEM_NUM);
+}
+// after a quiet period everything but a few small buffers goes back to the os
+void CMBPClass::trim(int keepSmall)
+{
+	bool trimmed = false;
+	for (int i = 0; i < CMBP_CLASS_NUM; ++i)
+	{
+		size_t keep = i < 2 ? (size_t)keepSmall : 0;
+		while (m_pmclass[i].size() > keep)
+		{
+			MemCacheBufferForCMBP* pBufCMBP = m_pmclass[i].back();
+			m_pmclass[i].pop_back();
+			m_stat.buffersHeld--;
+			m_stat.bytesHeld -= pBufCMBP->getSpaceSize();
+			delete pBufCMBP;
+			trimmed = true;
+		}
+	}
+	if (trimmed)
+	{
+		m_stat.trims++;
+	}
+}
+void CMBPClass::getStat(NTMSG_PoolStat& stat)
+{
+	std::lock_guard<std::mutex> guard(m_pmlock);
+	stat = m_stat;
+}
+void CMBPClass::setConfig(int highWater, int idleTrimMs)
+{
+	std::lock_guard<std::mutex> guard(m_pmlock);
+	m_highWater = highWater > 0 ? highWater : 0;
+	m_idleTrimMs = idleTrimMs;
+	for (int i = 0; i < CMBP_CLASS_NUM; ++i)
 	{
-		if ((*iter)->getSpaceSize() >= pBufCMBP->getSpaceSize())
+		while ((int)m_pmclass[i].size() > m_highWater)
 		{
-			m_pmlist.insert(iter, pBufCMBP);
-			return;
+			MemCacheBufferForCMBP* pBufCMBP = m_pmclass[i].back();
+			m_pmclass[i].pop_back();
+			m_stat.buffersHeld--;
+			m_stat.bytesHeld -= pBufCMBP->getSpaceSize();
+			delete pBufCMBP;
 		}
 	}
-	m_pmlist.push_back(pBufCMBP);
+}
+
+NTMSG_RecvChunk* NTMSG_RecvChunk::Create(int size)
+{
+	NTMSG_RecvChunk* chunk = new NTMSG_RecvChunk();
+	chunk->m_buf = CMBPClass::getCMBPInst()->reqAMBF(size);
+	chunk->m_ref.store(1);
+	return chunk;
+}
+NTMSG_RecvChunk::~NTMSG_RecvChunk()
+{
+	CMBPClass::getCMBPInst()->rlsMemBF(m_buf);
+	m_buf = NULL;
+}
+void NTMSG_RecvChunk::Release()
+{
+	if (m_ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		delete this;
+	}
+}
+char* NTMSG_RecvChunk::GetBuf()
+{
+	return m_buf->m_cachespacebuf;
+}
+int NTMSG_RecvChunk::GetCap() const
+{
+	return m_buf->getSpaceSize();
+}
+
+void NTMSG::NTMSG_PoolUpdate(int dt)
+{
+	CMBPClass::getCMBPInst()->update(dt);
+}
+void NTMSG::NTMSG_PoolGetStat(NTMSG_PoolStat& stat)
+{
+	CMBPClass::getCMBPInst()->getStat(stat);
+}
+void NTMSG::NTMSG_PoolSetConfig(int highWater, int idleTrimMs)
+{
+	CMBPClass::getCMBPInst()->setConfig(highWater, idleTrimMs);
 }
 
 
@@ -264,17 +376,43 @@ m_ntmsgheadlength(2)
 {   
 	m_cPosForRW = 0;
 	m_bufMemSpaceStartPos = 0;	
+	m_viewChunk = NULL;
+	m_viewBase = NULL;
 	NTMSG_initVaule();
 	NTMSG_NewCreateBuf(size);
 }
+// a complete frame that stays inside the receive chunk it arrived in
+NTMSG::NTMSG(NTMSG_RecvChunk* chunk, int offset, int headLength, int size, bool compressed):
+m_sizeAndType(size),
+m_ntmsgheadlength(headLength)
+{
+	m_compressed = compressed;
+	m_arrivalUs = 0;
+	m_streamOffset = 0;
+	m_streamTotal = -1;
+	m_cipherDone = false;
+	m_bufMemSpaceStartPos = 0;
+	m_cPosForRW = headLength + size;
+	m_MembufObject = NULL;
+	m_viewChunk = chunk;
+	m_viewChunk->AddRef();
+	m_viewBase = chunk->GetBuf() + offset;
+}
 void NTMSG::NTMSG_initVaule()
 {
 	m_cPosForRW = 0;
 	m_sizeAndType = -1;
 	m_ntmsgheadlength = 2;
+	m_compressed = false;
+	m_arrivalUs = 0;
+	m_streamOffset = 0;
+	m_streamTotal = -1;
+	m_cipherDone = false;
 }
 char* NTMSG::NTMSG_getBufFromCache(int pos)
 {
+	if (m_viewChunk != NULL)
+		return m_viewBase + pos;
 	return m_MembufObject->getMemCacheBuf(pos);
 }
 
@@ -286,6 +424,11 @@ NTMSG::~NTMSG()
 		CMBPClass::getCMBPInst()->rlsMemBF(m_MembufObject);
     }
 	m_MembufObject = NULL;
+	if (m_viewChunk != NULL)
+	{
+		m_viewChunk->Release();
+	}
+	m_viewChunk = NULL;
 }
 
 void NTMSG::NTMSG_CallWhileReceive(int size)
@@ -330,6 +473,17 @@ void NTMSG::NTMSG_CallWhileReceive(int size)
 	}
 }
 
+// the receiver already parsed the header, only the payload is still to come
+void NTMSG::NTMSG_initRecvFrame(int headLength, int size, bool compressed)
+{
+	m_sizeAndType = size;
+	m_ntmsgheadlength = headLength;
+	m_bufMemSpaceStartPos = 0;
+	m_cPosForRW = headLength;
+	m_compressed = compressed;
+	NTMSG_checkBSize_I(size);
+}
+
 bool NTMSG::NTMSG_IsOver() const
 {
 	if (m_sizeAndType < 0)
@@ -394,20 +548,54 @@ void NTMSG::NTMSG_endWriteData_impl_type2()
 	m_bufMemSpaceStartPos = m_cPosForRW;
 }
 
+// rewrites the header of a finished frame for the compressed framing, there the top bit
+// of the length is the compressed flag, so 0x7FFF and up always take the 0xFFFF form.
+void NTMSG::NTMSG_markFrame(bool compressed)
+{
+	m_compressed = compressed;
+	if (m_sizeAndType < 0x7FFF)
+	{
+		m_ntmsgheadlength = 2;
+		m_cPosForRW = 4;
+		NTMSG_wUShortValue((compressed ? 0x8000 : 0) | m_sizeAndType);
+		m_cPosForRW = 4;
+	}
+	else
+	{
+		m_ntmsgheadlength = 6;
+		m_cPosForRW = 0;
+		NTMSG_wUShortValue(0xFFFF);
+		NTMSG_wUIntValue((compressed ? 0x80000000u : 0) | (unsigned int)m_sizeAndType);
+		m_cPosForRW = 0;
+	}
+	m_bufMemSpaceStartPos = m_cPosForRW;
+}
+
 void NTMSG::NTMSG_checkBSize_I(int size)
 {
-	while (m_cPosForRW + size > m_MembufObject->getSpaceSize())
+	if (m_viewChunk != NULL)
+	{
+		// writing into a received frame, give it a buffer of its own first
+		int viewLen = m_sizeAndType + m_ntmsgheadlength;
+		int need = m_cPosForRW + size > viewLen ? m_cPosForRW + size : viewLen;
+		m_MembufObject = CMBPClass::getCMBPInst()->reqAMBF(need);
+		memcpy(m_MembufObject->m_cachespacebuf, m_viewBase, viewLen);
+		m_viewChunk->Release();
+		m_viewChunk = NULL;
+		m_viewBase = NULL;
+	}
+	if (m_cPosForRW + size > m_MembufObject->getSpaceSize())
     {
-		m_MembufObject->AllocMoreSize();
+		m_MembufObject = CMBPClass::getCMBPInst()->growAMBF(m_MembufObject, m_cPosForRW + size);
     }
 }
 void NTMSG::sBufDataValue(char value)
 {
-	*(m_MembufObject->getMemCacheBuf(m_cPosForRW++)) = value;
+	*(NTMSG_getBufFromCache(m_cPosForRW++)) = value;
 }
 char NTMSG::gBufDataValue()
 {
-	return *(m_MembufObject->getMemCacheBuf(m_cPosForRW++));
+	return *(NTMSG_getBufFromCache(m_cPosForRW++));
 }
  
  
@@ -474,6 +662,34 @@ const char* NTMSG::NTMSG_rRawValue(int sz)
 	}
 }
 
+// payload bytes left behind the read cursor
+int NTMSG::NTMSG_rRemain() const
+{
+	if (m_sizeAndType < 0)
+		return 0;
+	int left = m_bufMemSpaceStartPos + m_ntmsgheadlength + m_sizeAndType - m_cPosForRW;
+	return left > 0 ? left : 0;
+}
+
+// like NTMSG_rRawValue but NULL instead of running off the end of the payload
+const char* NTMSG::NTMSG_rSpan(int sz)
+{
+	if (sz < 0 || sz > NTMSG_rRemain())
+		return NULL;
+	char* pOut = NTMSG_getCBuf();
+	m_cPosForRW += sz;
+	return pOut;
+}
+
+// reserves sz bytes at the write cursor for the caller to fill in place
+char* NTMSG::NTMSG_wSpan(int sz)
+{
+	NTMSG_checkBSize_I(sz);
+	char* pOut = NTMSG_getCBuf();
+	m_cPosForRW += sz;
+	return pOut;
+}
+
 char* NTMSG::NTMSG_getReadBufFr()
 {
 	int tmppos = m_cPosForRW;
@@ -4,6 +4,7 @@
 #include "assert.h"
 #include "vector"
 #include "stdio.h"
+#include <atomic>
 
 
 typedef unsigned char	UInt8;
@@ -16,6 +17,32 @@ typedef __int64 Int64;
 
 class MemCacheBufferForCMBP;
 
+// refcounted receive block, NTMSG views keep it alive until they are freed
+class NTMSG_RecvChunk
+{
+public:
+	static NTMSG_RecvChunk* Create(int size);
+	void    AddRef()            { m_ref.fetch_add(1, std::memory_order_relaxed); }
+	void    Release();
+	bool    IsUnique() const    { return m_ref.load(std::memory_order_acquire) == 1; }
+	char*   GetBuf();
+	int     GetCap() const;
+private:
+	NTMSG_RecvChunk() {}
+	~NTMSG_RecvChunk();
+	MemCacheBufferForCMBP*  m_buf;
+	std::atomic<int>        m_ref;
+};
+
+struct NTMSG_PoolStat
+{
+	Int64   hits;
+	Int64   misses;
+	Int64   trims;
+	Int64   bytesHeld;
+	Int64   buffersHeld;
+};
+
 class NTMSG
 {
 	void    NTMSG_checkBSize_I(int size);
@@ -26,9 +53,21 @@ class NTMSG
     int m_sizeAndType;
 	int m_ntmsgheadlength; //2 or 4
 	int m_bufMemSpaceStartPos;
+	// frame carries the compressed flag of the compressed framing
+	bool m_compressed;
+	// steady clock us of the read that completed a received frame, 0 for anything else
+	Int64 m_arrivalUs;
+	// a piece of a streamed frame: where it starts in that frame's payload and the payload size.
+	// m_streamTotal is -1 for whole frames
+	int m_streamOffset;
+	int m_streamTotal;
+	// the connection's stream cipher has been run over the payload, or never has to be:
+	// encrypted for a frame to send, decrypted for a received one
+	bool m_cipherDone;
 
 public:
 	NTMSG(int size = 512);
+	NTMSG(NTMSG_RecvChunk* chunk, int offset, int headLength, int size, bool compressed);
 	~NTMSG();
 	int			NTMSG_GetSizeAndType() const          { return m_sizeAndType; }	
 	void		NTMSG_NewCreateBuf(int bufSize = 0);
@@ -40,7 +79,19 @@ public:
 	void		NTMSG_CallWhileReceive(int size);
 	void		NTMSG_CallWhileSend(int size);	
 	char*		NTMSG_getCBuf()          { return NTMSG_getBufFromCache(m_cPosForRW); }    
+	char*		NTMSG_getPayload()       { return NTMSG_getBufFromCache(m_bufMemSpaceStartPos + m_ntmsgheadlength); }
 	bool		NTMSG_IsOver() const;
+	bool		NTMSG_IsCompressed() const			{ return m_compressed; }
+	Int64		NTMSG_getArrival() const			{ return m_arrivalUs; }
+	void		NTMSG_setArrival(Int64 us)			{ m_arrivalUs = us; }
+	bool		NTMSG_IsStreamPiece() const			{ return m_streamTotal >= 0; }
+	int			NTMSG_getStreamOffset() const		{ return m_streamOffset; }
+	int			NTMSG_getStreamTotal() const		{ return m_streamTotal; }
+	void		NTMSG_setStreamPiece(int offset, int total)	{ m_streamOffset = offset; m_streamTotal = total; }
+	bool		NTMSG_IsCipherDone() const			{ return m_cipherDone; }
+	void		NTMSG_setCipherDone(bool done)		{ m_cipherDone = done; }
+	void		NTMSG_initRecvFrame(int headLength, int size, bool compressed);
+	void		NTMSG_markFrame(bool compressed);
 	void		NTMSG_ResetFSendPos()					{ m_cPosForRW = m_bufMemSpaceStartPos; }
 	void		NTMSG_ResetFReadPos()					{ m_cPosForRW = m_bufMemSpaceStartPos + m_ntmsgheadlength; } 
 	void		NTMSG_wUShortValue(unsigned short v);
@@ -49,15 +100,24 @@ public:
 	void		NTMSG_wUIntValue(unsigned int v);
 	void		NTMSG_wRawValue(const char* buf, int sz);
 	const char* NTMSG_rRawValue(int sz);
+	int			NTMSG_rRemain() const;
+	const char* NTMSG_rSpan(int sz);
+	char*		NTMSG_wSpan(int sz);
 	void		NTMSG_dumpData();
 	void		NTMSG_beginWriteData();
 	void		NTMSG_endWriteData();
 	void		NTMSG_endWriteData_impl_type1();
 	void		NTMSG_endWriteData_impl_type2();
+	static void	NTMSG_PoolUpdate(int dt);
+	static void	NTMSG_PoolGetStat(NTMSG_PoolStat& stat);
+	static void	NTMSG_PoolSetConfig(int highWater, int idleTrimMs);
 protected:
   
     int			m_cPosForRW;
 	MemCacheBufferForCMBP* m_MembufObject;
+	// set for a received frame parsed in place, m_MembufObject is NULL then
+	NTMSG_RecvChunk* m_viewChunk;
+	char*   m_viewBase;
 	void sBufDataValue(char value);
 	char gBufDataValue();
 };
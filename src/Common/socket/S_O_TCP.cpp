@@ -5,6 +5,12 @@
 #include <stdlib.h>
 #include "SocketConnectionManager.h"
 #include "lua.hpp"
+#include "LMData.h"
+#include <chrono>
+
+extern "C" {
+LUA_API int luaS_yield(lua_State *L, int nrets);
+}
 
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_HAS_PENDING_MESSAGE(lua_State *L)
 {
@@ -95,6 +101,558 @@ static int STATIC_FUNCTION_INTERFACE_TO_LUA_ENERATE_ENCRYPT_SECRET(lua_State *L)
 	lua_pushinteger(L, resulekeyreturntolua);
 	return 1;
 }
+// eng.socket.setIOThread(enable [, socketName])
+// takes effect on the next successful connect of that socket
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD(lua_State *L)
+{
+	bool enableIOThreadFromLuaState = lua_toboolean(L, 1) != 0;
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	D_F_S->GetConnectionSocketManager()->SetIOThreadMode(enableIOThreadFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.poolStats() -> { hits, misses, trims, bytesHeld, buffersHeld } of the NTMSG buffer pool
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS(lua_State *L)
+{
+	NTMSG_PoolStat poolStatFromNTMSG;
+	NTMSG::NTMSG_PoolGetStat(poolStatFromNTMSG);
+	lua_newtable(L);
+	lua_pushnumber(L, (lua_Number)poolStatFromNTMSG.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushnumber(L, (lua_Number)poolStatFromNTMSG.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushnumber(L, (lua_Number)poolStatFromNTMSG.trims);
+	lua_setfield(L, -2, "trims");
+	lua_pushnumber(L, (lua_Number)poolStatFromNTMSG.bytesHeld);
+	lua_setfield(L, -2, "bytesHeld");
+	lua_pushnumber(L, (lua_Number)poolStatFromNTMSG.buffersHeld);
+	lua_setfield(L, -2, "buffersHeld");
+	return 1;
+}
+
+// eng.socket.setPoolConfig(highWaterPerClass, idleTrimMs), idleTrimMs <= 0 never trims
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG(lua_State *L)
+{
+	int highWaterFromLuaState = (int)luaL_checkinteger(L, 1);
+	int idleTrimMsFromLuaState = (int)luaL_checkinteger(L, 2);
+	NTMSG::NTMSG_PoolSetConfig(highWaterFromLuaState, idleTrimMsFromLuaState);
+	return 0;
+}
+// eng.socket.setCompression(threshold [, dict [, socketName]])
+// switches the socket to the compressed framing, both ends must do it before connecting.
+// frames of at least threshold payload bytes are LZ4 packed, threshold < 0 turns it off.
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION(lua_State *L)
+{
+	int thresholdFromLuaState = (int)luaL_checkinteger(L, 1);
+	size_t dictLenFromLuaState = 0;
+	const char* dictFromLuaState = luaL_optlstring(L, 2, NULL, &dictLenFromLuaState);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 3 ? GetSocketObjectByName(luaL_checkstring(L, 3)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	D_F_S->GetConnectionSocketManager()->SetCompression(thresholdFromLuaState, dictFromLuaState, (int)dictLenFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.drain([maxCount [, budgetMs [, socketName]]]) -> array of CLMData
+// hands over every complete message in one call instead of hasPendingMsg + LoadMsg per message.
+// maxCount <= 0 and budgetMs <= 0 mean no limit, whatever is left stays queued for the next tick.
+// every message is a CLMData of its own like LoadMsg gives, a handler may keep it as long as it likes.
+// a streamed frame ends the batch, its pieces go to OnStreamChunk on the next drain so the
+// handlers see everything in arrival order.
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE(lua_State *L)
+{
+	int maxCountFromLuaState = (int)luaL_optinteger(L, 1, 0);
+	lua_Number budgetMsFromLuaState = luaL_optnumber(L, 2, 0);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 3 ? GetSocketObjectByName(luaL_checkstring(L, 3)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_newtable(L);
+		return 1;
+	}
+	CSocketConnectionManager* mgr = D_F_S->GetConnectionSocketManager();
+	int total = mgr->GetCachedMsgCount();
+	if (maxCountFromLuaState > 0 && maxCountFromLuaState < total)
+		total = maxCountFromLuaState;
+	lua_createtable(L, total, 0);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+		std::chrono::microseconds((long long)(budgetMsFromLuaState * 1000));
+	int tableIndex = lua_gettop(L);
+	int count = 0;
+	while (count < total)
+	{
+		if (mgr->IsStreamPieceNext())
+		{
+			if (count > 0)
+				break;
+			mgr->DispatchStreamPieces();
+		}
+		if (mgr->GetCachedMsgCount() == 0)
+			break;
+		// the clock is only read every 16 messages, it costs more than a message here
+		if (budgetMsFromLuaState > 0 && count > 0 && (count & 15) == 0 && std::chrono::steady_clock::now() >= deadline)
+			break;
+		count++;
+		CLMData* msgObjectOfLua = new CLMData(CLMData::className);
+		msgObjectOfLua->AttachNTMSG(mgr->PopMsgFromCache());
+		lua::LuaPlus<CLMData>::push(L, msgObjectOfLua, true, CLMData::className);
+		lua_rawseti(L, tableIndex, count);
+	}
+	return 1;
+}
+// eng.socket.setDnsTTL(ttlMs [, failTtlMs]) how long resolved hosts are reused by connects and
+// reconnects, failed lookups are kept failTtlMs. 0 disables caching, any call flushes the cache.
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL(lua_State *L)
+{
+	int ttlMsFromLuaState = (int)luaL_checkinteger(L, 1);
+	int failTtlMsFromLuaState = (int)luaL_optinteger(L, 2, SKT_RESOLVER_FAIL_TTL_MS);
+	CSktResolver::Inst()->SetTTL(ttlMsFromLuaState, failTtlMsFromLuaState);
+	return 0;
+}
+// eng.socket.setSendWatermarks(highBytes, lowBytes [, highMsgs, lowMsgs [, socketName]])
+// OnSendQueueHigh(name, bytes, msgs) is called once the unsent bytes or messages reach a high mark,
+// OnSendQueueLow(name, bytes, msgs) once they are back under the low marks. 0 turns a pair off.
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS(lua_State *L)
+{
+	int highBytesFromLuaState = (int)luaL_checkinteger(L, 1);
+	int lowBytesFromLuaState = (int)luaL_checkinteger(L, 2);
+	int highMsgsFromLuaState = (int)luaL_optinteger(L, 3, 0);
+	int lowMsgsFromLuaState = (int)luaL_optinteger(L, 4, 0);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 5 ? GetSocketObjectByName(luaL_checkstring(L, 5)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	D_F_S->GetConnectionSocketManager()->SetSendWatermarks(highBytesFromLuaState, lowBytesFromLuaState, highMsgsFromLuaState, lowMsgsFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.sendQueueDepth([socketName]) -> { urgentMsgs, urgentBytes, normalMsgs, normalBytes,
+// bulkMsgs, bulkBytes, inflightMsgs, inflightBytes }, inflight is what already left the lanes
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH(lua_State *L)
+{
+	static const char* laneNames[SKT_LANE_COUNT][2] = {
+		{ "urgentMsgs", "urgentBytes" },
+		{ "normalMsgs", "normalBytes" },
+		{ "bulkMsgs", "bulkBytes" },
+	};
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	lua_createtable(L, 0, SKT_LANE_COUNT * 2 + 2);
+	if (!D_F_S)
+		return 1;
+	CSocketConnectionManager* mgr = D_F_S->GetConnectionSocketManager();
+	int msgs = 0;
+	int bytes = 0;
+	for (int lane = 0; lane < SKT_LANE_COUNT; lane++)
+	{
+		mgr->GetSendLaneDepth(lane, msgs, bytes);
+		lua_pushinteger(L, msgs);
+		lua_setfield(L, -2, laneNames[lane][0]);
+		lua_pushinteger(L, bytes);
+		lua_setfield(L, -2, laneNames[lane][1]);
+	}
+	mgr->GetSendInflightDepth(msgs, bytes);
+	lua_pushinteger(L, msgs);
+	lua_setfield(L, -2, "inflightMsgs");
+	lua_pushinteger(L, bytes);
+	lua_setfield(L, -2, "inflightBytes");
+	return 1;
+}
+// eng.socket.getStats([socketName]) -> table of the SktConnStat counters, nil for an unknown socket.
+// dispatchHist[i] counts messages that waited [2^(i-2), 2^(i-1)) us from arrival to lua, [1] is under 1us
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS(lua_State *L)
+{
+	SktConnStat statOfSocket;
+	if (!GetSocketStatsByName(lua_gettop(L) >= 1 ? luaL_checkstring(L, 1) : "defaultSocket", statOfSocket))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_createtable(L, 0, 14);
+	lua_pushnumber(L, (lua_Number)statOfSocket.bytesSent);
+	lua_setfield(L, -2, "bytesSent");
+	lua_pushnumber(L, (lua_Number)statOfSocket.bytesRecv);
+	lua_setfield(L, -2, "bytesRecv");
+	lua_pushnumber(L, (lua_Number)statOfSocket.framesSent);
+	lua_setfield(L, -2, "framesSent");
+	lua_pushnumber(L, (lua_Number)statOfSocket.framesRecv);
+	lua_setfield(L, -2, "framesRecv");
+	lua_pushnumber(L, (lua_Number)statOfSocket.sendCalls);
+	lua_setfield(L, -2, "sendCalls");
+	lua_pushnumber(L, (lua_Number)statOfSocket.recvCalls);
+	lua_setfield(L, -2, "recvCalls");
+	lua_pushnumber(L, (lua_Number)statOfSocket.pollCalls);
+	lua_setfield(L, -2, "pollCalls");
+	lua_pushnumber(L, (lua_Number)statOfSocket.partialWrites);
+	lua_setfield(L, -2, "partialWrites");
+	lua_pushnumber(L, (lua_Number)statOfSocket.poolAllocs);
+	lua_setfield(L, -2, "poolAllocs");
+	lua_pushinteger(L, statOfSocket.sendQueueDepth);
+	lua_setfield(L, -2, "sendQueueDepth");
+	lua_pushinteger(L, statOfSocket.sendQueueMax);
+	lua_setfield(L, -2, "sendQueueMax");
+	lua_pushinteger(L, statOfSocket.recvQueueDepth);
+	lua_setfield(L, -2, "recvQueueDepth");
+	lua_pushinteger(L, statOfSocket.recvQueueMax);
+	lua_setfield(L, -2, "recvQueueMax");
+	lua_createtable(L, SKT_STAT_HIST_BUCKETS, 0);
+	for (int i = 0; i < SKT_STAT_HIST_BUCKETS; i++)
+	{
+		lua_pushnumber(L, (lua_Number)statOfSocket.dispatchHist[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setfield(L, -2, "dispatchHist");
+	return 1;
+}
+// eng.socket.startCapture(path [, socketName]) records the plain frames every socket, or only
+// socketName, sends and receives from now on. a running capture is closed first
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE(lua_State *L)
+{
+	const char* pathFromLuaState = luaL_checkstring(L, 1);
+	const char* filterFromLuaState = luaL_optstring(L, 2, "");
+	lua_pushboolean(L, CSktCapture::Inst()->Start(pathFromLuaState, filterFromLuaState));
+	return 1;
+}
+// eng.socket.stopCapture() -> frames, bytes written by the capture
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE(lua_State *L)
+{
+	Int64 frames = 0;
+	Int64 bytes = 0;
+	CSktCapture::Inst()->Stop();
+	CSktCapture::Inst()->GetStat(frames, bytes);
+	lua_pushnumber(L, (lua_Number)frames);
+	lua_pushnumber(L, (lua_Number)bytes);
+	return 2;
+}
+// eng.socket.startReplay(path [, realtime [, socketName [, sourceName]]])
+// closes the socket and feeds it the frames sourceName, by default the socket itself, received
+// in the capture. realtime keeps the captured gaps, false replays as fast as lua drains them.
+// OnConnectToServer is called as for a real connect, sends are dropped until stopReplay
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY(lua_State *L)
+{
+	const char* pathFromLuaState = luaL_checkstring(L, 1);
+	bool realtimeFromLuaState = lua_isnoneornil(L, 2) ? true : lua_toboolean(L, 2) != 0;
+	S_O_TCP* D_F_S = lua_gettop(L) >= 3 ? GetSocketObjectByName(luaL_checkstring(L, 3)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	std::string sourceFromLuaState = lua_isnoneornil(L, 4) ? D_F_S->getSocketName() : luaL_checkstring(L, 4);
+	lua_pushboolean(L, D_F_S->GetConnectionSocketManager()->StartReplay(pathFromLuaState, realtimeFromLuaState, sourceFromLuaState.c_str()));
+	return 1;
+}
+// eng.socket.stopReplay([socketName]) leaves the socket disconnected
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	if (D_F_S && D_F_S->GetConnectionSocketManager()->IsReplaying())
+		D_F_S->GetConnectionSocketManager()->StopReplay();
+	return 0;
+}
+// eng.socket.replayDone([socketName]) -> true once every frame of the replay is in the message cache
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	lua_pushboolean(L, D_F_S && D_F_S->GetConnectionSocketManager()->IsReplayDone());
+	return 1;
+}
+// eng.socket.setTransport("tcp"|"udp" [, socketName]) picks the transport of the next connect.
+// udp runs the reliable datagram protocol of SktArq, CLMData:SendMsg and the message cache
+// work the same on both, CLMData:SendUnreliable only skips the resends on udp
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT(lua_State *L)
+{
+	std::string transportFromLuaState = luaL_checkstring(L, 1);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S || (transportFromLuaState != "tcp" && transportFromLuaState != "udp"))
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	D_F_S->GetConnectionSocketManager()->SetTransport(transportFromLuaState == "udp" ? SKT_TRANSPORT_UDP : SKT_TRANSPORT_TCP);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.setArqConfig({ mtu, interval, minRto, fastResend, sndWnd, rcvWnd, nodelay, deadLink } [, socketName])
+// missing fields keep their value, times are ms. a live udp link takes it right away
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	SktArqConfig arqConfigFromLuaState = D_F_S->GetConnectionSocketManager()->GetArqConfig();
+	struct { const char* name; int* value; } intFields[] = {
+		{ "mtu", &arqConfigFromLuaState.mtu },
+		{ "interval", &arqConfigFromLuaState.interval },
+		{ "minRto", &arqConfigFromLuaState.minRto },
+		{ "fastResend", &arqConfigFromLuaState.fastResend },
+		{ "sndWnd", &arqConfigFromLuaState.sndWnd },
+		{ "rcvWnd", &arqConfigFromLuaState.rcvWnd },
+		{ "deadLink", &arqConfigFromLuaState.deadLink },
+	};
+	for (size_t i = 0; i < sizeof(intFields) / sizeof(intFields[0]); i++)
+	{
+		lua_getfield(L, 1, intFields[i].name);
+		if (!lua_isnil(L, -1))
+			*intFields[i].value = (int)luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	lua_getfield(L, 1, "nodelay");
+	if (!lua_isnil(L, -1))
+		arqConfigFromLuaState.nodelay = lua_toboolean(L, -1) != 0;
+	lua_pop(L, 1);
+	D_F_S->GetConnectionSocketManager()->SetArqConfig(arqConfigFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.arqStats([socketName]) -> { datagramsOut, datagramsIn, segmentsOut, segmentsIn, retransmits,
+// fastRetransmits, duplicates, unreliableDropped, srtt, rto }, nil unless the socket is on a udp link
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	SktArqStat statOfArq;
+	if (!D_F_S || !D_F_S->GetConnectionSocketManager()->GetArqStat(statOfArq))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_createtable(L, 0, 10);
+	lua_pushnumber(L, (lua_Number)statOfArq.datagramsOut);
+	lua_setfield(L, -2, "datagramsOut");
+	lua_pushnumber(L, (lua_Number)statOfArq.datagramsIn);
+	lua_setfield(L, -2, "datagramsIn");
+	lua_pushnumber(L, (lua_Number)statOfArq.segmentsOut);
+	lua_setfield(L, -2, "segmentsOut");
+	lua_pushnumber(L, (lua_Number)statOfArq.segmentsIn);
+	lua_setfield(L, -2, "segmentsIn");
+	lua_pushnumber(L, (lua_Number)statOfArq.retransmits);
+	lua_setfield(L, -2, "retransmits");
+	lua_pushnumber(L, (lua_Number)statOfArq.fastRetransmits);
+	lua_setfield(L, -2, "fastRetransmits");
+	lua_pushnumber(L, (lua_Number)statOfArq.duplicates);
+	lua_setfield(L, -2, "duplicates");
+	lua_pushnumber(L, (lua_Number)statOfArq.unreliableDropped);
+	lua_setfield(L, -2, "unreliableDropped");
+	lua_pushinteger(L, statOfArq.srtt);
+	lua_setfield(L, -2, "srtt");
+	lua_pushinteger(L, statOfArq.rto);
+	lua_setfield(L, -2, "rto");
+	return 1;
+}
+// eng.socket.setProbe({ interval, timeout, window, request, reply, rttHighUs, rttLowUs } [, socketName])
+// request and reply are the frame prefixes the server knows probes by, times are ms but the
+// thresholds us. OnLatencyHigh fires once the rtt reaches rttHighUs, OnLatencyLow once it is back
+// at rttLowUs. nil instead of the table stops probing
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	if (lua_isnoneornil(L, 1))
+	{
+		D_F_S->GetConnectionSocketManager()->StopProbe();
+		lua_pushboolean(L, true);
+		return 1;
+	}
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int intervalFromLuaState = SKT_PROBE_INTERVAL_MS;
+	int timeoutFromLuaState = SKT_PROBE_TIMEOUT_MS;
+	int windowFromLuaState = SKT_PROBE_WINDOW_MS;
+	int highFromLuaState = 0;
+	int lowFromLuaState = 0;
+	struct { const char* name; int* value; } intFields[] = {
+		{ "interval", &intervalFromLuaState },
+		{ "timeout", &timeoutFromLuaState },
+		{ "window", &windowFromLuaState },
+		{ "rttHighUs", &highFromLuaState },
+		{ "rttLowUs", &lowFromLuaState },
+	};
+	for (size_t i = 0; i < sizeof(intFields) / sizeof(intFields[0]); i++)
+	{
+		lua_getfield(L, 1, intFields[i].name);
+		if (!lua_isnil(L, -1))
+			*intFields[i].value = (int)luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	size_t len = 0;
+	lua_getfield(L, 1, "request");
+	const char* request = luaL_checklstring(L, -1, &len);
+	std::string requestFromLuaState(request, len);
+	lua_pop(L, 1);
+	lua_getfield(L, 1, "reply");
+	const char* reply = luaL_checklstring(L, -1, &len);
+	std::string replyFromLuaState(reply, len);
+	lua_pop(L, 1);
+	CSocketConnectionManager* manager = D_F_S->GetConnectionSocketManager();
+	if (!manager->SetProbe(intervalFromLuaState, timeoutFromLuaState, windowFromLuaState, requestFromLuaState, replyFromLuaState))
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	manager->SetProbeThresholds(highFromLuaState, lowFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// eng.socket.probeStats([socketName]) -> { sent, received, lost, outstanding, lastRttUs, srttUs,
+// jitterUs, minRttUs [, offsetUs] }, offsetUs once a reply carried the server times. nil unless probing
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	if (!D_F_S || !D_F_S->GetConnectionSocketManager()->IsProbing())
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	const SktProbeStat& statOfProbe = D_F_S->GetConnectionSocketManager()->GetProbeStat();
+	lua_createtable(L, 0, 9);
+	lua_pushnumber(L, (lua_Number)statOfProbe.sent);
+	lua_setfield(L, -2, "sent");
+	lua_pushnumber(L, (lua_Number)statOfProbe.received);
+	lua_setfield(L, -2, "received");
+	lua_pushnumber(L, (lua_Number)statOfProbe.lost);
+	lua_setfield(L, -2, "lost");
+	lua_pushinteger(L, statOfProbe.outstanding);
+	lua_setfield(L, -2, "outstanding");
+	lua_pushnumber(L, (lua_Number)statOfProbe.lastRttUs);
+	lua_setfield(L, -2, "lastRttUs");
+	lua_pushnumber(L, (lua_Number)statOfProbe.srttUs);
+	lua_setfield(L, -2, "srttUs");
+	lua_pushnumber(L, (lua_Number)statOfProbe.jitterUs);
+	lua_setfield(L, -2, "jitterUs");
+	lua_pushnumber(L, (lua_Number)statOfProbe.minRttUs);
+	lua_setfield(L, -2, "minRttUs");
+	if (statOfProbe.hasOffset)
+	{
+		lua_pushnumber(L, (lua_Number)statOfProbe.offsetUs);
+		lua_setfield(L, -2, "offsetUs");
+	}
+	return 1;
+}
+// eng.socket.serverTimeUs([socketName]) -> the server clock now as estimated from the probes,
+// nil until a reply carried the server times
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US(lua_State *L)
+{
+	S_O_TCP* D_F_S = lua_gettop(L) >= 1 ? GetSocketObjectByName(luaL_checkstring(L, 1)) : GetSocketObjectByDefaultName();
+	if (!D_F_S || !D_F_S->GetConnectionSocketManager()->IsProbing()
+		|| !D_F_S->GetConnectionSocketManager()->GetProbeStat().hasOffset)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushnumber(L, (lua_Number)(SktStatNowUs() + D_F_S->GetConnectionSocketManager()->GetProbeStat().offsetUs));
+	return 1;
+}
+// eng.socket.setStreaming(threshold [, socketName])
+// uncompressed frames with more than threshold payload bytes are not assembled, their payload goes
+// to OnStreamChunk(name, data, offset, total) piece by piece as it is read, at most 64K at a time.
+// offset 0 starts a frame, offset + #data == total ends it. threshold < 0 turns it off, it takes
+// effect on the next connect
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING(lua_State *L)
+{
+	int thresholdFromLuaState = (int)luaL_checkinteger(L, 1);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	D_F_S->GetConnectionSocketManager()->SetStreamThreshold(thresholdFromLuaState);
+	lua_pushboolean(L, true);
+	return 1;
+}
+// the async calls below only work inside a coroutine. when they cannot answer at once they park
+// it, eng.socket.update resumes it with the results once its event happened
+// eng.socket.connectAsync(addr, port [, socketName]) -> true | false, netState
+// the connect timeout of the manager applies
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC(lua_State *L)
+{
+	const char* pAddrFromLuaState = luaL_checkstring(L, 1);
+	int portofSocketFromLuaState = (int)luaL_checkinteger(L, 2);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 3 ? GetSocketObjectByName(luaL_checkstring(L, 3)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushboolean(L, false);
+		lua_pushinteger(L, NetConState_ConnectError);
+		return 2;
+	}
+	CSocketConnectionManager* mgr = D_F_S->GetConnectionSocketManager();
+	if (!mgr->ConnectToAddrPort(portofSocketFromLuaState, pAddrFromLuaState) && mgr->GetStateOfNet() != NetConState_Connecting)
+	{
+		lua_pushboolean(L, false);
+		lua_pushinteger(L, mgr->GetStateOfNet());
+		return 2;
+	}
+	if (mgr->GetStateOfNet() == NetConState_Connected)
+	{
+		lua_pushboolean(L, true);
+		return 1;
+	}
+	if (!mgr->GetAsync()->Park(L, SKT_ASYNC_CONNECT, 0))
+		return luaL_error(L, "connectAsync must be called from a coroutine");
+	return luaS_yield(L, 0);
+}
+// eng.socket.recvAsync([timeoutMs [, socketName]]) -> CLMData | nil, "timeout" | "closed"
+// timeoutMs <= 0 waits until a message comes or the connection goes down
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC(lua_State *L)
+{
+	int timeoutFromLuaState = (int)luaL_optinteger(L, 1, 0);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S)
+	{
+		lua_pushnil(L);
+		lua_pushstring(L, "closed");
+		return 2;
+	}
+	CSocketConnectionManager* mgr = D_F_S->GetConnectionSocketManager();
+	// earlier waiters go first, a message only skips the queue when nobody waits
+	if (!mgr->GetAsync()->HasWaiters() && mgr->GetCachedMsgCount() > 0 && !mgr->IsStreamPieceNext())
+	{
+		CLMData* msgObjectOfLua = new CLMData(CLMData::className);
+		msgObjectOfLua->AttachNTMSG(mgr->PopMsgFromCache());
+		lua::LuaPlus<CLMData>::push(L, msgObjectOfLua, true, CLMData::className);
+		return 1;
+	}
+	if (!mgr->GetAsync()->Park(L, SKT_ASYNC_RECV, timeoutFromLuaState))
+		return luaL_error(L, "recvAsync must be called from a coroutine");
+	return luaS_yield(L, 0);
+}
+// eng.socket.flushAsync([timeoutMs [, socketName]]) -> true | false, "timeout" | "closed"
+// true once everything queued for sending has left, over udp once the peer acked it
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC(lua_State *L)
+{
+	int timeoutFromLuaState = (int)luaL_optinteger(L, 1, 0);
+	S_O_TCP* D_F_S = lua_gettop(L) >= 2 ? GetSocketObjectByName(luaL_checkstring(L, 2)) : GetSocketObjectByDefaultName();
+	if (!D_F_S || D_F_S->GetConnectionSocketManager()->GetStateOfNet() != NetConState_Connected)
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "closed");
+		return 2;
+	}
+	CSocketConnectionManager* mgr = D_F_S->GetConnectionSocketManager();
+	if (mgr->IsSendDrained())
+	{
+		lua_pushboolean(L, true);
+		return 1;
+	}
+	if (!mgr->GetAsync()->Park(L, SKT_ASYNC_FLUSH, timeoutFromLuaState))
+		return luaL_error(L, "flushAsync must be called from a coroutine");
+	return luaS_yield(L, 0);
+}
 static const struct luaL_Reg emptyfunsforclean[] = {
     {NULL, NULL}
 };
@@ -108,6 +666,30 @@ static const struct luaL_Reg funsforregisterluainterface[] = {
 	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ENCRYPT_SEED_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ENCRYPT_SEED },
 	{ STATIC_FUNCTION_INTERFACE_TO_LUA_ENERATE_ENCRYPT_SECRET_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_ENERATE_ENCRYPT_SECRET },
 	{ STATIC_FUNCTION_INTERFACE_TO_LUA_RECONNECT_TO_SERVER_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_RECONNECT_TO_SERVER },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC },
+	{ STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC_STR, STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC },
     {NULL, NULL}
 };
 
@@ -117,6 +699,12 @@ int eng_lua_socket_register(lua_State *L) {
     luaL_newmetatable(L, SOCKET_NAMESPACE);
 	luaL_register(L, NULL, emptyfunsforclean);
 	luaL_register(L, SOCKET_NAMESPACE, funsforregisterluainterface);
+	lua_pushinteger(L, SKT_LANE_URGENT);
+	lua_setfield(L, -2, "LANE_URGENT");
+	lua_pushinteger(L, SKT_LANE_NORMAL);
+	lua_setfield(L, -2, "LANE_NORMAL");
+	lua_pushinteger(L, SKT_LANE_BULK);
+	lua_setfield(L, -2, "LANE_BULK");
     
     lua_pushvalue(L, -2);
 #ifdef DEBUG_ENG_SOCKET_OUT
@@ -135,7 +723,8 @@ S_O_TCP*GetSocketObjectByDefaultName()
 
 S_O_TCP * GetSocketObjectByName(const char * socketname)
 {	
-	for (std::set<S_O_TCP*>::iterator it = S_O_TCP::s_staticForMultSocketobjList.begin(); it != S_O_TCP::s_staticForMultSocketobjList.end(); ++it)
+	std::set<S_O_TCP*>& socketList = S_O_TCP::GetSocketList();
+	for (std::set<S_O_TCP*>::iterator it = socketList.begin(); it != socketList.end(); ++it)
 	{
 		if ((*it)->getSocketName().compare(socketname) == 0)
 		{
@@ -151,6 +740,16 @@ S_O_TCP * GetSocketObjectByName(const char * socketname)
 	return NULL;
 }
 
+// telemetry of one named socket for native callers, false when there is no such socket
+bool GetSocketStatsByName(const char * socketname, SktConnStat& stat)
+{
+	S_O_TCP* D_F_S = GetSocketObjectByName(socketname);
+	if (D_F_S == NULL)
+		return false;
+	D_F_S->GetConnectionSocketManager()->GetStats(stat);
+	return true;
+}
+
 CSocketConnectionManager*S_O_TCP::GetConnectionSocketManager()
 {
 	if (m_pointSocketConnectionMgr == NULL)
@@ -164,12 +763,36 @@ void S_O_TCP::RestartTheSocketObject()
 {
 	if (m_pointSocketConnectionMgr != NULL)
 	{
+		m_pointSocketConnectionMgr->GetAsync()->DropWaiters();
 		delete m_pointSocketConnectionMgr;
 	}
 	m_pointSocketConnectionMgr = new CSocketConnectionManager;
 	m_pointSocketConnectionMgr->SetNameOfSocketConnet(getSocketName().c_str());
 }
 std::set<S_O_TCP*> S_O_TCP::s_staticForMultSocketobjList;
+#ifdef WIN32
+static __declspec(thread) std::set<S_O_TCP*>* s_boundSocketList = NULL;
+#else
+static __thread std::set<S_O_TCP*>* s_boundSocketList = NULL;
+#endif
+std::set<S_O_TCP*>& S_O_TCP::GetSocketList()
+{
+	return s_boundSocketList != NULL ? *s_boundSocketList : s_staticForMultSocketobjList;
+}
+// NULL goes back to the process wide list
+void S_O_TCP::BindSocketList(std::set<S_O_TCP*>* socketList)
+{
+	s_boundSocketList = socketList;
+}
+void S_O_TCP::DropAsyncWaiters()
+{
+	std::set<S_O_TCP*>& socketList = GetSocketList();
+	for (std::set<S_O_TCP*>::iterator iter = socketList.begin(); iter != socketList.end(); ++iter)
+	{
+		if ((*iter)->m_pointSocketConnectionMgr != NULL)
+			(*iter)->m_pointSocketConnectionMgr->GetAsync()->DropWaiters();
+	}
+}
 int S_O_TCP::FUNCTION_INTERFACE_TO_LUA_CKECK_PENGDING_MESSAGE(lua_State *L)
 {	
 	NTMSG* pCurrentReadMsg = GetConnectionSocketManager()->getMsgFromCache();
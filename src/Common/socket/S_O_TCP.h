@@ -23,20 +23,23 @@ public:
 	S_O_TCP(const char* instClassName)
 	{	
 		m_pointSocketConnectionMgr = NULL;
-		s_staticForMultSocketobjList.insert(this);		
+		m_socketList = &GetSocketList();
+		m_socketList->insert(this);
 		m_socketObjectName = instClassName;
 	}
 	~S_O_TCP()
 	{
 		if (m_pointSocketConnectionMgr)
 		{
+			m_pointSocketConnectionMgr->GetAsync()->DropWaiters();
 			m_pointSocketConnectionMgr->CloseConnect();
 			m_pointSocketConnectionMgr->ClearCachedMsg();
 		}
-		s_staticForMultSocketobjList.erase(this);
+		m_socketList->erase(this);
 	}
 private:
 	CSocketConnectionManager * m_pointSocketConnectionMgr;
+	std::set<S_O_TCP*>* m_socketList;
 	std::string m_socketObjectName;
 	int a;
 	int b;
@@ -45,6 +48,13 @@ private:
 	double f;
 public:
 	static std::set<S_O_TCP*> s_staticForMultSocketobjList;
+	// sockets are created in and looked up by name from the list bound to the calling thread,
+	// s_staticForMultSocketobjList unless a host running several lua states binds one per state
+	static std::set<S_O_TCP*>& GetSocketList();
+	static void BindSocketList(std::set<S_O_TCP*>* socketList);
+	// coroutines parked on any socket of the list are dropped unresumed, call it before the
+	// lua state that parked them closes
+	static void DropAsyncWaiters();
 public:
 	CSocketConnectionManager * GetConnectionSocketManager();
 	void RestartTheSocketObject();
@@ -81,6 +91,7 @@ public:
 };
 extern S_O_TCP*GetSocketObjectByDefaultName();
 extern S_O_TCP*GetSocketObjectByName(const char * socketname);
+extern bool GetSocketStatsByName(const char * socketname, SktConnStat& stat);
 
 #define STATIC_FUNCTION_INTERFACE_TO_LUA_CONNEC_TO_SERVER ext_socket_static_con2Ser
 #define STATIC_FUNCTION_INTERFACE_TO_LUA_CONNEC_TO_SERVER_STR "connect"
@@ -106,11 +117,89 @@ extern S_O_TCP*GetSocketObjectByName(const char * socketname);
 #define STATIC_FUNCTION_INTERFACE_TO_LUA_ENERATE_ENCRYPT_SECRET generateSecret
 #define STATIC_FUNCTION_INTERFACE_TO_LUA_ENERATE_ENCRYPT_SECRET_STR "generateSecret"
 
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD setIOThread
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD_STR "setIOThread"
+
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS poolStats
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS_STR "poolStats"
+
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG setPoolConfig
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG_STR "setPoolConfig"
+
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION setCompression
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION_STR "setCompression"
+
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE drainMsg
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE_STR "drain"
+
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL setDnsTTL
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL_STR "setDnsTTL"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS setSendWatermarks
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS_STR "setSendWatermarks"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH sendQueueDepth
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH_STR "sendQueueDepth"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS getStats
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS_STR "getStats"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE startCapture
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE_STR "startCapture"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE stopCapture
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE_STR "stopCapture"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY startReplay
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY_STR "startReplay"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY stopReplay
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY_STR "stopReplay"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE replayDone
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE_STR "replayDone"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT setTransport
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT_STR "setTransport"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG setArqConfig
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG_STR "setArqConfig"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS arqStats
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS_STR "arqStats"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE setProbe
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE_STR "setProbe"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS probeStats
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS_STR "probeStats"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US serverTimeUs
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US_STR "serverTimeUs"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING setStreaming
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING_STR "setStreaming"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC connectAsync
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC_STR "connectAsync"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC recvAsync
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC_STR "recvAsync"
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC flushAsync
+#define STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC_STR "flushAsync"
+
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_CONNEC_TO_SERVER(lua_State *L);
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_RECONNECT_TO_SERVER(lua_State *L);
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_HAS_PENDING_MESSAGE(lua_State *L);
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_UPDATE_NET_MESSAGE(lua_State *L);
 static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ENCRYPT_SEED(lua_State *L);
 static int STATIC_FUNCTION_INTERFACE_TO_KEEP_SOCKET_ALIVED_INT(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_IO_THREAD(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_POOL_STATS(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_POOL_CONFIG(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_COMPRESSION(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_DRAIN_MESSAGE(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_DNS_TTL(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_SEND_WATERMARKS(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SEND_QUEUE_DEPTH(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_GET_STATS(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_START_CAPTURE(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_CAPTURE(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_START_REPLAY(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_STOP_REPLAY(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_REPLAY_DONE(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_TRANSPORT(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_ARQ_CONFIG(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_ARQ_STATS(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_PROBE(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_PROBE_STATS(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SERVER_TIME_US(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_SET_STREAMING(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_CONNECT_ASYNC(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_RECV_ASYNC(lua_State *L);
+static int STATIC_FUNCTION_INTERFACE_TO_LUA_FLUSH_ASYNC(lua_State *L);
 int eng_lua_socket_register(lua_State *L);
 #endif
\ No newline at end of file
@@ -0,0 +1,538 @@
+#include "stdafx.h"
+#include "SktArq.h"
+#include <string.h>
+
+// unreliable partials untouched this long are given up on
+#define SKT_ARQ_UNREL_TIMEOUT      (3000)
+
+static inline int TimeDiff(unsigned int later, unsigned int earlier)
+{
+	return (int)(later - earlier);
+}
+
+static inline void PutU16(std::vector<char>& buf, unsigned int v)
+{
+	buf.push_back((char)(v & 0xFF));
+	buf.push_back((char)((v >> 8) & 0xFF));
+}
+
+static inline void PutU32(std::vector<char>& buf, unsigned int v)
+{
+	for (int i = 0; i < 4; i++)
+		buf.push_back((char)((v >> (i * 8)) & 0xFF));
+}
+
+static inline unsigned int GetU16(const unsigned char* p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static inline unsigned int GetU32(const unsigned char* p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+CSktArq::CSktArq(unsigned int conv, SktArqOutput output, void* user)
+{
+	m_output = output;
+	m_user = user;
+	m_conv = conv;
+	m_current = 0;
+	m_dead = false;
+	m_sndUna = 0;
+	m_sndNxt = 0;
+	m_rcvNxt = 0;
+	m_srtt = 0;
+	m_rttvar = 0;
+	m_probeWait = 0;
+	m_probeTs = 0;
+	m_probeAsk = false;
+	m_probeTell = false;
+	m_rcvPartialSegs = 0;
+	m_rcvQueued = 0;
+	m_unrelId = 0;
+	memset(&m_stat, 0, sizeof(m_stat));
+	DefaultConfig(m_config);
+	m_rmtWnd = m_config.rcvWnd;
+	m_rto = 200;
+	SetConfig(m_config);
+}
+
+CSktArq::~CSktArq()
+{
+	for (size_t i = 0; i < m_sndQueue.size(); i++)
+		delete m_sndQueue[i];
+	for (size_t i = 0; i < m_sndBuf.size(); i++)
+		delete m_sndBuf[i];
+	for (size_t i = 0; i < m_unrelQueue.size(); i++)
+		delete m_unrelQueue[i];
+	for (std::map<unsigned int, Segment*>::iterator it = m_rcvBuf.begin(); it != m_rcvBuf.end(); ++it)
+		delete it->second;
+}
+
+void CSktArq::DefaultConfig(SktArqConfig& config)
+{
+	config.mtu = 1400;
+	config.interval = 10;
+	config.minRto = 30;
+	config.fastResend = 2;
+	config.sndWnd = 128;
+	config.rcvWnd = 256;
+	config.nodelay = true;
+	config.deadLink = 20;
+}
+
+void CSktArq::SetConfig(const SktArqConfig& config)
+{
+	m_config = config;
+	if (m_config.mtu < SKT_ARQ_MTU_MIN)
+		m_config.mtu = SKT_ARQ_MTU_MIN;
+	if (m_config.mtu > SKT_ARQ_MTU_MAX)
+		m_config.mtu = SKT_ARQ_MTU_MAX;
+	if (m_config.interval < 1)
+		m_config.interval = 1;
+	if (m_config.minRto < 1)
+		m_config.minRto = 1;
+	if (m_config.fastResend < 0)
+		m_config.fastResend = 0;
+	if (m_config.sndWnd < 1)
+		m_config.sndWnd = 1;
+	if (m_config.rcvWnd < 1)
+		m_config.rcvWnd = 1;
+	if (m_config.deadLink < 2)
+		m_config.deadLink = 2;
+	if (m_rto < m_config.minRto)
+		m_rto = m_config.minRto;
+	m_stat.rto = m_rto;
+}
+
+unsigned int CSktArq::PeekConv(const char* buf, int len)
+{
+	return len < SKT_ARQ_CONV_SIZE ? 0 : GetU32((const unsigned char*)buf);
+}
+
+// queues one message, <0 when it does not fit in 65535 fragments
+int CSktArq::Send(const char* buf, int len, bool reliable)
+{
+	if (len < 0)
+		return -1;
+	int mss = Mss();
+	int count = len <= mss ? 1 : (len + mss - 1) / mss;
+	if (count > 0xFFFF)
+		return -2;
+	unsigned int id = m_unrelId;
+	if (!reliable)
+		m_unrelId++;
+	for (int i = 0; i < count; i++)
+	{
+		int size = len - i * mss < mss ? len - i * mss : mss;
+		Segment* seg = new Segment();
+		seg->cmd = reliable ? SKT_ARQ_CMD_PUSH : SKT_ARQ_CMD_UNREL;
+		seg->frg = (unsigned short)(count - i - 1);
+		seg->sn = reliable ? 0 : id;
+		seg->ts = reliable ? 0 : (unsigned int)count;
+		seg->resendts = 0;
+		seg->rto = 0;
+		seg->fastack = 0;
+		seg->xmit = 0;
+		if (size > 0)
+			seg->data.assign(buf + i * mss, buf + i * mss + size);
+		if (reliable)
+			m_sndQueue.push_back(seg);
+		else
+			m_unrelQueue.push_back(seg);
+	}
+	return 0;
+}
+
+// feeds one datagram, <0 when it is not ours or malformed
+int CSktArq::Input(const char* buf, int len)
+{
+	if (len < SKT_ARQ_CONV_SIZE)
+		return -1;
+	const unsigned char* p = (const unsigned char*)buf;
+	if (GetU32(p) != m_conv)
+		return -1;
+	m_stat.datagramsIn++;
+	p += SKT_ARQ_CONV_SIZE;
+	int left = len - SKT_ARQ_CONV_SIZE;
+	bool gotAck = false;
+	unsigned int maxAck = 0;
+	while (left >= SKT_ARQ_SEG_HEAD)
+	{
+		unsigned char cmd = p[0];
+		unsigned short frg = (unsigned short)GetU16(p + 1);
+		unsigned int wnd = GetU16(p + 3);
+		unsigned int ts = GetU32(p + 5);
+		unsigned int sn = GetU32(p + 9);
+		unsigned int una = GetU32(p + 13);
+		int size = (int)GetU16(p + 17);
+		p += SKT_ARQ_SEG_HEAD;
+		left -= SKT_ARQ_SEG_HEAD;
+		if (size > left)
+			return -2;
+		if (cmd < SKT_ARQ_CMD_PUSH || cmd > SKT_ARQ_CMD_UNREL)
+			return -3;
+		m_stat.segmentsIn++;
+		m_rmtWnd = wnd;
+		ParseUna(una);
+		if (cmd == SKT_ARQ_CMD_ACK)
+		{
+			if (TimeDiff(m_current, ts) >= 0)
+				UpdateAck(TimeDiff(m_current, ts));
+			ParseAck(sn);
+			if (!gotAck || TimeDiff(sn, maxAck) > 0)
+				maxAck = sn;
+			gotAck = true;
+		}
+		else if (cmd == SKT_ARQ_CMD_PUSH)
+		{
+			if (TimeDiff(sn, m_rcvNxt + m_config.rcvWnd) < 0)
+			{
+				m_ackList.push_back(std::make_pair(sn, ts));
+				if (TimeDiff(sn, m_rcvNxt) >= 0)
+				{
+					Segment* seg = new Segment();
+					seg->cmd = cmd;
+					seg->frg = frg;
+					seg->sn = sn;
+					seg->ts = ts;
+					seg->resendts = 0;
+					seg->rto = 0;
+					seg->fastack = 0;
+					seg->xmit = 0;
+					if (size > 0)
+						seg->data.assign((const char*)p, (const char*)p + size);
+					ParseData(seg);
+				}
+				else
+				{
+					m_stat.duplicates++;
+				}
+			}
+		}
+		else if (cmd == SKT_ARQ_CMD_WASK)
+		{
+			m_probeTell = true;
+		}
+		else if (cmd == SKT_ARQ_CMD_UNREL)
+		{
+			ParseUnreliable(sn, frg, ts, (const char*)p, size);
+		}
+		p += size;
+		left -= size;
+	}
+	if (gotAck)
+	{
+		for (size_t i = 0; i < m_sndBuf.size(); i++)
+		{
+			if (TimeDiff(maxAck, m_sndBuf[i]->sn) <= 0)
+				break;
+			m_sndBuf[i]->fastack++;
+		}
+	}
+	return 0;
+}
+
+// Jacobson/Karels, the same smoothing TCP uses
+void CSktArq::UpdateAck(int rtt)
+{
+	if (m_srtt == 0)
+	{
+		m_srtt = rtt;
+		m_rttvar = rtt / 2;
+	}
+	else
+	{
+		int delta = rtt > m_srtt ? rtt - m_srtt : m_srtt - rtt;
+		m_rttvar = (3 * m_rttvar + delta) / 4;
+		m_srtt = (7 * m_srtt + rtt) / 8;
+		if (m_srtt < 1)
+			m_srtt = 1;
+	}
+	int slack = 4 * m_rttvar > 2 * m_config.interval ? 4 * m_rttvar : 2 * m_config.interval;
+	int rto = m_srtt + slack;
+	m_rto = rto < m_config.minRto ? m_config.minRto : (rto > SKT_ARQ_RTO_MAX ? SKT_ARQ_RTO_MAX : rto);
+	m_stat.srtt = m_srtt;
+	m_stat.rto = m_rto;
+}
+
+void CSktArq::ParseUna(unsigned int una)
+{
+	while (!m_sndBuf.empty() && TimeDiff(una, m_sndBuf.front()->sn) > 0)
+	{
+		delete m_sndBuf.front();
+		m_sndBuf.pop_front();
+	}
+	m_sndUna = m_sndBuf.empty() ? m_sndNxt : m_sndBuf.front()->sn;
+}
+
+void CSktArq::ParseAck(unsigned int sn)
+{
+	if (TimeDiff(sn, m_sndUna) < 0 || TimeDiff(sn, m_sndNxt) >= 0)
+		return;
+	for (std::deque<Segment*>::iterator it = m_sndBuf.begin(); it != m_sndBuf.end(); ++it)
+	{
+		if ((*it)->sn == sn)
+		{
+			delete *it;
+			m_sndBuf.erase(it);
+			break;
+		}
+		if (TimeDiff(sn, (*it)->sn) < 0)
+			break;
+	}
+	m_sndUna = m_sndBuf.empty() ? m_sndNxt : m_sndBuf.front()->sn;
+}
+
+void CSktArq::ParseData(Segment* seg)
+{
+	if (m_rcvBuf.find(seg->sn) != m_rcvBuf.end())
+	{
+		m_stat.duplicates++;
+		delete seg;
+		return;
+	}
+	m_rcvBuf[seg->sn] = seg;
+	MoveReady();
+}
+
+// takes the in order segments off the out of order buffer. a message is only counted
+// against the window once it is whole, so one larger than the window still gets through
+void CSktArq::MoveReady()
+{
+	while (m_rcvQueued < m_config.rcvWnd)
+	{
+		std::map<unsigned int, Segment*>::iterator it = m_rcvBuf.find(m_rcvNxt);
+		if (it == m_rcvBuf.end())
+			break;
+		Segment* seg = it->second;
+		m_rcvBuf.erase(it);
+		m_rcvNxt++;
+		m_rcvPartial.insert(m_rcvPartial.end(), seg->data.begin(), seg->data.end());
+		m_rcvPartialSegs++;
+		if (seg->frg == 0)
+		{
+			m_rcvMsgs.push_back(std::vector<char>());
+			m_rcvMsgs.back().swap(m_rcvPartial);
+			m_rcvMsgSegs.push_back(m_rcvPartialSegs);
+			m_rcvQueued += m_rcvPartialSegs;
+			m_rcvPartialSegs = 0;
+		}
+		delete seg;
+	}
+}
+
+void CSktArq::ParseUnreliable(unsigned int id, unsigned short frg, unsigned int count, const char* data, int len)
+{
+	if (count == 0 || count > 0xFFFF || frg >= count)
+		return;
+	if (count == 1)
+	{
+		m_unrelMsgs.push_back(std::vector<char>(data, data + len));
+		return;
+	}
+	std::map<unsigned int, Partial>::iterator it = m_unrelParts.find(id);
+	if (it == m_unrelParts.end())
+	{
+		if (m_unrelParts.size() >= SKT_ARQ_UNREL_PARTIALS)
+		{
+			std::map<unsigned int, Partial>::iterator oldest = m_unrelParts.begin();
+			for (std::map<unsigned int, Partial>::iterator i = m_unrelParts.begin(); i != m_unrelParts.end(); ++i)
+			{
+				if (TimeDiff(i->second.lastMs, oldest->second.lastMs) < 0)
+					oldest = i;
+			}
+			m_unrelParts.erase(oldest);
+			m_stat.unreliableDropped++;
+		}
+		Partial& part = m_unrelParts[id];
+		part.got = 0;
+		part.count = (int)count;
+		part.frags.resize(count);
+		part.have.assign(count, 0);
+		it = m_unrelParts.find(id);
+	}
+	Partial& part = it->second;
+	if (part.count != (int)count)
+		return;
+	part.lastMs = m_current;
+	int index = (int)count - 1 - frg;
+	if (part.have[index])
+		return;
+	part.have[index] = 1;
+	part.frags[index].assign(data, data + len);
+	if (++part.got < part.count)
+		return;
+	m_unrelMsgs.push_back(std::vector<char>());
+	std::vector<char>& msg = m_unrelMsgs.back();
+	for (int i = 0; i < part.count; i++)
+		msg.insert(msg.end(), part.frags[i].begin(), part.frags[i].end());
+	m_unrelParts.erase(it);
+}
+
+// the next whole message, unreliable ones first since they are the latency sensitive kind
+bool CSktArq::Recv(std::vector<char>& out, bool& reliable)
+{
+	if (!m_unrelMsgs.empty())
+	{
+		out.swap(m_unrelMsgs.front());
+		m_unrelMsgs.pop_front();
+		reliable = false;
+		return true;
+	}
+	if (m_rcvMsgs.empty())
+		return false;
+	bool wasFull = m_rcvQueued >= m_config.rcvWnd;
+	out.swap(m_rcvMsgs.front());
+	m_rcvMsgs.pop_front();
+	m_rcvQueued -= m_rcvMsgSegs.front();
+	m_rcvMsgSegs.pop_front();
+	MoveReady();
+	if (wasFull && m_rcvQueued < m_config.rcvWnd)
+		m_probeTell = true;
+	reliable = true;
+	return true;
+}
+
+int CSktArq::WndUnused() const
+{
+	int wnd = m_config.rcvWnd - m_rcvQueued;
+	return wnd < 0 ? 0 : (wnd > 0xFFFF ? 0xFFFF : wnd);
+}
+
+void CSktArq::PutSegment(unsigned char cmd, unsigned short frg, unsigned int ts, unsigned int sn, const char* data, int len)
+{
+	if (m_outBuf.size() > SKT_ARQ_CONV_SIZE && (int)m_outBuf.size() + SKT_ARQ_SEG_HEAD + len > m_config.mtu)
+		FlushOut();
+	if (m_outBuf.empty())
+		PutU32(m_outBuf, m_conv);
+	m_outBuf.push_back((char)cmd);
+	PutU16(m_outBuf, frg);
+	PutU16(m_outBuf, (unsigned int)WndUnused());
+	PutU32(m_outBuf, ts);
+	PutU32(m_outBuf, sn);
+	PutU32(m_outBuf, m_rcvNxt);
+	PutU16(m_outBuf, (unsigned int)len);
+	if (len > 0)
+		m_outBuf.insert(m_outBuf.end(), data, data + len);
+	m_stat.segmentsOut++;
+}
+
+void CSktArq::FlushOut()
+{
+	if (m_outBuf.size() > SKT_ARQ_CONV_SIZE)
+	{
+		m_output(&m_outBuf[0], (int)m_outBuf.size(), m_user);
+		m_stat.datagramsOut++;
+	}
+	m_outBuf.clear();
+}
+
+// sends the pending acks, new segments the windows allow and whatever is due again.
+// nowMs is any millisecond clock, call it every interval or right after Input for quicker acks
+void CSktArq::Update(unsigned int nowMs)
+{
+	m_current = nowMs;
+	for (std::map<unsigned int, Partial>::iterator it = m_unrelParts.begin(); it != m_unrelParts.end();)
+	{
+		if (TimeDiff(m_current, it->second.lastMs) > SKT_ARQ_UNREL_TIMEOUT)
+		{
+			m_unrelParts.erase(it++);
+			m_stat.unreliableDropped++;
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	for (size_t i = 0; i < m_ackList.size(); i++)
+		PutSegment(SKT_ARQ_CMD_ACK, 0, m_ackList[i].second, m_ackList[i].first, NULL, 0);
+	m_ackList.clear();
+
+	// a closed remote window is probed with growing gaps until it opens again
+	if (m_rmtWnd == 0)
+	{
+		if (m_probeWait == 0)
+		{
+			m_probeWait = SKT_ARQ_PROBE_MIN;
+			m_probeTs = m_current + m_probeWait;
+		}
+		else if (TimeDiff(m_current, m_probeTs) >= 0)
+		{
+			m_probeWait += m_probeWait / 2;
+			if (m_probeWait > SKT_ARQ_PROBE_MAX)
+				m_probeWait = SKT_ARQ_PROBE_MAX;
+			m_probeTs = m_current + m_probeWait;
+			m_probeAsk = true;
+		}
+	}
+	else
+	{
+		m_probeWait = 0;
+		m_probeTs = 0;
+	}
+	if (m_probeAsk)
+		PutSegment(SKT_ARQ_CMD_WASK, 0, 0, 0, NULL, 0);
+	if (m_probeTell)
+		PutSegment(SKT_ARQ_CMD_WINS, 0, 0, 0, NULL, 0);
+	m_probeAsk = false;
+	m_probeTell = false;
+
+	unsigned int wnd = (unsigned int)m_config.sndWnd < m_rmtWnd ? (unsigned int)m_config.sndWnd : m_rmtWnd;
+	while (!m_sndQueue.empty() && TimeDiff(m_sndNxt, m_sndUna + wnd) < 0)
+	{
+		Segment* seg = m_sndQueue.front();
+		m_sndQueue.pop_front();
+		seg->sn = m_sndNxt++;
+		seg->xmit = 0;
+		m_sndBuf.push_back(seg);
+	}
+
+	unsigned int resent = m_config.fastResend > 0 ? (unsigned int)m_config.fastResend : 0xFFFFFFFFu;
+	unsigned int rtoSlack = m_config.nodelay ? 0 : (unsigned int)(m_rto >> 3);
+	for (size_t i = 0; i < m_sndBuf.size(); i++)
+	{
+		Segment* seg = m_sndBuf[i];
+		bool needSend = false;
+		if (seg->xmit == 0)
+		{
+			needSend = true;
+			seg->rto = m_rto;
+			seg->resendts = m_current + seg->rto + rtoSlack;
+		}
+		else if (TimeDiff(m_current, seg->resendts) >= 0)
+		{
+			needSend = true;
+			seg->rto += m_config.nodelay ? seg->rto / 2 : seg->rto;
+			if (seg->rto > SKT_ARQ_RTO_MAX)
+				seg->rto = SKT_ARQ_RTO_MAX;
+			seg->resendts = m_current + seg->rto;
+			m_stat.retransmits++;
+		}
+		else if (seg->fastack >= resent)
+		{
+			needSend = true;
+			seg->resendts = m_current + seg->rto;
+			m_stat.fastRetransmits++;
+		}
+		if (!needSend)
+			continue;
+		seg->xmit++;
+		seg->fastack = 0;
+		seg->ts = m_current;
+		PutSegment(SKT_ARQ_CMD_PUSH, seg->frg, seg->ts, seg->sn, seg->data.empty() ? NULL : &seg->data[0], (int)seg->data.size());
+		if (seg->xmit >= (unsigned int)m_config.deadLink)
+			m_dead = true;
+	}
+
+	while (!m_unrelQueue.empty())
+	{
+		Segment* seg = m_unrelQueue.front();
+		m_unrelQueue.pop_front();
+		PutSegment(SKT_ARQ_CMD_UNREL, seg->frg, seg->ts, seg->sn, seg->data.empty() ? NULL : &seg->data[0], (int)seg->data.size());
+		delete seg;
+	}
+	FlushOut();
+}
@@ -0,0 +1,144 @@
+#ifndef _SKTARQqowieurytpalskdj_reliableudp_lsll_H__
+#define _SKTARQqowieurytpalskdj_reliableudp_lsll_H__
+#include <vector>
+#include <deque>
+#include <map>
+#include "NTMSG.h"
+
+// datagram layout, integers are little endian
+//   u32 conv, then segments packed up to the mtu
+//   segment u8 cmd u16 frg u16 wnd u32 ts u32 sn u32 una u16 len data
+// frg counts the fragments still to come, 0 marks the last one of a message.
+// for SKT_ARQ_CMD_UNREL sn is the message id, ts the fragment count, and nothing is acked or resent
+#define SKT_ARQ_CMD_PUSH           (1)
+#define SKT_ARQ_CMD_ACK            (2)
+#define SKT_ARQ_CMD_WASK           (3)
+#define SKT_ARQ_CMD_WINS           (4)
+#define SKT_ARQ_CMD_UNREL          (5)
+#define SKT_ARQ_CONV_SIZE          (4)
+#define SKT_ARQ_SEG_HEAD           (19)
+#define SKT_ARQ_MTU_MIN            (64)
+#define SKT_ARQ_MTU_MAX            (65000)
+#define SKT_ARQ_RTO_MAX            (60000)
+#define SKT_ARQ_PROBE_MIN          (7000)
+#define SKT_ARQ_PROBE_MAX          (120000)
+// unreliable messages being reassembled at once, older ones are dropped
+#define SKT_ARQ_UNREL_PARTIALS     (8)
+
+// writes one datagram, returns <0 on error. the engine never touches a socket itself
+typedef int (*SktArqOutput)(const char* buf, int len, void* user);
+
+struct SktArqConfig
+{
+	int     mtu;            // datagram size the segments are packed into
+	int     interval;       // ms between updates, the rto slack is at least twice this
+	int     minRto;         // ms
+	int     fastResend;     // resend after this many later acks, 0 waits for the rto
+	int     sndWnd;         // segments in flight
+	int     rcvWnd;         // segments buffered out of order or unread
+	bool    nodelay;        // rto grows 1.5x per timeout instead of doubling
+	int     deadLink;       // a segment sent this many times marks the link dead
+};
+
+struct SktArqStat
+{
+	Int64   datagramsOut;
+	Int64   datagramsIn;
+	Int64   segmentsOut;
+	Int64   segmentsIn;
+	Int64   retransmits;        // on rto
+	Int64   fastRetransmits;    // on skipped acks
+	Int64   duplicates;         // pushes that had arrived before
+	Int64   unreliableDropped;  // partial unreliable messages given up on
+	int     srtt;               // ms
+	int     rto;                // ms
+};
+
+// selective repeat ARQ over an unreliable datagram link.
+// reliable messages arrive once and in order, each segment is acked on its own and
+// resent on its rto or early once later segments got acked. unreliable messages share the
+// datagrams but are sent once, and are delivered whole or not at all in arrival order.
+// not thread safe, the owner drives Input, Update and Recv from one thread.
+class CSktArq
+{
+public:
+	CSktArq(unsigned int conv, SktArqOutput output, void* user);
+	~CSktArq();
+	static void DefaultConfig(SktArqConfig& config);
+	void    SetConfig(const SktArqConfig& config);
+	const SktArqConfig& GetConfig() const { return m_config; }
+	int     Send(const char* buf, int len, bool reliable);
+	int     Input(const char* buf, int len);
+	void    Update(unsigned int nowMs);
+	bool    Recv(std::vector<char>& out, bool& reliable);
+	int     GetWaitSnd() const { return (int)(m_sndQueue.size() + m_sndBuf.size()); }
+	bool    IsDead() const { return m_dead; }
+	unsigned int GetConv() const { return m_conv; }
+	const SktArqStat& GetStat() const { return m_stat; }
+	static unsigned int PeekConv(const char* buf, int len);
+private:
+	struct Segment
+	{
+		unsigned int    sn;
+		unsigned int    ts;
+		unsigned int    resendts;
+		unsigned int    rto;
+		unsigned int    fastack;
+		unsigned int    xmit;
+		unsigned short  frg;
+		unsigned char   cmd;
+		std::vector<char> data;
+	};
+	struct Partial
+	{
+		unsigned int    lastMs;
+		int             got;
+		int             count;
+		std::vector< std::vector<char> > frags;
+		std::vector<char> have;
+	};
+	int     Mss() const { return m_config.mtu - SKT_ARQ_CONV_SIZE - SKT_ARQ_SEG_HEAD; }
+	int     WndUnused() const;
+	void    UpdateAck(int rtt);
+	void    ParseUna(unsigned int una);
+	void    ParseAck(unsigned int sn);
+	void    ParseData(Segment* seg);
+	void    ParseUnreliable(unsigned int id, unsigned short frg, unsigned int count, const char* data, int len);
+	void    MoveReady();
+	void    PutSegment(unsigned char cmd, unsigned short frg, unsigned int ts, unsigned int sn, const char* data, int len);
+	void    FlushOut();
+	SktArqConfig            m_config;
+	SktArqOutput            m_output;
+	void*                   m_user;
+	unsigned int            m_conv;
+	unsigned int            m_current;
+	bool                    m_dead;
+	unsigned int            m_sndUna;
+	unsigned int            m_sndNxt;
+	unsigned int            m_rcvNxt;
+	unsigned int            m_rmtWnd;
+	int                     m_srtt;
+	int                     m_rttvar;
+	int                     m_rto;
+	unsigned int            m_probeWait;
+	unsigned int            m_probeTs;
+	bool                    m_probeAsk;
+	bool                    m_probeTell;
+	std::deque<Segment*>    m_sndQueue;
+	std::deque<Segment*>    m_sndBuf;
+	std::map<unsigned int, Segment*> m_rcvBuf;
+	std::vector<char>       m_rcvPartial;
+	int                     m_rcvPartialSegs;
+	std::deque< std::vector<char> > m_rcvMsgs;
+	std::deque<int>         m_rcvMsgSegs;
+	int                     m_rcvQueued;
+	std::vector< std::pair<unsigned int, unsigned int> > m_ackList;
+	std::deque<Segment*>    m_unrelQueue;
+	unsigned int            m_unrelId;
+	std::map<unsigned int, Partial> m_unrelParts;
+	std::deque< std::vector<char> > m_unrelMsgs;
+	std::vector<char>       m_outBuf;
+	SktArqStat              m_stat;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "SktAsync.h"
+#include "SocketConnectionManager.h"
+#include "SktStat.h"
+#include "LMData.h"
+#include "lua.hpp"
+#include "Common/ENG_DBG.h"
+
+CSktAsync::CSktAsync()
+{
+	m_nextDeadlineUs = 0;
+	m_dropCount = 0;
+}
+
+// the lua states may be gone by now, the registry refs go with them. the waiters of a state
+// that closes while this lives on are taken out by DropWaiters first
+CSktAsync::~CSktAsync()
+{
+	m_waiters.clear();
+}
+
+bool CSktAsync::Park(lua_State* L, int kind, int timeoutMs)
+{
+	if (lua_pushthread(L) == 1)
+	{
+		lua_pop(L, 1);
+		return false;
+	}
+	Waiter waiter;
+	waiter.co = L;
+	waiter.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	waiter.kind = kind;
+	waiter.deadlineUs = timeoutMs > 0 ? SktStatNowUs() + timeoutMs * 1000LL : 0;
+	KeepDeadline(waiter);
+	m_waiters.push_back(waiter);
+	return true;
+}
+
+// a connect waits for the outcome, recv for a message and flush for every queued byte to leave,
+// all of them give up once the connection is down
+bool CSktAsync::IsReady(CSocketConnectionManager* mgr, const Waiter& waiter, bool hasMsg)
+{
+	int state = mgr->GetStateOfNet();
+	switch (waiter.kind)
+	{
+	case SKT_ASYNC_CONNECT:
+		return state != NetConState_Connecting;
+	case SKT_ASYNC_RECV:
+		return hasMsg || (state != NetConState_Connected && state != NetConState_Connecting);
+	case SKT_ASYNC_FLUSH:
+		return state != NetConState_Connected || mgr->IsSendDrained();
+	}
+	return true;
+}
+
+// connect  true | false, state
+// recv     CLMData | nil, "timeout" | "closed"
+// flush    true | false, "timeout" | "closed"
+int CSktAsync::PushResults(CSocketConnectionManager* mgr, const Waiter& waiter, bool timedOut)
+{
+	lua_State* co = waiter.co;
+	int state = mgr->GetStateOfNet();
+	switch (waiter.kind)
+	{
+	case SKT_ASYNC_CONNECT:
+		if (state == NetConState_Connected)
+		{
+			lua_pushboolean(co, true);
+			return 1;
+		}
+		lua_pushboolean(co, false);
+		lua_pushinteger(co, timedOut ? NetConState_ConnectTimeOut : state);
+		return 2;
+	case SKT_ASYNC_RECV:
+	{
+		NTMSG* msg = timedOut ? NULL : mgr->PopMsgFromCache();
+		if (msg == NULL)
+		{
+			lua_pushnil(co);
+			lua_pushstring(co, timedOut ? "timeout" : "closed");
+			return 2;
+		}
+		CLMData* data = new CLMData(CLMData::className);
+		data->AttachNTMSG(msg);
+		lua::LuaPlus<CLMData>::push(co, data, true, CLMData::className);
+		return 1;
+	}
+	case SKT_ASYNC_FLUSH:
+		if (!timedOut && state == NetConState_Connected)
+		{
+			lua_pushboolean(co, true);
+			return 1;
+		}
+		lua_pushboolean(co, false);
+		lua_pushstring(co, timedOut ? "timeout" : "closed");
+		return 2;
+	}
+	return 0;
+}
+
+void CSktAsync::Resume(const Waiter& waiter, int nargs)
+{
+	int status = lua_resume(waiter.co, nargs);
+	if (status != 0 && status != LUA_YIELD)
+	{
+		DBG_E("socket coroutine failed: %s \n", lua_isstring(waiter.co, -1) ? lua_tostring(waiter.co, -1) : "?");
+		lua_settop(waiter.co, 0);
+	}
+	luaL_unref(waiter.co, LUA_REGISTRYINDEX, waiter.ref);
+}
+
+// the coroutines are never resumed, resuming one into a closed state would touch freed memory
+void CSktAsync::DropWaiters()
+{
+	for (size_t i = 0; i < m_waiters.size(); i++)
+		luaL_unref(m_waiters[i].co, LUA_REGISTRYINDEX, m_waiters[i].ref);
+	m_waiters.clear();
+	m_nextDeadlineUs = 0;
+	m_dropCount++;
+}
+
+// waiters are woken in the order they parked, so recv waiters take the messages first come
+// first served. the clock is only read while a timeout can be due
+void CSktAsync::CheckWaiters(CSocketConnectionManager* mgr)
+{
+	Int64 nowUs = 0;
+	if (m_nextDeadlineUs != 0)
+	{
+		nowUs = SktStatNowUs();
+		if (nowUs < m_nextDeadlineUs)
+			nowUs = 0;
+	}
+	int msgs = mgr->GetCachedMsgCount();
+	std::vector<Waiter> wake;
+	std::vector<bool> timedOut;
+	m_nextDeadlineUs = 0;
+	size_t kept = 0;
+	for (size_t i = 0; i < m_waiters.size(); i++)
+	{
+		const Waiter& waiter = m_waiters[i];
+		bool hasMsg = msgs > 0;
+		bool expired = nowUs != 0 && waiter.deadlineUs != 0 && nowUs >= waiter.deadlineUs;
+		if (expired || IsReady(mgr, waiter, hasMsg))
+		{
+			if (waiter.kind == SKT_ASYNC_RECV && hasMsg && !expired)
+				msgs--;
+			wake.push_back(waiter);
+			timedOut.push_back(expired);
+			continue;
+		}
+		KeepDeadline(waiter);
+		m_waiters[kept++] = waiter;
+	}
+	m_waiters.resize(kept);
+	unsigned int dropCount = m_dropCount;
+	for (size_t i = 0; i < wake.size(); i++)
+	{
+		if (m_dropCount != dropCount)
+		{
+			luaL_unref(wake[i].co, LUA_REGISTRYINDEX, wake[i].ref);
+			continue;
+		}
+		// a coroutine resumed before may have taken the message this one was counted on,
+		// or the queue held only stream pieces. it waits on then
+		int state = mgr->GetStateOfNet();
+		if (wake[i].kind == SKT_ASYNC_RECV && !timedOut[i] && mgr->GetCachedMsgCount() == 0
+			&& (state == NetConState_Connected || state == NetConState_Connecting))
+		{
+			KeepDeadline(wake[i]);
+			m_waiters.push_back(wake[i]);
+			continue;
+		}
+		Resume(wake[i], PushResults(mgr, wake[i], timedOut[i]));
+	}
+}
+
+void CSktAsync::KeepDeadline(const Waiter& waiter)
+{
+	if (waiter.deadlineUs != 0 && (m_nextDeadlineUs == 0 || waiter.deadlineUs < m_nextDeadlineUs))
+		m_nextDeadlineUs = waiter.deadlineUs;
+}
@@ -0,0 +1,46 @@
+#ifndef _SKTASYNCzmxncbvqpwoeiru_coroutines_lsll_H__
+#define _SKTASYNCzmxncbvqpwoeiru_coroutines_lsll_H__
+#include <vector>
+#include "NTMSG.h"
+
+struct lua_State;
+class CSocketConnectionManager;
+
+#define SKT_ASYNC_CONNECT          (0)
+#define SKT_ASYNC_RECV             (1)
+#define SKT_ASYNC_FLUSH            (2)
+
+// coroutines parked on one connection by eng.socket.connectAsync, recvAsync and flushAsync.
+// the manager asks CheckWaiters after each Update while any are parked, a waiter is resumed
+// from C with its results once its event happened, its timeout ran out or the connection went
+// down. with nothing parked the manager never gets here.
+class CSktAsync
+{
+public:
+	CSktAsync();
+	~CSktAsync();
+	// false when L is not a coroutine, the caller returns lua_yield right after a true
+	bool    Park(lua_State* L, int kind, int timeoutMs);
+	bool    HasWaiters() const { return !m_waiters.empty(); }
+	void    CheckWaiters(CSocketConnectionManager* mgr);
+	// for the lua state that parked them going away, while it is still there
+	void    DropWaiters();
+	int     GetWaiterCount() const { return (int)m_waiters.size(); }
+private:
+	struct Waiter
+	{
+		lua_State*  co;
+		int         ref;
+		int         kind;
+		Int64       deadlineUs;     // 0 waits without a timeout
+	};
+	int     PushResults(CSocketConnectionManager* mgr, const Waiter& waiter, bool timedOut);
+	bool    IsReady(CSocketConnectionManager* mgr, const Waiter& waiter, bool hasMsg);
+	void    Resume(const Waiter& waiter, int nargs);
+	void    KeepDeadline(const Waiter& waiter);
+	std::vector<Waiter>     m_waiters;
+	Int64                   m_nextDeadlineUs;
+	unsigned int            m_dropCount;    // a resumed coroutine may drop the waiters being woken
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "stdafx.h"
+#include "SktCapture.h"
+#include <string.h>
+#include <chrono>
+#include "SktStat.h"
+#include "Common/ENG_DBG.h"
+
+static const char s_captureMagic[6] = { 'S', 'K', 'T', 'C', 'A', 'P' };
+
+CSktCapture* CSktCapture::Inst()
+{
+	static CSktCapture capture;
+	return &capture;
+}
+
+CSktCapture::CSktCapture()
+{
+	m_on = false;
+	m_file = NULL;
+	m_lastUs = 0;
+	m_frames = 0;
+	m_bytes = 0;
+}
+
+CSktCapture::~CSktCapture()
+{
+	Stop();
+}
+
+bool CSktCapture::Start(const char* path, const char* filter)
+{
+	Stop();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = fopen(path, "wb");
+	if (m_file == NULL)
+	{
+		DBG_E("can not open capture file %s \n", path);
+		return false;
+	}
+	setvbuf(m_file, NULL, _IOFBF, 256 * 1024);
+	unsigned char head[16];
+	memcpy(head, s_captureMagic, sizeof(s_captureMagic));
+	head[6] = SKT_CAPTURE_VERSION;
+	head[7] = 0;
+	unsigned long long wallUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	for (int i = 0; i < 8; i++)
+		head[8 + i] = (unsigned char)(wallUs >> (i * 8));
+	fwrite(head, 1, sizeof(head), m_file);
+	m_filter = filter != NULL ? filter : "";
+	m_names.clear();
+	m_lastUs = SktStatNowUs();
+	m_frames = 0;
+	m_bytes = 0;
+	m_on = true;
+	return true;
+}
+
+void CSktCapture::Stop()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_on = false;
+	if (m_file != NULL)
+	{
+		fclose(m_file);
+		m_file = NULL;
+	}
+}
+
+void CSktCapture::GetStat(Int64& frames, Int64& bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	frames = m_frames;
+	bytes = m_bytes;
+}
+
+// -1 once the name table is full
+int CSktCapture::NameId(const std::string& socketName)
+{
+	for (size_t i = 0; i < m_names.size(); i++)
+	{
+		if (m_names[i] == socketName)
+			return (int)i;
+	}
+	if (m_names.size() >= SKT_CAPTURE_MAX_NAMES)
+		return -1;
+	int id = (int)m_names.size();
+	m_names.push_back(socketName);
+	size_t len = socketName.size() > 255 ? 255 : socketName.size();
+	unsigned char head[3] = { SKT_CAPTURE_NAME, (unsigned char)id, (unsigned char)len };
+	fwrite(head, 1, sizeof(head), m_file);
+	fwrite(socketName.data(), 1, len, m_file);
+	return id;
+}
+
+void CSktCapture::PutVarint(unsigned long long v)
+{
+	unsigned char buf[10];
+	int n = 0;
+	while (v >= 0x80)
+	{
+		buf[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (unsigned char)v;
+	fwrite(buf, 1, n, m_file);
+}
+
+void CSktCapture::Record(int dir, const std::string& socketName, const char* payload, int size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_file == NULL || size < 0)
+		return;
+	if (!m_filter.empty() && m_filter != socketName)
+		return;
+	int id = NameId(socketName);
+	if (id < 0)
+		return;
+	Int64 nowUs = SktStatNowUs();
+	Int64 deltaUs = nowUs > m_lastUs ? nowUs - m_lastUs : 0;
+	m_lastUs = nowUs;
+	unsigned char head[2] = { (unsigned char)dir, (unsigned char)id };
+	fwrite(head, 1, sizeof(head), m_file);
+	PutVarint((unsigned long long)deltaUs);
+	PutVarint((unsigned long long)size);
+	fwrite(payload, 1, size, m_file);
+	m_frames++;
+	m_bytes += size;
+}
+
+CSktReplay::CSktReplay()
+{
+	m_file = NULL;
+	m_realtime = false;
+	m_done = true;
+	m_recordUs = 0;
+	m_firstUs = -1;
+	m_startUs = -1;
+	m_hasPending = false;
+	m_pendingUs = 0;
+	m_frames = 0;
+}
+
+CSktReplay::~CSktReplay()
+{
+	Close();
+}
+
+bool CSktReplay::Open(const char* path, const char* sourceName, bool realtime)
+{
+	Close();
+	m_file = fopen(path, "rb");
+	if (m_file == NULL)
+	{
+		DBG_E("can not open capture file %s \n", path);
+		return false;
+	}
+	setvbuf(m_file, NULL, _IOFBF, 256 * 1024);
+	unsigned char head[16];
+	if (fread(head, 1, sizeof(head), m_file) != sizeof(head)
+		|| memcmp(head, s_captureMagic, sizeof(s_captureMagic)) != 0
+		|| head[6] != SKT_CAPTURE_VERSION)
+	{
+		DBG_E("%s is not a socket capture file \n", path);
+		Close();
+		return false;
+	}
+	m_source = sourceName != NULL ? sourceName : "";
+	m_realtime = realtime;
+	m_done = false;
+	m_names.clear();
+	m_recordUs = 0;
+	m_firstUs = -1;
+	m_startUs = -1;
+	m_hasPending = false;
+	m_frames = 0;
+	return true;
+}
+
+void CSktReplay::Close()
+{
+	if (m_file != NULL)
+	{
+		fclose(m_file);
+		m_file = NULL;
+	}
+	m_hasPending = false;
+	m_done = true;
+}
+
+bool CSktReplay::GetVarint(unsigned long long& v)
+{
+	v = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int c = fgetc(m_file);
+		if (c == EOF)
+			return false;
+		v |= (unsigned long long)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+// reads up to the next inbound frame of the source socket, false at the end of the file.
+// a truncated last record, as left by a crash while capturing, ends the replay quietly
+bool CSktReplay::ReadPending()
+{
+	for (;;)
+	{
+		int kind = fgetc(m_file);
+		int id = fgetc(m_file);
+		if (kind == EOF || id == EOF)
+			return false;
+		if (kind == SKT_CAPTURE_NAME)
+		{
+			int len = fgetc(m_file);
+			if (len == EOF)
+				return false;
+			std::string name(len, '\0');
+			if (len > 0 && fread(&name[0], 1, len, m_file) != (size_t)len)
+				return false;
+			if ((int)m_names.size() <= id)
+				m_names.resize(id + 1);
+			m_names[id] = name;
+			continue;
+		}
+		unsigned long long deltaUs = 0;
+		unsigned long long size = 0;
+		if (!GetVarint(deltaUs) || !GetVarint(size) || size > 0x7FFFFFFFu)
+			return false;
+		m_recordUs += (Int64)deltaUs;
+		bool wanted = kind == SKT_CAPTURE_IN
+			&& (m_source.empty() || (id < (int)m_names.size() && m_names[id] == m_source));
+		if (!wanted)
+		{
+			if (fseek(m_file, (long)size, SEEK_CUR) != 0)
+				return false;
+			continue;
+		}
+		m_pending.resize((size_t)size);
+		if (size > 0 && fread(&m_pending[0], 1, (size_t)size, m_file) != size)
+			return false;
+		m_pendingUs = m_recordUs;
+		return true;
+	}
+}
+
+// the next due frame or NULL, the frame is owned by the caller
+NTMSG* CSktReplay::Next(Int64 nowUs)
+{
+	if (m_done)
+		return NULL;
+	if (!m_hasPending)
+	{
+		if (!ReadPending())
+		{
+			Close();
+			return NULL;
+		}
+		m_hasPending = true;
+	}
+	if (m_firstUs < 0)
+	{
+		m_firstUs = m_pendingUs;
+		m_startUs = nowUs;
+	}
+	if (m_realtime && m_pendingUs - m_firstUs > nowUs - m_startUs)
+		return NULL;
+	int size = (int)m_pending.size();
+	NTMSG* msg = new NTMSG(2 + size);
+	msg->NTMSG_initRecvFrame(2, size, false);
+	if (size > 0)
+		memcpy(msg->NTMSG_getReadBufFr(), &m_pending[0], size);
+	msg->NTMSG_CallWhileReceive(size);
+	msg->NTMSG_setArrival(nowUs);
+	m_hasPending = false;
+	m_frames++;
+	return msg;
+}
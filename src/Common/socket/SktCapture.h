@@ -0,0 +1,79 @@
+#ifndef _SKTCAPTUREmznxbcvlaksjd_capreplay_lsll_H__
+#define _SKTCAPTUREmznxbcvlaksjd_capreplay_lsll_H__
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "NTMSG.h"
+
+// capture file layout, integers are little endian, varints are 7 bits per byte low first
+//   header  "SKTCAP" u8 version u8 0 u64 wall clock of the start in us
+//   record  u8 SKT_CAPTURE_NAME u8 id u8 len name, before the first frame of that socket
+//           u8 SKT_CAPTURE_IN or SKT_CAPTURE_OUT u8 id varint us since the previous record varint len payload
+// payloads are the plain frames lua reads or writes, after decryption and inflating
+#define SKT_CAPTURE_VERSION        (1)
+#define SKT_CAPTURE_NAME           (0)
+#define SKT_CAPTURE_IN             (1)
+#define SKT_CAPTURE_OUT            (2)
+#define SKT_CAPTURE_MAX_NAMES      (255)
+// a replay stops feeding the receive queue at this depth until lua drains it
+#define SKT_REPLAY_QUEUE           (4096)
+
+// process wide writer, every connection manager records into it while it is on.
+// an empty filter records all sockets.
+class CSktCapture
+{
+public:
+	static CSktCapture* Inst();
+	CSktCapture();
+	~CSktCapture();
+	bool    Start(const char* path, const char* filter);
+	void    Stop();
+	bool    IsOn() const { return m_on.load(std::memory_order_relaxed); }
+	void    Record(int dir, const std::string& socketName, const char* payload, int size);
+	void    GetStat(Int64& frames, Int64& bytes);
+private:
+	int     NameId(const std::string& socketName);
+	void    PutVarint(unsigned long long v);
+	std::mutex                  m_mutex;
+	std::atomic<bool>           m_on;
+	FILE*                       m_file;
+	std::string                 m_filter;
+	std::vector<std::string>    m_names;
+	Int64                       m_lastUs;
+	Int64                       m_frames;
+	Int64                       m_bytes;
+};
+
+// reads the inbound frames of one captured socket back as received NTMSGs.
+// realtime keeps the captured gaps, measured from the first frame, otherwise
+// every frame is due at once
+class CSktReplay
+{
+public:
+	CSktReplay();
+	~CSktReplay();
+	bool    Open(const char* path, const char* sourceName, bool realtime);
+	void    Close();
+	NTMSG*  Next(Int64 nowUs);
+	bool    IsDone() const { return m_done; }
+	Int64   GetFrames() const { return m_frames; }
+private:
+	bool    ReadPending();
+	bool    GetVarint(unsigned long long& v);
+	FILE*                       m_file;
+	std::string                 m_source;
+	bool                        m_realtime;
+	bool                        m_done;
+	std::vector<std::string>    m_names;
+	Int64                       m_recordUs;
+	Int64                       m_firstUs;
+	Int64                       m_startUs;
+	bool                        m_hasPending;
+	Int64                       m_pendingUs;
+	std::vector<char>           m_pending;
+	Int64                       m_frames;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "stdafx.h"
+#include "SktCipher.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SKT_CIPHER_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SKT_CIPHER_NEON
+#include <arm_neon.h>
+#endif
+
+#define SKT_CIPHER_BLOCK        (4096)
+#define SKT_CIPHER_GOLDEN       (0x9E3779B97F4A7C15ULL)
+
+static inline unsigned long long SktCipherMix64(unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static void SktCipherXorScalar(unsigned char* dst, const unsigned char* ks, int len)
+{
+	int i = 0;
+	for (; i + 8 <= len; i += 8)
+	{
+		unsigned long long d;
+		unsigned long long k;
+		memcpy(&d, dst + i, 8);
+		memcpy(&k, ks + i, 8);
+		d ^= k;
+		memcpy(dst + i, &d, 8);
+	}
+	for (; i < len; ++i)
+		dst[i] ^= ks[i];
+}
+
+#ifdef SKT_CIPHER_X86
+static void SktCipherXorSSE2(unsigned char* dst, const unsigned char* ks, int len)
+{
+	int i = 0;
+	for (; i + 64 <= len; i += 64)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(dst + i + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i*)(dst + i + 32));
+		__m128i a3 = _mm_loadu_si128((const __m128i*)(dst + i + 48));
+		a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i*)(ks + i)));
+		a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i*)(ks + i + 16)));
+		a2 = _mm_xor_si128(a2, _mm_loadu_si128((const __m128i*)(ks + i + 32)));
+		a3 = _mm_xor_si128(a3, _mm_loadu_si128((const __m128i*)(ks + i + 48)));
+		_mm_storeu_si128((__m128i*)(dst + i), a0);
+		_mm_storeu_si128((__m128i*)(dst + i + 16), a1);
+		_mm_storeu_si128((__m128i*)(dst + i + 32), a2);
+		_mm_storeu_si128((__m128i*)(dst + i + 48), a3);
+	}
+	SktCipherXorScalar(dst + i, ks + i, len - i);
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static void SktCipherXorAVX2(unsigned char* dst, const unsigned char* ks, int len)
+{
+	int i = 0;
+	for (; i + 128 <= len; i += 128)
+	{
+		__m256i a0 = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i a1 = _mm256_loadu_si256((const __m256i*)(dst + i + 32));
+		__m256i a2 = _mm256_loadu_si256((const __m256i*)(dst + i + 64));
+		__m256i a3 = _mm256_loadu_si256((const __m256i*)(dst + i + 96));
+		a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(ks + i)));
+		a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i*)(ks + i + 32)));
+		a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((const __m256i*)(ks + i + 64)));
+		a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((const __m256i*)(ks + i + 96)));
+		_mm256_storeu_si256((__m256i*)(dst + i), a0);
+		_mm256_storeu_si256((__m256i*)(dst + i + 32), a1);
+		_mm256_storeu_si256((__m256i*)(dst + i + 64), a2);
+		_mm256_storeu_si256((__m256i*)(dst + i + 96), a3);
+	}
+	SktCipherXorSSE2(dst + i, ks + i, len - i);
+}
+
+static bool SktCipherHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// osxsave and avx, then the os has to save the ymm state
+	if ((info[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & 0x20) != 0;
+#elif defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+#endif
+
+#ifdef SKT_CIPHER_NEON
+static void SktCipherXorNEON(unsigned char* dst, const unsigned char* ks, int len)
+{
+	int i = 0;
+	for (; i + 64 <= len; i += 64)
+	{
+		uint8x16_t a0 = vld1q_u8(dst + i);
+		uint8x16_t a1 = vld1q_u8(dst + i + 16);
+		uint8x16_t a2 = vld1q_u8(dst + i + 32);
+		uint8x16_t a3 = vld1q_u8(dst + i + 48);
+		vst1q_u8(dst + i, veorq_u8(a0, vld1q_u8(ks + i)));
+		vst1q_u8(dst + i + 16, veorq_u8(a1, vld1q_u8(ks + i + 16)));
+		vst1q_u8(dst + i + 32, veorq_u8(a2, vld1q_u8(ks + i + 32)));
+		vst1q_u8(dst + i + 48, veorq_u8(a3, vld1q_u8(ks + i + 48)));
+	}
+	SktCipherXorScalar(dst + i, ks + i, len - i);
+}
+#endif
+
+typedef void (*SktCipherXorFunc)(unsigned char* dst, const unsigned char* ks, int len);
+
+static SktCipherXorFunc SktCipherPickKernel(const char** name)
+{
+#if defined(SKT_CIPHER_X86)
+	if (SktCipherHasAVX2())
+	{
+		*name = "avx2";
+		return SktCipherXorAVX2;
+	}
+	*name = "sse2";
+	return SktCipherXorSSE2;
+#elif defined(SKT_CIPHER_NEON)
+	*name = "neon";
+	return SktCipherXorNEON;
+#else
+	*name = "scalar";
+	return SktCipherXorScalar;
+#endif
+}
+
+static const char* s_sktCipherKernelName = NULL;
+static SktCipherXorFunc s_sktCipherXor = SktCipherPickKernel(&s_sktCipherKernelName);
+
+const char* CSktCipher::GetKernelName()
+{
+	return s_sktCipherKernelName;
+}
+
+bool CSktCipher::UseKernel(const char* name)
+{
+	if (strcmp(name, "scalar") == 0)
+	{
+		s_sktCipherXor = SktCipherXorScalar;
+		s_sktCipherKernelName = "scalar";
+		return true;
+	}
+#if defined(SKT_CIPHER_X86)
+	if (strcmp(name, "avx2") == 0 && SktCipherHasAVX2())
+	{
+		s_sktCipherXor = SktCipherXorAVX2;
+		s_sktCipherKernelName = "avx2";
+		return true;
+	}
+	if (strcmp(name, "sse2") == 0)
+	{
+		s_sktCipherXor = SktCipherXorSSE2;
+		s_sktCipherKernelName = "sse2";
+		return true;
+	}
+#elif defined(SKT_CIPHER_NEON)
+	if (strcmp(name, "neon") == 0)
+	{
+		s_sktCipherXor = SktCipherXorNEON;
+		s_sktCipherKernelName = "neon";
+		return true;
+	}
+#endif
+	return false;
+}
+
+CSktCipher::CSktCipher()
+{
+	Reset();
+}
+
+void CSktCipher::Reset()
+{
+	m_inited = false;
+	m_key = 0;
+	m_pos = 0;
+	m_blockIdx = ~0ULL;
+}
+
+void CSktCipher::Init(unsigned int seed)
+{
+	m_key = SktCipherMix64((unsigned long long)seed ^ 0x6A09E667F3BCC909ULL);
+	m_pos = 0;
+	m_blockIdx = ~0ULL;
+	m_inited = true;
+}
+
+// 4K of keystream at a time, the xor kernel then runs over it in one go
+void CSktCipher::FillBlock(unsigned long long blockIdx)
+{
+	unsigned long long ctr = m_key + blockIdx * (SKT_CIPHER_BLOCK / 8) * SKT_CIPHER_GOLDEN;
+	unsigned long long* words = (unsigned long long*)m_block;
+	for (int i = 0; i < SKT_CIPHER_BLOCK / 8; i += 4)
+	{
+		unsigned long long w0 = SktCipherMix64(ctr);
+		unsigned long long w1 = SktCipherMix64(ctr + SKT_CIPHER_GOLDEN);
+		unsigned long long w2 = SktCipherMix64(ctr + 2 * SKT_CIPHER_GOLDEN);
+		unsigned long long w3 = SktCipherMix64(ctr + 3 * SKT_CIPHER_GOLDEN);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		w0 = __builtin_bswap64(w0);
+		w1 = __builtin_bswap64(w1);
+		w2 = __builtin_bswap64(w2);
+		w3 = __builtin_bswap64(w3);
+#endif
+		words[i] = w0;
+		words[i + 1] = w1;
+		words[i + 2] = w2;
+		words[i + 3] = w3;
+		ctr += 4 * SKT_CIPHER_GOLDEN;
+	}
+	m_blockIdx = blockIdx;
+}
+
+void CSktCipher::Apply(char* buf, int len)
+{
+	if (!m_inited || len <= 0)
+		return;
+	unsigned char* dst = (unsigned char*)buf;
+	while (len > 0)
+	{
+		unsigned long long blockIdx = m_pos / SKT_CIPHER_BLOCK;
+		int offset = (int)(m_pos % SKT_CIPHER_BLOCK);
+		if (blockIdx != m_blockIdx)
+			FillBlock(blockIdx);
+		int n = SKT_CIPHER_BLOCK - offset;
+		if (n > len)
+			n = len;
+		s_sktCipherXor(dst, m_block + offset, n);
+		dst += n;
+		len -= n;
+		m_pos += n;
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _SKTCIPHERqpwoeiruvnbmxz_cipher_lsll_H__
+#define _SKTCIPHERqpwoeiruvnbmxz_cipher_lsll_H__
+
+// seeded keystream for the socket payload obfuscation.
+// byte n of a stream is byte (n & 7) (little endian) of
+//   mix64(key + (n >> 3) * 0x9E3779B97F4A7C15),  key = mix64(seed ^ 0x6A09E667F3BCC909)
+// where mix64 is the splitmix64 finaliser. the position runs on across frames, so
+// both ends have to apply it to the payloads in wire order. headers stay in clear.
+class CSktCipher
+{
+public:
+	CSktCipher();
+	void    Init(unsigned int seed);
+	void    Reset();
+	bool    IsInited() const { return m_inited; }
+	void    Apply(char* buf, int len);
+	static const char* GetKernelName();
+	// forces the xor kernel by name ("scalar", "sse2", "avx2", "neon") for the benches,
+	// false when this build or cpu has no such kernel
+	static bool UseKernel(const char* name);
+private:
+	void    FillBlock(unsigned long long blockIdx);
+	bool                m_inited;
+	unsigned long long  m_key;
+	unsigned long long  m_pos;
+	unsigned long long  m_blockIdx;
+	unsigned char       m_block[4096];
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "SktCompress.h"
+#include "Common/lz4/lz4.h"
+#include "Common/ENG_DBG.h"
+
+CSktCompress::CSktCompress()
+{
+	m_dictStream = NULL;
+	memset(&m_stat, 0, sizeof(m_stat));
+}
+
+CSktCompress::~CSktCompress()
+{
+	if (m_dictStream != NULL)
+		LZ4_freeStream((LZ4_stream_t*)m_dictStream);
+	m_dictStream = NULL;
+}
+
+// the dictionary is hashed once here, each frame then starts from a copy of that state
+void CSktCompress::SetDict(const char* dict, int len)
+{
+	if (m_dictStream != NULL)
+		LZ4_freeStream((LZ4_stream_t*)m_dictStream);
+	m_dictStream = NULL;
+	m_dict.assign(dict ? dict : "", dict && len > 0 ? len : 0);
+	if (m_dict.empty())
+		return;
+	m_dictStream = LZ4_createStream();
+	LZ4_loadDict((LZ4_stream_t*)m_dictStream, m_dict.data(), (int)m_dict.size());
+}
+
+// msg has been through NTMSG_endWriteData. returns the frame to send, either msg itself
+// or a new compressed NTMSG, msg is freed in that case.
+NTMSG* CSktCompress::CompressNTMSG(NTMSG* msg, int threshold)
+{
+	int size = msg->NTMSG_GetSizeAndType();
+	if (size < threshold || size <= 0)
+	{
+		msg->NTMSG_markFrame(false);
+		return msg;
+	}
+	int bound = LZ4_compressBound(size);
+	if ((int)m_scratch.size() < bound)
+		m_scratch.resize(bound);
+	int packed = 0;
+	if (m_dictStream != NULL)
+	{
+		LZ4_stream_t stream;
+		memcpy(&stream, m_dictStream, sizeof(stream));
+		packed = LZ4_compress_fast_continue(&stream, msg->NTMSG_getPayload(), &m_scratch[0], size, bound, 1);
+	}
+	else
+	{
+		packed = LZ4_compress_default(msg->NTMSG_getPayload(), &m_scratch[0], size, bound);
+	}
+	// not worth the receivers time unless the frame really shrinks
+	if (packed <= 0 || packed + 4 >= size)
+	{
+		m_stat.framesSkipped++;
+		msg->NTMSG_markFrame(false);
+		return msg;
+	}
+	NTMSG* out = new NTMSG(packed + 16);
+	out->NTMSG_beginWriteData();
+	out->NTMSG_wUIntValue((unsigned int)size);
+	out->NTMSG_wRawValue(&m_scratch[0], packed);
+	out->NTMSG_endWriteData();
+	out->NTMSG_markFrame(true);
+	m_stat.framesCompressed++;
+	m_stat.bytesIn += size;
+	m_stat.bytesOut += packed + 4;
+	delete msg;
+	return out;
+}
+
+// msg is a complete, already decrypted, compressed frame. returns the plain frame
+// (msg is freed) or NULL when the payload is broken.
+NTMSG* CSktCompress::DecompressNTMSG(NTMSG* msg)
+{
+	int size = msg->NTMSG_GetSizeAndType();
+	const unsigned char* src = (const unsigned char*)msg->NTMSG_getPayload();
+	if (size < 4)
+		return NULL;
+	int orig = (int)(((unsigned int)src[0] << 24) | ((unsigned int)src[1] << 16) | ((unsigned int)src[2] << 8) | src[3]);
+	if (orig <= 0 || orig > SKT_COMPRESS_MAX_FRAME)
+	{
+		DBG_E("compressed frame claims %d bytes \n", orig);
+		return NULL;
+	}
+	int headLen = orig >= 0xFFFF ? 4 : 2;
+	NTMSG* out = new NTMSG(headLen + orig);
+	out->NTMSG_initRecvFrame(headLen, orig, false);
+	int unpacked = LZ4_decompress_safe_usingDict((const char*)src + 4, out->NTMSG_getPayload(), size - 4, orig,
+		m_dict.empty() ? NULL : m_dict.data(), (int)m_dict.size());
+	if (unpacked != orig)
+	{
+		DBG_E("lz4 frame broken, %d of %d bytes \n", unpacked, orig);
+		delete out;
+		return NULL;
+	}
+	out->NTMSG_CallWhileReceive(orig);
+	delete msg;
+	return out;
+}
@@ -0,0 +1,36 @@
+#ifndef _SKTCOMPRESSzmxncbvlaksj_compress_lsll_H__
+#define _SKTCOMPRESSzmxncbvlaksj_compress_lsll_H__
+#include <vector>
+#include <string>
+#include "NTMSG.h"
+
+#define SKT_COMPRESS_MAX_FRAME     (64 * 1024 * 1024)
+
+struct SktCompressStat
+{
+	Int64   framesCompressed;
+	Int64   framesSkipped;
+	Int64   bytesIn;        // payload bytes before compression, compressed frames only
+	Int64   bytesOut;       // payload bytes on the wire for those frames
+};
+
+// per frame LZ4 for the compressed framing.
+// a compressed payload is a big endian u32 of the original size followed by one LZ4 block,
+// every frame is self contained apart from the optional preset dictionary.
+class CSktCompress
+{
+public:
+	CSktCompress();
+	~CSktCompress();
+	void    SetDict(const char* dict, int len);
+	NTMSG*  CompressNTMSG(NTMSG* msg, int threshold);
+	NTMSG*  DecompressNTMSG(NTMSG* msg);
+	const SktCompressStat& GetStat() const { return m_stat; }
+private:
+	void*               m_dictStream;
+	std::string         m_dict;
+	std::vector<char>   m_scratch;
+	SktCompressStat     m_stat;
+};
+
+#endif
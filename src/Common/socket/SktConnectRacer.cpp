@@ -0,0 +1,205 @@
+#include "stdafx.h"
+#include "SktConnectRacer.h"
+#include <string.h>
+#ifndef WIN32
+#include <poll.h>
+#define SKT_RACER_INPROGRESS	EINPROGRESS
+#else
+#define SKT_RACER_INPROGRESS	WSAEWOULDBLOCK
+#endif
+#include "Common/ENG_DBG.h"
+
+CSktConnectRacer::CSktConnectRacer()
+{
+	m_next = 0;
+	m_winner = NULL;
+	m_active = false;
+	m_staggerMs = SKT_RACER_STAGGER_MS;
+	m_started = 0;
+}
+
+CSktConnectRacer::~CSktConnectRacer()
+{
+	Cancel();
+}
+
+// false when no candidate got as far as an outstanding connect
+bool CSktConnectRacer::Start(const SktResolvedList& addrs, int port, int staggerMs)
+{
+	Cancel();
+	m_staggerMs = staggerMs;
+	m_started = 0;
+	// first family as the resolver ordered it, then alternate
+	std::vector<SktResolvedAddr> firstFamily;
+	std::vector<SktResolvedAddr> otherFamily;
+	for (size_t i = 0; i < addrs.size(); i++)
+	{
+		SktResolvedAddr addr = addrs[i];
+		if (addr.family == AF_INET)
+			((struct sockaddr_in*)&addr.addr)->sin_port = htons(port);
+		else if (addr.family == AF_INET6)
+			((struct sockaddr_in6*)&addr.addr)->sin6_port = htons(port);
+		else
+			continue;
+		if (addr.family == addrs[0].family)
+			firstFamily.push_back(addr);
+		else
+			otherFamily.push_back(addr);
+	}
+	m_candidates.clear();
+	for (size_t i = 0; i < firstFamily.size() || i < otherFamily.size(); i++)
+	{
+		if (i < firstFamily.size())
+			m_candidates.push_back(firstFamily[i]);
+		if (i < otherFamily.size())
+			m_candidates.push_back(otherFamily[i]);
+	}
+	m_next = 0;
+	m_active = true;
+	if (!StartNext())
+	{
+		m_active = false;
+		return false;
+	}
+	return true;
+}
+
+// starts the next candidate that gets to an outstanding or completed connect
+bool CSktConnectRacer::StartNext()
+{
+	while (m_next < m_candidates.size())
+	{
+		const SktResolvedAddr& addr = m_candidates[m_next++];
+		CSkt* skt = new CSkt();
+		if (skt->SKT_CrtSkt(addr.family, SOCK_STREAM, addr.protocol) == -1)
+		{
+			delete skt;
+			continue;
+		}
+#ifdef WIN32
+		u_long modeofsocket = 1;
+		ioctlsocket(skt->SKT_GSkt(), FIONBIO, &modeofsocket);
+#else
+		fcntl(skt->SKT_GSkt(), F_SETFL, fcntl(skt->SKT_GSkt(), F_GETFL, 0) | O_NONBLOCK);
+#endif
+		struct addrinfo ai;
+		memset(&ai, 0, sizeof(ai));
+		ai.ai_family = addr.family;
+		ai.ai_socktype = SOCK_STREAM;
+		ai.ai_protocol = addr.protocol;
+		ai.ai_addrlen = addr.addrlen;
+		ai.ai_addr = (struct sockaddr*)&addr.addr;
+		m_started++;
+		m_lastStart = std::chrono::steady_clock::now();
+		if (skt->SKT_CNC2(&ai) == 0)
+		{
+			m_winner = skt;
+			return true;
+		}
+		if (skt->SKT_GEo() != SKT_RACER_INPROGRESS)
+		{
+			DBG_L("connect attempt %d failed, error id is %d \n", m_started, skt->SKT_GEo());
+			skt->SKT_ClsSkt(1);
+			delete skt;
+			continue;
+		}
+		m_attempts.push_back(skt);
+		return true;
+	}
+	return false;
+}
+
+void CSktConnectRacer::CloseAttempt(size_t i)
+{
+	m_attempts[i]->SKT_ClsSkt(1);
+	delete m_attempts[i];
+	m_attempts.erase(m_attempts.begin() + i);
+}
+
+// one zero timeout poll over the outstanding attempts per call
+int CSktConnectRacer::Update()
+{
+	if (!m_active)
+		return SKT_RACE_FAILED;
+	for (size_t i = 0; i < m_attempts.size() && m_winner == NULL;)
+	{
+		int fd = m_attempts[i]->SKT_GSkt();
+		bool done = false;
+#ifndef WIN32
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		done = poll(&pfd, 1, 0) > 0;
+#else
+		struct timeval tv = { 0, 0 };
+		fd_set wset;
+		fd_set eset;
+		FD_ZERO(&wset);
+		FD_ZERO(&eset);
+		FD_SET(fd, &wset);
+		FD_SET(fd, &eset);
+		done = select(fd + 1, NULL, &wset, &eset, &tv) > 0;
+#endif
+		if (!done)
+		{
+			++i;
+			continue;
+		}
+		int soError = 0;
+		socklen_t soErrorLen = sizeof(soError);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&soError, &soErrorLen) == 0 && soError == 0)
+		{
+			m_winner = m_attempts[i];
+			m_attempts.erase(m_attempts.begin() + i);
+			break;
+		}
+		DBG_L("connect attempt failed, error id is %d \n", soError);
+		CloseAttempt(i);
+		// a refused attempt hands over to the next candidate right away
+		StartNext();
+	}
+	if (m_winner != NULL)
+	{
+		while (!m_attempts.empty())
+			CloseAttempt(m_attempts.size() - 1);
+		return SKT_RACE_WON;
+	}
+	if (m_next < m_candidates.size() &&
+		std::chrono::steady_clock::now() - m_lastStart >= std::chrono::milliseconds(m_staggerMs))
+	{
+		StartNext();
+		if (m_winner != NULL)
+			return Update();
+	}
+	if (m_attempts.empty() && m_next >= m_candidates.size())
+	{
+		m_active = false;
+		return SKT_RACE_FAILED;
+	}
+	return SKT_RACE_PENDING;
+}
+
+CSkt* CSktConnectRacer::TakeWinner()
+{
+	CSkt* winner = m_winner;
+	m_winner = NULL;
+	m_active = false;
+	m_candidates.clear();
+	return winner;
+}
+
+void CSktConnectRacer::Cancel()
+{
+	while (!m_attempts.empty())
+		CloseAttempt(m_attempts.size() - 1);
+	if (m_winner != NULL)
+	{
+		m_winner->SKT_ClsSkt(1);
+		delete m_winner;
+		m_winner = NULL;
+	}
+	m_candidates.clear();
+	m_next = 0;
+	m_active = false;
+}
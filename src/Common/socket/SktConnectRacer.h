@@ -0,0 +1,43 @@
+#ifndef _SKTCONNECTRACERzpxoqiwuemnv_eyeballs_lsll_H__
+#define _SKTCONNECTRACERzpxoqiwuemnv_eyeballs_lsll_H__
+#include <vector>
+#include <chrono>
+#include "CSkt.h"
+#include "SktResolver.h"
+
+// rfc 8305 recommends 250ms between connection attempts
+#define SKT_RACER_STAGGER_MS       (250)
+
+#define SKT_RACE_PENDING           (0)
+#define SKT_RACE_WON               (1)
+#define SKT_RACE_FAILED            (-1)
+
+// happy eyeballs connect over every resolved address.
+// candidates are interleaved by family, a new non blocking connect starts each
+// stagger interval or as soon as the previous one fails, the first one to
+// complete wins and the others are closed.
+class CSktConnectRacer
+{
+public:
+	CSktConnectRacer();
+	~CSktConnectRacer();
+	bool    Start(const SktResolvedList& addrs, int port, int staggerMs);
+	int     Update();
+	CSkt*   TakeWinner();
+	void    Cancel();
+	bool    IsActive() const { return m_active; }
+	int     GetAttemptCount() const { return m_started; }
+private:
+	bool    StartNext();
+	void    CloseAttempt(size_t i);
+	std::vector<SktResolvedAddr>            m_candidates;
+	size_t                                  m_next;
+	std::vector<CSkt*>                      m_attempts;
+	CSkt*                                   m_winner;
+	bool                                    m_active;
+	int                                     m_staggerMs;
+	int                                     m_started;
+	std::chrono::steady_clock::time_point   m_lastStart;
+};
+
+#endif
@@ -0,0 +1,344 @@
+#include "stdafx.h"
+#include "SktIOThread.h"
+#include "SocketConnectionManager.h"
+#ifndef WIN32
+#include <poll.h>
+#endif
+#include "Common/ENG_DBG.h"
+
+CSktIOThread::CSktIOThread()
+{
+	m_skt = NULL;
+	m_thread = NULL;
+	m_running.store(false);
+	m_errorCode.store(-1);
+	m_queuedBytes.store(0);
+	m_queuedMsgs.store(0);
+	m_recvStreamBytes.store(0);
+	m_sendIdle.store(false);
+	m_recvStalled.store(false);
+	m_wakeRead = -1;
+	m_wakeWrite = -1;
+	m_recvPending = NULL;
+	m_counters = NULL;
+}
+
+CSktIOThread::~CSktIOThread()
+{
+	std::list<NTMSG*> sendBack;
+	std::list<NTMSG*> recvBack;
+	Stop(sendBack, recvBack);
+	for (std::list<NTMSG*>::iterator iter = sendBack.begin(); iter != sendBack.end(); ++iter)
+		delete *iter;
+	for (std::list<NTMSG*>::iterator iter = recvBack.begin(); iter != recvBack.end(); ++iter)
+		delete *iter;
+}
+
+bool CSktIOThread::Start(CSkt* skt, bool compressFraming, int streamThreshold, CSktIOCounters* counters)
+{
+	if (m_thread != NULL || skt == NULL || counters == NULL)
+		return false;
+	if (!OpenWake())
+		return false;
+	m_skt = skt;
+	m_counters = counters;
+	m_recvPending = NULL;
+	m_recvBytes.SetCompressFraming(compressFraming);
+	m_recvBytes.SetStreamThreshold(streamThreshold);
+	m_recvBytes.SetCounters(counters);
+	m_recvStreamBytes.store(0);
+	m_sendIdle.store(false);
+	m_recvStalled.store(false);
+	m_errorCode.store(-1);
+	m_running.store(true);
+	m_thread = new std::thread(&CSktIOThread::Run, this);
+	return true;
+}
+
+// joins the thread and hands every NTMSG it still owns back to the caller,
+// unsent ones in send order and complete received ones in recv order.
+// a half received frame is useless once the socket goes away and is dropped.
+void CSktIOThread::Stop(std::list<NTMSG*>& sendBack, std::list<NTMSG*>& recvBack)
+{
+	if (m_thread == NULL)
+		return;
+	m_running.store(false);
+	Wake();
+	m_thread->join();
+	delete m_thread;
+	m_thread = NULL;
+	CloseWake();
+
+	NTMSG* msg = NULL;
+	sendBack.splice(sendBack.end(), m_sending);
+	while (m_sendRing.Pop(msg))
+		sendBack.push_back(msg);
+	while (m_recvRing.Pop(msg))
+		recvBack.push_back(msg);
+	if (m_recvPending != NULL)
+		recvBack.push_back(m_recvPending);
+	m_recvPending = NULL;
+	while ((msg = m_recvBytes.PopFrame()) != NULL)
+		recvBack.push_back(msg);
+	m_recvBytes.Reset();
+	m_queuedBytes.store(0);
+	m_queuedMsgs.store(0);
+	m_skt = NULL;
+}
+
+bool CSktIOThread::PushSend(NTMSG* msg)
+{
+	int bytes = msg->NTMSG_getSdCapSize();
+	if (!m_sendRing.Push(msg))
+		return false;
+	m_queuedBytes.fetch_add(bytes);
+	m_queuedMsgs.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sendIdle.load() && m_sendIdle.exchange(false))
+		Wake();
+	return true;
+}
+
+NTMSG* CSktIOThread::PopRecv()
+{
+	NTMSG* msg = NULL;
+	if (!m_recvRing.Pop(msg))
+		return NULL;
+	if (msg->NTMSG_IsStreamPiece())
+		m_recvStreamBytes.fetch_sub(msg->NTMSG_GetSizeAndType());
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_recvStalled.load() && m_recvStalled.exchange(false))
+		Wake();
+	return msg;
+}
+
+// the read end is non blocking so a drain stops when it is empty, the write end too so
+// a wake with the pipe full, which means one is pending already, never blocks
+bool CSktIOThread::OpenWake()
+{
+#ifndef WIN32
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+	m_wakeRead = fds[0];
+	m_wakeWrite = fds[1];
+#else
+	// select only takes sockets, a udp socket connected to itself is the pipe
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s == INVALID_SOCKET)
+		return false;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int len = sizeof(addr);
+	u_long nonBlock = 1;
+	if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0
+		|| getsockname(s, (struct sockaddr*)&addr, &len) != 0
+		|| connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0
+		|| ioctlsocket(s, FIONBIO, &nonBlock) != 0)
+	{
+		closesocket(s);
+		return false;
+	}
+	m_wakeRead = (int)s;
+	m_wakeWrite = (int)s;
+#endif
+	return true;
+}
+
+void CSktIOThread::CloseWake()
+{
+#ifdef WIN32
+	if (m_wakeRead >= 0)
+		closesocket(m_wakeRead);
+#else
+	if (m_wakeRead >= 0)
+		close(m_wakeRead);
+	if (m_wakeWrite >= 0)
+		close(m_wakeWrite);
+#endif
+	m_wakeRead = -1;
+	m_wakeWrite = -1;
+}
+
+void CSktIOThread::Wake()
+{
+	char c = 1;
+#ifndef WIN32
+	ssize_t ret = write(m_wakeWrite, &c, 1);
+	(void)ret;
+#else
+	send(m_wakeWrite, &c, 1, 0);
+#endif
+}
+
+void CSktIOThread::DrainWake()
+{
+	char buf[64];
+#ifndef WIN32
+	while (read(m_wakeRead, buf, sizeof(buf)) > 0)
+		;
+#else
+	while (recv(m_wakeRead, buf, sizeof(buf), 0) > 0)
+		;
+#endif
+}
+
+bool CSktIOThread::WaitSkt(bool wantRead, bool wantWrite, bool& canRead, bool& canWrite)
+{
+	int fd = m_skt->SKT_GSkt();
+	CSktIOCounters::Add(m_counters->pollCalls, 1);
+#ifndef WIN32
+	struct pollfd pfd[2];
+	pfd[0].fd = fd;
+	pfd[0].events = (wantRead ? POLLIN : 0) | (wantWrite ? POLLOUT : 0);
+	pfd[0].revents = 0;
+	pfd[1].fd = m_wakeRead;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+	int ret = poll(pfd, 2, -1);
+	if (ret < 0)
+		return errno == EINTR;
+	if (pfd[1].revents & POLLIN)
+		DrainWake();
+	if (pfd[0].revents & (POLLERR | POLLNVAL))
+		return false;
+	canRead = wantRead && (pfd[0].revents & (POLLIN | POLLHUP)) != 0;
+	canWrite = (pfd[0].revents & POLLOUT) != 0;
+#else
+	fd_set rset;
+	fd_set wset;
+	fd_set eset;
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	FD_ZERO(&eset);
+	FD_SET(fd, &eset);
+	FD_SET(m_wakeRead, &rset);
+	if (wantRead)
+		FD_SET(fd, &rset);
+	if (wantWrite)
+		FD_SET(fd, &wset);
+	int ret = select((fd > m_wakeRead ? fd : m_wakeRead) + 1, &rset, &wset, &eset, NULL);
+	if (ret < 0 || FD_ISSET(fd, &eset))
+		return false;
+	if (FD_ISSET(m_wakeRead, &rset))
+		DrainWake();
+	canRead = wantRead && FD_ISSET(fd, &rset) != 0;
+	canWrite = FD_ISSET(fd, &wset) != 0;
+#endif
+	return true;
+}
+
+void CSktIOThread::Run()
+{
+	while (m_running.load())
+	{
+		NTMSG* msg = NULL;
+		while (m_sendRing.Pop(msg))
+			m_sending.push_back(msg);
+
+		bool canRead = false;
+		bool canWrite = false;
+		// stop reading while the lua thread is behind, the tcp window pushes back on the peer
+		bool wantRead = FlushFrames();
+		// say what the wait is for, then look once more. a push or pop the lua thread makes
+		// after this look sees the flag and wakes the poll, one made before it is seen here
+		if (m_sending.empty())
+		{
+			m_sendIdle.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while (m_sendRing.Pop(msg))
+				m_sending.push_back(msg);
+			if (!m_sending.empty())
+				m_sendIdle.store(false);
+		}
+		if (!wantRead)
+		{
+			m_recvStalled.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wantRead = FlushFrames();
+		}
+		bool waitOk = WaitSkt(wantRead, !m_sending.empty(), canRead, canWrite);
+		m_sendIdle.store(false);
+		m_recvStalled.store(false);
+		if (!waitOk)
+		{
+			m_errorCode.store(NetErrorCode_Select);
+			break;
+		}
+		int err = -1;
+		if (canWrite)
+			err = DoWrite();
+		if (err < 0 && canRead)
+			err = DoRead();
+		if (err >= 0)
+		{
+			m_errorCode.store(err);
+			break;
+		}
+	}
+}
+
+// moves every parsed frame into the recv ring, false when the ring is full.
+// the frame that did not fit waits in m_recvPending for the next pass.
+bool CSktIOThread::FlushFrames()
+{
+	if (m_recvPending != NULL)
+	{
+		if (!PushRecvFrame(m_recvPending))
+			return false;
+		m_recvPending = NULL;
+	}
+	while ((m_recvPending = m_recvBytes.PopFrame()) != NULL)
+	{
+		if (!PushRecvFrame(m_recvPending))
+			return false;
+	}
+	return true;
+}
+
+// a streamed frame is held to SKT_IOTHREAD_STREAM_BYTES in flight, the ring alone would
+// let a thousand chunks pile up behind a slow lua thread
+bool CSktIOThread::PushRecvFrame(NTMSG* msg)
+{
+	if (!msg->NTMSG_IsStreamPiece())
+		return m_recvRing.Push(msg);
+	int size = msg->NTMSG_GetSizeAndType();
+	if (m_recvStreamBytes.load() >= SKT_IOTHREAD_STREAM_BYTES)
+		return false;
+	m_recvStreamBytes.fetch_add(size);
+	if (m_recvRing.Push(msg))
+		return true;
+	m_recvStreamBytes.fetch_sub(size);
+	return false;
+}
+
+// both return -1 while the socket is healthy, else the NetErrorCode to report.
+int CSktIOThread::DoRead()
+{
+	for (;;)
+	{
+		if (!FlushFrames())
+			return -1;
+		if (m_recvBytes.IsBroken())
+			return NetErrorCode_BadFrame;
+		int n = m_recvBytes.Recv(m_skt);
+		if (n < 0 && m_skt->SKT_IsWB())
+			return -1;
+		if (n <= 0)
+			return NetErrorCode_RecvZeroByte;
+	}
+}
+
+int CSktIOThread::DoWrite()
+{
+	int sentBytes = 0;
+	size_t framesBefore = m_sending.size();
+	int err = CSocketConnectionManager::SendGatherNTMSG(m_skt, m_sending, m_sendIov, *m_counters, sentBytes);
+	m_queuedBytes.fetch_sub(sentBytes);
+	m_queuedMsgs.fetch_sub((int)(framesBefore - m_sending.size()));
+	return err;
+}
@@ -0,0 +1,67 @@
+#ifndef _SKTIOTHREADpqowieurmzncbv_iothread_lsll_H__
+#define _SKTIOTHREADpqowieurmzncbv_iothread_lsll_H__
+#include <list>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "CSkt.h"
+#include "NTMSG.h"
+#include "SktSPSCRing.h"
+#include "SktRecvRing.h"
+
+#define SKT_IOTHREAD_RING_SIZE     (1024)
+// stream pieces the lua thread has not popped yet, reading stops above this
+#define SKT_IOTHREAD_STREAM_BYTES  (1024 * 1024)
+
+// background reader/writer for one connected CSkt.
+// the lua thread pushes encoded NTMSG into the send ring and pops complete
+// NTMSG from the recv ring, the sockets fd is never touched by both sides at once.
+// the thread blocks in poll with no timeout, the lua thread wakes it through a pipe
+// (a loopback udp socket on windows) only when it sleeps on something the lua thread changed.
+class CSktIOThread
+{
+public:
+	CSktIOThread();
+	~CSktIOThread();
+	bool    Start(CSkt* skt, bool compressFraming, int streamThreshold, CSktIOCounters* counters);
+	void    Stop(std::list<NTMSG*>& sendBack, std::list<NTMSG*>& recvBack);
+	bool    IsRunning() const { return m_thread != NULL; }
+	bool    PushSend(NTMSG* msg);
+	int     GetQueuedBytes() const { return m_queuedBytes.load(); }
+	int     GetQueuedMsgs() const { return m_queuedMsgs.load(); }
+	NTMSG*  PopRecv();
+	int     GetError() const { return m_errorCode.load(); }
+private:
+	void    Run();
+	bool    OpenWake();
+	void    CloseWake();
+	void    Wake();
+	void    DrainWake();
+	bool    WaitSkt(bool wantRead, bool wantWrite, bool& canRead, bool& canWrite);
+	bool    FlushFrames();
+	bool    PushRecvFrame(NTMSG* msg);
+	int     DoRead();
+	int     DoWrite();
+	CSkt*                                              m_skt;
+	CSktIOCounters*                                    m_counters;
+	std::thread*                                       m_thread;
+	std::atomic<bool>                                  m_running;
+	std::atomic<int>                                   m_errorCode;
+	// pushed but not yet written, for the lanes and the watermarks on the lua thread
+	std::atomic<int>                                   m_queuedBytes;
+	std::atomic<int>                                   m_queuedMsgs;
+	std::atomic<int>                                   m_recvStreamBytes;
+	// set by the thread before it blocks, with nothing to send or with the recv ring full
+	std::atomic<bool>                                  m_sendIdle;
+	std::atomic<bool>                                  m_recvStalled;
+	int                                                m_wakeRead;
+	int                                                m_wakeWrite;
+	NTMSG*                                             m_recvPending;
+	CSktRecvRing                                       m_recvBytes;
+	std::list<NTMSG*>                                  m_sending;
+	std::vector<SKT_IOV>                               m_sendIov;
+	CSktSPSCRing<NTMSG*, SKT_IOTHREAD_RING_SIZE>       m_sendRing;
+	CSktSPSCRing<NTMSG*, SKT_IOTHREAD_RING_SIZE>       m_recvRing;
+};
+
+#endif
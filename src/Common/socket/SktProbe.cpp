@@ -0,0 +1,204 @@
+#include "stdafx.h"
+#include "SktProbe.h"
+#include <string.h>
+
+static inline void PutBE(std::vector<char>& out, unsigned long long v, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--)
+		out.push_back((char)((v >> (i * 8)) & 0xFF));
+}
+
+static inline unsigned long long GetBE(const unsigned char* p, int bytes)
+{
+	unsigned long long v = 0;
+	for (int i = 0; i < bytes; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+CSktProbe::CSktProbe()
+{
+	m_on = false;
+	m_intervalUs = SKT_PROBE_INTERVAL_MS * 1000LL;
+	m_timeoutUs = SKT_PROBE_TIMEOUT_MS * 1000LL;
+	m_windowUs = SKT_PROBE_WINDOW_MS * 1000LL;
+	m_seq = 0;
+	m_highUs = 0;
+	m_lowUs = 0;
+	Reset();
+}
+
+// false for prefixes out of range, the prober stays as it was then
+bool CSktProbe::Configure(int intervalMs, int timeoutMs, int windowMs, const std::string& request, const std::string& reply)
+{
+	if (intervalMs <= 0 || timeoutMs <= 0 || windowMs <= 0
+		|| request.empty() || request.size() > SKT_PROBE_MAX_PREFIX
+		|| reply.empty() || reply.size() > SKT_PROBE_MAX_PREFIX)
+		return false;
+	m_intervalUs = intervalMs * 1000LL;
+	m_timeoutUs = timeoutMs * 1000LL;
+	m_windowUs = windowMs * 1000LL;
+	m_request = request;
+	m_reply = reply;
+	m_on = true;
+	Reset();
+	return true;
+}
+
+// a new connection is a new path, nothing measured on the old one carries over
+void CSktProbe::Reset()
+{
+	m_nextUs = 0;
+	m_outstanding.clear();
+	m_window.clear();
+	m_high = false;
+	memset(&m_stat, 0, sizeof(m_stat));
+}
+
+// <= 0 turns the callbacks off, the low mark only matters once the high one was crossed
+void CSktProbe::SetThresholds(Int64 highUs, Int64 lowUs)
+{
+	m_highUs = highUs;
+	m_lowUs = lowUs;
+	m_high = false;
+}
+
+// the next request payload once the interval is up
+bool CSktProbe::BuildRequest(Int64 nowUs, std::vector<char>& out)
+{
+	if (!m_on || nowUs < m_nextUs)
+		return false;
+	m_nextUs = nowUs + m_intervalUs;
+	if (m_outstanding.size() >= SKT_PROBE_MAX_OUTSTANDING)
+	{
+		m_outstanding.erase(m_outstanding.begin());
+		m_stat.lost++;
+	}
+	unsigned int seq = m_seq++;
+	out.assign(m_request.begin(), m_request.end());
+	PutBE(out, seq, 4);
+	PutBE(out, (unsigned long long)nowUs, 8);
+	m_outstanding[seq] = nowUs;
+	m_stat.sent++;
+	m_stat.outstanding = (int)m_outstanding.size();
+	return true;
+}
+
+// true when the payload is a probe reply, it is used up then. the server's hold time
+// between t2 and t3 is taken off the round trip, the offset is the NTP one
+//   ((t2 - t1) + (t3 - t4)) / 2
+bool CSktProbe::OnFrame(const char* payload, int size, Int64 arrivalUs)
+{
+	int prefix = (int)m_reply.size();
+	if (!m_on || (size != prefix + 12 && size != prefix + 28) || memcmp(payload, m_reply.data(), prefix) != 0)
+		return false;
+	const unsigned char* p = (const unsigned char*)payload + prefix;
+	unsigned int seq = (unsigned int)GetBE(p, 4);
+	Int64 t1 = (Int64)GetBE(p + 4, 8);
+	std::map<unsigned int, Int64>::iterator it = m_outstanding.find(seq);
+	// a late reply to a probe given up on
+	if (it == m_outstanding.end() || it->second != t1)
+		return true;
+	m_outstanding.erase(it);
+	m_stat.outstanding = (int)m_outstanding.size();
+	Int64 t4 = arrivalUs;
+	Int64 rttUs = t4 - t1;
+	Int64 offsetUs = 0;
+	bool hasOffset = size == prefix + 28;
+	if (hasOffset)
+	{
+		Int64 t2 = (Int64)GetBE(p + 12, 8);
+		Int64 t3 = (Int64)GetBE(p + 20, 8);
+		if (t3 >= t2 && t3 - t2 < rttUs)
+			rttUs -= t3 - t2;
+		offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+	}
+	if (rttUs < 0)
+		rttUs = 0;
+	m_stat.received++;
+	AddSample(t4, rttUs, offsetUs, hasOffset);
+	return true;
+}
+
+void CSktProbe::AddSample(Int64 atUs, Int64 rttUs, Int64 offsetUs, bool hasOffset)
+{
+	if (m_stat.received == 1)
+	{
+		m_stat.srttUs = rttUs;
+		m_stat.jitterUs = 0;
+	}
+	else
+	{
+		Int64 d = rttUs > m_stat.lastRttUs ? rttUs - m_stat.lastRttUs : m_stat.lastRttUs - rttUs;
+		m_stat.jitterUs += (d - m_stat.jitterUs) / 16;
+		m_stat.srttUs += (rttUs - m_stat.srttUs) / 8;
+	}
+	m_stat.lastRttUs = rttUs;
+	while (!m_window.empty() && m_window.back().rttUs >= rttUs)
+		m_window.pop_back();
+	Sample sample;
+	sample.atUs = atUs;
+	sample.rttUs = rttUs;
+	sample.offsetUs = offsetUs;
+	sample.hasOffset = hasOffset;
+	m_window.push_back(sample);
+	TrimWindow(atUs);
+}
+
+// the newest sample always stays, so the minimum never goes blank between probes
+void CSktProbe::TrimWindow(Int64 nowUs)
+{
+	while (m_window.size() > 1 && m_window.front().atUs < nowUs - m_windowUs)
+		m_window.pop_front();
+	if (m_window.empty())
+		return;
+	m_stat.minRttUs = m_window.front().rttUs;
+	if (m_window.front().hasOffset)
+	{
+		m_stat.offsetUs = m_window.front().offsetUs;
+		m_stat.hasOffset = true;
+	}
+}
+
+void CSktProbe::Expire(Int64 nowUs)
+{
+	for (std::map<unsigned int, Int64>::iterator it = m_outstanding.begin(); it != m_outstanding.end();)
+	{
+		if (nowUs - it->second > m_timeoutUs)
+		{
+			m_outstanding.erase(it++);
+			m_stat.lost++;
+		}
+		else
+		{
+			++it;
+		}
+	}
+	m_stat.outstanding = (int)m_outstanding.size();
+	TrimWindow(nowUs);
+}
+
+// the level is the smoothed rtt, or the age of the oldest unanswered probe when that is more,
+// so a stalled link crosses the high mark without waiting for a reply that may never come
+int CSktProbe::CheckThreshold(Int64 nowUs, Int64& levelUs)
+{
+	levelUs = m_stat.received > 0 ? m_stat.srttUs : 0;
+	if (!m_on || m_highUs <= 0)
+		return SKT_PROBE_CROSS_NONE;
+	for (std::map<unsigned int, Int64>::iterator it = m_outstanding.begin(); it != m_outstanding.end(); ++it)
+	{
+		if (nowUs - it->second > levelUs)
+			levelUs = nowUs - it->second;
+	}
+	if (!m_high && levelUs >= m_highUs)
+	{
+		m_high = true;
+		return SKT_PROBE_CROSS_HIGH;
+	}
+	if (m_high && levelUs <= m_lowUs)
+	{
+		m_high = false;
+		return SKT_PROBE_CROSS_LOW;
+	}
+	return SKT_PROBE_CROSS_NONE;
+}
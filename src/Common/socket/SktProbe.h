@@ -0,0 +1,82 @@
+#ifndef _SKTPROBEalskdjfhgqpwoei_latprobe_lsll_H__
+#define _SKTPROBEalskdjfhgqpwoei_latprobe_lsll_H__
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include "NTMSG.h"
+
+// probe payloads, integers big endian like the rest of the protocol
+//   request  request prefix u32 seq i64 t1
+//   reply    reply prefix u32 seq i64 t1 [i64 t2 i64 t3]
+// t1 is our send time, the server echoes it untouched. t2 and t3 are the server's receive
+// and send times in its own us clock, a reply without them only gives the round trip.
+#define SKT_PROBE_MAX_PREFIX       (32)
+#define SKT_PROBE_MAX_OUTSTANDING  (64)
+#define SKT_PROBE_INTERVAL_MS      (1000)
+#define SKT_PROBE_TIMEOUT_MS       (3000)
+#define SKT_PROBE_WINDOW_MS        (10000)
+
+#define SKT_PROBE_CROSS_NONE       (0)
+#define SKT_PROBE_CROSS_HIGH       (1)
+#define SKT_PROBE_CROSS_LOW        (2)
+
+struct SktProbeStat
+{
+	Int64   sent;
+	Int64   received;
+	Int64   lost;           // unanswered within the timeout
+	Int64   lastRttUs;
+	Int64   srttUs;         // 1/8 gain
+	Int64   jitterUs;       // RFC 3550 interarrival jitter of the round trips, 1/16 gain
+	Int64   minRttUs;       // over the window
+	Int64   offsetUs;       // server clock minus ours, from the lowest rtt sample in the window
+	bool    hasOffset;
+	int     outstanding;
+};
+
+// latency prober of one connection, the manager sends what BuildRequest gives it and offers
+// every received payload to OnFrame, which keeps the replies away from lua.
+// times are steady clock us on our side
+class CSktProbe
+{
+public:
+	CSktProbe();
+	bool    Configure(int intervalMs, int timeoutMs, int windowMs, const std::string& request, const std::string& reply);
+	void    Stop()                      { m_on = false; Reset(); }
+	bool    IsOn() const                { return m_on; }
+	void    Reset();
+	void    SetThresholds(Int64 highUs, Int64 lowUs);
+	bool    BuildRequest(Int64 nowUs, std::vector<char>& out);
+	bool    OnFrame(const char* payload, int size, Int64 arrivalUs);
+	void    Expire(Int64 nowUs);
+	int     CheckThreshold(Int64 nowUs, Int64& levelUs);
+	const SktProbeStat& GetStat() const { return m_stat; }
+private:
+	struct Sample
+	{
+		Int64   atUs;
+		Int64   rttUs;
+		Int64   offsetUs;
+		bool    hasOffset;
+	};
+	void    AddSample(Int64 atUs, Int64 rttUs, Int64 offsetUs, bool hasOffset);
+	void    TrimWindow(Int64 nowUs);
+	bool                        m_on;
+	Int64                       m_intervalUs;
+	Int64                       m_timeoutUs;
+	Int64                       m_windowUs;
+	std::string                 m_request;
+	std::string                 m_reply;
+	Int64                       m_nextUs;
+	unsigned int                m_seq;
+	std::map<unsigned int, Int64> m_outstanding;
+	// rtt ascending from the front, the front is the window minimum
+	std::deque<Sample>          m_window;
+	Int64                       m_highUs;
+	Int64                       m_lowUs;
+	bool                        m_high;
+	SktProbeStat                m_stat;
+};
+
+#endif
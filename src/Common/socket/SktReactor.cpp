@@ -0,0 +1,144 @@
+#include "stdafx.h"
+#include "SktReactor.h"
+#include <string.h>
+#ifdef SKT_REACTOR_EPOLL
+#include <sys/epoll.h>
+#elif !defined(WIN32)
+#include <sys/select.h>
+#endif
+#include "Common/ENG_DBG.h"
+
+#define SKT_REACTOR_MAX_EVENTS   (64)
+
+CSktReactor* CSktReactor::Inst()
+{
+	static CSktReactor reactor;
+	return &reactor;
+}
+
+CSktReactor::CSktReactor()
+{
+	m_pollCount = 0;
+	m_epfd = -1;
+#ifdef SKT_REACTOR_EPOLL
+	m_epfd = epoll_create(SKT_REACTOR_MAX_EVENTS);
+	if (m_epfd < 0)
+	{
+		DBG_E("epoll_create failed, errno is %d \n", errno);
+	}
+#endif
+}
+
+CSktReactor::~CSktReactor()
+{
+#ifdef SKT_REACTOR_EPOLL
+	if (m_epfd >= 0)
+		close(m_epfd);
+#endif
+	m_epfd = -1;
+	m_skts.clear();
+}
+
+bool CSktReactor::Register(CSkt* skt)
+{
+	int fd = skt->SKT_GSkt();
+	if (fd < 0)
+		return false;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	skt->SetWS(false);
+	skt->SetRS(false);
+	skt->SetES(false);
+#ifdef SKT_REACTOR_EPOLL
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.ptr = skt;
+	if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		DBG_E("epoll_ctl add failed, errno is %d \n", errno);
+		return false;
+	}
+#endif
+	m_skts[fd] = skt;
+	return true;
+}
+
+void CSktReactor::Unregister(CSkt* skt)
+{
+	int fd = skt->SKT_GSkt();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<int, CSkt*>::iterator iter = m_skts.find(fd);
+	if (iter == m_skts.end() || iter->second != skt)
+		return;
+#ifdef SKT_REACTOR_EPOLL
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, &ev);
+#endif
+	m_skts.erase(iter);
+}
+
+int CSktReactor::Poll()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_skts.empty())
+		return 0;
+	m_pollCount++;
+#ifdef SKT_REACTOR_EPOLL
+	// a full batch means more sockets are ready, keep going until epoll runs dry
+	struct epoll_event evs[SKT_REACTOR_MAX_EVENTS];
+	int total = 0;
+	int n = 0;
+	do
+	{
+		n = epoll_wait(m_epfd, evs, SKT_REACTOR_MAX_EVENTS, 0);
+		for (int i = 0; i < n; ++i)
+		{
+			CSkt* skt = (CSkt*)evs[i].data.ptr;
+			unsigned int e = evs[i].events;
+			if (e & EPOLLERR)
+				skt->SetES(true);
+			if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+				skt->SetRS(true);
+			if (e & EPOLLOUT)
+				skt->SetWS(true);
+		}
+		if (n > 0)
+			total += n;
+	} while (n == SKT_REACTOR_MAX_EVENTS);
+	return total;
+#else
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	fd_set rset;
+	fd_set wset;
+	fd_set eset;
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	FD_ZERO(&eset);
+	int maxfd = -1;
+	for (std::map<int, CSkt*>::iterator iter = m_skts.begin(); iter != m_skts.end(); ++iter)
+	{
+		FD_SET(iter->first, &rset);
+		FD_SET(iter->first, &wset);
+		FD_SET(iter->first, &eset);
+		if (iter->first > maxfd)
+			maxfd = iter->first;
+	}
+	int ret = select(maxfd + 1, &rset, &wset, &eset, &tv);
+	for (std::map<int, CSkt*>::iterator iter = m_skts.begin(); iter != m_skts.end(); ++iter)
+	{
+		CSkt* skt = iter->second;
+		if (ret < 0)
+		{
+			skt->SetES(true);
+			continue;
+		}
+		skt->SetES(FD_ISSET(iter->first, &eset) != 0);
+		skt->SetRS(FD_ISSET(iter->first, &rset) != 0);
+		skt->SetWS(FD_ISSET(iter->first, &wset) != 0);
+	}
+	return ret;
+#endif
+}
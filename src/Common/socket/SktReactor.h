@@ -0,0 +1,35 @@
+#ifndef _SKTREACTORjkdfiwoeqpmznbv_epwt_lsll_H__
+#define _SKTREACTORjkdfiwoeqpmznbv_epwt_lsll_H__
+#include <map>
+#include <mutex>
+#include "CSkt.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#define SKT_REACTOR_EPOLL
+#endif
+
+// one readiness syscall per tick for every live CSkt.
+// Poll() only refreshes the read/write/error flags of the registered sockets,
+// the connection managers consume them in their own Update.
+// epoll is edge triggered, so a flag stays set until SKT_R/SKT_S hit EWOULDBLOCK.
+// sockets may come and go from several threads, but Poll must not overlap the
+// Updates of the managers it serves, their flags are plain bools.
+class CSktReactor
+{
+public:
+	static CSktReactor* Inst();
+	CSktReactor();
+	~CSktReactor();
+	bool    Register(CSkt* skt);
+	void    Unregister(CSkt* skt);
+	int     Poll();
+	unsigned int GetPollCount() const { return m_pollCount; }
+	int     GetSktCount() const { return (int)m_skts.size(); }
+private:
+	std::mutex              m_mutex;
+	std::map<int, CSkt*>    m_skts;
+	int                     m_epfd;
+	unsigned int            m_pollCount;
+};
+
+#endif
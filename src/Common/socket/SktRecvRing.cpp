@@ -0,0 +1,201 @@
+#include "stdafx.h"
+#include "SktRecvRing.h"
+
+CSktRecvRing::CSktRecvRing()
+{
+	m_chunk = NULL;
+	m_rd = 0;
+	m_wr = 0;
+	m_big = NULL;
+	m_broken = false;
+	m_compressFraming = false;
+	m_streamThreshold = -1;
+	m_streamTotal = 0;
+	m_streamLeft = 0;
+	m_counters = NULL;
+	m_recvUs = 0;
+}
+
+CSktRecvRing::~CSktRecvRing()
+{
+	Reset();
+}
+
+void CSktRecvRing::Reset()
+{
+	if (m_chunk != NULL)
+		m_chunk->Release();
+	m_chunk = NULL;
+	m_rd = 0;
+	m_wr = 0;
+	if (m_big != NULL)
+		delete m_big;
+	m_big = NULL;
+	m_broken = false;
+	m_streamTotal = 0;
+	m_streamLeft = 0;
+}
+
+void CSktRecvRing::PrepareSpace()
+{
+	if (m_chunk == NULL)
+	{
+		if (m_counters != NULL)
+			CSktIOCounters::Add(m_counters->poolAllocs, 1);
+		m_chunk = NTMSG_RecvChunk::Create(SKT_RECV_CHUNK_SIZE);
+		m_rd = 0;
+		m_wr = 0;
+		return;
+	}
+	bool unique = m_chunk->IsUnique();
+	if (m_rd == m_wr && unique)
+	{
+		m_rd = 0;
+		m_wr = 0;
+		return;
+	}
+	if (m_chunk->GetCap() - m_wr >= SKT_RECV_MIN_READ)
+		return;
+	// the tail only holds part of one frame, PopFrame has cut out everything before it
+	int pending = m_wr - m_rd;
+	if (unique)
+	{
+		memmove(m_chunk->GetBuf(), m_chunk->GetBuf() + m_rd, pending);
+	}
+	else
+	{
+		if (m_counters != NULL)
+			CSktIOCounters::Add(m_counters->poolAllocs, 1);
+		NTMSG_RecvChunk* chunk = NTMSG_RecvChunk::Create(SKT_RECV_CHUNK_SIZE);
+		memcpy(chunk->GetBuf(), m_chunk->GetBuf() + m_rd, pending);
+		m_chunk->Release();
+		m_chunk = chunk;
+	}
+	m_rd = 0;
+	m_wr = pending;
+}
+
+// one SKT_R, same return value. frames completed by a read all get its time as arrival
+int CSktRecvRing::Recv(CSkt* skt)
+{
+	int n = 0;
+	if (m_big != NULL)
+	{
+		n = skt->SKT_R(m_big->NTMSG_getRdCapSize(), m_big->NTMSG_getReadBufFr());
+		if (n > 0)
+			m_big->NTMSG_CallWhileReceive(n);
+	}
+	else
+	{
+		PrepareSpace();
+		n = skt->SKT_R(m_chunk->GetCap() - m_wr, m_chunk->GetBuf() + m_wr);
+		if (n > 0)
+			m_wr += n;
+	}
+	if (m_counters != NULL)
+	{
+		CSktIOCounters::Add(m_counters->recvCalls, 1);
+		if (n > 0)
+		{
+			CSktIOCounters::Add(m_counters->bytesRecv, n);
+			m_recvUs = SktStatNowUs();
+		}
+	}
+	return n;
+}
+
+// next complete frame or NULL, the 0xFFFF escape is dropped like NTMSG_CallWhileReceive does.
+// with the compressed framing the top bit of either length form is the compressed flag.
+// while a frame is streamed every call hands out what has been read of it so far.
+NTMSG* CSktRecvRing::PopFrame()
+{
+	if (m_streamLeft > 0)
+	{
+		int have = m_wr - m_rd;
+		if (have <= 0)
+			return NULL;
+		int size = have < m_streamLeft ? have : m_streamLeft;
+		NTMSG* piece = new NTMSG(m_chunk, m_rd, 0, size, false);
+		piece->NTMSG_setStreamPiece(m_streamTotal - m_streamLeft, m_streamTotal);
+		piece->NTMSG_setArrival(m_recvUs);
+		m_rd += size;
+		m_streamLeft -= size;
+		return piece;
+	}
+	if (m_big != NULL)
+	{
+		if (!m_big->NTMSG_IsOver())
+			return NULL;
+		NTMSG* ret = m_big;
+		m_big = NULL;
+		ret->NTMSG_setArrival(m_recvUs);
+		return ret;
+	}
+	if (m_chunk == NULL || m_broken)
+		return NULL;
+	const unsigned char* head = (const unsigned char*)m_chunk->GetBuf() + m_rd;
+	int avail = m_wr - m_rd;
+	if (avail < 2)
+		return NULL;
+	int escapeLen = 0;
+	int headLen = 2;
+	bool compressed = false;
+	int size = (head[0] << 8) | head[1];
+	if (size == 0xFFFF)
+	{
+		if (avail < 6)
+			return NULL;
+		unsigned int longSize = ((unsigned int)head[2] << 24) | (head[3] << 16) | (head[4] << 8) | head[5];
+		if (m_compressFraming)
+		{
+			compressed = (longSize & 0x80000000u) != 0;
+			longSize &= 0x7FFFFFFFu;
+		}
+		if (longSize > 0x7FFFFFFFu)
+		{
+			m_broken = true;
+			return NULL;
+		}
+		size = (int)longSize;
+		escapeLen = 2;
+		headLen = 4;
+	}
+	else if (m_compressFraming)
+	{
+		compressed = (size & 0x8000) != 0;
+		size &= 0x7FFF;
+	}
+	// an inflated frame needs all of its input, compressed ones are always assembled
+	if (m_streamThreshold >= 0 && size > m_streamThreshold && !compressed)
+	{
+		m_rd += escapeLen + headLen;
+		m_streamTotal = size;
+		m_streamLeft = size;
+		return PopFrame();
+	}
+	if (size > SKT_COMPRESS_MAX_FRAME)
+	{
+		m_broken = true;
+		return NULL;
+	}
+	int frameLen = escapeLen + headLen + size;
+	if (frameLen > avail)
+	{
+		if (frameLen > m_chunk->GetCap())
+		{
+			int have = avail - escapeLen - headLen;
+			if (m_counters != NULL)
+				CSktIOCounters::Add(m_counters->poolAllocs, 1);
+			m_big = new NTMSG(headLen + size);
+			m_big->NTMSG_initRecvFrame(headLen, size, compressed);
+			memcpy(m_big->NTMSG_getReadBufFr(), head + escapeLen + headLen, have);
+			m_big->NTMSG_CallWhileReceive(have);
+			m_rd = m_wr;
+		}
+		return NULL;
+	}
+	NTMSG* msg = new NTMSG(m_chunk, m_rd + escapeLen, headLen, size, compressed);
+	msg->NTMSG_setArrival(m_recvUs);
+	m_rd += frameLen;
+	return msg;
+}
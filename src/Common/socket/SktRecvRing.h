@@ -0,0 +1,49 @@
+#ifndef _SKTRECVRINGmzbqoweiruty_recvring_lsll_H__
+#define _SKTRECVRINGmzbqoweiruty_recvring_lsll_H__
+#include "CSkt.h"
+#include "NTMSG.h"
+#include "SktStat.h"
+#include "SktCompress.h"
+
+#define SKT_RECV_CHUNK_SIZE     (65536)
+#define SKT_RECV_MIN_READ       (4096)
+
+// receive side of one connection.
+// the socket is drained into 64K chunks with as few SKT_R calls as possible and the
+// frames are cut out in place, every frame that fits in a chunk becomes an NTMSG view
+// into it. only the partial frame at the tail is copied when a chunk runs full, and a
+// frame bigger than a chunk is read straight into an NTMSG of its own.
+// with a stream threshold set, an uncompressed frame above it is never assembled: its payload
+// comes out as pieces viewing the chunks it was read into, so a frame of any size only ever
+// holds the chunks not consumed yet.
+// a length past SKT_COMPRESS_MAX_FRAME, or past what an int holds for a streamed frame, can only
+// come from a broken or hostile peer: nothing more is parsed and IsBroken says so until Reset.
+class CSktRecvRing
+{
+public:
+	CSktRecvRing();
+	~CSktRecvRing();
+	int     Recv(CSkt* skt);
+	NTMSG*  PopFrame();
+	void    Reset();
+	bool    IsBroken() const { return m_broken; }
+	void    SetCompressFraming(bool on)  { m_compressFraming = on; }
+	void    SetStreamThreshold(int bytes) { m_streamThreshold = bytes; }
+	void    SetCounters(CSktIOCounters* counters) { m_counters = counters; }
+private:
+	void    PrepareSpace();
+	NTMSG_RecvChunk*    m_chunk;
+	int                 m_rd;
+	int                 m_wr;
+	NTMSG*              m_big;
+	bool                m_broken;
+	bool                m_compressFraming;
+	int                 m_streamThreshold;
+	// payload size and bytes still to come of the frame being streamed, m_streamLeft is 0 otherwise
+	int                 m_streamTotal;
+	int                 m_streamLeft;
+	CSktIOCounters*     m_counters;
+	Int64               m_recvUs;
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "stdafx.h"
+#include "SktResolver.h"
+#include <string.h>
+#include "Common/ENG_DBG.h"
+
+CSktResolver* CSktResolver::Inst()
+{
+	static CSktResolver resolver;
+	return &resolver;
+}
+
+CSktResolver::CSktResolver()
+{
+	m_thread = NULL;
+	m_running = false;
+	m_resolveFunc = ResolveByGetaddrinfo;
+	m_ttlMs = SKT_RESOLVER_TTL_MS;
+	m_failTtlMs = SKT_RESOLVER_FAIL_TTL_MS;
+	m_nextTicket = 1;
+	memset(&m_stat, 0, sizeof(m_stat));
+}
+
+// a lookup stuck in the system resolver delays this until it returns
+CSktResolver::~CSktResolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cond.notify_all();
+	if (m_thread != NULL)
+	{
+		m_thread->join();
+		delete m_thread;
+		m_thread = NULL;
+	}
+}
+
+static int fillResolvedList(struct addrinfo* res, SktResolvedList& out)
+{
+	for (struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next)
+	{
+		if (ai->ai_addr == NULL || ai->ai_addrlen > sizeof(struct sockaddr_storage))
+			continue;
+		SktResolvedAddr addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.family = ai->ai_family;
+		addr.socktype = ai->ai_socktype;
+		addr.protocol = ai->ai_protocol;
+		addr.addrlen = (int)ai->ai_addrlen;
+		memcpy(&addr.addr, ai->ai_addr, ai->ai_addrlen);
+		out.push_back(addr);
+	}
+	return out.empty() ? -1 : 0;
+}
+
+int CSktResolver::ResolveByGetaddrinfo(const char* host, SktResolvedList& out)
+{
+	struct addrinfo hints;
+	struct addrinfo* res = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_family = AF_UNSPEC;
+	int err = getaddrinfo(host, NULL, &hints, &res);
+	if (err != 0)
+	{
+		DBG_L("getaddrinfo error content: %s", gai_strerror(err));
+		return err;
+	}
+	err = fillResolvedList(res, out);
+	freeaddrinfo(res);
+	return err;
+}
+
+// returns 0 with out/err filled when the answer is known now, else a ticket for Take
+int CSktResolver::Request(const char* host, SktResolvedList& out, int& err)
+{
+	out.clear();
+	// literal addresses never need the resolver
+	struct addrinfo hints;
+	struct addrinfo* res = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_flags = AI_NUMERICHOST;
+	if (getaddrinfo(host, NULL, &hints, &res) == 0)
+	{
+		err = fillResolvedList(res, out);
+		freeaddrinfo(res);
+		return 0;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, CacheEntry>::iterator cached = m_cache.find(host);
+	if (cached != m_cache.end())
+	{
+		if (std::chrono::steady_clock::now() < cached->second.expire)
+		{
+			m_stat.cacheHits++;
+			out = cached->second.addrs;
+			err = cached->second.err;
+			return 0;
+		}
+		m_cache.erase(cached);
+	}
+	m_stat.cacheMisses++;
+	int ticket = m_nextTicket++;
+	if (m_nextTicket <= 0)
+		m_nextTicket = 1;
+	Job& job = m_jobs[ticket];
+	job.host = host;
+	job.done = false;
+	job.err = 0;
+	// one lookup per host no matter how many sockets wait for it
+	if (m_inflight.insert(job.host).second)
+		m_queue.push_back(job.host);
+	if (m_thread == NULL)
+	{
+		m_running = true;
+		m_thread = new std::thread(&CSktResolver::Run, this);
+	}
+	m_cond.notify_one();
+	return ticket;
+}
+
+// true once the lookup behind ticket finished, the ticket is spent then
+bool CSktResolver::Take(int ticket, SktResolvedList& out, int& err)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<int, Job>::iterator iter = m_jobs.find(ticket);
+	if (iter == m_jobs.end())
+	{
+		err = -1;
+		return true;
+	}
+	if (!iter->second.done)
+		return false;
+	out.swap(iter->second.addrs);
+	err = iter->second.err;
+	m_jobs.erase(iter);
+	return true;
+}
+
+// the lookup itself keeps running and still fills the cache
+void CSktResolver::Cancel(int ticket)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_jobs.erase(ticket);
+}
+
+void CSktResolver::SetTTL(int ttlMs, int failTtlMs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ttlMs = ttlMs;
+	m_failTtlMs = failTtlMs;
+	m_cache.clear();
+}
+
+void CSktResolver::SetResolveFunc(SktResolveFunc fn)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_resolveFunc = fn != NULL ? fn : ResolveByGetaddrinfo;
+	m_cache.clear();
+}
+
+void CSktResolver::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.clear();
+}
+
+void CSktResolver::GetStat(SktResolverStat& stat)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	stat = m_stat;
+}
+
+void CSktResolver::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_running)
+	{
+		if (m_queue.empty())
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+		std::string host = m_queue.front();
+		m_queue.pop_front();
+		SktResolveFunc resolveFunc = m_resolveFunc;
+		lock.unlock();
+		SktResolvedList addrs;
+		int err = resolveFunc(host.c_str(), addrs);
+		lock.lock();
+		m_stat.lookups++;
+		if (err != 0)
+			m_stat.failures++;
+		int ttlMs = err == 0 ? m_ttlMs : m_failTtlMs;
+		if (ttlMs > 0)
+		{
+			CacheEntry& entry = m_cache[host];
+			entry.err = err;
+			entry.addrs = addrs;
+			entry.expire = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttlMs);
+		}
+		for (std::map<int, Job>::iterator iter = m_jobs.begin(); iter != m_jobs.end(); ++iter)
+		{
+			if (iter->second.done || iter->second.host != host)
+				continue;
+			iter->second.done = true;
+			iter->second.err = err;
+			iter->second.addrs = addrs;
+		}
+		m_inflight.erase(host);
+	}
+}
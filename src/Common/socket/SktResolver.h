@@ -0,0 +1,92 @@
+#ifndef _SKTRESOLVERqmwnebrvtcyx_dnsworker_lsll_H__
+#define _SKTRESOLVERqmwnebrvtcyx_dnsworker_lsll_H__
+#ifdef WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+#include <map>
+#include <set>
+#include <list>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define SKT_RESOLVER_TTL_MS        (300 * 1000)
+#define SKT_RESOLVER_FAIL_TTL_MS   (5 * 1000)
+
+// one resolved address, it owns its sockaddr so cache entries outlive getaddrinfo
+struct SktResolvedAddr
+{
+	int     family;
+	int     socktype;
+	int     protocol;
+	int     addrlen;
+	struct sockaddr_storage addr;
+};
+typedef std::vector<SktResolvedAddr> SktResolvedList;
+
+// 0 and out filled on success, else a nonzero error. tests swap in a stub to run offline
+typedef int (*SktResolveFunc)(const char* host, SktResolvedList& out);
+
+struct SktResolverStat
+{
+	int     cacheHits;
+	int     cacheMisses;
+	int     lookups;
+	int     failures;
+};
+
+// host name lookups off the lua thread with a host -> address cache.
+// Request answers cache hits and numeric addresses at once, everything else
+// goes to one worker thread and is picked up later with Take by ticket.
+// getaddrinfo has no ttl, entries live for the configured time instead.
+class CSktResolver
+{
+public:
+	static CSktResolver* Inst();
+	CSktResolver();
+	~CSktResolver();
+	int     Request(const char* host, SktResolvedList& out, int& err);
+	bool    Take(int ticket, SktResolvedList& out, int& err);
+	void    Cancel(int ticket);
+	void    SetTTL(int ttlMs, int failTtlMs);
+	void    SetResolveFunc(SktResolveFunc fn);
+	void    Flush();
+	void    GetStat(SktResolverStat& stat);
+	static int  ResolveByGetaddrinfo(const char* host, SktResolvedList& out);
+private:
+	struct Job
+	{
+		std::string         host;
+		bool                done;
+		int                 err;
+		SktResolvedList     addrs;
+	};
+	struct CacheEntry
+	{
+		int                 err;
+		SktResolvedList     addrs;
+		std::chrono::steady_clock::time_point expire;
+	};
+	void    Run();
+	std::mutex                      m_mutex;
+	std::condition_variable         m_cond;
+	std::thread*                    m_thread;
+	bool                            m_running;
+	SktResolveFunc                  m_resolveFunc;
+	int                             m_ttlMs;
+	int                             m_failTtlMs;
+	int                             m_nextTicket;
+	std::map<int, Job>              m_jobs;
+	std::list<std::string>          m_queue;
+	std::set<std::string>           m_inflight;
+	std::map<std::string, CacheEntry> m_cache;
+	SktResolverStat                 m_stat;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _SKTSPSCRINGkdlsoeiqpzmx_ringbuf_lsll_H__
+#define _SKTSPSCRINGkdlsoeiqpzmx_ringbuf_lsll_H__
+#include <atomic>
+
+// lock-free ring for exactly one producer thread and one consumer thread.
+// N must be a power of two, Push fails when full and Pop fails when empty.
+template <typename T, unsigned int N>
+class CSktSPSCRing
+{
+public:
+	CSktSPSCRing()
+	{
+		m_head.store(0);
+		m_tail.store(0);
+	}
+	bool Push(const T& v)
+	{
+		unsigned int t = m_tail.load(std::memory_order_relaxed);
+		if (t - m_head.load(std::memory_order_acquire) == N)
+			return false;
+		m_items[t & (N - 1)] = v;
+		m_tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool Pop(T& v)
+	{
+		unsigned int h = m_head.load(std::memory_order_relaxed);
+		if (h == m_tail.load(std::memory_order_acquire))
+			return false;
+		v = m_items[h & (N - 1)];
+		m_head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	bool Empty() const
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+	}
+	unsigned int Size() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+private:
+	T                           m_items[N];
+	char                        m_padA[64];
+	std::atomic<unsigned int>   m_head;
+	char                        m_padB[64];
+	std::atomic<unsigned int>   m_tail;
+	char                        m_padC[64];
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _SKTSTATqpwoeirutyalskd_telemetry_lsll_H__
+#define _SKTSTATqpwoeirutyalskd_telemetry_lsll_H__
+#include <atomic>
+#include <chrono>
+#include "NTMSG.h"
+
+// bucket 0 is under 1us, bucket i holds [2^(i-1), 2^i) us, the last one is open ended (8s and up)
+#define SKT_STAT_HIST_BUCKETS      (24)
+
+// snapshot of one connection, see CSocketConnectionManager::GetStats
+struct SktConnStat
+{
+	Int64   bytesSent;
+	Int64   bytesRecv;
+	Int64   framesSent;
+	Int64   framesRecv;
+	Int64   sendCalls;
+	Int64   recvCalls;
+	Int64   pollCalls;      // io thread polls, or ticks that consumed reactor readiness
+	Int64   partialWrites;
+	Int64   poolAllocs;     // receive chunks and oversized frames taken from the NTMSG pool
+	int     sendQueueDepth;
+	int     sendQueueMax;
+	int     recvQueueDepth;
+	int     recvQueueMax;
+	Int64   dispatchHist[SKT_STAT_HIST_BUCKETS];   // frame arrival to lua dispatch
+};
+
+// counters bumped next to the syscalls, by the lua thread or by the io thread.
+// relaxed adds are enough, readers only want a roughly current total
+class CSktIOCounters
+{
+public:
+	CSktIOCounters() { Reset(); }
+	void    Reset()
+	{
+		bytesSent.store(0, std::memory_order_relaxed);
+		bytesRecv.store(0, std::memory_order_relaxed);
+		framesSent.store(0, std::memory_order_relaxed);
+		sendCalls.store(0, std::memory_order_relaxed);
+		recvCalls.store(0, std::memory_order_relaxed);
+		pollCalls.store(0, std::memory_order_relaxed);
+		partialWrites.store(0, std::memory_order_relaxed);
+		poolAllocs.store(0, std::memory_order_relaxed);
+	}
+	static void Add(std::atomic<Int64>& counter, Int64 v) { counter.fetch_add(v, std::memory_order_relaxed); }
+	std::atomic<Int64>  bytesSent;
+	std::atomic<Int64>  bytesRecv;
+	std::atomic<Int64>  framesSent;
+	std::atomic<Int64>  sendCalls;
+	std::atomic<Int64>  recvCalls;
+	std::atomic<Int64>  pollCalls;
+	std::atomic<Int64>  partialWrites;
+	std::atomic<Int64>  poolAllocs;
+};
+
+inline Int64 SktStatNowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int SktStatBucketOf(Int64 us)
+{
+	int bucket = 0;
+	while (us > 0 && bucket < SKT_STAT_HIST_BUCKETS - 1)
+	{
+		us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+#endif
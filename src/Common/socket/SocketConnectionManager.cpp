@@ -7,6 +7,8 @@
 #endif
 #include "stdio.h"
 #include "SocketConnectionManager.h"
+#include "SktReactor.h"
+#include "SktIOThread.h"
 
 #define CONNECT_TIMEOUT         5000
 #ifdef WIN32
@@ -36,10 +38,15 @@ void CSocketConnectionManager::SetNtConState(int stat)
 void CSocketConnectionManager::InitValue()
 {
 	m_scmpSocket = NULL;
+	m_ioThread = NULL;
 	m_portNumber = -1;
 	SetNtConState(NetConState_Disconnected);
 	m_tOutTimerSocketConnecting = -1;
 	m_endecodeinited = false;
+	m_resolveTicket = 0;
+	m_replay = NULL;
+	m_arq = NULL;
+	m_unrelNonce = 0;
 }
 CSocketConnectionManager::CSocketConnectionManager()
 {    
@@ -48,6 +55,24 @@ CSocketConnectionManager::CSocketConnectionManager()
 	m_retryconnectcount = 0;
 	m_instanceName		= "defaultSocket";
 	m_instanceName2		= "Socket2";
+	m_useIOThread		= false;
+	m_compressThreshold	= -1;
+	m_streamThreshold	= -1;
+	m_transport			= SKT_TRANSPORT_TCP;
+	CSktArq::DefaultConfig(m_arqConfig);
+	m_sendSeed			= 0;
+	m_recvSeed			= 0;
+	m_sendWireBytes		= 0;
+	memset(m_sendLaneBytes, 0, sizeof(m_sendLaneBytes));
+	m_sendHighBytes		= 0;
+	m_sendLowBytes		= 0;
+	m_sendHighMsgs		= 0;
+	m_sendLowMsgs		= 0;
+	m_sendQueueHigh		= false;
+	memset(&m_stat, 0, sizeof(m_stat));
+	m_dispatchClockUs	= 0;
+	m_dispatchPops		= 0;
+	m_recvBytes.SetCounters(&m_ioCounters);
 	memset(m_sADDR, 0, sizeof(m_sADDR));
 	m_SocketNameForMultSocket = "";
 }
@@ -56,6 +81,7 @@ CSocketConnectionManager::~CSocketConnectionManager()
 {
     CloseConnect();
     ClearCachedMsg();
+	CHECK_DEL(m_ioThread);
 }
 bool CSocketConnectionManager::CheckEnableOfUpdate()
 {
@@ -120,64 +146,135 @@ bool CSocketConnectionManager::UpdateConnectingStatus(int dt)
 	 
 }
 
-NTMSG*  CSocketConnectionManager::GenNTMSGWhileRead()
+bool CSocketConnectionManager::UpdateCheckReadFlag()
 {
-	NTMSG* pMessageFromRecvList = NULL;
-	if (!m_recvMessageList.empty())
-	{
-		pMessageFromRecvList = m_recvMessageList.back();
-		if (pMessageFromRecvList->NTMSG_IsOver())
+	while (m_scmpSocket->getRS()) {
+		int DataSizeReceived = m_recvBytes.Recv(m_scmpSocket);
+		if (DataSizeReceived < 0 && m_scmpSocket->SKT_IsWB())
+		{
+			m_scmpSocket->SetRS(false);
+			break;
+		}
+		if (DataSizeReceived <= 0)
 		{
 #ifdef DEBUG_SOCKET_INFOMA
-			DBG_L("set to null  \n");
+			DBG_L("receive zero byte meaning socket colose by server or client!!!\n");
+#endif
+			OnErrorOfErrorCode(NetErrorCode_RecvZeroByte);
+#ifdef DEBUG_SOCKET_INFOMA
+			DBG_L("send error code NetErrorCode_RecvZeroByte!!!\n");
 #endif
-			pMessageFromRecvList = NULL;
+			return true;
 		}
-		else
+		NTMSG* pMessageFromRecvList = NULL;
+		while ((pMessageFromRecvList = m_recvBytes.PopFrame()) != NULL)
+			QueueRecvNTMSG(pMessageFromRecvList);
+		if (m_recvBytes.IsBroken())
 		{
-#ifdef DEBUG_SOCKET_INFOMA				
-			pMessageFromRecvList = NULL;
-#endif
+			OnErrorOfErrorCode(NetErrorCode_BadFrame);
+			return true;
 		}
 	}
+	return false;
+}
+// frames are queued as they came off the wire and only decoded once they reach the head of
+// the queue, in wire order. a seed lua sets while it handles one frame applies from the next
+// one on, however many frames the same read brought in
+void CSocketConnectionManager::QueueRecvNTMSG(NTMSG* msg)
+{
+	m_recvMessageList.push_back(msg);
+	m_stat.framesRecv++;
+	if ((int)m_recvMessageList.size() > m_stat.recvQueueMax)
+		m_stat.recvQueueMax = (int)m_recvMessageList.size();
+}
 
-	if (!pMessageFromRecvList)
+// decrypts and inflates one queued frame in place, msg is NULL after when it was a probe reply.
+// false when it can not be inflated, msg is freed then.
+// pieces of a streamed frame are decrypted in order like the rest of the stream and left as
+// they are, they are neither captured nor offered to the probe
+bool CSocketConnectionManager::DecodeRecvNTMSG(NTMSG*& msg)
+{
+	DoDecodeofNTMSG(msg);
+	msg->NTMSG_setCipherDone(true);
+	if (msg->NTMSG_IsStreamPiece())
+		return true;
+	if (msg->NTMSG_IsCompressed())
 	{
-#ifdef DEBUG_SOCKET_INFOMA
-		DBG_L("create an empty to receive data !!!\n");
-#endif
-		pMessageFromRecvList = new NTMSG();
-		m_recvMessageList.push_back(pMessageFromRecvList);
+		Int64 arrivalUs = msg->NTMSG_getArrival();
+		NTMSG* plain = m_compress.DecompressNTMSG(msg);
+		if (plain == NULL)
+		{
+			delete msg;
+			msg = NULL;
+			return false;
+		}
+		plain->NTMSG_setArrival(arrivalUs);
+		plain->NTMSG_setCipherDone(true);
+		msg = plain;
+	}
+	if (m_probe.IsOn() && m_probe.OnFrame(msg->NTMSG_getPayload(), msg->NTMSG_GetSizeAndType(),
+		msg->NTMSG_getArrival() > 0 ? msg->NTMSG_getArrival() : SktStatNowUs()))
+	{
+		delete msg;
+		msg = NULL;
+		return true;
 	}
-	return pMessageFromRecvList;
+	if (CSktCapture::Inst()->IsOn())
+		CSktCapture::Inst()->Record(SKT_CAPTURE_IN, m_SocketNameForMultSocket, msg->NTMSG_getPayload(), msg->NTMSG_GetSizeAndType());
+	return true;
 }
 
-bool CSocketConnectionManager::UpdateCheckReadFlag()
+// decodes the head of the queue, probe replies on the way are used up. false when nothing is
+// left, or when a frame could not be inflated: everything behind it is dropped and the link closed
+bool CSocketConnectionManager::PrepareRecvHead()
 {
-	while (m_scmpSocket->getRS()) {
-		NTMSG* pMessageFromRecvList = NULL;
-		pMessageFromRecvList = GenNTMSGWhileRead();
-		ENG_ASSERT(pMessageFromRecvList->NTMSG_getRdCapSize() > 0, "read buf size error errorr.");
-		int DataSizeReceived = m_scmpSocket->SKT_R(pMessageFromRecvList->NTMSG_getRdCapSize(),pMessageFromRecvList->NTMSG_getReadBufFr());
-		if (DataSizeReceived <= 0)
-		{
-#ifdef DEBUG_SOCKET_INFOMA
-			DBG_L("receive zero byte meaning socket colose by server or client!!!\n");
-#endif
-			OnErrorOfErrorCode(NetErrorCode_RecvZeroByte);
-#ifdef DEBUG_SOCKET_INFOMA
-			DBG_L("send error code NetErrorCode_RecvZeroByte!!!\n");
-#endif
+	while (!m_recvMessageList.empty())
+	{
+		NTMSG*& head = m_recvMessageList.front();
+		if (head->NTMSG_IsCipherDone())
 			return true;
+		if (!DecodeRecvNTMSG(head))
+		{
+			m_recvMessageList.pop_front();
+			for (std::deque<NTMSG*>::iterator iter = m_recvMessageList.begin(); iter != m_recvMessageList.end(); ++iter)
+				delete *iter;
+			m_recvMessageList.clear();
+			OnErrorOfErrorCode(NetErrorCode_Decompress);
+			return false;
 		}
-		DoDecodeofNTMSG(pMessageFromRecvList, DataSizeReceived);
-		
-		pMessageFromRecvList->NTMSG_CallWhileReceive(DataSizeReceived);
-		CheckSocketConnectState();
+		if (head == NULL)
+			m_recvMessageList.pop_front();
 	}
 	return false;
 }
-bool CSocketConnectionManager::DoDecodeofNTMSG(NTMSG * mtmsg,int datasr)
+
+// the keys go away with the link, whatever it left in the queue is decoded with them first
+void CSocketConnectionManager::DecodeQueuedRecv()
+{
+	std::deque<NTMSG*>::iterator iter = m_recvMessageList.begin();
+	while (iter != m_recvMessageList.end())
+	{
+		if ((*iter)->NTMSG_IsCipherDone())
+		{
+			++iter;
+			continue;
+		}
+		if (!DecodeRecvNTMSG(*iter))
+		{
+			for (std::deque<NTMSG*>::iterator rest = iter + 1; rest != m_recvMessageList.end(); ++rest)
+				delete *rest;
+			m_recvMessageList.erase(iter, m_recvMessageList.end());
+			return;
+		}
+		if (*iter == NULL)
+			iter = m_recvMessageList.erase(iter);
+		else
+			++iter;
+	}
+}
+
+// DoDecodeofNTMSG runs once per frame, when it reaches the head of the queue
+bool CSocketConnectionManager::DoDecodeofNTMSG(NTMSG * mtmsg)
 {
 	NTMSG * pMessageFromRecvList = mtmsg;
 	if (pMessageFromRecvList->NTMSG_GetSizeAndType() >= 0)
@@ -185,78 +282,232 @@ bool CSocketConnectionManager::DoDecodeofNTMSG(NTMSG * mtmsg,int datasr)
 #ifdef DEBUG_SOCKET_INFOMA
 		DBG_L("decode msg data !!!\n");
 #endif
-		DecodeEncryptBuf(pMessageFromRecvList->NTMSG_getCBuf(), datasr);
+		DecodeEncryptBuf(pMessageFromRecvList->NTMSG_getPayload(), pMessageFromRecvList->NTMSG_GetSizeAndType());
 #ifdef DEBUG_SOCKET_INFOMA
 		DBG_L("decode msg data end!!!\n");
 #endif
 	}
 	return true;
 }
-bool CSocketConnectionManager::UpdateCheckWriteFlagNTMSG(NTMSG*ntmsg)
+// gathers up to SKT_IOV_MAX queued frames into one SKT_SV call per pass and hands the
+// written bytes back frame by frame, a partially written frame stays at the front.
+// returns -1 while the socket is healthy, else the NetErrorCode to report.
+// sentBytes gets the bytes that went out during the call.
+int CSocketConnectionManager::SendGatherNTMSG(CSkt* skt, std::list<NTMSG*>& sendList, std::vector<SKT_IOV>& iov, CSktIOCounters& counters, int& sentBytes)
 {
-	NTMSG* pMessageFromSendList = ntmsg;
-	while (!pMessageFromSendList->NTMSG_IsOver())
+	sentBytes = 0;
+	int framesDone = 0;
+	if (iov.size() < SKT_IOV_MAX)
+		iov.resize(SKT_IOV_MAX);
+	while (!sendList.empty())
 	{
-		int sizeSendedbufsz = m_scmpSocket->SKT_S(pMessageFromSendList->NTMSG_getSdCapSize(), pMessageFromSendList->NTMSG_getCBuf());
-		if (sizeSendedbufsz >= 0)
-			pMessageFromSendList->NTMSG_CallWhileSend(sizeSendedbufsz);
+		int iovCount = 0;
+		int iovBytes = 0;
+		for (std::list<NTMSG*>::iterator iter = sendList.begin(); iter != sendList.end() && iovCount < SKT_IOV_MAX; ++iter)
+		{
+			int capOfNTMSG = (*iter)->NTMSG_getSdCapSize();
+			SKT_IOV_SET(iov[iovCount], (*iter)->NTMSG_getCBuf(), capOfNTMSG);
+			iovBytes += capOfNTMSG;
+			++iovCount;
+		}
+		int sizeSendedbufsz = skt->SKT_SV(iovCount, &iov[0]);
+		CSktIOCounters::Add(counters.sendCalls, 1);
+		if (sizeSendedbufsz < 0 && skt->SKT_IsWB())
+		{
+			skt->SetWS(false);
+			break;
+		}
 		if (sizeSendedbufsz < 0)
 		{
 #ifdef DEBUG_SOCKET_INFOMA
 			DBG_L("send zerobyte by send always socket connet off by server or client \n");
 #endif
-			OnErrorOfErrorCode(NetErrorCode_SendZeroByte);
-			return true;
+			CSktIOCounters::Add(counters.bytesSent, sentBytes);
+			CSktIOCounters::Add(counters.framesSent, framesDone);
+			return NetErrorCode_SendZeroByte;
+		}
+		int leftOfSended = sizeSendedbufsz;
+		sentBytes += sizeSendedbufsz;
+		while (leftOfSended > 0)
+		{
+			NTMSG* pMessageFromSendList = sendList.front();
+			int capOfNTMSG = pMessageFromSendList->NTMSG_getSdCapSize();
+			int usedOfNTMSG = leftOfSended < capOfNTMSG ? leftOfSended : capOfNTMSG;
+			pMessageFromSendList->NTMSG_CallWhileSend(usedOfNTMSG);
+			leftOfSended -= usedOfNTMSG;
+			if (!pMessageFromSendList->NTMSG_IsOver())
+				break;
+			delete pMessageFromSendList;
+			sendList.pop_front();
+			framesDone++;
+		}
+		// a short write means the kernel buffer is full, the next pass would only see EWOULDBLOCK
+		if (sizeSendedbufsz < iovBytes)
+		{
+			CSktIOCounters::Add(counters.partialWrites, 1);
+			break;
 		}
 	}
-	return false;
+	CSktIOCounters::Add(counters.bytesSent, sentBytes);
+	CSktIOCounters::Add(counters.framesSent, framesDone);
+	return -1;
 }
+// the wire list is topped up from the lanes SKT_SEND_WIRE_BYTES at a time,
+// so an urgent frame never queues behind more than that much bulk
 bool CSocketConnectionManager::UpdateCheckWriteFlag()
 {
 	while (m_scmpSocket->getWS())
 	{
-		if (m_sendMessageList.empty())
+		NTMSG* msg = NULL;
+		while (m_sendWireBytes < SKT_SEND_WIRE_BYTES && (msg = PopSendLane()) != NULL)
 		{
-			break;
+			m_sendMessageList.push_back(msg);
+			m_sendWireBytes += msg->NTMSG_getSdCapSize();
 		}
-		else
+		if (m_sendMessageList.empty())
+			break;
+		int sentBytes = 0;
+		int errorCode = SendGatherNTMSG(m_scmpSocket, m_sendMessageList, m_sendIov, m_ioCounters, sentBytes);
+		m_sendWireBytes -= sentBytes;
+		if (errorCode >= 0)
 		{
-			NTMSG* pMessageFromSendList = m_sendMessageList.front();
-			if(UpdateCheckWriteFlagNTMSG(pMessageFromSendList))
-				return true;
-#ifdef DEBUG_SOCKET_INFOMA
-			int sizeSendedbufsz = m_scmpSocket->SKT_S(pMessageFromSendList->getSendCap(),pMessageFromSendList->getCurrentBuf());
-			if (sizeSendedbufsz >= 0)
-				pMessageFromSendList->onSend(sizeSendedbufsz);
-			if (sizeSendedbufsz < 0)
-			{
-#ifdef DEBUG_SOCKET_INFOMA
-				DBG_L("send zerobyte by send always socket connet off by server or client \n");
-#endif
-				OnErrorOfErrorCode(NetErrorCode_SendZeroByte);
-				return true;
-			}
-#endif
-
-			if (pMessageFromSendList->NTMSG_IsOver())
-			{
-#ifdef DEBUG_SOCKET_INFOMA
-				DBG_L("pMessageFromSendList->isEnd() \n", pMessageFromSendList->isEnd());
-#endif
-				delete pMessageFromSendList;
-			}
-			m_sendMessageList.pop_front();
+			OnErrorOfErrorCode(errorCode);
+			return true;
 		}
-		CheckSocketConnectState();
+		// anything left means the kernel buffer is full
+		if (!m_sendMessageList.empty())
+			break;
 	}
+	CheckSendWatermarks();
 	return false;
 }
+
+// next frame in lane priority order, encrypted here because the stream cipher has to see
+// frames in the order they go on the wire
+NTMSG* CSocketConnectionManager::PopSendLane()
+{
+	for (int lane = 0; lane < SKT_LANE_COUNT; lane++)
+	{
+		if (m_sendLanes[lane].empty())
+			continue;
+		NTMSG* msg = m_sendLanes[lane].front();
+		m_sendLanes[lane].pop_front();
+		m_sendLaneBytes[lane] -= msg->NTMSG_getSdCapSize();
+		EncodeEncryptMsg(msg);
+		return msg;
+	}
+	return NULL;
+}
+
+void CSocketConnectionManager::GetSendLaneDepth(int lane, int& msgs, int& bytes) const
+{
+	msgs = 0;
+	bytes = 0;
+	if (lane < 0 || lane >= SKT_LANE_COUNT)
+		return;
+	msgs = (int)m_sendLanes[lane].size();
+	bytes = m_sendLaneBytes[lane];
+}
+
+// frames already taken off the lanes but not written yet, the io threads ones included
+void CSocketConnectionManager::GetSendInflightDepth(int& msgs, int& bytes) const
+{
+	msgs = (int)m_sendMessageList.size();
+	bytes = m_sendWireBytes;
+	if (m_ioThread != NULL && m_ioThread->IsRunning())
+	{
+		msgs += m_ioThread->GetQueuedMsgs();
+		bytes += m_ioThread->GetQueuedBytes();
+	}
+}
+
+// <= 0 leaves that dimension out, the low marks only matter once a high mark was crossed
+void CSocketConnectionManager::SetSendWatermarks(int highBytes, int lowBytes, int highMsgs, int lowMsgs)
+{
+	m_sendHighBytes = highBytes;
+	m_sendLowBytes = lowBytes;
+	m_sendHighMsgs = highMsgs;
+	m_sendLowMsgs = lowMsgs;
+}
+
+// OnSendQueueHigh fires once when either high mark is reached, OnSendQueueLow once
+// the queue is back under both low marks
+void CSocketConnectionManager::CheckSendWatermarks()
+{
+	if (m_sendHighBytes <= 0 && m_sendHighMsgs <= 0)
+		return;
+	int msgs = 0;
+	int bytes = 0;
+	GetSendInflightDepth(msgs, bytes);
+	for (int lane = 0; lane < SKT_LANE_COUNT; lane++)
+	{
+		msgs += (int)m_sendLanes[lane].size();
+		bytes += m_sendLaneBytes[lane];
+	}
+	if (!m_sendQueueHigh)
+	{
+		if ((m_sendHighBytes > 0 && bytes >= m_sendHighBytes) || (m_sendHighMsgs > 0 && msgs >= m_sendHighMsgs))
+		{
+			m_sendQueueHigh = true;
+			lua::OnSendQueueHigh(m_SocketNameForMultSocket.c_str(), bytes, msgs);
+		}
+	}
+	else if ((m_sendHighBytes <= 0 || bytes <= m_sendLowBytes) && (m_sendHighMsgs <= 0 || msgs <= m_sendLowMsgs))
+	{
+		m_sendQueueHigh = false;
+		lua::OnSendQueueLow(m_SocketNameForMultSocket.c_str(), bytes, msgs);
+	}
+}
+
+// parked coroutines are checked once the network side is done with this frame, whichever
+// way it returned
 void CSocketConnectionManager::Update(int dt)
 {
+	UpdateNet(dt);
+	if (m_async.HasWaiters())
+		m_async.CheckWaiters(this);
+}
+
+void CSocketConnectionManager::UpdateNet(int dt)
+{
+	if (m_replay != NULL)
+	{
+		UpdateReplay();
+		return;
+	}
+	if (m_resolveTicket != 0)
+	{
+		UpdateResolving(dt);
+		return;
+	}
+	if (m_racer.IsActive())
+	{
+		UpdateRacing(dt);
+		return;
+	}
 	if (!CheckEnableOfUpdate())
 		return;
-	CheckSocketConnectState();
-	if (GetStateOfNet() == NetConState_ConnectError)	return;
+	// the next dispatch reads the clock again
+	m_dispatchPops = 0;
+	if (m_probe.IsOn() && GetStateOfNet() == NetConState_Connected)
+	{
+		UpdateProbe();
+		// a threshold callback may have closed the link
+		if (!CheckEnableOfUpdate())
+			return;
+	}
+	if (m_arq != NULL)
+	{
+		UpdateArq();
+		return;
+	}
+	if (m_ioThread != NULL && m_ioThread->IsRunning())
+	{
+		UpdateIOThread();
+		return;
+	}
+	if (!CheckSocketConnectState())	return;
+	CSktIOCounters::Add(m_ioCounters.pollCalls, 1);
 	if (GetStateOfNet() == NetConState_Connecting)
 	{
 		if (UpdateConnectingStatus(dt))
@@ -268,163 +519,71 @@ void CSocketConnectionManager::Update(int dt)
 	if (UpdateCheckReadFlag())
 		return;
 }
-bool CSocketConnectionManager::DoConnectToAddr_socket(addrinfo*resaddrinfo,int port)
+// the host is looked up by CSktResolver, a cached or literal address connects right away,
+// otherwise the manager waits in NetConState_Connecting until UpdateResolving gets the answer
+bool CSocketConnectionManager::DoConnectToAddrPort(int port ,const char* oldpAddr)
 {
-	struct addrinfo*aipaddrinfo = resaddrinfo;
-	for (; aipaddrinfo; aipaddrinfo = aipaddrinfo->ai_next)
+	memcpy(m_sADDR, oldpAddr, strlen(oldpAddr) + 1);
+	m_portNumber = port;	
+	SktResolvedList resolvedaddrs;
+	int errorCodeOfResolve = 0;
+	m_resolveTicket = CSktResolver::Inst()->Request(oldpAddr, resolvedaddrs, errorCodeOfResolve);
+	if (m_resolveTicket != 0)
 	{
-		struct sockaddr_in * tmpsockaddrin = NULL;
-		tmpsockaddrin = (struct sockaddr_in*)(aipaddrinfo->ai_addr);
-		tmpsockaddrin->sin_port = htons(port);
-		int retvalue = m_scmpSocket->SKT_CrtSkt(aipaddrinfo->ai_family, aipaddrinfo->ai_socktype, aipaddrinfo->ai_protocol);
-#ifdef DEBUG_SOCKET_INFOMA
-		if (retvalue < 0)
-		{
-			bool tmperror = false;
-#ifdef WIN32 
-			tmperror = (errno == WSAEAFNOSUPPORT || errno == WSAEPROTONOSUPPORT);
-#else
-			tmperror = (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT);
-#endif	
-			if (aipaddrinfo->ai_next && tmperror)
-				continue;
-			else if (tmperror)
-				break;
-#endif
-			if (retvalue == -1)
-			{
-				if (aipaddrinfo->ai_next != NULL)
-					continue;
-				DBG_L("------------create socket failed, error id is %d \n", m_scmpSocket->SKT_GEo());
-				OnErrorOfErrorCode(NetErrorCode_CreateSocket);
-				freeaddrinfo(resaddrinfo);
-#ifdef DEBUG_SOCKET_INFOMA
-				DBG_L("------------create socket return value is -1\n");
-#endif
-				return (false);
-			}
-#ifdef WIN32
-		{
-			u_long modeofsocket = 1;
-			int iResultiotclsocket = ioctlsocket(m_scmpSocket->SKT_GSkt(), FIONBIO, &modeofsocket);
-#ifdef DEBUG_SOCKET_INFOMA
-			if (retvalue < 0)
-			{
-				bool tmperror = false;
-#ifdef WIN32 
-				tmperror = (errno == WSAEAFNOSUPPORT || errno == WSAEPROTONOSUPPORT);
-#else
-				tmperror = (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT);
-#endif	
-				if (aipaddrinfo->ai_next && tmperror)
-					continue;
-				else if (tmperror)
-					break;
-#endif
-				if (iResultiotclsocket != NO_ERROR)
-				{
-					DBG_L("-----------ioctlsocket failed with error: %ld\n", iResultiotclsocket);
-				}
-			}
-#else
-		{
-			int fcntlflagvalue = 0;
-			{
-				fcntlflagvalue = fcntl(m_scmpSocket->SKT_GSkt(), F_GETFL, 0);
-			}
-			{
-				fcntl(m_scmpSocket->SKT_GSkt(), F_SETFL, fcntlflagvalue | O_NONBLOCK);
-			}
-		}
-#endif
-
-		if (retvalue < 0)
-		{
-			bool tmperror = false;
-#ifdef WIN32 
-			tmperror = (errno == WSAEAFNOSUPPORT || errno == WSAEPROTONOSUPPORT);
-#else
-			tmperror = (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT);
-#endif	
-			if (aipaddrinfo->ai_next && tmperror)
-			{
-				continue;
-			}
-			else if (tmperror)
-			{
-				break;
-			}
-		}
-		else
-		{
-			retvalue = m_scmpSocket->SKT_CNC2(aipaddrinfo);
-			if (retvalue == -1 && m_scmpSocket->SKT_GEo() != DWOULDBLOCK)
-			{
-				if (aipaddrinfo->ai_next)
-					continue;
-				DBG_L("-----------connect failed, error id is %d \n", m_scmpSocket->SKT_GEo());
-#ifdef DEBUG_SOCKET_INFOMA
-				if (retvalue < 0)
-				{
-					bool tmperror = false;
-#ifdef WIN32 
-					tmperror = (errno == WSAEAFNOSUPPORT || errno == WSAEPROTONOSUPPORT);
-#else
-					tmperror = (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT);
-#endif	
-					if (aipaddrinfo->ai_next && tmperror)
-						continue;
-					else if (tmperror)
-						break;
-#endif
-					OnErrorOfErrorCode(NetErrorCode_ConnectToServer);
-					freeaddrinfo(resaddrinfo);
-#ifdef DEBUG_SOCKET_INFOMA
-					DBG_L(" -------- freeaddrinfo_lk return false!!! \n");
-#endif
-					return (false);
-				}
-				else
-				{
-#ifdef DEBUG_SOCKET_INFOMA
-					DBG_L(" ------ break the run circle !!! \n");
-#endif
-					break;
-				}
-			}
-		}
-		freeaddrinfo(resaddrinfo);
+		m_tOutTimerSocketConnecting = CONNECT_TIMEOUT;
+		SetNtConState(NetConState_Connecting);
 		return true;
+	}
+	return DoConnectToResolved(resolvedaddrs, errorCodeOfResolve, port);
 }
-bool CSocketConnectionManager::DoConnectToAddrPort(int port ,const char* oldpAddr)
+void CSocketConnectionManager::UpdateResolving(int dt)
 {
-	char pAddrRecord[256];		
-	memcpy(pAddrRecord, oldpAddr, strlen(oldpAddr) + 1);
-	struct addrinfo*aipaddrinfo = NULL;	
-	memcpy(m_sADDR, oldpAddr, strlen(oldpAddr) + 1);
-	struct addrinfo*resaddrinfo = NULL;
-	m_portNumber = port;	
-	if (GetUrlAddrinfoCompatibleIpv6v4(&resaddrinfo,oldpAddr, port) != 0)
+	SktResolvedList resolvedaddrs;
+	int errorCodeOfResolve = 0;
+	if (!CSktResolver::Inst()->Take(m_resolveTicket, resolvedaddrs, errorCodeOfResolve))
+	{
+		CheckConnectingTimeOut(dt);
+		return;
+	}
+	m_resolveTicket = 0;
+	DoConnectToResolved(resolvedaddrs, errorCodeOfResolve, m_portNumber);
+}
+bool CSocketConnectionManager::DoConnectToResolved(const SktResolvedList& addrs, int err, int port)
+{
+	if (err != 0 || addrs.empty())
 	{
 		OnErrorOfErrorCode(NetErrorCode_DNSError);
 		return false;
 	}
-	m_scmpSocket = new CSkt();
-	aipaddrinfo = resaddrinfo;
-	
-	if (!DoConnectToAddr_socket(aipaddrinfo, port))
+	if (m_transport == SKT_TRANSPORT_UDP)
+		return DoConnectUdp(addrs, port);
+	if (!m_racer.Start(addrs, port, SKT_RACER_STAGGER_MS))
 	{
+		DBG_L("------------no address of %s could be connected \n", m_sADDR);
+		OnErrorOfErrorCode(NetErrorCode_ConnectToServer);
 		return false;
 	}
-	
 	m_tOutTimerSocketConnecting = CONNECT_TIMEOUT;
-#ifdef DEBUG_SOCKET_INFOMA
-	CheckSocketConnectState();
-	ReConnectToPreServer();
-#endif
 	SetNtConState(NetConState_Connecting);
-	
-	return CheckSocketConnectState();
+	return true;
+}
+// the socket only becomes m_scmpSocket once one of the racing attempts is connected
+void CSocketConnectionManager::UpdateRacing(int dt)
+{
+	int raceResult = m_racer.Update();
+	if (raceResult == SKT_RACE_PENDING)
+	{
+		CheckConnectingTimeOut(dt);
+		return;
+	}
+	if (raceResult == SKT_RACE_FAILED)
+	{
+		OnErrorOfErrorCode(NetErrorCode_ConnectToServer);
+		return;
+	}
+	m_scmpSocket = m_racer.TakeWinner();
+	CSktReactor::Inst()->Register(m_scmpSocket);
+	OnSuccessWhileConnecting();
 }
 void CSocketConnectionManager::OnErrorOfErrorCode(int errorCode)
 {
@@ -474,6 +633,10 @@ void CSocketConnectionManager::OnSuccessWhileConnecting()
 {
 	SetNtConState(NetConState_Connected);
 	m_tOutTimerSocketConnecting = -1;
+	m_probe.Reset();
+	// the ARQ timers run on the lua thread, a udp link never gets the io thread
+	if (m_useIOThread && m_arq == NULL)
+		StartIOThread();
 	lua::OnConnectToServer(m_SocketNameForMultSocket.c_str());
 }
 
@@ -532,15 +695,55 @@ int CSocketConnectionManager::GetUrlAddrinfoCompatibleIpv6v4(struct addrinfo**ou
  
 
 
+// both ends have to agree on the compressed framing before the connection is made,
+// threshold < 0 goes back to the plain framing.
+void CSocketConnectionManager::SetCompression(int threshold, const char* dict, int dictLen)
+{
+	m_compressThreshold = threshold;
+	m_compress.SetDict(dict, dictLen);
+	m_recvBytes.SetCompressFraming(threshold >= 0);
+}
+
+// uncompressed frames with more than bytes of payload reach lua through OnStreamChunk piece by
+// piece instead of as one message, bytes < 0 assembles everything. takes effect on the next connect
+void CSocketConnectionManager::SetStreamThreshold(int bytes)
+{
+	m_streamThreshold = bytes;
+	m_recvBytes.SetStreamThreshold(bytes);
+}
+
 void CSocketConnectionManager::CloseConnect()
 {
+	if (m_replay != NULL)
+		StopReplay();
+	if (m_resolveTicket != 0)
+	{
+		CSktResolver::Inst()->Cancel(m_resolveTicket);
+		m_resolveTicket = 0;
+		SetNtConState(NetConState_Disconnected);
+	}
+	if (m_racer.IsActive())
+	{
+		m_racer.Cancel();
+		SetNtConState(NetConState_Disconnected);
+	}
+	// the io thread hands back what it read, then the queue is decoded while the keys are there
+	StopIOThread();
+	DecodeQueuedRecv();
 	m_endecodeinited = false;
+	m_sendCipher.Reset();
+	m_recvCipher.Reset();
 	if (m_scmpSocket == NULL)
 	{
 		return;
 	}
 	else
 	{
+		StopIOThread();
+		m_recvBytes.Reset();
+		CHECK_DEL(m_arq);
+		m_unrelNonce = 0;
+		CSktReactor::Inst()->Unregister(m_scmpSocket);
 		m_scmpSocket->SKT_ClsSkt(1);
 		delete m_scmpSocket;
 		m_scmpSocket = NULL;
@@ -558,63 +761,157 @@ void CSocketConnectionManager::DoWhileSocketError()
 	else
 		OnErrorOfErrorCode(NetErrorCode_Select);
 }
-bool CSocketConnectionManager::CheckSocketConnectState()
+// the io thread is only started once a connection is up and lives until CloseConnect,
+// so the reactor and the thread never watch the same socket.
+void CSocketConnectionManager::StartIOThread()
 {
-	struct timeval checksockettimevalueconnectstate;
-	fd_set  t_fd_set_write;
-	int socketgetsktFD = m_scmpSocket->SKT_GSkt();
-	fd_set  t_fd_set_error;
-	checksockettimevalueconnectstate.tv_usec = 0;
-	fd_set  t_fd_set_read;
-	checksockettimevalueconnectstate.tv_sec = 0;
-	FD_ZERO(&t_fd_set_error);
-	FD_SET(socketgetsktFD, &t_fd_set_error);
-#ifdef DEBUG_SOCKET_INFOMA
-	if (m_portNumber == -1)
+	if (m_ioThread == NULL)
+		m_ioThread = new CSktIOThread();
+	if (m_ioThread->IsRunning())
+		return;
+	CSktReactor::Inst()->Unregister(m_scmpSocket);
+	if (!m_ioThread->Start(m_scmpSocket, m_compressThreshold >= 0, m_streamThreshold, &m_ioCounters))
 	{
-		FD_ZERO(&t_fd_set_write);
-		FD_SET(socketgetsktFD, &t_fd_set_write);
-		return DoConnectToAddrPort(port,oldpAddr);
+		// no wake pipe for the thread, the connection stays on the reactor
+		CSktReactor::Inst()->Register(m_scmpSocket);
+		return;
 	}
-	else
+	FlushSendToIOThread();
+}
+
+void CSocketConnectionManager::StopIOThread()
+{
+	if (m_ioThread == NULL || !m_ioThread->IsRunning())
+		return;
+	std::list<NTMSG*> sendBack;
+	std::list<NTMSG*> recvBack;
+	m_ioThread->Stop(sendBack, recvBack);
+	m_sendMessageList.splice(m_sendMessageList.begin(), sendBack);
+	m_sendWireBytes = 0;
+	for (std::list<NTMSG*>::iterator iter = m_sendMessageList.begin(); iter != m_sendMessageList.end(); ++iter)
+		m_sendWireBytes += (*iter)->NTMSG_getSdCapSize();
+	for (std::list<NTMSG*>::iterator iter = recvBack.begin(); iter != recvBack.end(); ++iter)
+		QueueRecvNTMSG(*iter);
+}
+
+// m_sendMessageList only stages what did not fit in the ring yet, the lanes feed
+// the thread up to SKT_SEND_THREAD_BYTES so urgent frames can still get ahead
+void CSocketConnectionManager::FlushSendToIOThread()
+{
+	while (!m_sendMessageList.empty() && m_ioThread->PushSend(m_sendMessageList.front()))
 	{
-		FD_ZERO(&t_fd_set_read);
-		FD_SET(socketgetsktFD, &t_fd_set_read);
-		CloseConnect();
-		ClearCachedMsg();
-		FD_ZERO(&t_fd_set_read);
-		FD_SET(socketgetsktFD, &t_fd_set_read);
-		bool returnvalue = DoConnectToAddrPort(port,pStrofServerAddr);
-		lua::OnTryingReconnect(m_SocketNameForMultSocket.c_str());
-		return returnvalue;
+		m_sendWireBytes -= m_sendMessageList.front()->NTMSG_getSdCapSize();
+		m_sendMessageList.pop_front();
 	}
-#else
-	FD_ZERO(&t_fd_set_write);
-	FD_SET(socketgetsktFD, &t_fd_set_write);
-	FD_ZERO(&t_fd_set_read);
-	FD_SET(socketgetsktFD, &t_fd_set_read);
-	int ret = select(socketgetsktFD + 1, &t_fd_set_read, &t_fd_set_write, &t_fd_set_error, &checksockettimevalueconnectstate);
-	if (ret < 0 || FD_ISSET(socketgetsktFD, &t_fd_set_error))
-    {
+	NTMSG* msg = NULL;
+	while (m_sendMessageList.empty() && m_ioThread->GetQueuedBytes() < SKT_SEND_THREAD_BYTES && (msg = PopSendLane()) != NULL)
+	{
+		if (!m_ioThread->PushSend(msg))
+		{
+			m_sendMessageList.push_back(msg);
+			m_sendWireBytes += msg->NTMSG_getSdCapSize();
+		}
+	}
+}
+
+void CSocketConnectionManager::UpdateIOThread()
+{
+	int errorCode = m_ioThread->GetError();
+	if (errorCode >= 0)
+	{
+		OnErrorOfErrorCode(errorCode);
+		return;
+	}
+	FlushSendToIOThread();
+	CheckSendWatermarks();
+	NTMSG* msg = NULL;
+	// frames arrive raw from the io thread, the cipher state stays on this thread
+	while ((msg = m_ioThread->PopRecv()) != NULL)
+		QueueRecvNTMSG(msg);
+}
+
+bool CSocketConnectionManager::CheckSocketConnectState()
+{
+	// readiness is refreshed once per tick by CSktReactor::Poll, only the error flag is checked here
+	if (m_scmpSocket->getES())
+	{
 		DoWhileSocketError();
-        return false;
-    }    
-	m_scmpSocket->SetWS(FD_ISSET(socketgetsktFD, &t_fd_set_write));
-	m_scmpSocket->SetRS(FD_ISSET(socketgetsktFD, &t_fd_set_read));
+		return false;
+	}
 	return true;
-#endif
 }
 
 
 NTMSG* CSocketConnectionManager::getMsgFromCache()
 {
+	DispatchStreamPieces();
 	return m_recvMessageList.empty() ? NULL : m_recvMessageList.front();
 }
 
+// the head is decoded first, a probe reply there would count but never come out
+int CSocketConnectionManager::GetCachedMsgCount()
+{
+	PrepareRecvHead();
+	return (int)m_recvMessageList.size();
+}
+
+bool CSocketConnectionManager::IsStreamPieceNext()
+{
+	return PrepareRecvHead() && m_recvMessageList.front()->NTMSG_IsStreamPiece();
+}
+
+
+// O(1) take of the oldest complete message, NULL when nothing is queued
+NTMSG* CSocketConnectionManager::PopMsgFromCache()
+{
+	DispatchStreamPieces();
+	if (m_recvMessageList.empty())
+		return NULL;
+	NTMSG* msg = m_recvMessageList.front();
+	m_recvMessageList.pop_front();
+	RecordDispatch(msg);
+	return msg;
+}
+
+// hands the stream pieces at the head of the queue to OnStreamChunk, each is freed right
+// after so its receive chunk goes back to the pool. the handler may close the connection
+int CSocketConnectionManager::DispatchStreamPieces()
+{
+	int count = 0;
+	while (IsStreamPieceNext())
+	{
+		NTMSG* piece = m_recvMessageList.front();
+		m_recvMessageList.pop_front();
+		RecordDispatch(piece);
+		lua::OnStreamChunk(m_SocketNameForMultSocket.c_str(), piece->NTMSG_getPayload(), piece->NTMSG_GetSizeAndType(),
+			piece->NTMSG_getStreamOffset(), piece->NTMSG_getStreamTotal());
+		delete piece;
+		count++;
+	}
+	return count;
+}
+
+// arrival to dispatch goes into log2 us buckets. the clock is read on the first
+// dispatch after an Update and then every 16th, a drain pops faster than it ticks
+void CSocketConnectionManager::RecordDispatch(NTMSG* msg)
+{
+	if (msg->NTMSG_getArrival() == 0)
+		return;
+	if ((m_dispatchPops++ & 15) == 0)
+		m_dispatchClockUs = SktStatNowUs();
+	Int64 waitUs = m_dispatchClockUs - msg->NTMSG_getArrival();
+	m_stat.dispatchHist[SktStatBucketOf(waitUs > 0 ? waitUs : 0)]++;
+}
 
 void CSocketConnectionManager::RemoveMsgFromCache(NTMSG* pMsg)
 {	
-	for (std::list<NTMSG*>::iterator iter = m_recvMessageList.begin(); iter != m_recvMessageList.end(); ++iter)
+	if (!m_recvMessageList.empty() && m_recvMessageList.front() == pMsg)
+	{
+		m_recvMessageList.pop_front();
+		RecordDispatch(pMsg);
+		return;
+	}
+	for (std::deque<NTMSG*>::iterator iter = m_recvMessageList.begin(); iter != m_recvMessageList.end(); ++iter)
     {
 		if ((*iter) == pMsg)
 		{
@@ -644,36 +941,372 @@ void CSocketConnectionManager::RemoveMsgFromCache(NTMSG* pMsg)
 #endif
 }
 
-void CSocketConnectionManager::SendMsgFromNetMsg(NTMSG* msg)
+void CSocketConnectionManager::SendMsgFromNetMsg(NTMSG* msg, int lane)
 {
+	if (lane < 0 || lane >= SKT_LANE_COUNT)
+		lane = SKT_LANE_NORMAL;
+	if (CSktCapture::Inst()->IsOn())
+		CSktCapture::Inst()->Record(SKT_CAPTURE_OUT, m_SocketNameForMultSocket, msg->NTMSG_getPayload(), msg->NTMSG_GetSizeAndType());
+	// nobody listens on the other side of a replay
+	if (m_replay != NULL)
+	{
+		delete msg;
+		return;
+	}
+	// the compressed flag lives in the tcp length header, udp links send plain payloads
+	if (m_compressThreshold >= 0 && m_transport != SKT_TRANSPORT_UDP)
+		msg = m_compress.CompressNTMSG(msg, m_compressThreshold);
 	msg->NTMSG_ResetFSendPos();
-	EncodeEncryptMsg(msg);
-	m_sendMessageList.push_back(msg);
+	m_sendLanes[lane].push_back(msg);
+	m_sendLaneBytes[lane] += msg->NTMSG_getSdCapSize();
+	int depth = GetSendQueueDepth();
+	if (depth > m_stat.sendQueueMax)
+		m_stat.sendQueueMax = depth;
+	if (m_ioThread != NULL && m_ioThread->IsRunning())
+		FlushSendToIOThread();
+	CheckSendWatermarks();
 }
-void CSocketConnectionManager::InitEncryptBySeed(long sendSeed, long recvSeed)
+
+int CSocketConnectionManager::GetSendQueueDepth() const
 {
-	m_endecodeinited = true;
-	for (std::list<NTMSG*>::iterator iter = m_sendMessageList.begin(); iter != m_sendMessageList.end(); ++iter)
+	int msgs = 0;
+	int bytes = 0;
+	GetSendInflightDepth(msgs, bytes);
+	for (int lane = 0; lane < SKT_LANE_COUNT; lane++)
+		msgs += (int)m_sendLanes[lane].size();
+	return msgs;
+}
+
+// nothing left on our side, over udp that includes segments the peer has not acked yet
+bool CSocketConnectionManager::IsSendDrained() const
+{
+	if (GetSendQueueDepth() > 0)
+		return false;
+	return m_arq == NULL || m_arq->GetWaitSnd() == 0;
+}
+
+void CSocketConnectionManager::GetStats(SktConnStat& stat) const
+{
+	stat = m_stat;
+	stat.bytesSent = m_ioCounters.bytesSent.load(std::memory_order_relaxed);
+	stat.bytesRecv = m_ioCounters.bytesRecv.load(std::memory_order_relaxed);
+	stat.framesSent = m_ioCounters.framesSent.load(std::memory_order_relaxed);
+	stat.sendCalls = m_ioCounters.sendCalls.load(std::memory_order_relaxed);
+	stat.recvCalls = m_ioCounters.recvCalls.load(std::memory_order_relaxed);
+	stat.pollCalls = m_ioCounters.pollCalls.load(std::memory_order_relaxed);
+	stat.partialWrites = m_ioCounters.partialWrites.load(std::memory_order_relaxed);
+	stat.poolAllocs = m_ioCounters.poolAllocs.load(std::memory_order_relaxed);
+	stat.sendQueueDepth = GetSendQueueDepth();
+	stat.recvQueueDepth = (int)m_recvMessageList.size();
+}
+
+// the max depths restart from the current ones
+void CSocketConnectionManager::ResetStats()
+{
+	m_ioCounters.Reset();
+	memset(&m_stat, 0, sizeof(m_stat));
+	m_stat.sendQueueMax = GetSendQueueDepth();
+	m_stat.recvQueueMax = (int)m_recvMessageList.size();
+}
+
+// drops the connection and reads the inbound frames of sourceName from a capture instead,
+// they come out of the cache exactly like received ones. sends are dropped meanwhile
+bool CSocketConnectionManager::StartReplay(const char* path, bool realtime, const char* sourceName)
+{
+	CloseConnect();
+	ClearCachedMsg();
+	CSktReplay* replay = new CSktReplay();
+	if (!replay->Open(path, sourceName, realtime))
 	{
-#ifdef DEBUG_SOCKET_INFOMA
+		delete replay;
+		return false;
 	}
-	if (!m_recvMessageList.empty())
+	m_replay = replay;
+	SetNtConState(NetConState_Connected);
+	lua::OnConnectToServer(m_SocketNameForMultSocket.c_str());
+	return true;
+}
+
+void CSocketConnectionManager::StopReplay()
+{
+	CHECK_DEL(m_replay);
+	SetNtConState(NetConState_Disconnected);
+}
+
+// a finished replay stays connected until it is stopped so lua can drain the cache
+void CSocketConnectionManager::UpdateReplay()
+{
+	m_dispatchPops = 0;
+	Int64 nowUs = SktStatNowUs();
+	NTMSG* msg = NULL;
+	while ((int)m_recvMessageList.size() < SKT_REPLAY_QUEUE && (msg = m_replay->Next(nowUs)) != NULL)
 	{
-		m_recvMessageList.front();
+		// captured after decoding
+		msg->NTMSG_setCipherDone(true);
+		QueueRecvNTMSG(msg);
 	}
+}
+
+// seed of the keystream of one unreliable message, never the seed of the reliable stream itself
+static inline unsigned int UnreliableSeedOf(unsigned int seed, unsigned int nonce)
+{
+	return seed + 0x9E3779B9u * (nonce + 1);
+}
+
+// udp has no handshake, the first address that takes a connected datagram socket becomes the
+// link and the manager is connected right away. the server learns the conv from the first datagram,
+// an unreachable server only shows through the dead link check
+bool CSocketConnectionManager::DoConnectUdp(const SktResolvedList& addrs, int port)
+{
+	for (size_t i = 0; i < addrs.size(); i++)
 	{
+		SktResolvedAddr addr = addrs[i];
+		if (addr.family == AF_INET)
+			((struct sockaddr_in*)&addr.addr)->sin_port = htons(port);
+		else if (addr.family == AF_INET6)
+			((struct sockaddr_in6*)&addr.addr)->sin6_port = htons(port);
+		else
+			continue;
+		CSkt* skt = new CSkt();
+		if (skt->SKT_CrtSkt(addr.family, SOCK_DGRAM, 0) == -1)
+		{
+			delete skt;
+			continue;
+		}
+#ifdef WIN32
+		u_long modeofsocket = 1;
+		ioctlsocket(skt->SKT_GSkt(), FIONBIO, &modeofsocket);
+#else
+		fcntl(skt->SKT_GSkt(), F_SETFL, fcntl(skt->SKT_GSkt(), F_GETFL, 0) | O_NONBLOCK);
 #endif
-		EncodeEncryptMsg(*iter);
+		struct addrinfo ai;
+		memset(&ai, 0, sizeof(ai));
+		ai.ai_family = addr.family;
+		ai.ai_socktype = SOCK_DGRAM;
+		ai.ai_addrlen = addr.addrlen;
+		ai.ai_addr = (struct sockaddr*)&addr.addr;
+		if (skt->SKT_CNC2(&ai) != 0)
+		{
+			DBG_L("udp connect failed, error id is %d \n", skt->SKT_GEo());
+			skt->SKT_ClsSkt(1);
+			delete skt;
+			continue;
+		}
+		m_scmpSocket = skt;
+		CSktReactor::Inst()->Register(m_scmpSocket);
+		unsigned int conv = (unsigned int)SktStatNowUs() ^ (unsigned int)((size_t)this * 2654435761u);
+		m_arq = new CSktArq(conv != 0 ? conv : 1, ArqOutput, this);
+		m_arq->SetConfig(m_arqConfig);
+		m_arqBuf.resize(SKT_ARQ_MTU_MAX);
+		OnSuccessWhileConnecting();
+		return true;
+	}
+	DBG_L("------------no address of %s takes a udp socket \n", m_sADDR);
+	OnErrorOfErrorCode(NetErrorCode_ConnectToServer);
+	return false;
+}
+
+// a datagram the kernel can not take is dropped, the ARQ sends it again
+int CSocketConnectionManager::ArqOutput(const char* buf, int len, void* user)
+{
+	CSocketConnectionManager* mgr = (CSocketConnectionManager*)user;
+	int sent = mgr->m_scmpSocket->SKT_S(len, (char*)buf);
+	CSktIOCounters::Add(mgr->m_ioCounters.sendCalls, 1);
+	if (sent > 0)
+		CSktIOCounters::Add(mgr->m_ioCounters.bytesSent, sent);
+	return sent;
+}
+
+// one tick of a udp link: datagrams in, the lanes into the ARQ, its flush, then the
+// messages that became whole. the lanes feed it up to two send windows so urgent frames
+// still get ahead of queued bulk
+void CSocketConnectionManager::UpdateArq()
+{
+	CSktIOCounters::Add(m_ioCounters.pollCalls, 1);
+	// a refused datagram leaves an error on the socket, the dead link check decides instead
+	m_scmpSocket->SetES(false);
+	for (int i = 0; i < SKT_ARQ_RECV_BURST && m_scmpSocket->getRS(); i++)
+	{
+		int len = m_scmpSocket->SKT_R((int)m_arqBuf.size(), &m_arqBuf[0]);
+		CSktIOCounters::Add(m_ioCounters.recvCalls, 1);
+		if (len < 0)
+		{
+			if (m_scmpSocket->SKT_IsWB())
+				m_scmpSocket->SetRS(false);
+			continue;
+		}
+		CSktIOCounters::Add(m_ioCounters.bytesRecv, len);
+		m_arq->Input(&m_arqBuf[0], len);
+	}
+	NTMSG* msg = NULL;
+	int framesDone = 0;
+	while (m_arq->GetWaitSnd() < 2 * m_arqConfig.sndWnd && (msg = PopSendLane()) != NULL)
+	{
+		if (m_arq->Send(msg->NTMSG_getPayload(), msg->NTMSG_GetSizeAndType(), true) < 0)
+			DBG_E("frame of %d bytes is too large for the udp link \n", msg->NTMSG_GetSizeAndType());
+		delete msg;
+		framesDone++;
+	}
+	CSktIOCounters::Add(m_ioCounters.framesSent, framesDone);
+	m_arq->Update((unsigned int)(SktStatNowUs() / 1000));
+	bool reliable = false;
+	while (m_arq->Recv(m_arqMsg, reliable))
+		DeliverArqMsg(reliable);
+	if (m_arq->IsDead())
+	{
+		OnErrorOfErrorCode(NetErrorCode_LinkDead);
+		return;
 	}
+	CheckSendWatermarks();
+}
+
+// reliable messages come in stream order and are queued undecoded like tcp frames,
+// an encrypted unreliable one starts with the nonce of its own keystream
+void CSocketConnectionManager::DeliverArqMsg(bool reliable)
+{
+	char* payload = m_arqMsg.empty() ? NULL : &m_arqMsg[0];
+	int size = (int)m_arqMsg.size();
+	if (!reliable && m_endecodeinited)
+	{
+		if (size < 4)
+			return;
+		unsigned int nonce = (unsigned char)payload[0] | ((unsigned char)payload[1] << 8)
+			| ((unsigned char)payload[2] << 16) | ((unsigned int)(unsigned char)payload[3] << 24);
+		payload += 4;
+		size -= 4;
+		m_unrelCipher.Init(UnreliableSeedOf(m_recvSeed, nonce));
+		m_unrelCipher.Apply(payload, size);
+	}
+	NTMSG* msg = new NTMSG(2 + size);
+	msg->NTMSG_initRecvFrame(2, size, false);
+	if (size > 0)
+		memcpy(msg->NTMSG_getReadBufFr(), payload, size);
+	msg->NTMSG_CallWhileReceive(size);
+	msg->NTMSG_setArrival(SktStatNowUs());
+	if (reliable)
+	{
+		QueueRecvNTMSG(msg);
+		return;
+	}
+	msg->NTMSG_setCipherDone(true);
+	if (m_probe.IsOn() && m_probe.OnFrame(payload, size, msg->NTMSG_getArrival()))
+	{
+		delete msg;
+		return;
+	}
+	if (CSktCapture::Inst()->IsOn())
+		CSktCapture::Inst()->Record(SKT_CAPTURE_IN, m_SocketNameForMultSocket, msg->NTMSG_getPayload(), size);
+	QueueRecvNTMSG(msg);
+}
+
+// sent once without resends or ordering. anywhere but on a connected udp link it
+// falls back to the normal lane and goes out reliably
+void CSocketConnectionManager::SendUnreliableFromNetMsg(NTMSG* msg)
+{
+	if (m_arq == NULL || m_replay != NULL)
+	{
+		SendMsgFromNetMsg(msg, SKT_LANE_NORMAL);
+		return;
+	}
+	int size = msg->NTMSG_GetSizeAndType();
+	if (CSktCapture::Inst()->IsOn())
+		CSktCapture::Inst()->Record(SKT_CAPTURE_OUT, m_SocketNameForMultSocket, msg->NTMSG_getPayload(), size);
+	if (m_endecodeinited)
+	{
+		unsigned int nonce = m_unrelNonce++;
+		m_arqMsg.resize(4 + size);
+		for (int i = 0; i < 4; i++)
+			m_arqMsg[i] = (char)((nonce >> (i * 8)) & 0xFF);
+		if (size > 0)
+			memcpy(&m_arqMsg[4], msg->NTMSG_getPayload(), size);
+		m_unrelCipher.Init(UnreliableSeedOf(m_sendSeed, nonce));
+		m_unrelCipher.Apply(&m_arqMsg[4], size);
+		m_arq->Send(&m_arqMsg[0], 4 + size, false);
+	}
+	else
+	{
+		m_arq->Send(msg->NTMSG_getPayload(), size, false);
+	}
+	CSktIOCounters::Add(m_ioCounters.framesSent, 1);
+	delete msg;
+}
+
+// applies to the next udp connect, and right away to a live link
+void CSocketConnectionManager::SetArqConfig(const SktArqConfig& config)
+{
+	m_arqConfig = config;
+	if (m_arq != NULL)
+	{
+		m_arq->SetConfig(config);
+		m_arqConfig = m_arq->GetConfig();
+	}
+}
+
+bool CSocketConnectionManager::GetArqStat(SktArqStat& stat) const
+{
+	if (m_arq == NULL)
+		return false;
+	stat = m_arq->GetStat();
+	return true;
+}
+
+// starts over with a clean measurement, false leaves the probe as it was
+bool CSocketConnectionManager::SetProbe(int intervalMs, int timeoutMs, int windowMs, const std::string& request, const std::string& reply)
+{
+	return m_probe.Configure(intervalMs, timeoutMs, windowMs, request, reply);
+}
+
+// probes go out urgent on tcp so queued bulk does not show up as latency, and
+// unreliable on udp where a resent probe would only measure the ARQ
+void CSocketConnectionManager::UpdateProbe()
+{
+	Int64 nowUs = SktStatNowUs();
+	m_probe.Expire(nowUs);
+	if (m_probe.BuildRequest(nowUs, m_probeBuf))
+	{
+		NTMSG* msg = new NTMSG();
+		msg->NTMSG_beginWriteData();
+		msg->NTMSG_wRawValue(&m_probeBuf[0], (int)m_probeBuf.size());
+		msg->NTMSG_endWriteData();
+		if (m_arq != NULL)
+			SendUnreliableFromNetMsg(msg);
+		else
+			SendMsgFromNetMsg(msg, SKT_LANE_URGENT);
+	}
+	Int64 levelUs = 0;
+	int cross = m_probe.CheckThreshold(nowUs, levelUs);
+	if (cross == SKT_PROBE_CROSS_NONE)
+		return;
+	const SktProbeStat& stat = m_probe.GetStat();
+	if (cross == SKT_PROBE_CROSS_HIGH)
+		lua::OnLatencyHigh(m_SocketNameForMultSocket.c_str(), (int)levelUs, (int)stat.jitterUs);
+	else
+		lua::OnLatencyLow(m_SocketNameForMultSocket.c_str(), (int)levelUs, (int)stat.jitterUs);
+}
+// the send cipher starts with the next frame PopSendLane takes off the lanes, frames committed
+// to the wire list or the io thread before go out the way they were committed
+void CSocketConnectionManager::InitEncryptBySeed(long sendSeed, long recvSeed)
+{
+	m_endecodeinited = true;
+	m_sendSeed = (unsigned int)sendSeed;
+	m_recvSeed = (unsigned int)recvSeed;
+	m_sendCipher.Init((unsigned int)sendSeed);
+	m_recvCipher.Init((unsigned int)recvSeed);
 }
  
 void CSocketConnectionManager::DecodeEncryptBuf(char *buf, int len)
 {
-//	m_endecodeinited
+	if (!m_endecodeinited)
+		return;
+	m_recvCipher.Apply(buf, len);
 }
+// payload only, the length header has to stay readable for the framing
 void CSocketConnectionManager::EncodeEncryptMsg(NTMSG *msg)
 {
-//	m_endecodeinited
+	if (!m_endecodeinited || msg->NTMSG_IsCipherDone())
+		return;
+	m_sendCipher.Apply(msg->NTMSG_getPayload(), msg->NTMSG_GetSizeAndType());
+	msg->NTMSG_setCipherDone(true);
 }
 int CSocketConnectionManager::SetConnectionAlived(int keep[4])
 {
@@ -721,7 +1354,16 @@ void CSocketConnectionManager::ClearCachedMsg()
 		delete *iterSend;
 	}
 	m_sendMessageList.clear();
-	for (std::list<NTMSG*>::iterator iterrecvmesage = m_recvMessageList.begin(); iterrecvmesage != m_recvMessageList.end(); ++iterrecvmesage)
+	m_sendWireBytes = 0;
+	for (int lane = 0; lane < SKT_LANE_COUNT; lane++)
+	{
+		for (std::deque<NTMSG*>::iterator iter = m_sendLanes[lane].begin(); iter != m_sendLanes[lane].end(); ++iter)
+			delete *iter;
+		m_sendLanes[lane].clear();
+		m_sendLaneBytes[lane] = 0;
+	}
+	m_sendQueueHigh = false;
+	for (std::deque<NTMSG*>::iterator iterrecvmesage = m_recvMessageList.begin(); iterrecvmesage != m_recvMessageList.end(); ++iterrecvmesage)
 	{
 		delete *iterrecvmesage;
 #ifdef DEBUG_SOCKET_INFOMA
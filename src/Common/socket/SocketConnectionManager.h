@@ -1,8 +1,20 @@
 #ifndef __jklasdjkljklejkilewjiowiojfjla982389hjdf_lsdjflksjdfll_H__
 #define __jklasdjkljklejkilewjiowiojfjla982389hjdf_lsdjflksjdfll_H__
 #include <list>
+#include <deque>
+#include <vector>
 #include "CSkt.h"
 #include "NTMSG.h"
+#include "SktRecvRing.h"
+#include "SktCipher.h"
+#include "SktCompress.h"
+#include "SktResolver.h"
+#include "SktConnectRacer.h"
+#include "SktStat.h"
+#include "SktCapture.h"
+#include "SktArq.h"
+#include "SktProbe.h"
+#include "SktAsync.h"
 #include <string>
 #define NetConState_Connecting         (0)
 #define NetConState_ConnectTimeOut	   (1)
@@ -17,7 +29,26 @@
 #define NetErrorCode_SendZeroByte      (4)
 #define NetErrorCode_DNSError   	   (10)
 #define NetErrorCode_ConnectTimeOut	   (11)
+#define NetErrorCode_Decompress	       (12)
+#define NetErrorCode_LinkDead          (13)
+#define NetErrorCode_BadFrame          (14)
 
+// send priority lanes, lower goes first, order within a lane is kept
+#define SKT_LANE_URGENT                (0)
+#define SKT_LANE_NORMAL                (1)
+#define SKT_LANE_BULK                  (2)
+#define SKT_LANE_COUNT                 (3)
+// bytes committed to the wire ahead of the lanes, bounds how long an urgent frame waits
+#define SKT_SEND_WIRE_BYTES            (64 * 1024)
+#define SKT_SEND_THREAD_BYTES          (256 * 1024)
+
+// transport of the next connect, udp runs the CSktArq protocol over one datagram socket
+#define SKT_TRANSPORT_TCP              (0)
+#define SKT_TRANSPORT_UDP              (1)
+// datagrams read per tick before the rest waits for the next one
+#define SKT_ARQ_RECV_BURST             (1024)
+
+class CSktIOThread;
 
 
 class CSocketConnectionManager
@@ -31,9 +62,10 @@ public:
 	int     SetConnectionAlived(int keep[4]/*alive_idle_interval_count*/);
 	bool    ConnectToAddrPort(int port, const char* pStrofServerAddr);
 	bool    DoConnectToAddrPort(int port ,const char* pStrofServerAddr);    
+	bool    DoConnectToResolved(const SktResolvedList& addrs, int err, int port);
     void    ReConnectToPreServer();    
     void    CloseConnect();
-	void    SendMsgFromNetMsg(NTMSG* msg);
+	void    SendMsgFromNetMsg(NTMSG* msg, int lane = SKT_LANE_NORMAL);
 	void    InitEncryptBySeed(long send, long recv);    
     void    DecodeEncryptBuf(char *buf, int len);
 	void    EncodeEncryptMsg(NTMSG *msg);
@@ -43,32 +75,96 @@ public:
 	void    CheckConnectingTimeOut(int dt);
 	bool    UpdateConnectingStatus(int dt);
 	bool    UpdateConnectingStatus1(int dt);
-	bool    UpdateCheckWriteFlagNTMSG(NTMSG * mtmsg);
-	bool    DoDecodeofNTMSG(NTMSG * mtmsg,int );
-	NTMSG*  GenNTMSGWhileRead();
+	static int SendGatherNTMSG(CSkt* skt, std::list<NTMSG*>& sendList, std::vector<SKT_IOV>& iov, CSktIOCounters& counters, int& sentBytes);
+	bool    DoDecodeofNTMSG(NTMSG * mtmsg);
 	bool    UpdateCheckReadFlag();
 	bool    UpdateCheckWriteFlag();
 	void	DoWhileSocketError();
-	bool	DoConnectToAddr_socket(addrinfo*resaddrinfo,int port);
 	bool	ReConnectToUrlPort(const char*url, int port);
 	int     GetStateOfNet() const { return m_netConnectionState; }
 	NTMSG*   getMsgFromCache();
 	void    RemoveMsgFromCache(NTMSG* Msg);
+	NTMSG*  PopMsgFromCache();
+	int     GetCachedMsgCount();
+	bool    IsStreamPieceNext();
+	int     DispatchStreamPieces();
 	void    SetNameOfSocketConnet(const char * name){ m_SocketNameForMultSocket = name; }
 	void    Update(int dt);
 	void    SetNtConState(int stat);
+	void    SetIOThreadMode(bool enable)  { m_useIOThread = enable; }
+	bool    GetIOThreadMode() const       { return m_useIOThread; }
+	void    SetCompression(int threshold, const char* dict, int dictLen);
+	void    SetStreamThreshold(int bytes);
+	int     GetStreamThreshold() const    { return m_streamThreshold; }
+	const SktCompressStat& GetCompressStat() const { return m_compress.GetStat(); }
+	void    SetSendWatermarks(int highBytes, int lowBytes, int highMsgs, int lowMsgs);
+	void    GetSendLaneDepth(int lane, int& msgs, int& bytes) const;
+	void    GetSendInflightDepth(int& msgs, int& bytes) const;
+	bool    IsSendDrained() const;
+	void    GetStats(SktConnStat& stat) const;
+	void    ResetStats();
+	bool    StartReplay(const char* path, bool realtime, const char* sourceName);
+	void    StopReplay();
+	bool    IsReplaying() const { return m_replay != NULL; }
+	bool    IsReplayDone() const { return m_replay != NULL && m_replay->IsDone(); }
+	void    SetTransport(int transport) { m_transport = transport; }
+	int     GetTransport() const        { return m_transport; }
+	void    SetArqConfig(const SktArqConfig& config);
+	const SktArqConfig& GetArqConfig() const { return m_arqConfig; }
+	bool    GetArqStat(SktArqStat& stat) const;
+	void    SendUnreliableFromNetMsg(NTMSG* msg);
+	bool    SetProbe(int intervalMs, int timeoutMs, int windowMs, const std::string& request, const std::string& reply);
+	void    StopProbe()                 { m_probe.Stop(); }
+	void    SetProbeThresholds(Int64 highUs, Int64 lowUs) { m_probe.SetThresholds(highUs, lowUs); }
+	bool    IsProbing() const           { return m_probe.IsOn(); }
+	const SktProbeStat& GetProbeStat() const { return m_probe.GetStat(); }
+	CSktAsync* GetAsync()               { return &m_async; }
 private:
+	void    UpdateNet(int dt);
+	void    UpdateProbe();
+	bool    DoConnectUdp(const SktResolvedList& addrs, int port);
+	void    UpdateArq();
+	void    DeliverArqMsg(bool reliable);
+	static int ArqOutput(const char* buf, int len, void* user);
+	void    UpdateReplay();
+	void    QueueRecvNTMSG(NTMSG* msg);
+	bool    DecodeRecvNTMSG(NTMSG*& msg);
+	bool    PrepareRecvHead();
+	void    DecodeQueuedRecv();
+	void    UpdateResolving(int dt);
+	void    UpdateRacing(int dt);
+	void    StartIOThread();
+	void    StopIOThread();
+	void    UpdateIOThread();
+	void    FlushSendToIOThread();
+	NTMSG*  PopSendLane();
+	void    CheckSendWatermarks();
+	int     GetSendQueueDepth() const;
+	void    RecordDispatch(NTMSG* msg);
 	void    OnConnectTimeOutError();
 	void    OnErrorOfErrorCode(int errorID);
 	void    OnSuccessWhileConnecting();
 	bool    CheckSocketConnectState();	
 	char                    m_sADDR[256];
 	int                     m_portNumber;
+	// frames in wire order, fed from the lanes by PopSendLane which is the only place they get encrypted
 	std::list<NTMSG*>  m_sendMessageList;
-	std::list<NTMSG*>  m_recvMessageList;
+	int                     m_sendWireBytes;
+	std::deque<NTMSG*>      m_sendLanes[SKT_LANE_COUNT];
+	int                     m_sendLaneBytes[SKT_LANE_COUNT];
+	int                     m_sendHighBytes;
+	int                     m_sendLowBytes;
+	int                     m_sendHighMsgs;
+	int                     m_sendLowMsgs;
+	bool                    m_sendQueueHigh;
+	// only complete frames are queued, consumers take them from the front
+	std::deque<NTMSG*> m_recvMessageList;
+	CSktRecvRing            m_recvBytes;
 	CSkt*        m_scmpSocket;
     int                     m_netConnectionState;
     bool                    m_endecodeinited;    
+	CSktCipher              m_sendCipher;
+	CSktCipher              m_recvCipher;
 	static CSocketConnectionManager*  m_SocketConnectMgrInstance;
 	std::string             m_SocketNameForMultSocket;
 	int                     m_tOutTimerSocketConnecting;
@@ -76,6 +172,35 @@ private:
 	int						m_retryconnectcount;
 	const char*				m_instanceName;
 	std::string             m_instanceName2;
+	bool                    m_useIOThread;
+	CSktIOThread*           m_ioThread;
+	std::vector<SKT_IOV>    m_sendIov;
+	int                     m_compressThreshold;
+	int                     m_streamThreshold;
+	int                     m_resolveTicket;
+	CSktConnectRacer        m_racer;
+	CSktCompress            m_compress;
+	// syscall side counters, shared with the io thread while it runs
+	CSktIOCounters          m_ioCounters;
+	// lua thread side of the stats, the io counters are merged in by GetStats
+	SktConnStat             m_stat;
+	Int64                   m_dispatchClockUs;
+	int                     m_dispatchPops;
+	// set while a capture file stands in for the socket
+	CSktReplay*             m_replay;
+	int                     m_transport;
+	SktArqConfig            m_arqConfig;
+	CSktArq*                m_arq;
+	std::vector<char>       m_arqBuf;
+	std::vector<char>       m_arqMsg;
+	CSktProbe               m_probe;
+	std::vector<char>       m_probeBuf;
+	CSktAsync               m_async;
+	// unreliable messages are encrypted each on its own, keyed by the seeds and a nonce
+	unsigned int            m_sendSeed;
+	unsigned int            m_recvSeed;
+	unsigned int            m_unrelNonce;
+	CSktCipher              m_unrelCipher;
 };
 
 #endif
\ No newline at end of file
@@ -124,6 +124,7 @@ extern "C" void DoCommandFromOpenUrl_impl(const char * uri)
 				std::string fpn = "";
 				fpn = fpn + (GameApp::GetInstance()->getSavePath()) + "config.txt";
 				remove(fpn.c_str());
+				GET_FS()->InvalidateFile(fpn.c_str());
 			}
 			else if (kv[0].compare("removeSaveFile") == 0)
 			{
@@ -131,6 +132,7 @@ extern "C" void DoCommandFromOpenUrl_impl(const char * uri)
 				std::string filename = UrlDecode(kv[1]);
 				fpn = fpn + (GameApp::GetInstance()->getSavePath()) + filename;
 				remove(fpn.c_str());
+				GET_FS()->InvalidateFile(fpn.c_str());
 			}
 			else if (kv[0].compare("removeCacheFile") == 0)
 			{
@@ -138,6 +140,7 @@ extern "C" void DoCommandFromOpenUrl_impl(const char * uri)
 				std::string filename = UrlDecode(kv[1]);
 				fpn = fpn + (GameApp::GetInstance()->getCachePath()) + filename;
 				remove(fpn.c_str());
+				GET_FS()->InvalidateFile(fpn.c_str());
 			}
 			else if (kv[0].compare("configfilecontent") == 0)
 			{
@@ -150,6 +153,7 @@ extern "C" void DoCommandFromOpenUrl_impl(const char * uri)
 					fwrite(filecontent.c_str(), filecontent.size(), 1, fptr);
 					fclose(fptr);
 				}
+				GET_FS()->InvalidateFile(fpn.c_str());
 			}
 		}
 	}
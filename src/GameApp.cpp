@@ -4,6 +4,7 @@
  
 #include "Common/socket/S_O_TCP.h"
 #include "Common/socket/SocketConnectionManager.h"
+#include "Common/socket/SktReactor.h"
 
 #include "GlobalFunc.h" 
 #ifdef WIN32
@@ -106,6 +107,8 @@ void GameApp::update(int dt)
 		m_luaRecreateFlag = false;
 		GET_DLC()->reset();
 		GET_FS()->release();
+		// nothing parked by the old lua state may be resumed once it is recreated
+		S_O_TCP::DropAsyncWaiters();
 		if (GetSocketObjectByDefaultName())
 		{
 			GetSocketObjectByDefaultName()->RestartTheSocketObject();
@@ -126,6 +129,8 @@ void GameApp::update(int dt)
 	if (g_CatchLuaError >=3)
 		return;
 #endif
+    CSktReactor::Inst()->Poll();
+    NTMSG::NTMSG_PoolUpdate(dt);
     lua::CallUpdate(dt);
 }
 void GameApp::SendMessageToLua(const char * jsoncontent)
@@ -154,9 +154,11 @@ void BSPatch_File(const char* oldfile, const char*patchabsolutionfile, const cha
 		fs->read(preFileContent, size);
 		bspatch_file_mem(preFileContent, size, fullnewfile, fullpatchfile);
 	//	MARC_DELETE preFileContent;
+		GET_FS()->InvalidateFile(fullnewfile);
 		return ;
 	}
 	bspatch_file(oldfn, fullnewfile, fullpatchfile);
+	GET_FS()->InvalidateFile(fullnewfile);
 }
  
 #if defined(TARGET_IPHONE_SIMULATOR) || defined(TARGET_OS_IPHONE)
@@ -10,6 +10,8 @@ extern "C" void extMD5(const char* src, std::string& outStr);
 extern "C" const char * extBase64(const char* src);
 extern "C" const char * stringFromBase64(const char* src);
 extern "C" void AddZip2FS(const char* pathname);
+extern "C" void SetZipIndexCache2FS(int enable);
+extern "C" void InvalidateFileCache2FS(const char* pathname);
 extern "C" void NotifyGameRestart();
 extern "C" void NotifyGameRestartEnd();
 extern int SALTATable(lua_State *L);
@@ -43,6 +43,8 @@ CFSys::~CFSys(void)
 }
 void CFSys::releaseZip()
 {
+	InvalidateFile(NULL);
+	m_zipOverlay.Clear();
 	std::map<std::string, CZFRder*>::iterator iter = m_zrs.begin();
 	while(iter != m_zrs.end())
 	{
@@ -75,17 +77,11 @@ int CFSys::getMode(const char *m)
 	}
 	return a;
 }
+// archive paths are relative to the app, the app, cache or save path in front is dropped
 FileBaseStreamPtr CFSys::OpenZipFile(const char *path)
 {
-	for (std::map<std::string, CZFRder*>::iterator iterIdx = m_zrs.begin(); iterIdx != m_zrs.end(); ++iterIdx)
-	{
-		FileBaseStreamPtr file = iterIdx->second->openFile(path);
-		if (file.get())
-		{
-			return file;
-		}
-	}
-	return FileBaseStreamPtr();
+	bool isf = false;
+	return m_zipOverlay.Open(GET_DLC()->GetRelateFName(path, isf));
 }
 FileBaseStreamPtr CFSys::OpenDirectlyFile(const char *path, int mode)
 {
@@ -123,21 +119,25 @@ FileBaseStreamPtr CFSys::OpenFile(const char* path, const char *mode, bool absol
 	int accessMode = getMode(mode);
 	if (absolutionpath)
 	{
+		if (accessMode & ESM::FAM_WRITE)
+		{
+			InvalidateFile(path);
+		}
 		return OpenDirectlyFile(path, accessMode);
 	}
 	const char *a = GameApp::getInstance()->getAppPath();
-	char newfn[500];
-	GET_DLC()->GetFName(path, newfn, sizeof(newfn));
-
-	FileBaseStreamPtr zf = OpenZipFile(path);
-	if (zf.get())
-		return zf;
+	const FileResolve *r = Resolve(path);
+	if (r->zr != NULL)
+		return r->zr->openEntry(r->entry);
+	// a write drops the entry below, the name has to outlive it
+	string newfn = r->diskPath;
 #ifdef OS_ANDROID
-	if(strncmp(newfn,a,strlen(a)) == 0)
+	if(strncmp(newfn.c_str(),a,strlen(a)) == 0)
 	{
 		if(m_obbfile != NULL)
 		{
-			FileBaseStreamPtr file = m_obbfile->openFile(path);
+			bool isf = false;
+			FileBaseStreamPtr file = m_obbOverlay.Open(GET_DLC()->GetRelateFName(path, isf));
 			if (file.get())
 			{
 				return file;
@@ -150,51 +150,111 @@ FileBaseStreamPtr CFSys::OpenFile(const char* path, const char *mode, bool absol
 		}
 	}
 #endif
-	if (strstr(newfn, ".ls"))
+	if (accessMode & ESM::FAM_WRITE)
+	{
+		InvalidateFile(path);
+	}
+	if (strstr(newfn.c_str(), ".ls"))
 	{	
-		FileBaseStreamPtr Fsfs(MARC_NEW CFStream(newfn, accessMode));
+		FileBaseStreamPtr Fsfs(MARC_NEW CFStream(newfn.c_str(), accessMode));
 		return GetFileToMemFile(Fsfs);
 	}
 	else
 	{	
-		CFStream *pFileStream = MARC_NEW CFStream(newfn, accessMode);
+		CFStream *pFileStream = MARC_NEW CFStream(newfn.c_str(), accessMode);
 		return FileBaseStreamPtr(pFileStream);
 	}
 }
-int CFSys::zipFileLength(const char *path)
+// dev mode is not cached, GetFName looks in the debug path first then and a file saved there
+// has to be seen by the next call
+const CFSys::FileResolve* CFSys::Resolve(const char *path)
 {
-	map<string, CZFRder*>::iterator iterIdx = m_zrs.begin();
-	for (; iterIdx != m_zrs.end(); ++iterIdx)
+	FileResolve *r = &m_resolveScratch;
+	if (g_DevMode != 1)
 	{
-		size_t size = iterIdx->second->fileLength(path);
-		if (size)
+		std::map<std::string, FileResolve>::iterator it = m_resolved.find(path);
+		if (it != m_resolved.end())
 		{
-			return size;
+			m_resolveStat.hits++;
+			return &it->second;
 		}
+		if (m_resolved.size() >= FS_RESOLVE_CACHE_MAX)
+		{
+			InvalidateFile(NULL);
+		}
+		r = &m_resolved[path];
 	}
-	return 0;
+	m_resolveStat.misses++;
+	char nfn[512];
+	GET_DLC()->GetFName(path, nfn, sizeof(nfn));
+	r->diskPath = nfn;
+	CEFile file(nfn);
+	r->diskSize = file.exist() ? file.length() : -1;
+	bool isf = false;
+	if (!m_zipOverlay.Find(GET_DLC()->GetRelateFName(path, isf), r->zr, r->entry))
+	{
+		r->zr = NULL;
+		r->entry = NULL;
+	}
+	return r;
+}
+// a path is cached under the name it was asked by, relative or with the app, cache or save
+// path in front, every one of them goes
+void CFSys::InvalidateFile(const char *path)
+{
+	if (path == NULL)
+	{
+		m_resolveStat.drops += (unsigned int)m_resolved.size();
+		m_resolved.clear();
+		return;
+	}
+	if (m_resolved.empty())
+	{
+		return;
+	}
+	bool isf = false;
+	string rel = GET_DLC()->GetRelateFName(path, isf);
+	string names[5];
+	names[0] = path;
+	names[1] = rel;
+	names[2] = GameApp::getInstance()->getAppPath() + rel;
+	names[3] = GameApp::getInstance()->getCachePath() + rel;
+	names[4] = GameApp::getInstance()->getSavePath() + rel;
+	for (int i = 0; i < 5; i++)
+	{
+		m_resolveStat.drops += (unsigned int)m_resolved.erase(names[i]);
+	}
+}
+void CFSys::GetResolveStat(FSResolveStat &stat)
+{
+	stat = m_resolveStat;
+	stat.entries = (unsigned int)m_resolved.size();
+}
+int CFSys::zipFileLength(const char *path)
+{
+	bool isf = false;
+	return m_zipOverlay.Length(GET_DLC()->GetRelateFName(path, isf));
 }
 int CFSys::fileLength(const char* path)
 {
-    char newfname[500];
 	const char *a = GameApp::getInstance()->getAppPath();
-	GET_DLC()->GetFName(path, newfname, sizeof(newfname));
-	CEFile file(newfname);
-	if (file.exist())
+	const FileResolve *r = Resolve(path);
+	if (r->diskSize >= 0)
 	{
-		return file.length();
+		return r->diskSize;
 	}
 
-	size_t zs = zipFileLength(path);
+	size_t zs = r->zr != NULL ? r->zr->entryLength(r->entry) : 0;
 	if(zs)
 		return zs;
 	
 #ifdef OS_ANDROID
-	if(strncmp(newfname,a,strlen(a)) == 0)
+	if(strncmp(r->diskPath.c_str(),a,strlen(a)) == 0)
 	{
 		if (m_obbfile != NULL)
 		{
-			size_t sz = m_obbfile->fileLength(path);
+			bool isf = false;
+			size_t sz = m_obbOverlay.Length(GET_DLC()->GetRelateFName(path, isf));
 			if (sz)
 			{
 				return sz;
@@ -208,35 +268,29 @@ int CFSys::fileLength(const char* path)
 }
 bool CFSys::zipFileexist(const char *path)
 {
-	map<string, CZFRder*>::iterator iterIdx = m_zrs.begin();
-	for (; iterIdx != m_zrs.end(); ++iterIdx)
-	{
-		if (iterIdx->second->exist(path)) 
-			return true;
-	}
-	return false;
+	bool isf = false;
+	return m_zipOverlay.Exist(GET_DLC()->GetRelateFName(path, isf));
 }
 bool CFSys::exist(const char *path)
 {
-	char nfn[512];
 	const char *a = GameApp::getInstance()->getAppPath();
-	GET_DLC()->GetFName(path, nfn, sizeof(nfn));
-	CEFile file(nfn);
+	const FileResolve *r = Resolve(path);
 
-	if (file.exist())
+	if (r->diskSize >= 0)
 	{
 		return true;
 	}
 
-	if (zipFileexist(path))
+	if (r->zr != NULL)
 		return true;
 
 #ifdef OS_ANDROID
-	if(strncmp(nfn,a,strlen(a)) == 0)
+	if(strncmp(r->diskPath.c_str(),a,strlen(a)) == 0)
 	{
 		if (m_obbfile != NULL)
 		{	
-			if (m_obbfile->exist(path))
+			bool isf = false;
+			if (m_obbOverlay.Exist(GET_DLC()->GetRelateFName(path, isf)))
 			{
 				return true;
 			}
@@ -259,8 +313,10 @@ void CFSys::addZip(const char *fn)
 	if (f->rOrw())
 	{
 		delZip(fn);
-		CZFRder * zipReader = MARC_NEW CZFRder(f);
+		InvalidateFile(NULL);
+		CZFRder * zipReader = MARC_NEW CZFRder(f, m_zipIndexCache ? GetZipIndexPath(fn).c_str() : NULL);
 		m_zrs[fn] = zipReader;
+		m_zipOverlay.Add(fn, zipReader);
 	}
 	else
 	{
@@ -268,6 +324,18 @@ void CFSys::addZip(const char *fn)
 		return;
 	}
 }
+// one flat file per mounted name, "patch/a.zip" -> <cache>patch_a.zip.zidx
+string CFSys::GetZipIndexPath(const char *fn)
+{
+	string p = GameApp::getInstance()->getCachePath();
+	for (const char *c = fn; *c; c++)
+	{
+		p += (*c == '/' || *c == '\\' || *c == ':') ? '_' : *c;
+	}
+	p += ".zidx";
+	return p;
+}
+
 #ifdef OS_ANDROID
 void CFSys::addObbFile(const char *fn)
 {
@@ -275,9 +343,11 @@ void CFSys::addObbFile(const char *fn)
 	FileBaseStreamPtr f = FileBaseStreamPtr(p);
 	if (f->rOrw())
 	{
+		m_obbOverlay.Clear();
 		CHECK_DEL(m_obbfile);
 		CZFRder * zipReader = MARC_NEW CZFRder(f);
 		m_obbfile = zipReader;
+		m_obbOverlay.Add(fn, zipReader);
 	}
 	else
 	{
@@ -292,6 +362,8 @@ void CFSys::delZip(const char *filename)
 	std::map<std::string, CZFRder*>::iterator iter = m_zrs.find(filename);
 	if (iter != m_zrs.end())
 	{
+		InvalidateFile(NULL);
+		m_zipOverlay.Remove(iter->second);
 		CHECK_DEL(iter->second);
 		m_zrs.erase(iter);
 	}
@@ -301,9 +373,20 @@ extern "C" void AddZip2FS(const char* pathname)
 {
 	GET_FS()->addZip(pathname);
 }
+
+extern "C" void SetZipIndexCache2FS(int enable)
+{
+	GET_FS()->SetZipIndexCache(enable != 0);
+}
+
+extern "C" void InvalidateFileCache2FS(const char* pathname)
+{
+	GET_FS()->InvalidateFile(pathname);
+}
 void DLCFileInfoMgr::reset()
 {
 	m_fs.clear();
+	GET_FS()->InvalidateFile(NULL);
 }
 const char* DLCFileInfoMgr::GetRelateFName(const char *f, bool &isfull)
 {
@@ -417,6 +500,7 @@ void DLCFileInfoMgr::AddFile(const char* filename)
 	bool isf = false;;
 	const char * p = GetRelateFName(filename,isf);
 	m_fs[p] = entry;
+	GET_FS()->InvalidateFile(filename);
 }
 
 int DLCFileInfoMgr::UpdateFileInfo(lua_State *L)
@@ -425,6 +509,7 @@ int DLCFileInfoMgr::UpdateFileInfo(lua_State *L)
 	const char *fn = luaL_checklstring(L, 1, &lentmpforloadstring);
 	const char *crc = luaL_checklstring(L, 2, &lentmpforloadstring);
 	int v = luaL_checkinteger(L, 3);
+	GET_FS()->InvalidateFile(fn);
 	if (v == -1)
 	{
 		m_fs.erase(fn);
@@ -506,6 +591,7 @@ int DLCFileInfoMgr::SaveAllInfo(lua_State *L)
 	char tfn[1023];
 	const char *fn = luaL_checklstring(L, 1, &s);
 	snprintf(tfn, 1023, "%s%s", GameApp::getInstance()->getSavePath(), fn);
+	GET_FS()->InvalidateFile(tfn);
 	FILE* fptr = fopen(tfn, "wb");
 	if (fptr != NULL)
 	{
@@ -520,6 +606,7 @@ int DLCFileInfoMgr::SaveAllInfo(lua_State *L)
 		char tmp = -1;
 		fwrite(&tmp, 1, 1, fptr);
 		fclose(fptr);
+		GET_FS()->InvalidateFile(tfn);
 	}
 	else
 		return 0;    
@@ -8,6 +8,7 @@
 #include "AndroidReader.h"
 #endif
 #include "ZipReader.h"
+#include "ZipOverlay.h"
 
 #include "lua.hpp"
 using namespace std;
@@ -30,11 +31,24 @@ public :
 	void SaveItem(const char* fn,DLCEntry * de,FILE* fptr);
 	map<string, DLCEntry> m_fs;
 };
+struct FSResolveStat
+{
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int drops;         // entries invalidated
+	unsigned int entries;
+};
+// cache entries past this drop the whole cache, paths built at run time can not grow it for good
+#define FS_RESOLVE_CACHE_MAX       (16384)
 class CFSys
 {
 public:
 	map<string, CZFRder*>     m_zrs;
+	// every entry of m_zrs, kept in step by addZip and delZip
+	CZipOverlay               m_zipOverlay;
 	CFSys(){
+		m_zipIndexCache = true;
+		memset(&m_resolveStat, 0, sizeof(m_resolveStat));
 #ifdef OS_ANDROID
 		m_obbfile = NULL;
 #endif
@@ -53,12 +67,33 @@ public:
 	bool exist(const char *path);
 	bool zipFileexist(const char *path);
 	void addZip(const char *f);
+	// archives mounted by addZip keep their entry index in the cache path, see CZFRder
+	void SetZipIndexCache(bool enable){ m_zipIndexCache = enable; }
+	string GetZipIndexPath(const char *f);
+	bool m_zipIndexCache;
+	// where OpenFile, exist and fileLength find a path, looked up once and kept until the
+	// DLC info of the path changes, an archive is mounted or unmounted or the path is written
+	struct FileResolve
+	{
+		string      diskPath;       // what DLCFileInfoMgr::GetFName names
+		int         diskSize;       // -1 when there is no such file
+		CZFRder*    zr;             // the archive entry, NULL when no archive has the path
+		void*       entry;
+	};
+	const FileResolve* Resolve(const char *path);
+	// NULL drops every path
+	void InvalidateFile(const char *path);
+	void GetResolveStat(FSResolveStat &stat);
+	map<string, FileResolve>  m_resolved;
+	FileResolve               m_resolveScratch;
+	FSResolveStat             m_resolveStat;
 	
 	void delZip(const char *f);
 #ifdef OS_ANDROID
 	void addObbFile(const char *f);
 	AndroidReader  m_adrfR;
 	CZFRder*       m_obbfile;
+	CZipOverlay    m_obbOverlay;
 #endif
 
 };
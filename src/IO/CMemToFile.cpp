@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "CMemToFile.h"
 
-CMemToFile::CMemToFile(const char *a, int b, const char *c)
+CMemToFile::CMemToFile(const char *a, int b, const char *c, bool notshare)
 	: FileBaseStream(CEFilePtr(), ESM::FAM_READ | ESM::FAM_WRITE)
-	, MemStream(a, b, true)
+	, MemStream(a, b, notshare)
 {
 	m_fn = c;
 	setMode(ESM::FAM_READ | ESM::FAM_WRITE);
@@ -8,7 +8,7 @@ using namespace std;
 class CMemToFile : public FileBaseStream, public MemStream
 {
 public:
-	CMemToFile(const char *d, int s, const char *n);
+	CMemToFile(const char *d, int s, const char *n, bool notshare = true);
 	~CMemToFile(void){}
 	const char* fname() const {return m_fn.c_str();}
 	CEFilePtr getFptr() const {return CEFilePtr();}
@@ -23,11 +23,12 @@ MemStream::MemStream(const void* d, int s, bool notshare)
 	m_p			= 0;
 }
 
+// shared memory belongs to whoever handed it in
 void MemStream::freemem()
 {
 	if (!m_notshare)
 	{
-		printf("mem will free outside!!");
+		m_mem = NULL;
 	}
 	else
 	{
@@ -52,12 +53,13 @@ void MemStream::reCreate(int sz)
 	}
 }
 
+// shared memory is only ever read, the first write moves to a copy of its own
 bool MemStream::CheckBufSize(int sz)
 {	
-	if (m_p + sz > m_len)
+	if (m_p + sz > m_len || !m_notshare)
 	{
 		char* pO = getBuffer();
-		int nA = 2 * (m_p + sz);
+		int nA = m_p + sz > m_len ? 2 * (m_p + sz) : m_len;
 		m_mem = MARC_NEW char[nA];
 		if (m_mem != NULL)
 		{
@@ -66,6 +68,7 @@ bool MemStream::CheckBufSize(int sz)
 			{
 				CHECK_DEL_ARRAY(pO);
 			}
+			m_notshare = true;
 			m_len = nA;
 		}
 		else
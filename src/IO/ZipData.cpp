@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <algorithm>
 #include "ZipData.h"
 
 #define SIGNCODE (0x04034b50)
@@ -31,95 +32,98 @@ zFHeaderExt *zGetFileHeader(ReadFileInt *f, size_t off)
 		return NULL;
 	}
 }
-ZipFile getZipFileByzCDirExt(zCDirExt *cenDir)
-{
-	ZipFile zinfo;
-	zinfo.flags = cenDir->data.cmethod;
-	zinfo.fileOffset = cenDir->data.fheaderoff;
-	zinfo.comSize = cenDir->data.csize;
-	zinfo.fileSize = cenDir->data.ucsize;
-	return zinfo;
-}
-std::string zGetFileListGetZFfileName(ZipFile zinfo)
-{
-	if (zinfo.fileName.find('/') != -1)
-		return zinfo.fileName.substr(zinfo.fileName.rfind('/') + 1);
-	else
-		return zinfo.fileName;
-}
-
-bool checkzCDirExtCmethod(zCDirExt *cenDir)
-{
-	if (cenDir->data.cmethod != 8 &&
-		cenDir->data.cmethod != 0)
-		return false;
-	return true;
-}
-bool checkzCDirExtCmethodZhEADERNAME(zFHeaderExt * zfHeader)
-{
-	if (zfHeader->data.fnlen == 0 || zfHeader->file_name[zfHeader->data.fnlen - 1] == '/')
-		return false;
-	return true;
-}
-int zGetFileList(ReadFileInt *file, map<string, ZipFile> &lisf)
+// the whole central directory is read at once and every entry is taken from its record there,
+// names and crc included. the local headers are not touched, the data offset behind each is
+// found on the first open by zLocateFileData
+static void zReadFileList(ReadFileInt *file, vector<ZipFile> &lisf)
 {
 	zArchiveEnd *aE = zGetArchiveEnd(file);
-	zCDirExt *DExt = NULL;
-	unsigned long DirExtOff = 0;	
-	for (int i = 0; i < aE->dirnum; i++)
-	{		
-		DExt = zGetCentralDir(file, (DirExtOff + aE->diroff));
-		if (DExt == NULL)
+	size_t dl = aE->dirlen;
+	char *cd = new char[dl + 1];
+	file->seek(aE->diroff, SEEK_SET);
+	file->read(cd, (int)dl);
+	size_t p = 0;
+	for (int i = 0; i < aE->dirnum && p + sizeof(zCDir) <= dl; i++)
+	{
+		zCDir d;
+		memcpy(&d, cd + p, sizeof(zCDir));
+		if (SIGNCODE3 != d.sign)
+			break;
+		size_t rl = sizeof(zCDir) + d.fnlen + d.extlen + d.commentlen;
+		if (p + rl > dl)
 			break;
-		DirExtOff = DirExtOff + DExt->size;
-		zFHeaderExt *hd = NULL;
-		if (checkzCDirExtCmethod(DExt) == false)
+		const char *n = cd + p + sizeof(zCDir);
+		p += rl;
+		if (d.cmethod != 8 && d.cmethod != 0)
 		{
 			printf("zcomp format errrro !\n");
-			delete DExt;
 			continue;
 		}
-		hd = zGetFileHeader(file, DExt->data.fheaderoff);
-		if (hd == NULL)
-		{
-			if (DExt != NULL)
-				delete DExt;
-			DExt = NULL;
+		if (d.fnlen == 0 || n[d.fnlen - 1] == '/')
 			continue;
-		}
-		string name;
-		if (checkzCDirExtCmethodZhEADERNAME(hd) == false)
-		{
-			if (DExt != NULL)
-				delete DExt;
-			DExt = NULL;
-			if (hd != NULL)
-				delete hd;
-			hd = NULL;
-			continue;
-		}
-		else
-		{
-
-			ZipFile zinfo = getZipFileByzCDirExt(DExt);
-			zinfo.fileName = hd->file_name;
-			zinfo.crc32 = hd->data.crc32;
-			name = zGetFileListGetZFfileName(zinfo);
-			if (!name.empty())
-				lisf.insert(make_pair(name, zinfo));
-		}
-		
-		if (hd != NULL)
-			delete hd;
-		hd = NULL;
-		if (DExt != NULL)
-			delete DExt;
-		DExt = NULL;
+		ZipFile zinfo;
+		zinfo.flags = d.cmethod;
+		zinfo.fileOffset = d.fheaderoff;
+		zinfo.dataOffset = -1;
+		zinfo.comSize = d.csize;
+		zinfo.fileSize = d.ucsize;
+		zinfo.crc32 = d.crc32;
+		zinfo.fileName.assign(n, d.fnlen);
+		lisf.push_back(zinfo);
 	}
+	delete[] cd;
 	delete aE;
+}
+
+// keyed by the file name alone, the first entry with a name wins
+int zGetFileList(ReadFileInt *file, map<string, ZipFile> &lisf)
+{
+	vector<ZipFile> lst;
+	zReadFileList(file, lst);
+	for (size_t i = 0; i < lst.size(); i++)
+	{
+		size_t b = lst[i].fileName.rfind('/');
+		lisf.insert(make_pair(b == string::npos ? lst[i].fileName : lst[i].fileName.substr(b + 1), lst[i]));
+	}
 	return 1;
 }
 
+static bool zFileNameLess(const ZipFile &a, const ZipFile &b)
+{
+	return a.fileName < b.fileName;
+}
+
+static bool zFileNameEqual(const ZipFile &a, const ZipFile &b)
+{
+	return a.fileName == b.fileName;
+}
+
+// sorted by the full name, the first entry with a name wins
+int zGetFileList(ReadFileInt *file, vector<ZipFile> &lisf)
+{
+	lisf.clear();
+	zReadFileList(file, lisf);
+	stable_sort(lisf.begin(), lisf.end(), zFileNameLess);
+	lisf.erase(unique(lisf.begin(), lisf.end(), zFileNameEqual), lisf.end());
+	return 1;
+}
+
+// the data offset of an entry from its local header, once. the local extra field may differ
+// from the one in the central directory so it has to be read from there
+bool zLocateFileData(ReadFileInt *f, ZipFile &zf)
+{
+	if (zf.dataOffset >= 0)
+		return true;
+	zFHeader hd;
+	hd.sign = 0;
+	f->seek(zf.fileOffset, SEEK_SET);
+	f->read(&hd, sizeof(zFHeader));
+	if (hd.sign != SIGNCODE && hd.sign != 0x01010101)
+		return false;
+	zf.dataOffset = zf.fileOffset + sizeof(zFHeader) + hd.fnlen + hd.extlen;
+	return true;
+}
+
 char *zGetFileContent(ReadFileInt *f, size_t off, size_t c_s)
 {
 	zFHeaderExt *hd = zGetFileHeader(f, off);
@@ -154,7 +158,17 @@ char *zGetFileContent(ReadFileInt *f, size_t off, size_t c_s)
 
 bool zGetFileContent(ReadFileInt *f, ZipFile zf, char* &o, int &size)
 {
-	char *c = zGetFileContent(f, zf.fileOffset, zf.comSize);
+	char *c = NULL;
+	if (zf.dataOffset >= 0)
+	{
+		c = new char[zf.comSize];
+		f->seek(zf.dataOffset, SEEK_SET);
+		f->read(c, zf.comSize);
+	}
+	else
+	{
+		c = zGetFileContent(f, zf.fileOffset, zf.comSize);
+	}
 
 	if (8 == zf.flags)
 	{
@@ -214,6 +228,45 @@ bool zUncompressBuffer(char *source, size_t source_len, char *dest, size_t dest_
 	delete[]z;
 	return true;
 }
+// raw deflate read in place, unlike zUncompressBuffer no zlib header has to go in front of a copy
+bool zInflateRaw(const char *source, size_t source_len, char *dest, size_t dest_len)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+		return false;
+	zs.next_in = (Bytef *)source;
+	zs.avail_in = (uInt)source_len;
+	zs.next_out = (Bytef *)dest;
+	zs.avail_out = (uInt)dest_len;
+	int n = inflate(&zs, Z_FINISH);
+	bool ret = n == Z_STREAM_END || zs.total_out == dest_len;
+	inflateEnd(&zs);
+	return ret;
+}
+
+// where the data of an entry starts in a mapped archive, NULL when its local header or data
+// is not inside the mapping. the offset is kept in the entry like zLocateFileData does
+const char *zGetMappedData(const char *base, size_t size, ZipFile &zf)
+{
+	size_t o = (size_t)zf.dataOffset;
+	if (zf.dataOffset < 0)
+	{
+		o = (size_t)(U32)zf.fileOffset;
+		if (o + sizeof(zFHeader) > size)
+			return NULL;
+		zFHeader hd;
+		memcpy(&hd, base + o, sizeof(zFHeader));
+		if (hd.sign != SIGNCODE && hd.sign != 0x01010101)
+			return NULL;
+		o += sizeof(zFHeader) + hd.fnlen + hd.extlen;
+	}
+	if (o > size || (size_t)(U32)zf.comSize > size - o)
+		return NULL;
+	zf.dataOffset = (S32)o;
+	return base + o;
+}
+
 zCDirExt *zGetCentralDir(ReadFileInt *f, size_t o)
 {
 	zCDirExt *cd = new zCDirExt;
@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <map>
+#include <vector>
 #include <iostream>
 #define MAX_FILE_LENGHT 255
 #pragma pack(1) 
@@ -83,7 +84,8 @@ struct zFHDataExt
 
 struct ZFData
 {
-    S32 fileOffset;
+    S32 fileOffset;     // of the local header
+    S32 dataOffset;     // -1 until the local header was read on the first open
 	S32 comSize;
 	S32 fileSize;
 	S32 flags;
@@ -119,7 +121,11 @@ extern char *zGetFileContent(ReadFileInt *file, size_t offset, size_t c_size);
 extern zArchiveEnd *zGetArchiveEnd(ReadFileInt *file);
 extern zCDirExt *zGetCentralDir(ReadFileInt *file, size_t offset);
 bool zUncompressBuffer(char *source, size_t source_len, char *dest, size_t dest_len);
+bool zInflateRaw(const char *source, size_t source_len, char *dest, size_t dest_len);
+const char *zGetMappedData(const char *base, size_t size, ZipFile &info);
+bool zLocateFileData(ReadFileInt *file, ZipFile &info);
 bool zVerifyCrc32(unsigned int source_crc32, char *source, size_t len);
 int zGetFileList(ReadFileInt *file, std::map<std::string, ZipFile> &lsfile);
+int zGetFileList(ReadFileInt *file, std::vector<ZipFile> &lsfile);
 bool zGetFileContent(ReadFileInt *file, ZipFile info, char* &unc_buffer, int &size);
 #endif /* _ZIP_H_ */
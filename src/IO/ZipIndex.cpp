@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "ZipIndex.h"
+#include "ZipReader.h"
+#include <vector>
+#include <algorithm>
+
+// fnv-1a
+U32 CZipIndex::HashKey(const char *s, size_t len)
+{
+	U32 h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+CZipIndex::CZipIndex()
+{
+	m_map = NULL;
+	m_entries = NULL;
+	m_names = NULL;
+	m_count = 0;
+	m_namesSize = 0;
+}
+
+CZipIndex::~CZipIndex()
+{
+	Unload();
+}
+
+void CZipIndex::Unload()
+{
+	if (m_map != NULL)
+	{
+		m_map->release();
+	}
+	m_map = NULL;
+	m_entries = NULL;
+	m_names = NULL;
+	m_count = 0;
+	m_namesSize = 0;
+	m_dataOffsets.clear();
+}
+
+bool CZipIndex::Load(const char *path, const ZipIndexKey &key)
+{
+	Unload();
+	zMapRder *mp = MARC_NEW zMapRder();
+	if (!mp->open(path) || mp->length() < (int)sizeof(ZipIndexHead))
+	{
+		mp->release();
+		return false;
+	}
+	ZipIndexHead hd;
+	memcpy(&hd, mp->data(), sizeof(ZipIndexHead));
+	size_t size = sizeof(ZipIndexHead) + (size_t)hd.count * sizeof(ZipIndexEntry) + hd.namesSize;
+	if (hd.magic != ZIP_INDEX_MAGIC || hd.version != ZIP_INDEX_VERSION
+		|| hd.archiveSize != key.size || hd.archiveMtime != key.mtime || hd.archiveCrc != key.crc
+		|| hd.count > 0x7fffffff / sizeof(ZipIndexEntry) || size != (size_t)mp->length())
+	{
+		mp->release();
+		return false;
+	}
+	ZipIndexEntry *entries = (ZipIndexEntry*)(mp->data() + sizeof(ZipIndexHead));
+	for (U32 i = 0; i < hd.count; i++)
+	{
+		if ((size_t)entries[i].nameOff + entries[i].nameLen > hd.namesSize)
+		{
+			mp->release();
+			return false;
+		}
+	}
+	m_map = mp;
+	m_entries = entries;
+	m_names = mp->data() + sizeof(ZipIndexHead) + hd.count * sizeof(ZipIndexEntry);
+	m_count = hd.count;
+	m_namesSize = hd.namesSize;
+	m_dataOffsets.resize(hd.count);
+	for (U32 i = 0; i < hd.count; i++)
+	{
+		m_dataOffsets[i] = entries[i].dataOffset;
+	}
+	return true;
+}
+
+// a binary search on the hash, the names settle collisions
+ZipIndexEntry* CZipIndex::Find(const char *key)
+{
+	if (m_map == NULL)
+	{
+		return NULL;
+	}
+	size_t len = strlen(key);
+	U32 h = HashKey(key, len);
+	U32 lo = 0;
+	U32 hi = m_count;
+	while (lo < hi)
+	{
+		U32 mid = lo + (hi - lo) / 2;
+		if (m_entries[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < m_count && m_entries[lo].hash == h; lo++)
+	{
+		ZipIndexEntry *e = &m_entries[lo];
+		if (e->nameLen == len && memcmp(m_names + e->nameOff, key, len) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+void CZipIndex::ToZipFile(const ZipIndexEntry *e, ZipFile &f) const
+{
+	f.flags = e->method;
+	f.fileOffset = e->headerOffset;
+	f.dataOffset = m_dataOffsets[e - m_entries];
+	f.comSize = e->comSize;
+	f.fileSize = e->fileSize;
+	f.crc32 = e->crc32;
+	f.fileName.assign(m_names + e->nameOff, e->nameLen);
+}
+
+static bool zipIndexEntryLess(const ZipIndexEntry &a, const ZipIndexEntry &b)
+{
+	return a.hash < b.hash;
+}
+
+// written aside and renamed over, a reader never maps half a file
+bool CZipIndex::Write(const char *path, const ZipIndexKey &key, const std::vector<ZipFile> &lst)
+{
+	std::vector<ZipIndexEntry> entries;
+	std::string names;
+	entries.reserve(lst.size());
+	for (size_t i = 0; i < lst.size(); i++)
+	{
+		const ZipFile &f = lst[i];
+		if (f.fileName.size() > 0xffff)
+			return false;
+		ZipIndexEntry e;
+		memset(&e, 0, sizeof(e));
+		e.hash = HashKey(f.fileName.c_str(), f.fileName.size());
+		e.nameOff = (U32)names.size();
+		e.nameLen = (U16)f.fileName.size();
+		e.method = (U16)f.flags;
+		e.headerOffset = f.fileOffset;
+		e.dataOffset = -1;
+		e.comSize = f.comSize;
+		e.fileSize = f.fileSize;
+		e.crc32 = f.crc32;
+		names += f.fileName;
+		entries.push_back(e);
+	}
+	std::sort(entries.begin(), entries.end(), zipIndexEntryLess);
+	ZipIndexHead hd;
+	hd.magic = ZIP_INDEX_MAGIC;
+	hd.version = ZIP_INDEX_VERSION;
+	hd.archiveSize = key.size;
+	hd.archiveMtime = key.mtime;
+	hd.archiveCrc = key.crc;
+	hd.count = (U32)entries.size();
+	hd.namesSize = (U32)names.size();
+	std::string tmp = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL)
+	{
+		return false;
+	}
+	bool ok = fwrite(&hd, sizeof(hd), 1, f) == 1;
+	if (ok && !entries.empty())
+		ok = fwrite(&entries[0], sizeof(ZipIndexEntry), entries.size(), f) == entries.size();
+	if (ok && !names.empty())
+		ok = fwrite(names.data(), names.size(), 1, f) == 1;
+	ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+	remove(path);
+#endif
+	if (!ok || rename(tmp.c_str(), path) != 0)
+	{
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#ifndef _ZIPINDEXlkjhgfdsapoiuytr_sidecar_h_ldkfjslkdjf
+#define _ZIPINDEXlkjhgfdsapoiuytr_sidecar_h_ldkfjslkdjf
+#include <vector>
+#include "ZipData.h"
+
+// the entry list of one archive saved next to the cache, so a later mount maps it instead of
+// parsing the central directory. integers in host order, the file is only read where written.
+//   head, entries sorted by name hash, names
+// entries are found by their full name
+#define ZIP_INDEX_MAGIC            (0x5844495a)    // "ZIDX"
+#define ZIP_INDEX_VERSION          (2)
+
+#pragma pack(1)
+struct ZipIndexHead
+{
+	U32 magic;
+	U32 version;
+	U32 archiveSize;
+	U32 archiveMtime;
+	U32 archiveCrc;     // of the end of central directory record
+	U32 count;
+	U32 namesSize;
+};
+
+struct ZipIndexEntry
+{
+	U32 hash;
+	U32 nameOff;
+	U16 nameLen;
+	U16 method;
+	U32 headerOffset;
+	S32 dataOffset;     // -1 when not known yet, the first open finds it, see CZipIndex::SetDataOffset
+	U32 comSize;
+	U32 fileSize;
+	U32 crc32;
+};
+#pragma pack()
+
+struct ZipIndexKey
+{
+	U32 size;
+	U32 mtime;
+	U32 crc;
+};
+
+class zMapRder;
+class CZipIndex
+{
+public:
+	CZipIndex();
+	~CZipIndex();
+	// false when the file is missing, broken or made for another archive
+	bool Load(const char *path, const ZipIndexKey &key);
+	void Unload();
+	bool IsLoaded() const { return m_map != NULL; }
+	ZipIndexEntry* Find(const char *key);
+	U32 Count() const { return m_count; }
+	ZipIndexEntry* At(U32 i) { return &m_entries[i]; }
+	const char* Name(const ZipIndexEntry *e) const { return m_names + e->nameOff; }
+	void ToZipFile(const ZipIndexEntry *e, ZipFile &f) const;
+	void SetDataOffset(const ZipIndexEntry *e, S32 off) { m_dataOffsets[e - m_entries] = off; }
+	static bool Write(const char *path, const ZipIndexKey &key, const std::vector<ZipFile> &lst);
+	static U32 HashKey(const char *s, size_t len);
+private:
+	zMapRder*       m_map;
+	ZipIndexEntry*  m_entries;
+	const char*     m_names;
+	U32             m_count;
+	U32             m_namesSize;
+	// the mapping is read only, the data offsets found by opening entries are kept per mount
+	std::vector<S32> m_dataOffsets;
+};
+#endif
@@ -0,0 +1,307 @@
+#include "stdafx.h"
+#include "ZipOverlay.h"
+#include <set>
+#include <algorithm>
+
+#define ZIP_OVERLAY_NPOS           (0xffffffff)
+#define ZIP_OVERLAY_MIN_SLOTS      (256)
+
+static const char* fileNamePart(const char *s, size_t &len)
+{
+	const char *e = s + len;
+	const char *b = e;
+	while (b > s && b[-1] != '/')
+		b--;
+	len = e - b;
+	return b;
+}
+
+CZipOverlay::CZipOverlay()
+{
+	m_mounts.push_back(NULL);
+	m_paths.mask = 0;
+	m_paths.used = 0;
+	m_paths.byName = false;
+	m_names.mask = 0;
+	m_names.used = 0;
+	m_names.byName = true;
+}
+
+CZipOverlay::~CZipOverlay()
+{
+	Clear();
+}
+
+void CZipOverlay::Clear()
+{
+	for (size_t i = 1; i < m_mounts.size(); i++)
+	{
+		CHECK_DEL(m_mounts[i]);
+	}
+	m_mounts.resize(1);
+	m_paths.slots.clear();
+	m_paths.mask = 0;
+	m_paths.used = 0;
+	m_names.slots.clear();
+	m_names.mask = 0;
+	m_names.used = 0;
+}
+
+const char* CZipOverlay::SlotKey(const Table &t, const Slot &s, size_t &len)
+{
+	const char *n = m_mounts[s.mount]->zr->entryName(s.entry, len);
+	return t.byName ? fileNamePart(n, len) : n;
+}
+
+bool CZipOverlay::Better(const Slot &a, const Slot &b)
+{
+	if (a.mount != b.mount)
+	{
+		return m_mounts[a.mount]->name < m_mounts[b.mount]->name;
+	}
+	CZFRder *zr = m_mounts[a.mount]->zr;
+	return zr->entryOffset(a.entry) < zr->entryOffset(b.entry);
+}
+
+U32 CZipOverlay::Probe(Table &t, U32 hash, const char *key, size_t len)
+{
+	if (t.slots.empty())
+	{
+		return ZIP_OVERLAY_NPOS;
+	}
+	for (U32 i = hash & t.mask; t.slots[i].mount != 0; i = (i + 1) & t.mask)
+	{
+		if (t.slots[i].hash != hash)
+			continue;
+		size_t sl;
+		const char *sk = SlotKey(t, t.slots[i], sl);
+		if (sl == len && memcmp(sk, key, len) == 0)
+			return i;
+	}
+	return ZIP_OVERLAY_NPOS;
+}
+
+// kept at three quarters full at most
+void CZipOverlay::Reserve(Table &t, U32 count)
+{
+	U32 cap = (U32)t.slots.size();
+	if (cap != 0 && (size_t)count * 4 <= (size_t)cap * 3)
+	{
+		return;
+	}
+	if (cap < ZIP_OVERLAY_MIN_SLOTS)
+	{
+		cap = ZIP_OVERLAY_MIN_SLOTS;
+	}
+	while ((size_t)count * 4 > (size_t)cap * 3)
+	{
+		cap *= 2;
+	}
+	std::vector<Slot> old;
+	old.swap(t.slots);
+	Slot empty;
+	memset(&empty, 0, sizeof(empty));
+	t.slots.assign(cap, empty);
+	t.mask = cap - 1;
+	for (size_t i = 0; i < old.size(); i++)
+	{
+		if (old[i].mount == 0)
+			continue;
+		U32 j = old[i].hash & t.mask;
+		while (t.slots[j].mount != 0)
+			j = (j + 1) & t.mask;
+		t.slots[j] = old[i];
+	}
+}
+
+// the key takes the entry when it is new or the entry beats the one it holds
+void CZipOverlay::Offer(Table &t, const Slot &s)
+{
+	Reserve(t, t.used + 1);
+	size_t len;
+	const char *key = SlotKey(t, s, len);
+	U32 i = Probe(t, s.hash, key, len);
+	if (i != ZIP_OVERLAY_NPOS)
+	{
+		if (Better(s, t.slots[i]))
+			t.slots[i] = s;
+		return;
+	}
+	for (i = s.hash & t.mask; t.slots[i].mount != 0; i = (i + 1) & t.mask)
+		;
+	t.slots[i] = s;
+	t.used++;
+}
+
+// backward shift, the slots after a hole move up while that keeps them reachable from
+// their home slot, so there are no tombstones to skip later
+void CZipOverlay::Erase(Table &t, U32 i)
+{
+	U32 j = i;
+	for (;;)
+	{
+		j = (j + 1) & t.mask;
+		if (t.slots[j].mount == 0)
+			break;
+		U32 k = t.slots[j].hash & t.mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		t.slots[i] = t.slots[j];
+		i = j;
+	}
+	t.slots[i].mount = 0;
+	t.slots[i].entry = NULL;
+	t.used--;
+}
+
+void CZipOverlay::Add(const char *name, CZFRder *zr)
+{
+	U32 id = 1;
+	while (id < m_mounts.size() && m_mounts[id] != NULL)
+		id++;
+	if (id == m_mounts.size())
+		m_mounts.push_back(NULL);
+	Mount *m = MARC_NEW Mount();
+	m->name = name;
+	m->zr = zr;
+	m_mounts[id] = m;
+	std::vector<void*> es;
+	zr->listEntries(es);
+	Reserve(m_paths, m_paths.used + (U32)es.size());
+	Reserve(m_names, m_names.used + (U32)es.size());
+	for (size_t i = 0; i < es.size(); i++)
+	{
+		Slot s;
+		size_t len;
+		const char *n = zr->entryName(es[i], len);
+		s.mount = id;
+		s.entry = es[i];
+		s.hash = CZipIndex::HashKey(n, len);
+		Offer(m_paths, s);
+		n = fileNamePart(n, len);
+		s.hash = CZipIndex::HashKey(n, len);
+		Offer(m_names, s);
+	}
+}
+
+static bool mountNameLess(const std::pair<std::string, U32> &a, const std::pair<std::string, U32> &b)
+{
+	return a.first < b.first;
+}
+
+// the keys the archive held go to the next archive that has them. a path is asked of the
+// others in mount order, a file name is taken from the paths left, the best entry with that
+// name always holds its own path too
+void CZipOverlay::Remove(CZFRder *zr)
+{
+	U32 id = 1;
+	while (id < m_mounts.size() && (m_mounts[id] == NULL || m_mounts[id]->zr != zr))
+		id++;
+	if (id == m_mounts.size())
+		return;
+	std::vector<std::pair<std::string, U32> > rest;
+	for (U32 i = 1; i < m_mounts.size(); i++)
+	{
+		if (i != id && m_mounts[i] != NULL)
+			rest.push_back(std::make_pair(m_mounts[i]->name, i));
+	}
+	std::sort(rest.begin(), rest.end(), mountNameLess);
+	std::vector<void*> es;
+	zr->listEntries(es);
+	std::set<U32> vacated;
+	for (size_t i = 0; i < es.size(); i++)
+	{
+		size_t len;
+		const char *n = zr->entryName(es[i], len);
+		U32 h = CZipIndex::HashKey(n, len);
+		U32 at = Probe(m_paths, h, n, len);
+		if (at != ZIP_OVERLAY_NPOS && m_paths.slots[at].mount == id)
+		{
+			Erase(m_paths, at);
+			std::string path(n, len);
+			for (size_t r = 0; r < rest.size(); r++)
+			{
+				void *e = m_mounts[rest[r].second]->zr->findEntry(path.c_str());
+				if (e != NULL)
+				{
+					Slot s;
+					s.hash = h;
+					s.mount = rest[r].second;
+					s.entry = e;
+					Offer(m_paths, s);
+					break;
+				}
+			}
+		}
+		n = fileNamePart(n, len);
+		h = CZipIndex::HashKey(n, len);
+		at = Probe(m_names, h, n, len);
+		if (at != ZIP_OVERLAY_NPOS && m_names.slots[at].mount == id)
+		{
+			Erase(m_names, at);
+			vacated.insert(h);
+		}
+	}
+	CHECK_DEL(m_mounts[id]);
+	if (vacated.empty())
+		return;
+	// a name that was not vacated is held by its best entry already, offering it again is a no-op
+	for (size_t i = 0; i < m_paths.slots.size(); i++)
+	{
+		Slot s = m_paths.slots[i];
+		if (s.mount == 0)
+			continue;
+		size_t len;
+		const char *n = fileNamePart(m_mounts[s.mount]->zr->entryName(s.entry, len), len);
+		s.hash = CZipIndex::HashKey(n, len);
+		if (vacated.count(s.hash))
+			Offer(m_names, s);
+	}
+}
+
+// the full path first. only a bare file name is looked up by the file name alone, a path
+// with a folder never resolves to the same name in another folder
+bool CZipOverlay::Find(const char *path, CZFRder *&zr, void *&entry)
+{
+	std::string p = CZFRder::getSearchFileName(path);
+	size_t len = p.size();
+	U32 at = Probe(m_paths, CZipIndex::HashKey(p.c_str(), len), p.c_str(), len);
+	Table *t = &m_paths;
+	if (at == ZIP_OVERLAY_NPOS && p.find('/') == std::string::npos)
+	{
+		at = Probe(m_names, CZipIndex::HashKey(p.c_str(), len), p.c_str(), len);
+		t = &m_names;
+	}
+	if (at == ZIP_OVERLAY_NPOS)
+	{
+		return false;
+	}
+	zr = m_mounts[t->slots[at].mount]->zr;
+	entry = t->slots[at].entry;
+	return true;
+}
+
+FileBaseStreamPtr CZipOverlay::Open(const char *path)
+{
+	CZFRder *zr;
+	void *e;
+	if (!Find(path, zr, e))
+	{
+		return FileBaseStreamPtr();
+	}
+	return zr->openEntry(e);
+}
+
+size_t CZipOverlay::Length(const char *path)
+{
+	CZFRder *zr;
+	void *e;
+	return Find(path, zr, e) ? zr->entryLength(e) : 0;
+}
+
+bool CZipOverlay::Exist(const char *path)
+{
+	CZFRder *zr;
+	void *e;
+	return Find(path, zr, e);
+}
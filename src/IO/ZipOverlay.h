@@ -0,0 +1,53 @@
+#ifndef _ZIPOVERLAYqmwnebrvtcyxu_merged_h_pqowieurytlaksj
+#define _ZIPOVERLAYqmwnebrvtcyxu_merged_h_pqowieurytlaksj
+#include <string>
+#include <vector>
+#include "ZipReader.h"
+
+// one lookup table over every mounted archive, open addressing with linear probing.
+// a path is found by its full name. a bare file name with no folder falls back to the file
+// name alone, for callers that name a file without the folder the archive keeps it in.
+// each key holds the entry that wins: the archive with the smallest mount name, as CFSys
+// searched them before, and inside one archive the entry that comes first in it.
+class CZipOverlay
+{
+public:
+	CZipOverlay();
+	~CZipOverlay();
+	void Add(const char *name, CZFRder *zr);
+	void Remove(CZFRder *zr);
+	void Clear();
+	bool Find(const char *path, CZFRder *&zr, void *&entry);
+	FileBaseStreamPtr Open(const char *path);
+	size_t Length(const char *path);
+	bool Exist(const char *path);
+private:
+	struct Mount
+	{
+		std::string name;
+		CZFRder*    zr;
+	};
+	struct Slot
+	{
+		U32         hash;
+		U32         mount;      // 0 for a free slot
+		void*       entry;
+	};
+	struct Table
+	{
+		std::vector<Slot> slots;
+		U32         mask;
+		U32         used;
+		bool        byName;     // keyed by the file name alone
+	};
+	const char* SlotKey(const Table &t, const Slot &s, size_t &len);
+	bool Better(const Slot &a, const Slot &b);
+	U32 Probe(Table &t, U32 hash, const char *key, size_t len);
+	void Offer(Table &t, const Slot &s);
+	void Erase(Table &t, U32 i);
+	void Reserve(Table &t, U32 count);
+	std::vector<Mount*> m_mounts;   // by id, id 0 stays unused
+	Table               m_paths;
+	Table               m_names;
+};
+#endif
@@ -5,12 +5,26 @@
 #include <string>
 #include "IO/MemStream.h"
 #include <vector>
+#include <algorithm>
 #include "ZipReader.h"
 #include "IO/CMemToFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-CZFRder::CZFRder(const FileBaseStreamPtr &fs)
+CZFRder::CZFRder(const FileBaseStreamPtr &fs, const char *indexPath)
 {
 	m_fbsp = fs;
+	m_map = NULL;
+	if (indexPath != NULL)
+	{
+		m_indexPath = indexPath;
+	}
 	readscan();
 }
 
@@ -30,17 +44,80 @@ int zFRder::read(void* buffer, int size)
 
 size_t CZFRder::fileLength(const char *fn)
 {
-	ZipFile f;
-	int id = searchFile(fn, f);
-	int sz = f.fileSize;
-	if (id != -1)
+	void *e = findEntry(getSearchFileName(fn).c_str());
+	return e != NULL ? entryLength(e) : 0;
+}
+
+static bool zipFileNameLess(const ZipFile &a, const ZipFile &b)
+{
+	return a.fileName < b.fileName;
+}
+
+// a handle is an entry of m_index once that is loaded, a ZipFile of m_lst otherwise
+void* CZFRder::findEntry(const char *name)
+{
+	if (m_index.IsLoaded())
 	{
-		return sz;
+		return m_index.Find(name);
 	}
-	else
+	ZipFile k;
+	k.fileName = name;
+	vector<ZipFile>::iterator i = lower_bound(m_lst.begin(), m_lst.end(), k, zipFileNameLess);
+	return i != m_lst.end() && i->fileName == k.fileName ? &*i : NULL;
+}
+
+void CZFRder::listEntries(vector<void*> &out)
+{
+	if (m_index.IsLoaded())
 	{
-		return 0;
+		out.reserve(out.size() + m_index.Count());
+		for (U32 i = 0; i < m_index.Count(); i++)
+		{
+			out.push_back(m_index.At(i));
+		}
+		return;
 	}
+	out.reserve(out.size() + m_lst.size());
+	for (size_t i = 0; i < m_lst.size(); i++)
+	{
+		out.push_back(&m_lst[i]);
+	}
+}
+
+const char* CZFRder::entryName(void *e, size_t &len)
+{
+	if (m_index.IsLoaded())
+	{
+		len = ((ZipIndexEntry*)e)->nameLen;
+		return m_index.Name((ZipIndexEntry*)e);
+	}
+	len = ((ZipFile*)e)->fileName.size();
+	return ((ZipFile*)e)->fileName.c_str();
+}
+
+U32 CZFRder::entryOffset(void *e)
+{
+	return m_index.IsLoaded() ? ((ZipIndexEntry*)e)->headerOffset : ((ZipFile*)e)->fileOffset;
+}
+
+size_t CZFRder::entryLength(void *e)
+{
+	return m_index.IsLoaded() ? ((ZipIndexEntry*)e)->fileSize : ((ZipFile*)e)->fileSize;
+}
+
+// the data offset found on the first open stays with the entry
+FileBaseStreamPtr CZFRder::openEntry(void *e)
+{
+	if (m_index.IsLoaded())
+	{
+		ZipIndexEntry *ie = (ZipIndexEntry*)e;
+		ZipFile f;
+		m_index.ToZipFile(ie, f);
+		FileBaseStreamPtr s = openFile(f);
+		m_index.SetDataOffset(ie, f.dataOffset);
+		return s;
+	}
+	return openFile(*(ZipFile*)e);
 }
 
 bool CZFRder::readscan()
@@ -49,6 +126,17 @@ bool CZFRder::readscan()
 	std::string ext = fn.substr(fn.rfind('.') + 1, fn.length());
 	if (ext == "obb" || ext == "zip" || ext == "dat")
 	{
+		zMapRder *mp = MARC_NEW zMapRder();
+		if (mp->open(fn))
+		{
+			m_map = mp;
+			if (!readindex())
+			{
+				zGetFileList(mp, m_lst);
+			}
+			return true;
+		}
+		mp->release();
 		bool t = m_zFRder.open(fn);
 		if (t)
 		{
@@ -67,6 +155,30 @@ bool CZFRder::readscan()
 	}
 }
 
+// the index is keyed by the archive size, mtime and the crc of its end record, which holds the
+// size and offset of the central directory. a stale or missing one is rebuilt from the list
+bool CZFRder::readindex()
+{
+	if (m_indexPath.empty() || m_map->length() < (int)sizeof(zArchiveEnd))
+	{
+		return false;
+	}
+	ZipIndexKey key;
+	key.size = (U32)m_map->length();
+	key.mtime = m_map->mtime();
+	key.crc = (U32)crc32(crc32(0L, Z_NULL, 0), (const Bytef*)m_map->data() + m_map->length() - sizeof(zArchiveEnd), sizeof(zArchiveEnd));
+	if (m_index.Load(m_indexPath.c_str(), key))
+	{
+		return true;
+	}
+	zGetFileList(m_map, m_lst);
+	if (!CZipIndex::Write(m_indexPath.c_str(), key, m_lst))
+	{
+		DBG_E("zip index %s write error!\n", m_indexPath.c_str());
+	}
+	return true;
+}
+
 int zFRder::length()
 {
 	if (m_point == NULL)
@@ -83,11 +195,10 @@ int zFRder::length()
 
 FileBaseStreamPtr CZFRder::openFile(const char *fn)
 {
-	ZipFile f1zip;    
-	int ff = searchFile(fn, f1zip);
-	if (ff != -1)
+	void *e = findEntry(getSearchFileName(fn).c_str());
+	if (e != NULL)
 	{
-		return openFile(f1zip);
+		return openEntry(e);
 	}
 	else
 	{
@@ -98,16 +209,7 @@ FileBaseStreamPtr CZFRder::openFile(const char *fn)
 
 bool CZFRder::exist(const char *fn)
 {
-	ZipFile f;
-	int ret = searchFile(fn, f);
-	if( ret != -1)
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+	return findEntry(getSearchFileName(fn).c_str()) != NULL;
 }
 FileBaseStreamPtr CZFRder::createFileBaseStreamFromMem(char * data, int size, const char * fn)
 {
@@ -115,11 +217,37 @@ FileBaseStreamPtr CZFRder::createFileBaseStreamFromMem(char * data, int size, co
 }
 
 
+// stored entries become views onto the mapping, deflated ones are inflated from it directly
+FileBaseStreamPtr CZFRder::openMappedFile(ZipFile &zf)
+{
+	const char *src = zGetMappedData(m_map->data(), m_map->length(), zf);
+	if (src == NULL)
+	{
+		return FileBaseStreamPtr();
+	}
+	if (0 == zf.flags)
+	{
+		return FileBaseStreamPtr(MARC_NEW CMapToFile(m_map, src, zf.fileSize, zf.fileName.c_str()));
+	}
+	char *d = MARC_NEW char[zf.fileSize + 1];
+	if (!zInflateRaw(src, zf.comSize, d, zf.fileSize))
+	{
+		printf("Uncompress error\n");
+		CHECK_DEL_ARRAY(d);
+		return FileBaseStreamPtr();
+	}
+	return createFileBaseStreamFromMem(d, zf.fileSize, zf.fileName.c_str());
+}
+
 FileBaseStreamPtr CZFRder::openFile(ZipFile &zf)
 {   
     char *d = NULL;
     int sz = 0;
-	if (zGetFileContent(&m_zFRder, zf, d, sz))
+	if (m_map != NULL)
+	{
+		return openMappedFile(zf);
+	}
+	if (zLocateFileData(&m_zFRder, zf) && zGetFileContent(&m_zFRder, zf, d, sz))
 	{
 		return createFileBaseStreamFromMem(d, sz, zf.fileName.c_str());
 	}
@@ -129,36 +257,149 @@ FileBaseStreamPtr CZFRder::openFile(ZipFile &zf)
 	}
 }
 
+// the path as the archive names it, "./a\b//c.lua" -> "a/b/c.lua"
 string CZFRder::getSearchFileName(const char *fn)
 {
-	string s = fn;
 	string r;
-	if (s.find('/') != -1)
+	r.reserve(strlen(fn));
+	for (const char *c = fn; *c; c++)
 	{
-		r = s.substr(s.rfind('/') + 1);
-	}
-	else
-	{
-		r = s;
+		char ch = *c == '\\' ? '/' : *c;
+		bool atStart = r.empty() || r[r.size() - 1] == '/';
+		if (ch == '/' && atStart)
+		{
+			continue;
+		}
+		if (ch == '.' && atStart && (c[1] == '/' || c[1] == '\\'))
+		{
+			c++;
+			continue;
+		}
+		r += ch;
 	}
 	return r;
 }
 
 int CZFRder::searchFile(const char *sfn, ZipFile &fileOut)
 {	
-	map<string, ZipFile>::iterator i = m_lst.find(getSearchFileName(sfn));
-	if (i == m_lst.end())
+	void *e = findEntry(getSearchFileName(sfn).c_str());
+	if (e == NULL)
 	{
 		return -1;
 	}
+	if (m_index.IsLoaded())
+	{
+		m_index.ToZipFile((ZipIndexEntry*)e, fileOut);
+	}
 	else
 	{
-		fileOut = i->second;
-		return 1;
+		fileOut = *(ZipFile*)e;
 	}
+	return 1;
 }
 
 
+bool zMapRder::open(string f)
+{
+	close();
+#ifdef _WIN32
+	HANDLE h = CreateFileA(f.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(h, &sz) || sz.QuadPart <= 0 || sz.QuadPart > 0x7fffffff)
+	{
+		CloseHandle(h);
+		return false;
+	}
+	FILETIME wt;
+	unsigned int mt = GetFileTime(h, NULL, NULL, &wt) ? wt.dwLowDateTime ^ wt.dwHighDateTime : 0;
+	// the view keeps the mapping and the file open by itself
+	HANDLE mh = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(h);
+	if (mh == NULL)
+	{
+		return false;
+	}
+	void *p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mh);
+	if (p == NULL)
+	{
+		return false;
+	}
+	m_size = (int)sz.QuadPart;
+	m_mtime = mt;
+#else
+	int fd = ::open(f.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > 0x7fffffff)
+	{
+		::close(fd);
+		return false;
+	}
+	// every open of a stored entry views the same pages, nothing may write them
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+	{
+		return false;
+	}
+	m_size = (int)st.st_size;
+	m_mtime = (unsigned int)st.st_mtime;
+#endif
+	m_base = (const char*)p;
+	m_pos = 0;
+	return true;
+}
+
+void zMapRder::close()
+{
+	if (m_base == NULL)
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m_base);
+#else
+	munmap((void*)m_base, (size_t)m_size);
+#endif
+	m_base = NULL;
+	m_size = 0;
+	m_pos = 0;
+}
+
+void zMapRder::seek(int o, int w)
+{
+	int p = o;
+	if (w == SEEK_CUR)
+	{
+		p = m_pos + o;
+	}
+	else if (w == SEEK_END)
+	{
+		p = m_size + o;
+	}
+	m_pos = p < 0 ? 0 : (p > m_size ? m_size : p);
+}
+
+int zMapRder::read(void* buffer, int size)
+{
+	if (m_base == NULL || buffer == NULL)
+	{
+		return -1;
+	}
+	int n = m_size - m_pos < size ? m_size - m_pos : size;
+	memcpy(buffer, m_base + m_pos, n);
+	m_pos += n;
+	return n == size ? 1 : 0;
+}
+
 bool zFRder::open(string f)
 {
 	m_fath = f;
@@ -4,7 +4,10 @@
 #include "ZipData.h"
 #include <stdlib.h>
 #include "CFStream.h"
+#include "CMemToFile.h"
+#include "ZipIndex.h"
 #include <string>
+#include <vector>
 using namespace std;
 class zFRder : public ReadFileInt
 {
@@ -14,7 +17,7 @@ private:
 public:
 	zFRder(){ m_point = NULL; }
 	virtual ~zFRder(){ close(); }
-	virtual void close(){ fclose(m_point); m_point = NULL; }
+	virtual void close(){ if (m_point != NULL) fclose(m_point); m_point = NULL; }
 	virtual void seek(int o, int w){ fseek(m_point, o, w); }
 	virtual void seek_c(int o){ fseek(m_point, o, SEEK_CUR); }
 	virtual int read(void* o, int s);
@@ -25,18 +28,68 @@ public:
 
 };
 
+// the whole archive mapped read only, entries are read in place instead of seek + fread.
+// read keeps the fread count semantics of zFRder, 1 for a whole read.
+// the reader and every view onto the mapping hold a reference, the last release unmaps it
+class zMapRder : public ReadFileInt
+{
+private:
+	const char* m_base;
+	int m_size;
+	int m_pos;
+	int m_refs;
+	unsigned int m_mtime;
+	virtual ~zMapRder(){ close(); }
+public:
+	zMapRder(){ m_base = NULL; m_size = 0; m_pos = 0; m_refs = 1; m_mtime = 0; }
+	void retain(){ m_refs++; }
+	void release(){ if (--m_refs == 0) delete this; }
+	virtual void close();
+	virtual void seek(int o, int w);
+	virtual int read(void* o, int s);
+	virtual int length(){ return m_size; }
+	virtual bool open(string filepath);
+	const char* data() const { return m_base; }
+	unsigned int mtime() const { return m_mtime; }
+};
+
+// a stored entry served from the mapping without a copy, it keeps the mapping alive after
+// the archive is unmounted. a write goes to a private copy, see MemStream::CheckBufSize
+class CMapToFile : public CMemToFile
+{
+public:
+	CMapToFile(zMapRder *m, const char *d, int s, const char *n)
+		: CMemToFile(d, s, n, false)
+	{
+		m_map = m;
+		m_map->retain();
+	}
+	~CMapToFile(){ m_map->release(); }
+private:
+	zMapRder *m_map;
+};
+
 class CZFRder
 {
 private:
 	bool readscan();
+	bool readindex();
+	FileBaseStreamPtr openMappedFile(ZipFile &f);
 	FileBaseStreamPtr			m_fbsp;
-	map<string, ZipFile> m_lst;
+	vector<ZipFile>        m_lst;   // sorted by name
 	zFRder                 m_zFRder;
+	// set when the archive could be mapped, m_zFRder stays closed then
+	zMapRder*              m_map;
+	// stands in for m_lst once loaded from m_indexPath
+	CZipIndex              m_index;
+	string                 m_indexPath;
 	FILE* m_f;
 public:
-	CZFRder(const FileBaseStreamPtr &sFS);
+	// with an index path a mapped archive mounts from the index saved there, which is
+	// written on the first mount and rewritten once the archive changed
+	CZFRder(const FileBaseStreamPtr &sFS, const char *indexPath = NULL);
 
-	virtual ~CZFRder(){}
+	virtual ~CZFRder(){ if (m_map != NULL) m_map->release(); }
 	bool exist(const char *fn);
 	FileBaseStreamPtr openFile(ZipFile &f);
 	FileBaseStreamPtr createFileBaseStreamFromMem(char * data, int size, const char * fn);
@@ -45,9 +98,17 @@ public:
 	virtual int read(void* o, int s){ return fread(o,s,1,m_f); }
 	virtual int length(){ return 0; }	
 	size_t fileLength(const char *fn);
-	string getSearchFileName(const char *fn);
+	static string getSearchFileName(const char *fn);
 	virtual FileBaseStreamPtr openFile(const char *fn);
 	int searchFile(const char *fn, ZipFile &f);
+	// entries by handle for CFSys's merged index, a handle stays valid as long as the reader.
+	// names are the full entry names, not terminated when the entry comes from the index
+	void* findEntry(const char *name);
+	void listEntries(vector<void*> &out);
+	const char* entryName(void *e, size_t &len);
+	U32 entryOffset(void *e);
+	size_t entryLength(void *e);
+	FileBaseStreamPtr openEntry(void *e);
 
  
 };
@@ -191,6 +191,31 @@ int AddZipFileToFileSystemL(lua_State* L)
 	AddZip2FS(zipName);
 	return 0;
 }
+
+// InvalidateFileCache(path), no path drops every cached path
+int InvalidateFileCacheL(lua_State* L)
+{
+	const char* fileName = luaL_optlstring(L, 1, NULL, NULL);
+	InvalidateFileCache2FS(fileName);
+	return 0;
+}
+
+// GetFileCacheStat() -> { hits, misses, drops, entries } of the path cache of the file system
+int GetFileCacheStatL(lua_State* L)
+{
+	FSResolveStat resolveStat;
+	GET_FS()->GetResolveStat(resolveStat);
+	lua_newtable(L);
+	lua_pushnumber(L, (lua_Number)resolveStat.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushnumber(L, (lua_Number)resolveStat.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushnumber(L, (lua_Number)resolveStat.drops);
+	lua_setfield(L, -2, "drops");
+	lua_pushnumber(L, (lua_Number)resolveStat.entries);
+	lua_setfield(L, -2, "entries");
+	return 1;
+}
  
 
 int GetCachePathL(lua_State*L)
@@ -508,6 +533,8 @@ void lua::RegisteGlobalFunctions() {
 		{ "ShowExitGameDialog", PopUpGameExitUIL},
 		{ "ExitGame", ExitGameL},		
 		{ "AddZipToFileSystem", AddZipFileToFileSystemL },
+		{ "InvalidateFileCache", InvalidateFileCacheL },
+		{ "GetFileCacheStat", GetFileCacheStatL },
 		{ "GetCachePath",GetCachePathL},
 		{ "GetAppPath", GetAppPathL },
 		{ "GetSavePath", GetSavePathL },
@@ -617,6 +644,57 @@ void lua::OnConnectToServer(const char * connectName) {
 	RECOVER_SVD_LUA_SDK(_L, 0)
 }
 
+void lua::OnSendQueueHigh(const char * connectName, int bytes, int msgs) {
+	RECORD_GET_LUA_SDK(_L);
+	lua_getglobal(_L, "OnSendQueueHigh");
+	lua_pushstring(_L, connectName);
+	lua_pushinteger(_L, bytes);
+	lua_pushinteger(_L, msgs);
+	LUA_CALL(_L, 3, 0);
+	RECOVER_SVD_LUA_SDK(_L, 0)
+}
+
+void lua::OnSendQueueLow(const char * connectName, int bytes, int msgs) {
+	RECORD_GET_LUA_SDK(_L);
+	lua_getglobal(_L, "OnSendQueueLow");
+	lua_pushstring(_L, connectName);
+	lua_pushinteger(_L, bytes);
+	lua_pushinteger(_L, msgs);
+	LUA_CALL(_L, 3, 0);
+	RECOVER_SVD_LUA_SDK(_L, 0)
+}
+
+void lua::OnLatencyHigh(const char * connectName, int rttUs, int jitterUs) {
+	RECORD_GET_LUA_SDK(_L);
+	lua_getglobal(_L, "OnLatencyHigh");
+	lua_pushstring(_L, connectName);
+	lua_pushinteger(_L, rttUs);
+	lua_pushinteger(_L, jitterUs);
+	LUA_CALL(_L, 3, 0);
+	RECOVER_SVD_LUA_SDK(_L, 0)
+}
+
+void lua::OnLatencyLow(const char * connectName, int rttUs, int jitterUs) {
+	RECORD_GET_LUA_SDK(_L);
+	lua_getglobal(_L, "OnLatencyLow");
+	lua_pushstring(_L, connectName);
+	lua_pushinteger(_L, rttUs);
+	lua_pushinteger(_L, jitterUs);
+	LUA_CALL(_L, 3, 0);
+	RECOVER_SVD_LUA_SDK(_L, 0)
+}
+
+void lua::OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total) {
+	RECORD_GET_LUA_SDK(_L);
+	lua_getglobal(_L, "OnStreamChunk");
+	lua_pushstring(_L, connectName);
+	lua_pushlstring(_L, data, size);
+	lua_pushinteger(_L, offset);
+	lua_pushinteger(_L, total);
+	LUA_CALL(_L, 4, 0);
+	RECOVER_SVD_LUA_SDK(_L, 0)
+}
+
 
 void lua::SendMessageToLua(const char * jsoncontent) {
 	RECORD_GET_LUA_SDK(_L);
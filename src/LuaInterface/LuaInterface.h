@@ -408,6 +408,11 @@ private:
     void    OnNetFailed(const char * connectName,int codeId);
 	void    OnTryingReconnect(const char * connectName);
 	void    OnConnectToServer(const char * connectName);
+	void    OnSendQueueHigh(const char * connectName, int bytes, int msgs);
+	void    OnSendQueueLow(const char * connectName, int bytes, int msgs);
+	void    OnLatencyHigh(const char * connectName, int rttUs, int jitterUs);
+	void    OnLatencyLow(const char * connectName, int rttUs, int jitterUs);
+	void    OnStreamChunk(const char * connectName, const char * data, int size, int offset, int total);
  
 	void    SendMessageToLua(const char * jsoncontent);
 };
@@ -23,6 +23,20 @@
 #define IO_INPUT	1
 #define IO_OUTPUT	2
 
+#ifdef LUA_CUSTOM_FILE_SYSTEM
+extern void InvalidateFileCache2FS(const char *pathname);
+
+/* the engine file system caches where a path is, a file opened to write drops it */
+static void io_written (const char *filename, const char *mode) {
+  int en = errno;  /* pushresult reads it after */
+  if (strpbrk(mode, "wa+") != NULL)
+    InvalidateFileCache2FS(filename);
+  errno = en;
+}
+#else
+#define io_written(fn,m)	((void)0)
+#endif
+
 
 static const char *const fnames[] = {"input", "output"};
 
@@ -163,6 +177,7 @@ static int io_open (lua_State *L) {
   const char *mode = luaL_optstring(L, 2, "r");
   FILE **pf = newfile(L);
   *pf = fopen(filename, mode);
+  io_written(filename, mode);
   return (*pf == NULL) ? pushresult(L, 0, filename) : 1;
 }
 
@@ -203,6 +218,7 @@ static int g_iofile (lua_State *L, int f, const char *mode) {
     if (filename) {
       FILE **pf = newfile(L);
       *pf = fopen(filename, mode);
+      io_written(filename, mode);
       if (*pf == NULL)
         fileerror(L, 1, filename);
     }
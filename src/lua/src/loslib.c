@@ -41,16 +41,34 @@ static int os_execute (lua_State *L) {
 }
 
 
+#ifdef LUA_CUSTOM_FILE_SYSTEM
+extern void InvalidateFileCache2FS(const char *pathname);
+
+/* the engine file system caches where a path is, a removed or renamed file drops it */
+static void os_changed (const char *filename) {
+  int en = errno;  /* os_pushresult reads it after */
+  InvalidateFileCache2FS(filename);
+  errno = en;
+}
+#else
+#define os_changed(fn)	((void)0)
+#endif
+
 static int os_remove (lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
-  return os_pushresult(L, remove(filename) == 0, filename);
+  int ok = remove(filename) == 0;
+  os_changed(filename);
+  return os_pushresult(L, ok, filename);
 }
 
 
 static int os_rename (lua_State *L) {
   const char *fromname = luaL_checkstring(L, 1);
   const char *toname = luaL_checkstring(L, 2);
-  return os_pushresult(L, rename(fromname, toname) == 0, fromname);
+  int ok = rename(fromname, toname) == 0;
+  os_changed(fromname);
+  os_changed(toname);
+  return os_pushresult(L, ok, fromname);
 }
 
 
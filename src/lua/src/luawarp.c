@@ -152,6 +152,11 @@ LUA_API int luaS_yield(lua_State *L, int nrets) {
 LUA_API int luaS_pcall(lua_State *L, int nargs, int nresults, int err) {
 	return k(L, lua_pcallk(L, nargs, nresults, err, 0, k), 0);
 }
+#else
+/* 5.1 has no continuations, a C function yields by returning this */
+LUA_API int luaS_yield(lua_State *L, int nrets) {
+	return lua_yield(L, nrets);
+}
 #endif
 
 